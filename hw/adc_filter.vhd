@@ -0,0 +1,261 @@
+-- altera vhdl_input_version vhdl_2008
+
+-- EELE 467, Final Project
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+
+-- Per-channel smoothing for the ADC controller's readings
+-- Sits between the ADC controller and its readers: it reads every ADC channel
+-- at a fixed rate, filters each one, and presents the results at the same
+-- offsets the ADC controller uses for its raw readings. Bypassed channels are
+-- read continuously instead, so they follow the ADC within a sweep of them.
+entity ADC_Filter is
+    generic (
+        SYS_CLKs_sec : positive := 50000000 -- number of system clock periods in one second
+    );
+    port (
+        clk   : in std_logic; -- system clock
+        reset : in std_logic; -- system reset, active high
+
+        -- Memory-mapped Avalon agent interface
+        avs_s1_read      : in  std_logic;
+        avs_s1_write     : in  std_logic;
+        avs_s1_address   : in  std_logic_vector(4 downto 0);
+        avs_s1_readdata  : out std_logic_vector(31 downto 0);
+        avs_s1_writedata : in  std_logic_vector(31 downto 0);
+
+        -- Avalon host interface, for reading the ADC controller's channels
+        avm_adc_address       : out std_logic_vector(4 downto 0);
+        avm_adc_read          : out std_logic;
+        avm_adc_readdata      : in  std_logic_vector(31 downto 0);
+        avm_adc_waitrequest   : in  std_logic;
+        avm_adc_readdatavalid : in  std_logic
+    );
+end entity;
+
+
+architecture ADC_Filter_Arch of ADC_Filter is
+
+    constant ADC_CHANNELS : positive := 8;
+
+    -- Register map (word addresses)
+    -- Filtered readings, read-only, laid out like the ADC controller's
+    constant OUT_ADDR     : natural := 16#00#;
+    -- Per-channel filter configuration
+    constant CONFIG_ADDR  : natural := 16#08#;
+    -- Clocks between filter steps; zero stops the filters
+    constant DIVIDER_ADDR : natural := 16#10#;
+
+    -- Configuration fields
+    subtype CONFIG_MODE   is natural range 1 downto 0;
+    subtype CONFIG_LENGTH is natural range 11 downto 8;  -- box-car log2 length
+    subtype CONFIG_ALPHA  is natural range 31 downto 16; -- IIR weight, UQ0.16
+    constant MODE_BYPASS : std_logic_vector(1 downto 0) := "00";
+    constant MODE_IIR    : std_logic_vector(1 downto 0) := "01";
+    constant MODE_BOXCAR : std_logic_vector(1 downto 0) := "10";
+
+    -- Sample at 1 kHz by default
+    constant DEFAULT_DIVIDER : natural := SYS_CLKs_sec / 1000;
+
+    -- Filter state
+    -- The IIR filter keeps its output in UQ12.16, so that small weights still
+    -- move it: y += alpha * (x - y). The box-car filter sums 2**length
+    -- readings, then outputs their mean and starts over.
+    type config_t is array (0 to ADC_CHANNELS-1) of std_logic_vector(31 downto 0);
+    type reading_t is array (0 to ADC_CHANNELS-1) of unsigned(11 downto 0);
+    type state_t is array (0 to ADC_CHANNELS-1) of unsigned(27 downto 0);
+    type count_t is array (0 to ADC_CHANNELS-1) of unsigned(15 downto 0);
+    signal Config   : config_t;
+    signal Outputs  : reading_t;
+    signal States   : state_t;
+    signal Counts   : count_t;
+    -- Cleared when a channel is reconfigured, so its next reading restarts it
+    signal Primed   : std_logic_vector(0 to ADC_CHANNELS-1);
+    signal Divider  : unsigned(31 downto 0);
+
+    -- Sampler
+    -- Every Divider clocks, a filter sweep reads every channel and steps its
+    -- filter. Between them, as long as any channel is bypassed, bypass sweeps
+    -- read just the bypassed channels, back to back, so the filters' sample
+    -- rate doesn't hold back the unfiltered readings.
+    type sample_state_t is (SAMPLE_IDLE, SAMPLE_READ, SAMPLE_WAIT, SAMPLE_FILTER);
+    signal Sample_State : sample_state_t;
+    signal Sample_Ch    : natural range 0 to ADC_CHANNELS-1;
+    signal Sample       : unsigned(11 downto 0);
+    signal Wait_Count   : unsigned(31 downto 0);
+    signal Filter_Due   : std_logic; -- Divider has elapsed since the last filter sweep
+    signal Sweep_Filter : std_logic; -- The current sweep is a filter sweep
+
+    -- Whether a sweep reads a channel: filter sweeps read them all, bypass
+    -- sweeps those in any mode but IIR and box-car
+    function sampled (config : std_logic_vector(31 downto 0); filter : std_logic)
+            return boolean is
+    begin
+        return filter = '1'
+            or (config(CONFIG_MODE) /= MODE_IIR and config(CONFIG_MODE) /= MODE_BOXCAR);
+    end function;
+
+begin
+
+    -- Avalon register read
+    avalon_register_read : process (clk) is
+    begin
+        if rising_edge(clk) and avs_s1_read = '1' then
+            if unsigned(avs_s1_address) < OUT_ADDR + ADC_CHANNELS then
+                avs_s1_readdata <= std_logic_vector(resize(
+                                   Outputs(to_integer(unsigned(avs_s1_address)) - OUT_ADDR),
+                                   avs_s1_readdata'length));
+            elsif unsigned(avs_s1_address) < CONFIG_ADDR + ADC_CHANNELS then
+                avs_s1_readdata <= Config(to_integer(unsigned(avs_s1_address)) - CONFIG_ADDR);
+            elsif unsigned(avs_s1_address) = DIVIDER_ADDR then
+                avs_s1_readdata <= std_logic_vector(Divider);
+            else
+                avs_s1_readdata <= (others => '0');
+            end if;
+        end if;
+    end process;
+
+
+    -- Avalon register write, and the sampler and filters themselves
+    avalon_register_write : process (clk, reset) is
+        variable ch     : natural range 0 to ADC_CHANNELS-1;
+        variable diff   : signed(28 downto 0);
+        variable step   : signed(45 downto 0);
+        variable length : natural range 0 to 15;
+        variable sum    : unsigned(27 downto 0);
+
+        -- Read the first channel from first on that this sweep reads, or
+        -- finish the sweep if there are none
+        procedure next_channel (first : natural; filter : std_logic) is
+        begin
+            Sample_Ch <= 0;
+            Sample_State <= SAMPLE_IDLE;
+            for c in ADC_CHANNELS-1 downto 0 loop
+                if c >= first and sampled(Config(c), filter) then
+                    Sample_Ch <= c;
+                    Sample_State <= SAMPLE_READ;
+                end if;
+            end loop;
+        end procedure;
+    begin
+        if reset then
+            Config <= (others => (others => '0'));
+            Outputs <= (others => (others => '0'));
+            States <= (others => (others => '0'));
+            Counts <= (others => (others => '0'));
+            Primed <= (others => '0');
+            Divider <= to_unsigned(DEFAULT_DIVIDER, Divider'length);
+            Sample_State <= SAMPLE_IDLE;
+            Sample_Ch <= 0;
+            Sample <= (others => '0');
+            Wait_Count <= (others => '0');
+            Filter_Due <= '0';
+            Sweep_Filter <= '0';
+        elsif rising_edge(clk) then
+            case Sample_State is
+                when SAMPLE_IDLE =>
+                    -- Filter sweeps take priority; bypass sweeps, if any
+                    -- channels are bypassed, fill the gaps
+                    next_channel(0, Filter_Due);
+                    Sweep_Filter <= Filter_Due;
+                    Filter_Due <= '0';
+                when SAMPLE_READ =>
+                    if avm_adc_waitrequest = '0' then
+                        Sample_State <= SAMPLE_WAIT;
+                    end if;
+                when SAMPLE_WAIT =>
+                    if avm_adc_readdatavalid = '1' then
+                        Sample <= unsigned(avm_adc_readdata(11 downto 0));
+                        Sample_State <= SAMPLE_FILTER;
+                    end if;
+                when SAMPLE_FILTER =>
+                    ch := Sample_Ch;
+                    -- A channel that stopped bypassing while a bypass sweep
+                    -- read it waits for the next filter sweep
+                    if sampled(Config(ch), Sweep_Filter) then
+                        length := to_integer(unsigned(Config(ch)(CONFIG_LENGTH)));
+                        if Primed(ch) = '0' then
+                            -- First reading since reset or reconfiguration
+                            States(ch) <= Sample & x"0000";
+                            Counts(ch) <= (others => '0');
+                            Primed(ch) <= '1';
+                        end if;
+                        if Config(ch)(CONFIG_MODE) = MODE_IIR then
+                            if Primed(ch) = '0' then
+                                Outputs(ch) <= Sample;
+                            else
+                                diff := signed(resize(Sample & x"0000", diff'length))
+                                        - signed(resize(States(ch), diff'length));
+                                step := shift_right(diff * signed('0' & Config(ch)(CONFIG_ALPHA)),
+                                                    16);
+                                -- The result lies between the old state and
+                                -- the reading, so it fits; add modulo 2**28
+                                -- rather than resizing the step, which would
+                                -- keep its sign bit and lose its top bit once
+                                -- it reaches half scale
+                                sum := States(ch) + unsigned(step(sum'range));
+                                States(ch) <= sum;
+                                Outputs(ch) <= sum(27 downto 16);
+                            end if;
+                        elsif Config(ch)(CONFIG_MODE) = MODE_BOXCAR then
+                            if Primed(ch) = '0' then
+                                sum := resize(Sample, sum'length);
+                                Counts(ch) <= to_unsigned(1, Counts(ch)'length);
+                            else
+                                sum := States(ch) + Sample;
+                                Counts(ch) <= Counts(ch) + 1;
+                            end if;
+                            if (Primed(ch) = '0' and length = 0)
+                                    or (Primed(ch) = '1' and Counts(ch) + 1 = 2**length) then
+                                Outputs(ch) <= resize(shift_right(sum, length),
+                                                      Outputs(ch)'length);
+                                States(ch) <= (others => '0');
+                                Counts(ch) <= (others => '0');
+                            else
+                                States(ch) <= sum;
+                            end if;
+                        else
+                            Outputs(ch) <= Sample;
+                        end if;
+                    end if;
+                    if Sample_Ch = ADC_CHANNELS-1 then
+                        Sample_Ch <= 0;
+                        Sample_State <= SAMPLE_IDLE;
+                    else
+                        next_channel(Sample_Ch + 1, Sweep_Filter);
+                    end if;
+            end case;
+
+            -- Filter sweeps fall due every Divider clocks, whatever the
+            -- sampler is doing; comparing (rather than counting down) lets a
+            -- new divider apply at once
+            if Divider = 0 then
+                Wait_Count <= (others => '0');
+            elsif Wait_Count >= Divider - 1 then
+                Wait_Count <= (others => '0');
+                Filter_Due <= '1';
+            else
+                Wait_Count <= Wait_Count + 1;
+            end if;
+
+            -- Register writes come last, so reconfiguring a channel always
+            -- restarts its filter
+            if avs_s1_write = '1' then
+                if (unsigned(avs_s1_address) >= CONFIG_ADDR)
+                        and (unsigned(avs_s1_address) < CONFIG_ADDR + ADC_CHANNELS) then
+                    Config(to_integer(unsigned(avs_s1_address)) - CONFIG_ADDR) <= avs_s1_writedata;
+                    Primed(to_integer(unsigned(avs_s1_address)) - CONFIG_ADDR) <= '0';
+                elsif unsigned(avs_s1_address) = DIVIDER_ADDR then
+                    Divider <= unsigned(avs_s1_writedata);
+                end if;
+            end if;
+        end if;
+    end process;
+
+    avm_adc_address <= std_logic_vector(to_unsigned(4 * Sample_Ch, avm_adc_address'length));
+    avm_adc_read <= '1' when Sample_State = SAMPLE_READ else '0';
+
+end architecture;
@@ -13,8 +13,9 @@ use ieee.numeric_std.all;
 -- HPS interface for color LED module
 entity HPS_Multi_PWM is
     generic (
-        ADDR_WIDTH   : positive := 1;       -- address bus width for Platform Designer
-        NUM_CHANNELS : positive := 1;       -- number of PWM channels to produce, limited by address width
+        ADDR_WIDTH   : positive := 10;      -- address bus width for Platform Designer
+        NUM_CHANNELS : positive := 1;       -- number of PWM channels to produce, limited to 255
+        FIFO_DEPTH   : positive := 256;     -- duty cycles queued per channel by the sequencer, a power of two
         SYS_CLKs_sec : positive := 50000000 -- number of system clock periods in one second
     );
     port (
@@ -28,6 +29,23 @@ entity HPS_Multi_PWM is
         avs_s1_readdata  : out std_logic_vector(31 downto 0);
         avs_s1_writedata : in  std_logic_vector(31 downto 0);
 
+        -- Avalon host interface, for fetching queued duty cycles from memory
+        avm_m1_address       : out std_logic_vector(31 downto 0);
+        avm_m1_read          : out std_logic;
+        avm_m1_readdata      : in  std_logic_vector(31 downto 0);
+        avm_m1_waitrequest   : in  std_logic;
+        avm_m1_readdatavalid : in  std_logic;
+
+        -- Avalon host interface, for reading the ADC controller's channels
+        avm_adc_address       : out std_logic_vector(4 downto 0);
+        avm_adc_read          : out std_logic;
+        avm_adc_readdata      : in  std_logic_vector(31 downto 0);
+        avm_adc_waitrequest   : in  std_logic;
+        avm_adc_readdatavalid : in  std_logic;
+
+        -- Sequencer low-water interrupt, active high
+        irq : out std_logic;
+
         -- PWM output channels
         out_channels : out std_logic_vector(0 to NUM_CHANNELS-1)
     );
@@ -36,10 +54,175 @@ end entity;
 
 architecture HPS_Multi_PWM_Arch of HPS_Multi_PWM is
 
+    -- Control/status block location (word address)
+    constant CTRL_ADDR : natural := 16#100#;
+    -- Read-only capability register, so software can discover our generics
+    constant CAPS_ADDR : natural := CTRL_ADDR + 1;
+    -- Sequencer configuration and status
+    constant SEQ_DIVIDER_ADDR   : natural := CTRL_ADDR + 2;
+    constant SEQ_LOW_WATER_ADDR : natural := CTRL_ADDR + 3;
+    constant SEQ_STATUS_ADDR    : natural := CTRL_ADDR + 4;
+    constant SEQ_IRQ_EN_ADDR    : natural := CTRL_ADDR + 5;
+    -- Frame ring in memory, fetched into the sequencer FIFOs
+    constant RING_BASE_ADDR   : natural := CTRL_ADDR + 6;
+    constant RING_FRAMES_ADDR : natural := CTRL_ADDR + 7;
+    constant RING_HEAD_ADDR   : natural := CTRL_ADDR + 8;
+    constant RING_TAIL_ADDR   : natural := CTRL_ADDR + 9;
+    constant RING_CTRL_ADDR   : natural := CTRL_ADDR + 10;
+    -- ADC passthrough enable
+    constant PASS_CTRL_ADDR : natural := CTRL_ADDR + 11;
+    -- Gamma correction: bypass flag, and the table's auto-incrementing port
+    constant GAMMA_CTRL_ADDR  : natural := CTRL_ADDR + 12;
+    constant GAMMA_INDEX_ADDR : natural := CTRL_ADDR + 13;
+    constant GAMMA_DATA_ADDR  : natural := CTRL_ADDR + 14;
+    -- Sequencer FIFO window: writes queue a duty cycle, reads return the level
+    constant SEQ_FIFO_ADDR : natural := 16#200#;
+    -- ADC passthrough window: per-channel routing, gain, and offset
+    constant PASS_CONFIG_ADDR : natural := 16#300#;
+
+    -- Control register bits
+    constant CTRL_HOLD  : natural := 0;
+    constant CTRL_FLUSH : natural := 1;
+    -- Ring control register bits
+    constant RING_ENABLE : natural := 0;
+    constant RING_BUSY   : natural := 1;
+    -- Gamma control register bits
+    constant GAMMA_BYPASS : natural := 0;
+
+    -- ADC passthrough configuration fields
+    -- A channel with passthrough enabled follows its source ADC channel,
+    -- overriding any other writes to its duty cycle:
+    --   duty cycle = reading * gain / 1024 + offset, saturated to [0 1]
+    -- ADC readings are 12 bits, so a gain of 1024 copies them unchanged.
+    constant ADC_CHANNELS : positive := 8;
+    subtype PASS_SOURCE is natural range 2 downto 0;   -- ADC channel
+    constant PASS_ON      : natural := 3;
+    subtype PASS_OFFSET is natural range 17 downto 4;  -- signed, UQ2.12 units
+    subtype PASS_GAIN   is natural range 31 downto 18; -- signed, Q3.10
+
+    -- Largest duty cycle, in UQ2.12; larger values saturate to this
+    constant DUTY_ONE : unsigned(13 downto 0) := b"01_0000_0000_0000";
+
     -- Avalon-mapped control registers
+    -- Period and duty cycles form a shadow set: PWM drivers only load them at
+    -- the end of a period, and never while Hold is set. Setting Hold, writing
+    -- any number of registers, then clearing Hold commits all of the new values
+    -- together at the next period boundary.
     type duty_cycle_t is array (natural range <>) of unsigned(13 downto 0);
     signal Period      : unsigned(16 downto 0);
     signal Duty_Cycles : duty_cycle_t(out_channels'range);
+    signal Hold        : std_logic;
+
+    -- Sequencer
+    -- Each channel has a FIFO of queued duty cycles. Every Seq_Divider periods,
+    -- the sequencer sweeps across the channels, moving the head of each
+    -- non-empty FIFO into its duty cycle register. The drivers are held during
+    -- the sweep, so the new values all take effect at the following boundary.
+    -- Sweeps wait for Hold to clear, so software can queue a value on every
+    -- channel without a sweep splitting them up.
+    -- The FIFOs share one block RAM, indexed by channel and then position.
+    constant CH_BITS  : positive := maximum(1, clog2(NUM_CHANNELS));
+    constant PTR_BITS : positive := clog2(FIFO_DEPTH);
+    type ptr_array_t is array (natural range <>) of unsigned(PTR_BITS-1 downto 0);
+    type level_array_t is array (natural range <>) of unsigned(PTR_BITS downto 0);
+    type fifo_ram_t is array (0 to 2**(CH_BITS+PTR_BITS)-1) of unsigned(13 downto 0);
+    signal Fifo_RAM    : fifo_ram_t;
+    signal Write_Ptrs  : ptr_array_t(out_channels'range);
+    signal Read_Ptrs   : ptr_array_t(out_channels'range);
+    signal Levels      : level_array_t(out_channels'range);
+    signal Max_Level   : unsigned(PTR_BITS downto 0); -- fullest FIFO's level
+    signal Seq_Divider : unsigned(15 downto 0);       -- periods per step
+    signal Low_Water   : unsigned(15 downto 0);
+    signal Irq_Enable  : std_logic;
+    signal Overflow    : std_logic;                   -- a write found its FIFO full
+    signal Step_Count  : unsigned(15 downto 0);
+    signal Step_Pending : std_logic;                  -- a sweep is due
+    -- Sweep state: Sweep_Ch is the next channel to visit; a FIFO read issued
+    -- for Pop_Ch on one clock lands in Pop_Data on the next
+    signal Sweeping    : std_logic;
+    signal Sweep_Ch    : natural range 0 to NUM_CHANNELS-1;
+    signal Sweep_Max   : unsigned(PTR_BITS downto 0);
+    signal Pop_Valid   : std_logic;
+    signal Pop_Ch      : natural range 0 to NUM_CHANNELS-1;
+    signal Pop_Addr    : unsigned(CH_BITS+PTR_BITS-1 downto 0);
+    signal Pop_Data    : unsigned(13 downto 0);
+    -- FIFO write decoding: Avalon writes take priority over fetched values
+    signal Push_Req    : std_logic;
+    signal Push_En     : std_logic;
+    signal Push_Ch     : natural range 0 to NUM_CHANNELS-1;
+    signal Push_Addr   : unsigned(CH_BITS+PTR_BITS-1 downto 0);
+    signal Push_Data   : unsigned(13 downto 0);
+    -- Ring fetcher
+    -- Software fills frames of NUM_CHANNELS words in a ring of Ring_Frames
+    -- frames at Ring_Base, and advances Ring_Head past them. The fetcher reads
+    -- one word at a time, pushing each into its channel's FIFO, and advances
+    -- Ring_Tail after each whole frame. It only starts a frame when every FIFO
+    -- has room, and sweeps wait for it to finish, so frames are never split.
+    type fetch_state_t is (FETCH_IDLE, FETCH_READ, FETCH_WAIT, FETCH_PUSH);
+    signal Ring_Base   : unsigned(31 downto 0);
+    signal Ring_Frames : unsigned(15 downto 0);
+    signal Ring_Head   : unsigned(15 downto 0);
+    signal Ring_Tail   : unsigned(15 downto 0);
+    signal Ring_Enable : std_logic;
+    signal Fetch_State : fetch_state_t;
+    signal Fetch_Ch    : natural range 0 to NUM_CHANNELS-1;
+    signal Fetch_Addr  : unsigned(31 downto 0);           -- next word to read
+    signal Fetch_Data  : std_logic_vector(31 downto 0);
+    signal Fetch_Push  : std_logic;                       -- fetched word taken
+    -- ADC passthrough
+    -- The ADC poller reads each ADC channel in turn, while passthrough is
+    -- enabled. Separately, a two-stage pipeline visits one PWM channel per
+    -- clock, scaling its source's latest reading into a duty cycle.
+    type pass_config_t is array (natural range <>) of std_logic_vector(31 downto 0);
+    type adc_readings_t is array (0 to ADC_CHANNELS-1) of unsigned(11 downto 0);
+    type adc_state_t is (ADC_IDLE, ADC_READ, ADC_WAIT);
+    signal Pass_Enable  : std_logic;
+    signal Pass_Config  : pass_config_t(out_channels'range);
+    signal ADC_Readings : adc_readings_t;
+    signal ADC_State    : adc_state_t;
+    signal ADC_Ch       : natural range 0 to ADC_CHANNELS-1;
+    signal Pass_Ch      : natural range 0 to NUM_CHANNELS-1;
+    -- First stage: product and offset for Pass_Dest1
+    signal Pass_Product : signed(26 downto 0);
+    signal Pass_Offset  : signed(13 downto 0);
+    signal Pass_Dest1   : natural range 0 to NUM_CHANNELS-1;
+    signal Pass_Valid1  : std_logic;
+    -- Second stage: finished duty cycle for Pass_Dest
+    signal Pass_Duty    : unsigned(13 downto 0);
+    signal Pass_Dest    : natural range 0 to NUM_CHANNELS-1;
+    signal Pass_Valid   : std_logic;
+    -- Gamma correction
+    -- A table in block RAM maps each duty cycle below full scale to the one
+    -- the drivers actually use; full scale always passes straight through.
+    -- A scan looks up one channel per clock: a register written on one clock
+    -- is looked up at most NUM_CHANNELS clocks later and reaches its driver
+    -- the clock after that, so a driver loading at a period boundary
+    -- GAMMA_LATENCY or more clocks after the write uses it. Software loads
+    -- the table through a data port that advances its index after every
+    -- write, so a whole table is one burst of writes to a single register.
+    constant GAMMA_ENTRIES : positive := 4096;
+    constant GAMMA_LATENCY : positive := NUM_CHANNELS + 2;
+    type gamma_ram_t is array (0 to GAMMA_ENTRIES-1) of unsigned(12 downto 0);
+    signal Gamma_RAM    : gamma_ram_t;
+    signal Gamma_Bypass : std_logic;                -- drivers use Duty_Cycles as-is
+    signal Gamma_Index  : unsigned(11 downto 0);    -- next entry the data port writes
+    signal Gamma_Write  : std_logic;
+    signal Gamma_Ch     : natural range 0 to NUM_CHANNELS-1;
+    signal Gamma_Addr   : unsigned(11 downto 0);
+    -- A table read issued for Gamma_Ch on one clock lands in Gamma_Data on
+    -- the next, along with the channel and whether it was at full scale
+    signal Gamma_Data   : unsigned(12 downto 0);
+    signal Gamma_Dest   : natural range 0 to NUM_CHANNELS-1;
+    signal Gamma_Full   : std_logic;
+    signal Corrected    : duty_cycle_t(out_channels'range);
+    signal Driver_Duty  : duty_cycle_t(out_channels'range);
+    -- Clocks left until every corrected value reflects the last commit; only
+    -- held for while the table is in use
+    signal Gamma_Settle : natural range 0 to GAMMA_LATENCY;
+    -- Period boundary, from the first driver (all drivers count together)
+    signal Boundaries  : std_logic_vector(out_channels'range);
+    signal Commit_Hold : std_logic;
+    signal Driver_Hold : std_logic;
 
     -- PWM driver component
     component PWM is
@@ -51,15 +234,81 @@ architecture HPS_Multi_PWM_Arch of HPS_Multi_PWM is
             reset      : in  std_logic;             -- system reset, active high
             period     : in  unsigned(16 downto 0); -- PWM period in milliseconds, UQ10.7
             duty_cycle : in  unsigned(13 downto 0); -- PWM duty cycle, UQ2.12, range [0 1] (out-of-range values saturate)
-            pwm_out    : out std_logic              -- PWM output signal
+            hold       : in  std_logic;             -- defer control value updates while high
+            pwm_out    : out std_logic;             -- PWM output signal
+            boundary   : out std_logic              -- high for the last clock of each period
         );
     end component;
 
+    -- Clamp a written duty cycle to the register's range
+    function saturate_duty (data : std_logic_vector(31 downto 0)) return unsigned is
+    begin
+        if unsigned(data) > resize(DUTY_ONE, data'length) then
+            return DUTY_ONE;
+        else
+            return unsigned(data(DUTY_ONE'length-1 downto 0));
+        end if;
+    end function;
+
 begin
-    assert 2**(ADDR_WIDTH) >= NUM_CHANNELS + 1
-        report "Address space must be able to hold [1 + NUM_CHANNELS] elements"
+    assert 2**(ADDR_WIDTH) > CTRL_ADDR
+        report "Address space must reach the control block"
+        severity error;
+    assert 2**(ADDR_WIDTH) > SEQ_FIFO_ADDR + NUM_CHANNELS
+        report "Address space must reach the sequencer FIFO window"
+        severity error;
+    assert 2**(ADDR_WIDTH) >= PASS_CONFIG_ADDR + NUM_CHANNELS
+        report "Address space must reach the ADC passthrough window"
+        severity error;
+    assert NUM_CHANNELS < CTRL_ADDR
+        report "Duty cycle registers must not overlap the control block"
+        severity error;
+    assert (FIFO_DEPTH >= 2) and (2**PTR_BITS = FIFO_DEPTH) and (FIFO_DEPTH < 2**16)
+        report "Sequencer FIFO depth must be a power of two, from 2 to 32768"
         severity error;
 
+    -- Decode FIFO writes; writes to a full FIFO are dropped
+    fifo_push_decode : process (all) is
+        variable req : std_logic;
+        variable ch  : natural range 0 to NUM_CHANNELS-1;
+    begin
+        req := '0';
+        ch := 0;
+        Push_Data <= saturate_duty(avs_s1_writedata);
+        Fetch_Push <= '0';
+        if (avs_s1_write = '1')
+                and (unsigned(avs_s1_address) >= SEQ_FIFO_ADDR)
+                and (unsigned(avs_s1_address) < SEQ_FIFO_ADDR + NUM_CHANNELS) then
+            req := '1';
+            ch := to_integer(unsigned(avs_s1_address)) - SEQ_FIFO_ADDR;
+        elsif Fetch_State = FETCH_PUSH then
+            req := '1';
+            ch := Fetch_Ch;
+            Push_Data <= saturate_duty(Fetch_Data);
+            Fetch_Push <= '1';
+        end if;
+        Push_Req <= req;
+        Push_Ch <= ch;
+        if (req = '1') and (Levels(ch) < FIFO_DEPTH) then
+            Push_En <= '1';
+        else
+            Push_En <= '0';
+        end if;
+    end process;
+    Push_Addr <= to_unsigned(Push_Ch, CH_BITS) & Write_Ptrs(Push_Ch);
+    Pop_Addr  <= to_unsigned(Sweep_Ch, CH_BITS) & Read_Ptrs(Sweep_Ch);
+
+    -- FIFO storage: one write port for pushes, one read port for the sweep
+    fifo_ram_access : process (clk) is
+    begin
+        if rising_edge(clk) then
+            if Push_En then
+                Fifo_RAM(to_integer(Push_Addr)) <= Push_Data;
+            end if;
+            Pop_Data <= Fifo_RAM(to_integer(Pop_Addr));
+        end if;
+    end process;
+
     -- Manage reading from mapped registers
     avalon_register_read : process (clk) is
     begin
@@ -76,6 +325,66 @@ begin
                     avs_s1_readdata <= std_logic_vector(resize(
                                        Duty_Cycles(to_integer(unsigned(avs_s1_address)) - 1),
                                        avs_s1_readdata'length));
+            elsif unsigned(avs_s1_address) = to_unsigned(CTRL_ADDR, avs_s1_address'length) then
+                -- Control register: hold flag (flush reads as zero)
+                avs_s1_readdata <= (CTRL_HOLD => Hold, others => '0');
+            elsif unsigned(avs_s1_address) = to_unsigned(CAPS_ADDR, avs_s1_address'length) then
+                -- Capability register: channel count, ring fetcher, ADC
+                -- passthrough, and gamma table flags, and FIFO depth
+                avs_s1_readdata <= std_logic_vector(to_unsigned(FIFO_DEPTH, 16))
+                                 & "00000" & '1' & '1' & '1'
+                                 & std_logic_vector(to_unsigned(NUM_CHANNELS, 8));
+            elsif unsigned(avs_s1_address) = to_unsigned(SEQ_DIVIDER_ADDR, avs_s1_address'length) then
+                avs_s1_readdata <= std_logic_vector(resize(Seq_Divider, avs_s1_readdata'length));
+            elsif unsigned(avs_s1_address) = to_unsigned(SEQ_LOW_WATER_ADDR, avs_s1_address'length) then
+                avs_s1_readdata <= std_logic_vector(resize(Low_Water, avs_s1_readdata'length));
+            elsif unsigned(avs_s1_address) = to_unsigned(SEQ_STATUS_ADDR, avs_s1_address'length) then
+                -- Sequencer status: fullest level, then low-water and overflow flags
+                avs_s1_readdata <= (others => '0');
+                avs_s1_readdata(Max_Level'range) <= std_logic_vector(Max_Level);
+                if Max_Level <= Low_Water then
+                    avs_s1_readdata(16) <= '1';
+                end if;
+                avs_s1_readdata(17) <= Overflow;
+            elsif unsigned(avs_s1_address) = to_unsigned(SEQ_IRQ_EN_ADDR, avs_s1_address'length) then
+                avs_s1_readdata <= (0 => Irq_Enable, others => '0');
+            elsif unsigned(avs_s1_address) = to_unsigned(RING_BASE_ADDR, avs_s1_address'length) then
+                avs_s1_readdata <= std_logic_vector(Ring_Base);
+            elsif unsigned(avs_s1_address) = to_unsigned(RING_FRAMES_ADDR, avs_s1_address'length) then
+                avs_s1_readdata <= std_logic_vector(resize(Ring_Frames, avs_s1_readdata'length));
+            elsif unsigned(avs_s1_address) = to_unsigned(RING_HEAD_ADDR, avs_s1_address'length) then
+                avs_s1_readdata <= std_logic_vector(resize(Ring_Head, avs_s1_readdata'length));
+            elsif unsigned(avs_s1_address) = to_unsigned(RING_TAIL_ADDR, avs_s1_address'length) then
+                avs_s1_readdata <= std_logic_vector(resize(Ring_Tail, avs_s1_readdata'length));
+            elsif unsigned(avs_s1_address) = to_unsigned(RING_CTRL_ADDR, avs_s1_address'length) then
+                -- Ring control: enable flag, and whether a frame is mid-fetch
+                avs_s1_readdata <= (others => '0');
+                avs_s1_readdata(RING_ENABLE) <= Ring_Enable;
+                if Fetch_State /= FETCH_IDLE then
+                    avs_s1_readdata(RING_BUSY) <= '1';
+                end if;
+            elsif
+                    (unsigned(avs_s1_address) >= SEQ_FIFO_ADDR)
+                    and
+                    (unsigned(avs_s1_address) < SEQ_FIFO_ADDR + NUM_CHANNELS)
+                then
+                    -- Sequencer FIFO window: per-channel levels
+                    avs_s1_readdata <= std_logic_vector(resize(
+                                       Levels(to_integer(unsigned(avs_s1_address)) - SEQ_FIFO_ADDR),
+                                       avs_s1_readdata'length));
+            elsif unsigned(avs_s1_address) = to_unsigned(PASS_CTRL_ADDR, avs_s1_address'length) then
+                avs_s1_readdata <= (0 => Pass_Enable, others => '0');
+            elsif
+                    (unsigned(avs_s1_address) >= PASS_CONFIG_ADDR)
+                    and
+                    (unsigned(avs_s1_address) < PASS_CONFIG_ADDR + NUM_CHANNELS)
+                then
+                    -- ADC passthrough window: per-channel configuration
+                    avs_s1_readdata <= Pass_Config(to_integer(unsigned(avs_s1_address)) - PASS_CONFIG_ADDR);
+            elsif unsigned(avs_s1_address) = to_unsigned(GAMMA_CTRL_ADDR, avs_s1_address'length) then
+                avs_s1_readdata <= (GAMMA_BYPASS => Gamma_Bypass, others => '0');
+            elsif unsigned(avs_s1_address) = to_unsigned(GAMMA_INDEX_ADDR, avs_s1_address'length) then
+                avs_s1_readdata <= std_logic_vector(resize(Gamma_Index, avs_s1_readdata'length));
             elsif unsigned(avs_s1_address) > NUM_CHANNELS then
                 -- Unused registers: zeros
                 avs_s1_readdata <= (others => '0');
@@ -83,43 +392,378 @@ begin
         end if;
     end process;
 
-    -- Manage writing to mapped registers
+    -- Manage writing to mapped registers, and run the sequencer
     avalon_register_write : process (clk, reset) is
+        variable next_levels    : level_array_t(out_channels'range);
+        variable next_max       : unsigned(Max_Level'range);
+        variable next_sweep_max : unsigned(Sweep_Max'range);
     begin
         if reset then
             -- Reset all registers to their default values
             Period <= (others => '0');
             Duty_Cycles <= (others => (others => '0'));
-        elsif rising_edge(clk) and avs_s1_write = '1' then
-            if unsigned(avs_s1_address) = to_unsigned(0, avs_s1_address'length) then
-                -- Register zero: period
-                if resize(unsigned(avs_s1_writedata(Period'length-1 downto 0)), avs_s1_writedata'length)
-                        /= unsigned(avs_s1_writedata) then
-                    Period <= (others => '1');
+            Hold <= '0';
+            Seq_Divider <= to_unsigned(1, Seq_Divider'length);
+            Low_Water <= (others => '0');
+            Irq_Enable <= '0';
+            Overflow <= '0';
+            Write_Ptrs <= (others => (others => '0'));
+            Read_Ptrs <= (others => (others => '0'));
+            Levels <= (others => (others => '0'));
+            Max_Level <= (others => '0');
+            Step_Count <= (others => '0');
+            Step_Pending <= '0';
+            Sweeping <= '0';
+            Sweep_Ch <= 0;
+            Sweep_Max <= (others => '0');
+            Pop_Valid <= '0';
+            Pop_Ch <= 0;
+            Ring_Base <= (others => '0');
+            Ring_Frames <= (others => '0');
+            Ring_Head <= (others => '0');
+            Ring_Tail <= (others => '0');
+            Ring_Enable <= '0';
+            Fetch_State <= FETCH_IDLE;
+            Fetch_Ch <= 0;
+            Fetch_Addr <= (others => '0');
+            Fetch_Data <= (others => '0');
+            Pass_Enable <= '0';
+            Pass_Config <= (others => (others => '0'));
+            Gamma_Bypass <= '1';
+            Gamma_Index <= (others => '0');
+        elsif rising_edge(clk) then
+            next_levels := Levels;
+            next_max := Max_Level;
+            next_sweep_max := Sweep_Max;
+
+            if avs_s1_write = '1' then
+                if unsigned(avs_s1_address) = to_unsigned(0, avs_s1_address'length) then
+                    -- Register zero: period
+                    if resize(unsigned(avs_s1_writedata(Period'length-1 downto 0)), avs_s1_writedata'length)
+                            /= unsigned(avs_s1_writedata) then
+                        Period <= (others => '1');
+                    else
+                        Period <= unsigned(avs_s1_writedata(Period'length-1 downto 0));
+                    end if;
+                elsif (
+                        to_unsigned(1, avs_s1_address'length) <= unsigned(avs_s1_address)
+                    ) and (
+                        unsigned(avs_s1_address) <= to_unsigned(NUM_CHANNELS, avs_s1_address'length)
+                    ) then
+                        -- Next NUM_CHANNELS registers: duty cycle array
+                        Duty_Cycles(to_integer(unsigned(avs_s1_address)) - 1) <= saturate_duty(avs_s1_writedata);
+                elsif unsigned(avs_s1_address) = to_unsigned(CTRL_ADDR, avs_s1_address'length) then
+                    -- Control register: hold flag, and FIFO flush
+                    Hold <= avs_s1_writedata(CTRL_HOLD);
+                elsif unsigned(avs_s1_address) = to_unsigned(SEQ_DIVIDER_ADDR, avs_s1_address'length) then
+                    Seq_Divider <= unsigned(avs_s1_writedata(Seq_Divider'range));
+                elsif unsigned(avs_s1_address) = to_unsigned(SEQ_LOW_WATER_ADDR, avs_s1_address'length) then
+                    Low_Water <= unsigned(avs_s1_writedata(Low_Water'range));
+                elsif unsigned(avs_s1_address) = to_unsigned(SEQ_IRQ_EN_ADDR, avs_s1_address'length) then
+                    Irq_Enable <= avs_s1_writedata(0);
+                elsif unsigned(avs_s1_address) = to_unsigned(RING_BASE_ADDR, avs_s1_address'length) then
+                    Ring_Base <= unsigned(avs_s1_writedata(31 downto 2)) & "00";
+                elsif unsigned(avs_s1_address) = to_unsigned(RING_FRAMES_ADDR, avs_s1_address'length) then
+                    Ring_Frames <= unsigned(avs_s1_writedata(Ring_Frames'range));
+                elsif unsigned(avs_s1_address) = to_unsigned(RING_HEAD_ADDR, avs_s1_address'length) then
+                    Ring_Head <= unsigned(avs_s1_writedata(Ring_Head'range));
+                elsif unsigned(avs_s1_address) = to_unsigned(RING_CTRL_ADDR, avs_s1_address'length) then
+                    -- Enabling the ring starts fetching from its first frame
+                    Ring_Enable <= avs_s1_writedata(RING_ENABLE);
+                    if (Ring_Enable = '0') and (avs_s1_writedata(RING_ENABLE) = '1') then
+                        Ring_Tail <= (others => '0');
+                        Fetch_Addr <= Ring_Base;
+                    end if;
+                elsif
+                        (unsigned(avs_s1_address) >= SEQ_FIFO_ADDR)
+                        and
+                        (unsigned(avs_s1_address) < SEQ_FIFO_ADDR + NUM_CHANNELS)
+                    then
+                        -- Sequencer FIFO window: queued below, along with fetched values
+                        null;
+                elsif unsigned(avs_s1_address) = to_unsigned(PASS_CTRL_ADDR, avs_s1_address'length) then
+                    Pass_Enable <= avs_s1_writedata(0);
+                elsif
+                        (unsigned(avs_s1_address) >= PASS_CONFIG_ADDR)
+                        and
+                        (unsigned(avs_s1_address) < PASS_CONFIG_ADDR + NUM_CHANNELS)
+                    then
+                        -- ADC passthrough window: per-channel configuration
+                        Pass_Config(to_integer(unsigned(avs_s1_address)) - PASS_CONFIG_ADDR) <= avs_s1_writedata;
+                elsif unsigned(avs_s1_address) = to_unsigned(GAMMA_CTRL_ADDR, avs_s1_address'length) then
+                    Gamma_Bypass <= avs_s1_writedata(GAMMA_BYPASS);
+                elsif unsigned(avs_s1_address) = to_unsigned(GAMMA_INDEX_ADDR, avs_s1_address'length) then
+                    Gamma_Index <= unsigned(avs_s1_writedata(Gamma_Index'range));
+                elsif unsigned(avs_s1_address) = to_unsigned(GAMMA_DATA_ADDR, avs_s1_address'length) then
+                    -- Table entry stored below; wraps around after the last one
+                    Gamma_Index <= Gamma_Index + 1;
+                elsif unsigned(avs_s1_address) > NUM_CHANNELS then
+                    -- Unused and read-only registers: ignored
+                    null;
+                end if;
+            end if;
+
+            -- Queue a duty cycle, from either Avalon or the ring fetcher
+            if Push_En then
+                Write_Ptrs(Push_Ch) <= Write_Ptrs(Push_Ch) + 1;
+                next_levels(Push_Ch) := next_levels(Push_Ch) + 1;
+                if next_levels(Push_Ch) > next_max then
+                    next_max := next_levels(Push_Ch);
+                end if;
+                -- Channels this sweep has passed must count towards its result
+                if (Sweeping = '1') and (Push_Ch < Sweep_Ch) and (next_levels(Push_Ch) > next_sweep_max) then
+                    next_sweep_max := next_levels(Push_Ch);
+                end if;
+            elsif Push_Req then
+                Overflow <= '1';
+            end if;
+
+            -- Fetch frames from the ring, one word at a time
+            case Fetch_State is
+                when FETCH_IDLE =>
+                    -- Only start a frame that every FIFO has room for
+                    if (Ring_Enable = '1') and (Ring_Tail /= Ring_Head) and (Max_Level < FIFO_DEPTH) then
+                        Fetch_State <= FETCH_READ;
+                        Fetch_Ch <= 0;
+                    end if;
+                when FETCH_READ =>
+                    if avm_m1_waitrequest = '0' then
+                        Fetch_State <= FETCH_WAIT;
+                    end if;
+                when FETCH_WAIT =>
+                    if avm_m1_readdatavalid = '1' then
+                        Fetch_Data <= avm_m1_readdata;
+                        Fetch_State <= FETCH_PUSH;
+                    end if;
+                when FETCH_PUSH =>
+                    -- Wait out any Avalon write to the FIFO window
+                    if Fetch_Push = '1' then
+                        if Fetch_Ch = NUM_CHANNELS-1 then
+                            Fetch_State <= FETCH_IDLE;
+                            if Ring_Tail + 1 >= Ring_Frames then
+                                Ring_Tail <= (others => '0');
+                                Fetch_Addr <= Ring_Base;
+                            else
+                                Ring_Tail <= Ring_Tail + 1;
+                                Fetch_Addr <= Fetch_Addr + 4;
+                            end if;
+                        else
+                            Fetch_State <= FETCH_READ;
+                            Fetch_Ch <= Fetch_Ch + 1;
+                            Fetch_Addr <= Fetch_Addr + 4;
+                        end if;
+                    end if;
+            end case;
+
+            -- Count periods, and request a sweep every Seq_Divider of them
+            if (Boundaries(0) = '1') and (Period /= 0) then
+                if Step_Count + 1 >= Seq_Divider then
+                    Step_Count <= (others => '0');
+                    if next_max /= 0 then
+                        Step_Pending <= '1';
+                    end if;
                 else
-                    Period <= unsigned(avs_s1_writedata(Period'length-1 downto 0));
+                    Step_Count <= Step_Count + 1;
                 end if;
-            elsif (
-                    to_unsigned(1, avs_s1_address'length) <= unsigned(avs_s1_address)
-                ) and (
-                    unsigned(avs_s1_address) <= to_unsigned(NUM_CHANNELS, avs_s1_address'length)
-                ) then
-                    -- Next NUM_CHANNELS registers: duty cycle array
-                    if unsigned(avs_s1_writedata)
-                            > resize(unsigned'(b"01_0000_0000_0000"), avs_s1_writedata'length) then
-                        Duty_Cycles(to_integer(unsigned(avs_s1_address)) - 1) <= b"01_0000_0000_0000";
-                    else
-                        Duty_Cycles(to_integer(unsigned(avs_s1_address)) - 1)
-                            <= unsigned(avs_s1_writedata(Duty_Cycles(0)'length-1 downto 0));
+            end if;
+
+            -- Start a requested sweep once software isn't holding the registers,
+            -- and no frame is partway through being fetched
+            if (Step_Pending = '1') and (Hold = '0') and (Sweeping = '0') and (Fetch_State = FETCH_IDLE) then
+                Step_Pending <= '0';
+                Sweeping <= '1';
+                Sweep_Ch <= 0;
+                next_sweep_max := (others => '0');
+            end if;
+
+            -- Sweep: pop one channel per clock; its value arrives on the next
+            Pop_Valid <= '0';
+            if Sweeping = '1' then
+                -- A value pushed on this clock isn't in the RAM yet, so only
+                -- pop from FIFOs that already held something
+                if Levels(Sweep_Ch) /= 0 then
+                    Read_Ptrs(Sweep_Ch) <= Read_Ptrs(Sweep_Ch) + 1;
+                    next_levels(Sweep_Ch) := next_levels(Sweep_Ch) - 1;
+                    Pop_Valid <= '1';
+                    Pop_Ch <= Sweep_Ch;
+                end if;
+                if next_levels(Sweep_Ch) > next_sweep_max then
+                    next_sweep_max := next_levels(Sweep_Ch);
+                end if;
+                if Sweep_Ch = NUM_CHANNELS-1 then
+                    Sweeping <= '0';
+                    next_max := next_sweep_max;
+                else
+                    Sweep_Ch <= Sweep_Ch + 1;
+                end if;
+            end if;
+            if Pop_Valid = '1' then
+                Duty_Cycles(Pop_Ch) <= Pop_Data;
+            end if;
+            -- Passthrough overrides everything else
+            if Pass_Valid = '1' then
+                Duty_Cycles(Pass_Dest) <= Pass_Duty;
+            end if;
+
+            Levels <= next_levels;
+            Max_Level <= next_max;
+            Sweep_Max <= next_sweep_max;
+
+            -- Flushing empties every FIFO, and abandons any sweep in progress
+            if (avs_s1_write = '1') and (avs_s1_writedata(CTRL_FLUSH) = '1')
+                    and (unsigned(avs_s1_address) = to_unsigned(CTRL_ADDR, avs_s1_address'length)) then
+                Write_Ptrs <= (others => (others => '0'));
+                Read_Ptrs <= (others => (others => '0'));
+                Levels <= (others => (others => '0'));
+                Max_Level <= (others => '0');
+                Overflow <= '0';
+                Step_Pending <= '0';
+                Sweeping <= '0';
+                Pop_Valid <= '0';
+            end if;
+        end if;
+    end process;
+
+    -- Read the ADC channels in turn while passthrough is enabled
+    adc_poll : process (clk, reset) is
+    begin
+        if reset then
+            ADC_State <= ADC_IDLE;
+            ADC_Ch <= 0;
+            ADC_Readings <= (others => (others => '0'));
+        elsif rising_edge(clk) then
+            case ADC_State is
+                when ADC_IDLE =>
+                    if Pass_Enable = '1' then
+                        ADC_State <= ADC_READ;
                     end if;
-            elsif unsigned(avs_s1_address) > NUM_CHANNELS then
-                -- Unused registers: ignored
-                null;
+                when ADC_READ =>
+                    if avm_adc_waitrequest = '0' then
+                        ADC_State <= ADC_WAIT;
+                    end if;
+                when ADC_WAIT =>
+                    if avm_adc_readdatavalid = '1' then
+                        ADC_Readings(ADC_Ch) <= unsigned(avm_adc_readdata(11 downto 0));
+                        ADC_Ch <= (ADC_Ch + 1) mod ADC_CHANNELS;
+                        ADC_State <= ADC_IDLE;
+                    end if;
+            end case;
+        end if;
+    end process;
+    avm_adc_address <= std_logic_vector(to_unsigned(4 * ADC_Ch, avm_adc_address'length));
+    avm_adc_read <= '1' when ADC_State = ADC_READ else '0';
+
+    -- Scale each passthrough channel's source reading into a duty cycle
+    pass_compute : process (clk, reset) is
+        variable config : std_logic_vector(31 downto 0);
+        variable sum    : signed(17 downto 0);
+    begin
+        if reset then
+            Pass_Ch <= 0;
+            Pass_Product <= (others => '0');
+            Pass_Offset <= (others => '0');
+            Pass_Dest1 <= 0;
+            Pass_Valid1 <= '0';
+            Pass_Duty <= (others => '0');
+            Pass_Dest <= 0;
+            Pass_Valid <= '0';
+        elsif rising_edge(clk) then
+            -- First stage: multiply
+            config := Pass_Config(Pass_Ch);
+            Pass_Product <= signed('0' & ADC_Readings(to_integer(unsigned(config(PASS_SOURCE)))))
+                            * signed(config(PASS_GAIN));
+            Pass_Offset <= signed(config(PASS_OFFSET));
+            Pass_Dest1 <= Pass_Ch;
+            Pass_Valid1 <= Pass_Enable and config(PASS_ON);
+            if Pass_Ch = NUM_CHANNELS-1 then
+                Pass_Ch <= 0;
+            else
+                Pass_Ch <= Pass_Ch + 1;
+            end if;
+
+            -- Second stage: scale, offset, and saturate
+            sum := resize(shift_right(Pass_Product, 10), sum'length) + resize(Pass_Offset, sum'length);
+            if sum < 0 then
+                Pass_Duty <= (others => '0');
+            elsif sum > resize(signed('0' & DUTY_ONE), sum'length) then
+                Pass_Duty <= DUTY_ONE;
+            else
+                Pass_Duty <= unsigned(sum(Pass_Duty'range));
+            end if;
+            Pass_Dest <= Pass_Dest1;
+            Pass_Valid <= Pass_Valid1;
+        end if;
+    end process;
+
+    -- Gamma table storage: one write port for loading, one read port for the scan
+    Gamma_Write <= '1' when (avs_s1_write = '1')
+                            and (unsigned(avs_s1_address) = to_unsigned(GAMMA_DATA_ADDR, avs_s1_address'length))
+                   else '0';
+    Gamma_Addr <= Duty_Cycles(Gamma_Ch)(Gamma_Addr'range);
+    gamma_ram_access : process (clk) is
+    begin
+        if rising_edge(clk) then
+            if Gamma_Write then
+                Gamma_RAM(to_integer(Gamma_Index)) <= resize(saturate_duty(avs_s1_writedata), Gamma_Data'length);
+            end if;
+            Gamma_Data <= Gamma_RAM(to_integer(Gamma_Addr));
+        end if;
+    end process;
+
+    -- Look up each channel's corrected duty cycle in turn
+    gamma_lookup : process (clk, reset) is
+    begin
+        if reset then
+            Gamma_Ch <= 0;
+            Gamma_Dest <= 0;
+            Gamma_Full <= '0';
+            Corrected <= (others => (others => '0'));
+            Gamma_Settle <= 0;
+        elsif rising_edge(clk) then
+            -- First stage: table read, addressed by Gamma_Ch's duty cycle
+            Gamma_Dest <= Gamma_Ch;
+            if Duty_Cycles(Gamma_Ch) = DUTY_ONE then
+                Gamma_Full <= '1';
+            else
+                Gamma_Full <= '0';
+            end if;
+            if Gamma_Ch = NUM_CHANNELS-1 then
+                Gamma_Ch <= 0;
+            else
+                Gamma_Ch <= Gamma_Ch + 1;
+            end if;
+
+            -- Second stage: store the entry, or full scale
+            if Gamma_Full = '1' then
+                Corrected(Gamma_Dest) <= DUTY_ONE;
+            else
+                Corrected(Gamma_Dest) <= resize(Gamma_Data, DUTY_ONE'length);
+            end if;
+
+            -- Once a commit is released, keep the drivers held until the scan
+            -- has caught up with every channel
+            if Commit_Hold = '1' then
+                Gamma_Settle <= GAMMA_LATENCY;
+            elsif Gamma_Settle /= 0 then
+                Gamma_Settle <= Gamma_Settle - 1;
             end if;
         end if;
     end process;
+    Driver_Duty <= Duty_Cycles when Gamma_Bypass = '1' else Corrected;
+
+    -- Ring fetcher reads
+    avm_m1_address <= std_logic_vector(Fetch_Addr);
+    avm_m1_read <= '1' when Fetch_State = FETCH_READ else '0';
+
+    -- Interrupt once the fullest FIFO has drained to the low-water mark
+    irq <= '1' when (Irq_Enable = '1') and (Max_Level <= Low_Water) else '0';
+
+    -- Drivers must not pick up a partially-swept set of duty cycles
+    Commit_Hold <= Hold or Step_Pending or Sweeping or Pop_Valid;
+    Driver_Hold <= '1' when (Commit_Hold = '1') or ((Gamma_Settle /= 0) and (Gamma_Bypass = '0'))
+                   else '0';
 
-    -- Instantiate three PWM drivers
+    -- Instantiate one PWM driver per channel
     PWM_Drivers: for N in out_channels'range generate
         driver : PWM
             generic map (
@@ -129,8 +773,10 @@ begin
                 clk        => clk,
                 reset      => reset,
                 period     => Period,
-                duty_cycle => Duty_Cycles(N),
-                pwm_out    => out_channels(N)
+                duty_cycle => Driver_Duty(N),
+                hold       => Driver_Hold,
+                pwm_out    => out_channels(N),
+                boundary   => Boundaries(N)
             );
     end generate;
 
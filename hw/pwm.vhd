@@ -18,7 +18,9 @@ entity PWM is
         reset      : in  std_logic;             -- system reset, active high
         period     : in  unsigned(16 downto 0); -- PWM period in milliseconds, UQ10.7
         duty_cycle : in  unsigned(13 downto 0); -- PWM duty cycle, UQ2.12, range [0 1] (out-of-range values saturate)
-        pwm_out    : out std_logic              -- PWM output signal
+        hold       : in  std_logic := '0';      -- defer control value updates while high
+        pwm_out    : out std_logic;             -- PWM output signal
+        boundary   : out std_logic              -- high for the last clock of each period
     );
 end entity;
 
@@ -61,8 +63,8 @@ begin
             duty_limit <= "*"(clks_per_period, duty_cycle)(clks_per_period'high+duty_cycle'high downto 0+12);
         elsif rising_edge(clk) then
 
-            -- Update control values
-            if next_count = 0 then
+            -- Update control values, unless the new ones are being held back
+            if (next_count = 0) and (hold = '0') then
                 per_limit <= clks_per_period;
                 duty_limit <= "*"(clks_per_period, duty_cycle)(clks_per_period'high+duty_cycle'high downto 0+12);
             end if;
@@ -75,4 +77,7 @@ begin
     -- PWM output is a simple combinational comparison
     pwm_out <= '1' when (reset = '0') and (count < duty_limit) else '0';
 
+    -- Control values load at the end of this clock, unless held
+    boundary <= '1' when (reset = '0') and (next_count = 0) else '0';
+
 end architecture;
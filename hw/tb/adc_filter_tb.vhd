@@ -0,0 +1,336 @@
+-- EELE 467
+-- Test bench for the ADC_Filter component, checked against a reference model
+
+use std.env.all;
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+
+-- ADC_Filter test bench
+entity ADC_Filter_TB is
+end entity;
+
+architecture ADC_Filter_TB_Arch of ADC_Filter_TB is
+    constant CLK_PER      : time := 20 ns;
+    constant ADC_CHANNELS : positive := 8;
+    constant NUM_SWEEPS   : positive := 48;
+    -- Then enough at full scale for the longest box-car filter to finish
+    constant FULL_SWEEPS  : positive := 2**15 + 2;
+    -- Long enough that every check, and the bypass sweeps before it, fit
+    -- between filter sweeps
+    constant DIVIDER      : positive := 256;
+    -- Clocks for bypass sweeps to catch the bypassed channels up with the ADC
+    constant BYPASS_CLKS  : positive := 40;
+    -- The default divider is then 1000 clocks, leaving plenty of time to
+    -- configure the filters before the first sweep
+    constant SYS_CLKs_sec : positive := 1000000;
+
+    -- Register word addresses
+    constant OUT_ADDR     : natural := 16#00#;
+    constant CONFIG_ADDR  : natural := 16#08#;
+    constant DIVIDER_ADDR : natural := 16#10#;
+
+    -- Filter modes
+    constant MODE_BYPASS : natural := 0;
+    constant MODE_IIR    : natural := 1;
+    constant MODE_BOXCAR : natural := 2;
+
+    signal clk, reset : std_logic;
+    signal read, write : std_logic;
+    signal address     : std_logic_vector(4 downto 0);
+    signal readdata    : std_logic_vector(31 downto 0);
+    signal writedata   : std_logic_vector(31 downto 0);
+
+    -- Mock ADC controller: during filter sweep s, and the bypass sweeps after
+    -- the one before it, channel c reads adc_reading(c, s) (plus bump),
+    -- returned with a wait state and two clocks of latency
+    signal a_address     : std_logic_vector(4 downto 0);
+    signal a_read        : std_logic;
+    signal a_readdata    : std_logic_vector(31 downto 0);
+    signal a_waitrequest : std_logic := '1';
+    signal a_valid       : std_logic := '0';
+    -- Incremented each time the last channel is read, once counting; the
+    -- tests never bypass it, so only filter sweeps read it
+    signal counting      : boolean := false;
+    signal sweeps        : natural := 0;
+    signal bump          : natural := 0;
+    -- A noisy ramp for the first NUM_SWEEPS sweeps, then full-scale extremes:
+    -- a square wave between 0 and 4095 on channels 0 to 3, and a constant 4095
+    -- on the rest
+    function adc_reading (c : natural; s : natural) return natural is
+    begin
+        if s < NUM_SWEEPS then
+            return (s * 389 * (c + 1) + c * 512 + (s mod 3) * 700) mod 4096;
+        elsif c < 4 then
+            return (s mod 2) * 4095;
+        else
+            return 4095;
+        end if;
+    end function;
+
+    -- Configuration word for one channel
+    function filter_config (mode : natural; length : natural; alpha : natural)
+            return std_logic_vector is
+    begin
+        return std_logic_vector(to_unsigned(alpha, 16))
+             & "0000" & std_logic_vector(to_unsigned(length, 4))
+             & std_logic_vector(to_unsigned(mode, 8));
+    end function;
+begin
+
+    -- ADC_Filter DUT instance
+    dut : entity work.ADC_Filter
+        generic map (
+            SYS_CLKs_sec => SYS_CLKs_sec
+        )
+        port map (
+            clk              => clk,
+            reset            => reset,
+            avs_s1_read      => read,
+            avs_s1_write     => write,
+            avs_s1_address   => address,
+            avs_s1_readdata  => readdata,
+            avs_s1_writedata => writedata,
+            avm_adc_address       => a_address,
+            avm_adc_read          => a_read,
+            avm_adc_readdata      => a_readdata,
+            avm_adc_waitrequest   => a_waitrequest,
+            avm_adc_readdatavalid => a_valid
+        );
+
+    -- Clock driver
+    clock : process is
+    begin
+        clk <= '1';
+        while true loop
+            wait for CLK_PER / 2;
+            clk <= not clk;
+        end loop;
+    end process;
+
+    -- Mock ADC controller
+    mock_adc : process (clk) is
+        variable countdown : natural := 0;
+        variable ch        : natural;
+    begin
+        if rising_edge(clk) then
+            a_valid <= '0';
+            if countdown /= 0 then
+                countdown := countdown - 1;
+                if countdown = 0 then
+                    a_readdata <= std_logic_vector(to_unsigned(
+                                  (adc_reading(ch, sweeps) + bump) mod 4096, 32));
+                    a_valid <= '1';
+                    if ch = ADC_CHANNELS-1 and counting then
+                        sweeps <= sweeps + 1;
+                    end if;
+                end if;
+            elsif (a_read = '1') and (a_waitrequest = '0') then
+                assert a_address(1 downto 0) = "00"
+                    report "Misaligned ADC read from " & to_hstring(a_address)
+                    severity error;
+                ch := to_integer(unsigned(a_address(4 downto 2)));
+                countdown := 2;
+                a_waitrequest <= '1';
+            elsif a_read = '1' then
+                a_waitrequest <= '0';
+            end if;
+        end if;
+    end process;
+
+    -- Test driver
+    tester : process is
+        -- Reference model state, per channel
+        variable modes   : integer_vector(0 to ADC_CHANNELS-1);
+        variable lengths : integer_vector(0 to ADC_CHANNELS-1);
+        variable alphas  : integer_vector(0 to ADC_CHANNELS-1);
+        variable primed  : boolean_vector(0 to ADC_CHANNELS-1) := (others => false);
+        variable states  : integer_vector(0 to ADC_CHANNELS-1) := (others => 0);
+        variable counts  : integer_vector(0 to ADC_CHANNELS-1) := (others => 0);
+        variable outputs : integer_vector(0 to ADC_CHANNELS-1) := (others => 0);
+        variable value   : std_logic_vector(31 downto 0);
+        variable last    : natural;
+
+        -- Single-clock Avalon transfers
+        procedure avalon_write (addr : natural; data : natural) is
+        begin
+            address <= std_logic_vector(to_unsigned(addr, address'length));
+            writedata <= std_logic_vector(to_unsigned(data, writedata'length));
+            write <= '1';
+            wait until falling_edge(clk);
+            write <= '0';
+        end procedure;
+        procedure avalon_write (addr : natural; data : std_logic_vector(31 downto 0)) is
+        begin
+            address <= std_logic_vector(to_unsigned(addr, address'length));
+            writedata <= data;
+            write <= '1';
+            wait until falling_edge(clk);
+            write <= '0';
+        end procedure;
+        procedure avalon_read (addr : natural; data : out std_logic_vector(31 downto 0)) is
+        begin
+            address <= std_logic_vector(to_unsigned(addr, address'length));
+            read <= '1';
+            wait until falling_edge(clk);
+            read <= '0';
+            data := readdata;
+        end procedure;
+
+        -- Configure a channel, in both the DUT and the model
+        procedure configure (c : natural; mode : natural; length : natural; alpha : natural) is
+        begin
+            avalon_write(CONFIG_ADDR + c, filter_config(mode, length, alpha));
+            modes(c) := mode;
+            lengths(c) := length;
+            alphas(c) := alpha;
+            primed(c) := false;
+        end procedure;
+
+        -- Reference model: feed reading x to channel c
+        procedure model (c : natural; x : natural) is
+            variable diff : signed(29 downto 0);
+            variable step : signed(47 downto 0);
+        begin
+            if modes(c) = MODE_IIR then
+                if not primed(c) then
+                    states(c) := x * 2**16;
+                else
+                    diff := to_signed(x * 2**16 - states(c), diff'length);
+                    step := shift_right(diff * to_signed(alphas(c), 18), 16);
+                    states(c) := states(c) + to_integer(step);
+                end if;
+                outputs(c) := states(c) / 2**16;
+            elsif modes(c) = MODE_BOXCAR then
+                if not primed(c) then
+                    states(c) := 0;
+                    counts(c) := 0;
+                end if;
+                states(c) := states(c) + x;
+                counts(c) := counts(c) + 1;
+                if counts(c) = 2**lengths(c) then
+                    outputs(c) := states(c) / 2**lengths(c);
+                    states(c) := 0;
+                    counts(c) := 0;
+                end if;
+            else
+                outputs(c) := x;
+            end if;
+            primed(c) := true;
+        end procedure;
+    begin
+        wait until falling_edge(clk);
+
+        -- Initialization: reset system
+        reset <= '1';
+        read <= '0';
+        write <= '0';
+        address <= (others => '0');
+        writedata <= (others => '0');
+        for i in 1 to 5 loop
+            wait until falling_edge(clk);
+        end loop;
+        reset <= '0';
+
+        -- One channel per setting worth checking: bypass, IIR filters from
+        -- heavy to (almost) none, and box-car filters from 1 to 8 readings
+        configure(0, MODE_BYPASS, 0, 0);
+        configure(1, MODE_IIR,    0, 16#0100#);
+        configure(2, MODE_IIR,    0, 16#1000#);
+        configure(3, MODE_IIR,    0, 16#8000#);
+        configure(4, MODE_IIR,    0, 16#FFFF#);
+        configure(5, MODE_BOXCAR, 0, 0);
+        configure(6, MODE_BOXCAR, 2, 0);
+        configure(7, MODE_BOXCAR, 3, 0);
+        avalon_read(CONFIG_ADDR + 2, value);
+        assert value = filter_config(MODE_IIR, 0, 16#1000#)
+            report "Configuration reads " & to_hstring(value)
+            severity error;
+        avalon_write(DIVIDER_ADDR, DIVIDER);
+        avalon_read(DIVIDER_ADDR, value);
+        assert unsigned(value) = DIVIDER
+            report "Divider reads " & to_hstring(value)
+            severity error;
+        -- Until configured, every channel was bypassed, so let any bypass
+        -- sweep reading the last channel finish before counting sweeps
+        for i in 1 to 10 loop
+            wait until falling_edge(clk);
+        end loop;
+        counting <= true;
+
+        -- After every filter sweep, compare each channel against the model
+        for s in 0 to NUM_SWEEPS + FULL_SWEEPS - 1 loop
+            wait until sweeps = s + 1;
+            -- Let the last channel's reading through the filter, and bypass
+            -- sweeps read the bypassed channels again
+            for i in 1 to BYPASS_CLKS loop
+                wait until falling_edge(clk);
+            end loop;
+            for c in 0 to ADC_CHANNELS-1 loop
+                -- Bypassed channels follow the ADC, which has moved on to the
+                -- next filter sweep's readings
+                if modes(c) = MODE_BYPASS then
+                    model(c, adc_reading(c, s + 1));
+                else
+                    model(c, adc_reading(c, s));
+                end if;
+                avalon_read(OUT_ADDR + c, value);
+                assert unsigned(value) = outputs(c)
+                    report "Channel " & integer'image(c) & " reads " & integer'image(to_integer(unsigned(value)))
+                         & " after sweep " & integer'image(s) & ", expected " & integer'image(outputs(c))
+                    severity error;
+            end loop;
+
+            -- Partway through, reconfiguring a channel restarts its filter
+            if s = NUM_SWEEPS / 2 then
+                configure(1, MODE_BOXCAR, 1, 0);
+                configure(6, MODE_IIR, 0, 16#4000#);
+            end if;
+
+            -- At full scale, the IIR filter's steps span the whole UQ12.16
+            -- range in both directions, and the longest box-car filter's sum
+            -- reaches its widest
+            if s = NUM_SWEEPS - 1 then
+                configure(0, MODE_IIR,    0,  16#FFFF#);
+                configure(1, MODE_IIR,    0,  16#8000#);
+                configure(2, MODE_IIR,    0,  16#0001#);
+                configure(3, MODE_BOXCAR, 15, 0);
+                configure(4, MODE_BOXCAR, 15, 0);
+                configure(5, MODE_IIR,    0,  16#FFFF#);
+                configure(6, MODE_BYPASS, 0,  0);
+                configure(7, MODE_BOXCAR, 14, 0);
+            end if;
+        end loop;
+
+        -- A zero divider stops the filters
+        avalon_write(DIVIDER_ADDR, 0);
+        last := sweeps;
+        for i in 1 to 4 * DIVIDER loop
+            wait until falling_edge(clk);
+        end loop;
+        assert sweeps <= last + 1
+            report "Filtering continued with a zero divider"
+            severity error;
+
+        -- But bypassed channels still follow the ADC, within a bypass sweep
+        bump <= 1000;
+        for i in 1 to BYPASS_CLKS loop
+            wait until falling_edge(clk);
+        end loop;
+        avalon_read(OUT_ADDR + 6, value);
+        assert unsigned(value) = (adc_reading(6, sweeps) + 1000) mod 4096
+            report "Bypassed channel reads " & integer'image(to_integer(unsigned(value)))
+                 & " with the filters stopped, expected "
+                 & integer'image((adc_reading(6, sweeps) + 1000) mod 4096)
+            severity error;
+        avalon_read(OUT_ADDR + 0, value);
+        assert unsigned(value) = outputs(0)
+            report "Filtered channel changed with the filters stopped"
+            severity error;
+
+        report "ADC filter tests complete";
+        finish;
+    end process;
+
+end architecture;
@@ -0,0 +1,300 @@
+-- EELE 467
+-- Gamma correction test bench for the HPS_Multi_PWM component, at the board's
+-- 50 MHz system clock
+
+use std.env.all;
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+
+-- HPS_Multi_PWM gamma correction test bench
+entity HPS_Multi_PWM_Gamma_TB is
+end entity;
+
+architecture HPS_Multi_PWM_Gamma_TB_Arch of HPS_Multi_PWM_Gamma_TB is
+    constant CLK_PER      : time := 20 ns;
+    constant SYS_CLKs_sec : positive := 50000000;
+    constant NUM_CHANNELS : positive := 3;
+    -- A period of 1/16 ms (0x08 in UQ10.7) is 3125 clocks long
+    constant PERIOD       : natural := 16#08#;
+    constant PERIOD_CLKS  : positive := 3125;
+    -- Clocks from a duty cycle write to its corrected value reaching the drivers
+    constant LATENCY      : positive := NUM_CHANNELS + 2;
+    -- Several times the longest the tests should take
+    constant TIMEOUT      : time := 10 ms;
+    constant DUTY_ONE     : natural := 16#1000#;
+
+    -- Register word addresses
+    constant PERIOD_ADDR      : natural := 16#000#;
+    constant CTRL_ADDR        : natural := 16#100#;
+    constant CAPS_ADDR        : natural := 16#101#;
+    constant GAMMA_CTRL_ADDR  : natural := 16#10C#;
+    constant GAMMA_INDEX_ADDR : natural := 16#10D#;
+    constant GAMMA_DATA_ADDR  : natural := 16#10E#;
+
+    signal clk, reset : std_logic;
+    signal read, write : std_logic;
+    signal address     : std_logic_vector(9 downto 0);
+    signal readdata    : std_logic_vector(31 downto 0);
+    signal writedata   : std_logic_vector(31 downto 0);
+    signal irq         : std_logic;
+    signal outputs     : std_logic_vector(0 to NUM_CHANNELS-1);
+
+    -- The sequencer's ring fetcher and the ADC passthrough stay idle, so their
+    -- host interfaces only need tying off
+    signal m_address  : std_logic_vector(31 downto 0);
+    signal m_read     : std_logic;
+    signal a_address  : std_logic_vector(4 downto 0);
+    signal a_read     : std_logic;
+
+    -- Table entry n: a gamma of 2, with full scale at 4096
+    function gamma_entry (n : natural) return natural is
+    begin
+        return n * n / DUTY_ONE;
+    end function;
+
+    -- Duty cycle the drivers should use for d, with the table enabled
+    function corrected (d : natural) return natural is
+    begin
+        if d = DUTY_ONE then
+            return DUTY_ONE;
+        else
+            return gamma_entry(d);
+        end if;
+    end function;
+
+    -- Clocks a duty cycle holds its output high, as counted by measure below
+    function pulse_clks (d : natural) return natural is
+    begin
+        return minimum(PERIOD_CLKS * d / DUTY_ONE, PERIOD_CLKS - 1);
+    end function;
+begin
+
+    -- HPS_Multi_PWM DUT instance
+    dut : entity work.HPS_Multi_PWM
+        generic map (
+            ADDR_WIDTH   => 10,
+            NUM_CHANNELS => NUM_CHANNELS,
+            FIFO_DEPTH   => 8,
+            SYS_CLKs_sec => SYS_CLKs_sec
+        )
+        port map (
+            clk              => clk,
+            reset            => reset,
+            avs_s1_read      => read,
+            avs_s1_write     => write,
+            avs_s1_address   => address,
+            avs_s1_readdata  => readdata,
+            avs_s1_writedata => writedata,
+            avm_m1_address       => m_address,
+            avm_m1_read          => m_read,
+            avm_m1_readdata      => (others => '0'),
+            avm_m1_waitrequest   => '1',
+            avm_m1_readdatavalid => '0',
+            avm_adc_address       => a_address,
+            avm_adc_read          => a_read,
+            avm_adc_readdata      => (others => '0'),
+            avm_adc_waitrequest   => '1',
+            avm_adc_readdatavalid => '0',
+            irq              => irq,
+            out_channels     => outputs
+        );
+
+    -- Clock driver
+    clock : process is
+    begin
+        clk <= '1';
+        while true loop
+            wait for CLK_PER / 2;
+            clk <= not clk;
+        end loop;
+    end process;
+
+    -- Fail, rather than hang, if the outputs stop
+    watchdog : process is
+    begin
+        wait for TIMEOUT;
+        report "Test bench timed out" severity failure;
+        wait;
+    end process;
+
+    -- Test driver
+    tester : process is
+        variable value  : std_logic_vector(31 downto 0);
+        variable widths : integer_vector(0 to NUM_CHANNELS-1);
+
+        -- Single-clock Avalon transfers, started on a falling clock edge
+        procedure avalon_write (addr : natural; data : natural) is
+        begin
+            address <= std_logic_vector(to_unsigned(addr, address'length));
+            writedata <= std_logic_vector(to_unsigned(data, writedata'length));
+            write <= '1';
+            wait until falling_edge(clk);
+            write <= '0';
+        end procedure;
+        procedure avalon_read (addr : natural; data : out std_logic_vector(31 downto 0)) is
+        begin
+            address <= std_logic_vector(to_unsigned(addr, address'length));
+            read <= '1';
+            wait until falling_edge(clk);
+            read <= '0';
+            data := readdata;
+        end procedure;
+
+        -- Wait for the start of a period, then for the falling clock edge
+        -- after it; a write started there lands one clock into the period
+        procedure sync_period is
+        begin
+            wait until rising_edge(outputs(0));
+            wait until falling_edge(clk);
+        end procedure;
+
+        -- Count each channel's high clocks over the next whole period
+        procedure measure is
+        begin
+            wait until rising_edge(outputs(0));
+            widths := (others => 0);
+            for i in 1 to PERIOD_CLKS - 1 loop
+                wait until falling_edge(clk);
+                for c in 0 to NUM_CHANNELS-1 loop
+                    if outputs(c) = '1' then
+                        widths(c) := widths(c) + 1;
+                    end if;
+                end loop;
+            end loop;
+        end procedure;
+
+        -- Check the last period measured against expected duty cycles
+        procedure check_widths (d0 : natural; d1 : natural; d2 : natural; what : string) is
+            constant duties : integer_vector(0 to NUM_CHANNELS-1) := (d0, d1, d2);
+        begin
+            for c in 0 to NUM_CHANNELS-1 loop
+                assert widths(c) = pulse_clks(duties(c))
+                    report what & ": channel " & integer'image(c) & " was " & integer'image(widths(c))
+                         & " clocks wide, expected " & integer'image(pulse_clks(duties(c)))
+                    severity error;
+            end loop;
+        end procedure;
+
+        -- Write all three duty cycles, the last landing on the given clock of
+        -- the current period (counting from the clock that starts it)
+        procedure write_duties (d0 : natural; d1 : natural; d2 : natural; last_clk : positive) is
+        begin
+            for i in 1 to last_clk - NUM_CHANNELS loop
+                wait until falling_edge(clk);
+            end loop;
+            avalon_write(1, d0);
+            avalon_write(2, d1);
+            avalon_write(3, d2);
+        end procedure;
+    begin
+        wait until falling_edge(clk);
+
+        -- Initialization: reset system
+        reset <= '1';
+        read <= '0';
+        write <= '0';
+        address <= (others => '0');
+        writedata <= (others => '0');
+        for i in 1 to 5 loop
+            wait until falling_edge(clk);
+        end loop;
+        reset <= '0';
+
+        -- The table is advertised, and starts out bypassed
+        avalon_read(CAPS_ADDR, value);
+        assert value(10) = '1'
+            report "Capability register reads " & to_hstring(value)
+            severity error;
+        avalon_read(GAMMA_CTRL_ADDR, value);
+        assert unsigned(value) = 1
+            report "Gamma control reads " & to_hstring(value) & " after reset"
+            severity error;
+
+        -- Load the whole table through the data port, which wraps back to the
+        -- first entry afterwards
+        avalon_write(GAMMA_INDEX_ADDR, 0);
+        for n in 0 to 4095 loop
+            avalon_write(GAMMA_DATA_ADDR, gamma_entry(n));
+        end loop;
+        avalon_read(GAMMA_INDEX_ADDR, value);
+        assert unsigned(value) = 0
+            report "Gamma index reads " & to_hstring(value) & " after a full load"
+            severity error;
+
+        -- Bypassed, the drivers follow the registers directly
+        avalon_write(1, 16#800#);
+        avalon_write(2, 16#400#);
+        avalon_write(3, 16#C00#);
+        avalon_write(PERIOD_ADDR, PERIOD);
+        measure;
+        measure;
+        check_widths(16#800#, 16#400#, 16#C00#, "Bypassed");
+
+        -- Enabled, the table applies from the next period; full scale passes
+        -- through unchanged
+        avalon_write(GAMMA_CTRL_ADDR, 0);
+        measure;
+        measure;
+        check_widths(corrected(16#800#), corrected(16#400#), corrected(16#C00#), "Corrected");
+        sync_period;
+        write_duties(16#FFF#, 16#001#, DUTY_ONE, 2 * NUM_CHANNELS);
+        measure;
+        check_widths(corrected(16#FFF#), corrected(16#001#), DUTY_ONE, "Corrected extremes");
+
+        -- Lookup timing: duty cycles written LATENCY clocks before a period
+        -- boundary all take effect at that boundary. Each repeat starts two
+        -- periods (6250 clocks, one more than a multiple of NUM_CHANNELS)
+        -- after the last, so the scan reaches each channel at every possible
+        -- point relative to its write, including the latest
+        for i in 0 to NUM_CHANNELS-1 loop
+            sync_period;
+            write_duties(16#A00# + 16#100# * i, 16#600# + 16#100# * i, 16#200# + 16#100# * i,
+                         PERIOD_CLKS - LATENCY);
+            measure;
+            check_widths(corrected(16#A00# + 16#100# * i), corrected(16#600# + 16#100# * i),
+                         corrected(16#200# + 16#100# * i), "Written just in time");
+        end loop;
+
+        -- Releasing a hold just before a boundary defers the whole commit to
+        -- the boundary after, rather than splitting it across lookups
+        sync_period;
+        avalon_write(CTRL_ADDR, 1);
+        avalon_write(1, 16#300#);
+        avalon_write(2, 16#900#);
+        avalon_write(3, 16#E00#);
+        for i in 1 to PERIOD_CLKS - 6 loop
+            wait until falling_edge(clk);
+        end loop;
+        avalon_write(CTRL_ADDR, 0); -- lands on the period's last clock
+        measure;
+        check_widths(corrected(16#C00#), corrected(16#800#), corrected(16#400#), "Hold released late");
+        measure;
+        check_widths(corrected(16#300#), corrected(16#900#), corrected(16#E00#), "Hold committed");
+
+        -- Bypassing again restores the raw duty cycles
+        avalon_write(GAMMA_CTRL_ADDR, 1);
+        measure;
+        measure;
+        check_widths(16#300#, 16#900#, 16#E00#, "Bypassed again");
+
+        -- Bypassed, there are no lookups to wait for, so the same late
+        -- release commits at the very next boundary
+        sync_period;
+        avalon_write(CTRL_ADDR, 1);
+        avalon_write(1, 16#500#);
+        avalon_write(2, 16#B00#);
+        avalon_write(3, 16#100#);
+        for i in 1 to PERIOD_CLKS - 6 loop
+            wait until falling_edge(clk);
+        end loop;
+        avalon_write(CTRL_ADDR, 0); -- lands on the period's last clock
+        measure;
+        check_widths(16#500#, 16#B00#, 16#100#, "Hold released late, bypassed");
+
+        report "Gamma correction tests complete";
+        finish;
+    end process;
+
+end architecture;
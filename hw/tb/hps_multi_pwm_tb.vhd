@@ -0,0 +1,456 @@
+-- EELE 467
+-- Sequencer and ADC passthrough test bench for the HPS_Multi_PWM component
+
+use std.env.all;
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+
+-- HPS_Multi_PWM sequencer and passthrough test bench
+entity HPS_Multi_PWM_TB is
+end entity;
+
+architecture HPS_Multi_PWM_TB_Arch of HPS_Multi_PWM_TB is
+    constant CLK_PER      : time := 10 us;
+    constant NUM_CHANNELS : positive := 3;
+    constant FIFO_DEPTH   : positive := 8;
+    constant NUM_FRAMES   : positive := 6; -- per test
+    constant RING_FRAMES  : positive := 4;
+    constant DIVIDER      : positive := 2;
+    constant LOW_WATER    : natural := 2;
+    -- 128 clocks per millisecond, so a 2 ms period is 256 clocks long, and a
+    -- duty cycle of n/4096 is high for n/16 clocks
+    constant SYS_CLKs_sec : positive := 128000;
+    constant PERIOD_CLKS  : positive := 256;
+    -- Several times the longest the tests should take, so a stalled sequencer
+    -- or fetcher fails the run rather than hanging it
+    constant TIMEOUT      : time := 500 ms;
+
+    -- Register word addresses
+    constant PERIOD_ADDR        : natural := 16#000#;
+    constant CAPS_ADDR          : natural := 16#101#;
+    constant SEQ_DIVIDER_ADDR   : natural := 16#102#;
+    constant SEQ_LOW_WATER_ADDR : natural := 16#103#;
+    constant SEQ_STATUS_ADDR    : natural := 16#104#;
+    constant SEQ_IRQ_EN_ADDR    : natural := 16#105#;
+    constant RING_BASE_ADDR     : natural := 16#106#;
+    constant RING_FRAMES_ADDR   : natural := 16#107#;
+    constant RING_HEAD_ADDR     : natural := 16#108#;
+    constant RING_TAIL_ADDR     : natural := 16#109#;
+    constant RING_CTRL_ADDR     : natural := 16#10A#;
+    constant CTRL_ADDR          : natural := 16#100#;
+    constant PASS_CTRL_ADDR     : natural := 16#10B#;
+    constant SEQ_FIFO_ADDR      : natural := 16#200#;
+    constant PASS_CONFIG_ADDR   : natural := 16#300#;
+
+    signal clk, reset : std_logic;
+    signal read, write : std_logic;
+    signal address     : std_logic_vector(9 downto 0);
+    signal readdata    : std_logic_vector(31 downto 0);
+    signal writedata   : std_logic_vector(31 downto 0);
+    signal irq         : std_logic;
+    signal outputs     : std_logic_vector(0 to NUM_CHANNELS-1);
+
+    -- Mock memory for the ring fetcher: a small RAM behind an Avalon agent
+    -- with wait states and varying read latency, standing in for the HPS bridge
+    constant MEM_BASE    : natural := 16#1000#;
+    constant MEM_WORDS   : positive := RING_FRAMES * NUM_CHANNELS;
+    constant MEM_LATENCY : positive := 3; -- clocks, plus up to 2 more
+    type mem_t is array (0 to MEM_WORDS-1) of std_logic_vector(31 downto 0);
+    signal memory        : mem_t := (others => (others => '0'));
+    signal m_address     : std_logic_vector(31 downto 0);
+    signal m_read        : std_logic;
+    signal m_readdata    : std_logic_vector(31 downto 0);
+    signal m_waitrequest : std_logic := '1';
+    signal m_valid       : std_logic := '0';
+
+    -- Mock ADC controller: channel n always reads 0x200n + 0x123, with a
+    -- wait state and one clock of read latency
+    signal a_address     : std_logic_vector(4 downto 0);
+    signal a_read        : std_logic;
+    signal a_readdata    : std_logic_vector(31 downto 0);
+    signal a_waitrequest : std_logic := '1';
+    signal a_valid       : std_logic := '0';
+    function adc_reading (n : natural) return natural is
+    begin
+        return n * 16#200# + 16#123#;
+    end function;
+
+    -- Passthrough configuration word for one channel
+    function pass_config (source : natural; gain : integer; offset : integer)
+            return std_logic_vector is
+    begin
+        return std_logic_vector(to_signed(gain, 14))
+             & std_logic_vector(to_signed(offset, 14))
+             & '1' & std_logic_vector(to_unsigned(source, 3));
+    end function;
+
+    -- Frame k queues duty cycle k/16 + c/64 on channel c, so its pulses are
+    -- 16k + 4c clocks wide
+    function frame_duty (k : natural; c : natural) return natural is
+    begin
+        return k * 16#100# + c * 16#40#;
+    end function;
+begin
+
+    -- HPS_Multi_PWM DUT instance
+    dut : entity work.HPS_Multi_PWM
+        generic map (
+            ADDR_WIDTH   => 10,
+            NUM_CHANNELS => NUM_CHANNELS,
+            FIFO_DEPTH   => FIFO_DEPTH,
+            SYS_CLKs_sec => SYS_CLKs_sec
+        )
+        port map (
+            clk              => clk,
+            reset            => reset,
+            avs_s1_read      => read,
+            avs_s1_write     => write,
+            avs_s1_address   => address,
+            avs_s1_readdata  => readdata,
+            avs_s1_writedata => writedata,
+            avm_m1_address       => m_address,
+            avm_m1_read          => m_read,
+            avm_m1_readdata      => m_readdata,
+            avm_m1_waitrequest   => m_waitrequest,
+            avm_m1_readdatavalid => m_valid,
+            avm_adc_address       => a_address,
+            avm_adc_read          => a_read,
+            avm_adc_readdata      => a_readdata,
+            avm_adc_waitrequest   => a_waitrequest,
+            avm_adc_readdatavalid => a_valid,
+            irq              => irq,
+            out_channels     => outputs
+        );
+
+    -- Clock driver
+    clock : process is
+    begin
+        clk <= '1';
+        while true loop
+            wait for CLK_PER / 2;
+            clk <= not clk;
+        end loop;
+    end process;
+
+    -- Mock memory: stalls every other request, then answers MEM_LATENCY to
+    -- MEM_LATENCY + 2 clocks after accepting it. It also checks the fetcher
+    -- keeps to the Avalon protocol, since the real bridge won't.
+    mock_memory : process (clk) is
+        variable stall     : std_logic := '1';
+        variable countdown : natural := 0;
+        variable word      : natural;
+        variable stalled   : boolean := false;
+        variable held      : std_logic_vector(31 downto 0);
+    begin
+        if rising_edge(clk) then
+            -- A stalled read must be held, unchanged, until it's accepted
+            assert (not stalled) or ((m_read = '1') and (m_address = held))
+                report "Ring fetcher withdrew or changed a stalled read"
+                severity error;
+            stalled := (m_read = '1') and (m_waitrequest = '1');
+            held := m_address;
+
+            m_valid <= '0';
+            if countdown /= 0 then
+                assert m_read = '0'
+                    report "Ring fetcher issued a read before the last one returned"
+                    severity error;
+                countdown := countdown - 1;
+                if countdown = 0 then
+                    m_readdata <= memory(word);
+                    m_valid <= '1';
+                end if;
+            elsif (m_read = '1') and (m_waitrequest = '0') then
+                assert (unsigned(m_address) >= MEM_BASE) and (unsigned(m_address) < MEM_BASE + 4 * MEM_WORDS)
+                       and (m_address(1 downto 0) = "00")
+                    report "Ring fetch from " & to_hstring(m_address) & " is outside the ring"
+                    severity error;
+                word := (to_integer(unsigned(m_address)) - MEM_BASE) / 4;
+                countdown := MEM_LATENCY + word mod 3;
+                stall := '1';
+            elsif m_read = '1' then
+                stall := not stall;
+            end if;
+            m_waitrequest <= stall;
+        end if;
+    end process;
+
+    -- Mock ADC controller: stalls each request for one clock, then answers on
+    -- the clock after accepting it
+    mock_adc : process (clk) is
+    begin
+        if rising_edge(clk) then
+            a_valid <= '0';
+            if (a_read = '1') and (a_waitrequest = '0') then
+                assert a_address(1 downto 0) = "00"
+                    report "Misaligned ADC read from " & to_hstring(a_address)
+                    severity error;
+                a_readdata <= std_logic_vector(to_unsigned(
+                              adc_reading(to_integer(unsigned(a_address(4 downto 2)))), 32));
+                a_valid <= '1';
+                a_waitrequest <= '1';
+            elsif a_read = '1' then
+                a_waitrequest <= '0';
+            end if;
+        end if;
+    end process;
+
+    -- Fail, rather than hang, if the tests stall
+    watchdog : process is
+    begin
+        wait for TIMEOUT;
+        report "Test bench timed out" severity failure;
+        wait;
+    end process;
+
+    -- Test driver
+    tester : process is
+        variable value      : std_logic_vector(31 downto 0);
+        variable widths     : integer_vector(0 to NUM_CHANNELS-1);
+        variable slot       : natural;
+
+        -- Single-clock Avalon transfers
+        procedure avalon_write (addr : natural; data : natural) is
+        begin
+            address <= std_logic_vector(to_unsigned(addr, address'length));
+            writedata <= std_logic_vector(to_unsigned(data, writedata'length));
+            write <= '1';
+            wait until falling_edge(clk);
+            write <= '0';
+        end procedure;
+        procedure avalon_write (addr : natural; data : std_logic_vector(31 downto 0)) is
+        begin
+            address <= std_logic_vector(to_unsigned(addr, address'length));
+            writedata <= data;
+            write <= '1';
+            wait until falling_edge(clk);
+            write <= '0';
+        end procedure;
+        procedure avalon_read (addr : natural; data : out std_logic_vector(31 downto 0)) is
+        begin
+            address <= std_logic_vector(to_unsigned(addr, address'length));
+            read <= '1';
+            wait until falling_edge(clk);
+            read <= '0';
+            data := readdata;
+        end procedure;
+
+        -- Watch the outputs until frames first to last have played, checking
+        -- that each plays for DIVIDER periods, with every channel switching
+        -- frames at the same boundary
+        procedure check_frames (first : natural; last : natural) is
+            variable frame   : natural;
+            variable current : natural := first - 1;
+            variable repeats : natural := 0;
+            variable started : boolean := false;
+        begin
+            for p in 1 to (last - first + 3) * DIVIDER loop
+                -- Every channel's pulse starts at the period boundary
+                wait until rising_edge(outputs(0));
+                widths := (others => 0);
+                for i in 1 to PERIOD_CLKS - 2 loop
+                    wait until falling_edge(clk);
+                    for c in 0 to NUM_CHANNELS-1 loop
+                        if outputs(c) = '1' then
+                            widths(c) := widths(c) + 1;
+                        end if;
+                    end loop;
+                end loop;
+                frame := widths(0) / 16;
+                for c in 0 to NUM_CHANNELS-1 loop
+                    assert widths(c) = 16 * frame + 4 * c
+                        report "Channel " & integer'image(c) & " was " & integer'image(widths(c))
+                             & " clocks wide during frame " & integer'image(frame)
+                        severity error;
+                end loop;
+                if frame = current then
+                    repeats := repeats + 1;
+                else
+                    assert frame = current + 1
+                        report "Frame " & integer'image(frame) & " followed frame " & integer'image(current)
+                        severity error;
+                    -- The frame playing beforehand may have been held indefinitely
+                    assert (not started) or (repeats = DIVIDER)
+                        report "Frame " & integer'image(current) & " played for "
+                             & integer'image(repeats) & " periods"
+                        severity error;
+                    started := true;
+                    current := frame;
+                    repeats := 1;
+                end if;
+            end loop;
+            assert current = last
+                report "Sequence stopped at frame " & integer'image(current)
+                severity error;
+        end procedure;
+
+        -- Store frame k in ring slot n of the mock memory
+        procedure store_frame (n : natural; k : natural) is
+        begin
+            for c in 0 to NUM_CHANNELS-1 loop
+                memory(n * NUM_CHANNELS + c) <= std_logic_vector(to_unsigned(frame_duty(k, c), 32));
+            end loop;
+        end procedure;
+    begin
+        wait until falling_edge(clk);
+
+        -- Initialization: reset system
+        reset <= '1';
+        read <= '0';
+        write <= '0';
+        address <= (others => '0');
+        writedata <= (others => '0');
+        for i in 1 to 5 loop
+            wait until falling_edge(clk);
+        end loop;
+        reset <= '0';
+
+        -- Capabilities: FIFO depth, gamma table, passthrough and ring fetcher
+        -- flags, and channel count
+        avalon_read(CAPS_ADDR, value);
+        assert unsigned(value) = FIFO_DEPTH * 2**16 + 2**10 + 2**9 + 2**8 + NUM_CHANNELS
+            report "Capability register reads " & to_hstring(value)
+            severity error;
+
+        -- Configure the sequencer, then queue every frame
+        avalon_write(SEQ_DIVIDER_ADDR, DIVIDER);
+        avalon_write(SEQ_LOW_WATER_ADDR, LOW_WATER);
+        avalon_write(SEQ_IRQ_EN_ADDR, 1);
+        assert irq = '1'
+            report "Empty FIFOs should be below the low-water mark"
+            severity error;
+        -- Queue under hold, as the driver does, so no sweep can split a frame
+        avalon_write(CTRL_ADDR, 2#01#);
+        for k in 1 to NUM_FRAMES loop
+            for c in 0 to NUM_CHANNELS-1 loop
+                avalon_write(SEQ_FIFO_ADDR + c, frame_duty(k, c));
+            end loop;
+        end loop;
+        avalon_write(CTRL_ADDR, 2#00#);
+        avalon_read(SEQ_STATUS_ADDR, value);
+        assert unsigned(value(15 downto 0)) = NUM_FRAMES and value(16) = '0' and value(17) = '0'
+            report "Status after queueing reads " & to_hstring(value)
+            severity error;
+        assert irq = '0'
+            report "Full FIFOs should be above the low-water mark"
+            severity error;
+
+        -- Start the PWM, and play the queued frames
+        avalon_write(PERIOD_ADDR, 16#100#); -- 2 ms
+        check_frames(1, NUM_FRAMES);
+
+        -- Feed the next frames through a ring in memory instead, wrapping
+        -- around it partway through
+        avalon_write(RING_BASE_ADDR, MEM_BASE);
+        avalon_write(RING_FRAMES_ADDR, RING_FRAMES);
+        for n in 0 to RING_FRAMES-2 loop
+            store_frame(n, NUM_FRAMES + 1 + n);
+        end loop;
+        avalon_write(RING_HEAD_ADDR, RING_FRAMES-1);
+        avalon_write(RING_CTRL_ADDR, 1);
+        -- Once the fetcher has taken those frames, reuse their slots; each
+        -- word takes under a dozen clocks to fetch
+        for i in 1 to 12 * MEM_WORDS loop
+            avalon_read(RING_TAIL_ADDR, value);
+            exit when unsigned(value) = RING_FRAMES-1;
+        end loop;
+        assert unsigned(value) = RING_FRAMES-1
+            report "Ring fetcher stalled with its tail at " & to_hstring(value)
+            severity failure;
+        slot := RING_FRAMES-1;
+        for k in NUM_FRAMES + RING_FRAMES to 2 * NUM_FRAMES loop
+            store_frame(slot, k);
+            slot := (slot + 1) mod RING_FRAMES;
+        end loop;
+        avalon_write(RING_HEAD_ADDR, slot);
+        check_frames(NUM_FRAMES + 1, 2 * NUM_FRAMES);
+        avalon_read(RING_TAIL_ADDR, value);
+        assert unsigned(value) = slot
+            report "Ring tail stopped at " & to_hstring(value)
+            severity error;
+        avalon_read(RING_CTRL_ADDR, value);
+        assert value(1) = '0'
+            report "Ring fetcher still busy after draining"
+            severity error;
+        avalon_write(RING_CTRL_ADDR, 0);
+
+        -- Drained FIFOs raise the interrupt, and keep the last frame playing
+        avalon_read(SEQ_STATUS_ADDR, value);
+        assert unsigned(value(15 downto 0)) = 0 and value(16) = '1'
+            report "Status after draining reads " & to_hstring(value)
+            severity error;
+        assert irq = '1'
+            report "Drained FIFOs should raise the interrupt"
+            severity error;
+
+        -- Overfilling a FIFO drops the excess and flags it; flushing clears both
+        avalon_write(PERIOD_ADDR, 0);
+        for i in 0 to FIFO_DEPTH loop
+            avalon_write(SEQ_FIFO_ADDR, 16#100#);
+        end loop;
+        avalon_read(SEQ_FIFO_ADDR, value);
+        assert unsigned(value) = FIFO_DEPTH
+            report "Overfilled FIFO level reads " & to_hstring(value)
+            severity error;
+        avalon_read(SEQ_STATUS_ADDR, value);
+        assert unsigned(value(15 downto 0)) = FIFO_DEPTH and value(17) = '1'
+            report "Status after overfilling reads " & to_hstring(value)
+            severity error;
+        avalon_write(CTRL_ADDR, 2#10#);
+        avalon_read(SEQ_STATUS_ADDR, value);
+        assert unsigned(value(15 downto 0)) = 0 and value(17) = '0'
+            report "Status after flushing reads " & to_hstring(value)
+            severity error;
+
+        -- ADC passthrough: a straight copy, an inversion, and a gain of 2.0
+        -- that saturates
+        avalon_write(PASS_CONFIG_ADDR + 0, pass_config(2,  16#400#, 0));
+        avalon_write(PASS_CONFIG_ADDR + 1, pass_config(5, -16#400#, 16#1000#));
+        avalon_write(PASS_CONFIG_ADDR + 2, pass_config(7,  16#800#, 0));
+        avalon_read(PASS_CONFIG_ADDR + 1, value);
+        assert value = pass_config(5, -16#400#, 16#1000#)
+            report "Passthrough configuration reads " & to_hstring(value)
+            severity error;
+        avalon_write(PASS_CTRL_ADDR, 1);
+        -- Every ADC channel is read within a few clocks each
+        for i in 1 to 8 * 8 loop
+            wait until falling_edge(clk);
+        end loop;
+        avalon_read(1, value);
+        assert unsigned(value) = adc_reading(2)
+            report "Copied duty cycle reads " & to_hstring(value)
+            severity error;
+        avalon_read(2, value);
+        assert unsigned(value) = 16#1000# - adc_reading(5)
+            report "Inverted duty cycle reads " & to_hstring(value)
+            severity error;
+        avalon_read(3, value);
+        assert unsigned(value) = 16#1000#
+            report "Saturated duty cycle reads " & to_hstring(value)
+            severity error;
+        -- Passthrough overrides register writes while enabled, but not after
+        avalon_write(1, 16#800#);
+        for i in 1 to NUM_CHANNELS + 2 loop
+            wait until falling_edge(clk);
+        end loop;
+        avalon_read(1, value);
+        assert unsigned(value) = adc_reading(2)
+            report "Passthrough did not override a register write"
+            severity error;
+        avalon_write(PASS_CTRL_ADDR, 0);
+        -- Let the pipeline drain
+        wait until falling_edge(clk);
+        wait until falling_edge(clk);
+        avalon_write(1, 16#800#);
+        avalon_read(1, value);
+        assert unsigned(value) = 16#800#
+            report "Register write ignored after disabling passthrough"
+            severity error;
+
+        report "Sequencer and passthrough tests complete";
+        finish;
+    end process;
+
+end architecture;
@@ -18,7 +18,9 @@ architecture PWM_TB_Arch of PWM_TB is
     signal clk, reset : std_logic;
     signal period     : unsigned(16 downto 0);
     signal duty_cycle : unsigned(13 downto 0);
+    signal hold       : std_logic;
     signal output     : std_logic;
+    signal boundary   : std_logic;
 begin
 
     -- PWM DUT instance
@@ -31,7 +33,9 @@ begin
             reset      => reset,      -- system reset, active high
             period     => period,     -- PWM period in milliseconds, UQ10.7
             duty_cycle => duty_cycle, -- PWM duty cycle, UQ2.12, range [0 1] (out-of-range values saturate)
-            pwm_out    => output      -- PWM output signal
+            hold       => hold,       -- defer control value updates while high
+            pwm_out    => output,     -- PWM output signal
+            boundary   => boundary    -- high for the last clock of each period
         );
 
     -- Clock driver
@@ -46,6 +50,41 @@ begin
 
     -- Test driver
     tester : process is
+        variable width, length : natural;
+
+        -- Wait for the last clock of a period
+        procedure sync_boundary is
+        begin
+            wait until falling_edge(clk) and boundary = '1';
+        end procedure;
+
+        -- From the last clock of a period, count the clocks in the next one,
+        -- and how many of them the output is high for
+        procedure measure (width : out natural; length : out natural) is
+            variable high, clocks : natural := 0;
+        begin
+            loop
+                wait until falling_edge(clk);
+                clocks := clocks + 1;
+                if output = '1' then
+                    high := high + 1;
+                end if;
+                exit when boundary = '1';
+            end loop;
+            width := high;
+            length := clocks;
+        end procedure;
+
+        -- Measure the next period, and check it against the expected clocks
+        procedure check_period (expected_width : natural; expected_length : natural; what : string) is
+        begin
+            measure(width, length);
+            assert (width = expected_width) and (length = expected_length)
+                report what & ": period was " & integer'image(length) & " clocks, high for "
+                     & integer'image(width) & ", expected " & integer'image(expected_length)
+                     & " and " & integer'image(expected_width)
+                severity error;
+        end procedure;
     begin
         wait until falling_edge(clk);
 
@@ -53,6 +92,7 @@ begin
         reset <= '1';
         period <= b"00000000010000000"; -- 1
         duty_cycle <= b"01000000000000"; -- 1
+        hold <= '0';
         for i in 1 to 5 loop
             wait until falling_edge(clk);
         end loop;
@@ -80,6 +120,34 @@ begin
             wait until falling_edge(clk);
         end loop;
 
+        -- Fancy test: held update (output stays at 90% until released, then
+        -- changes at the next boundary)
+        sync_boundary;
+        check_period(90, 100, "Before hold");
+        hold <= '1';
+        duty_cycle <= b"00000110011010";
+        check_period(90, 100, "Held across a boundary");
+        check_period(90, 100, "Held across another boundary");
+        -- Released at a boundary, the new value loads there
+        hold <= '0';
+        check_period(10, 100, "Released at a boundary");
+
+        -- Fancy test: hold released mid-period takes effect at the boundary
+        hold <= '1';
+        duty_cycle <= b"00100000000000";
+        period <= b"00000000100000000";
+        for i in 1 to 30 loop
+            wait until falling_edge(clk);
+        end loop;
+        hold <= '0';
+        check_period(0, 70, "Released mid-period"); -- past the old 10% pulse
+        check_period(100, 200, "After mid-period release");
+
+        -- Fancy test: period and duty cycle change together when unheld
+        duty_cycle <= b"00111001100111";
+        period <= b"00000000010000000";
+        check_period(90, 100, "Unheld update");
+
         -- Fancy test: duty cycle is zero
         duty_cycle <= b"00000000000000";
         for i in 1 to 100 loop
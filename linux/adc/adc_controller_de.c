@@ -12,11 +12,38 @@
 #include <linux/fs.h>
 #include <linux/kernel.h>
 #include <linux/uaccess.h>
+#include <linux/mm.h>
+#include <linux/moduleparam.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
 
 //-----------------------------------------------------------------------
 // DEFINE STATEMENTS
 //-----------------------------------------------------------------------
 #include "reg_offsets.h"
+#include "adc_controller_stream.h"
+#include "adc_controller_ioctl.h"
+
+static_assert(ADC_CONTROLLER_STREAM_CHANNELS == NUM_CHANNELS);
+
+// Back the registers with plain memory instead of hardware, for testing
+static bool simulate;
+module_param(simulate, bool, 0444);
+MODULE_PARM_DESC(simulate, "Back the registers with plain memory and create a stand-in device");
+
+// Also register an IIO device, for use with libiio and friends
+static bool iio;
+module_param(iio, bool, 0444);
+MODULE_PARM_DESC(iio, "Also expose the channels through the IIO subsystem");
 
 
 //-----------------------------------------------------------------------
@@ -27,8 +54,29 @@
  * @miscdev: miscdevice used to create a char device for the adc_controller
  *           component
  * @base_addr: Base address of the adc_controller component
- * @lock: mutex used to prevent concurrent writes to the adc_controller
- *        component
+ * @phys_addr: Physical address of the registers, used for mmap()
+ * @lock: mutex used to keep burst reads and writes of the adc_controller
+ *        component from interleaving; also protects @users
+ * @irq: Sample-ready interrupt, or negative if the IP doesn't provide one
+ * @poll_timer: Timer used to watch for new samples when there's no interrupt
+ * @poll_interval: Period of @poll_timer
+ * @users: Number of open files; @poll_timer only runs while this is nonzero
+ * @snapshot: Channel readings as of the last detected change
+ * @seq: Incremented each time the channel readings change
+ * @wait: Wait queue for readers waiting on @seq
+ * @stream_miscdev: miscdevice for the timestamped sample stream
+ * @stream_fifo: Ring buffer of captured frames. The stream timer is its only
+ *               producer and the (exclusive) stream reader its only consumer,
+ *               so it needs no locking.
+ * @stream_timer: Timer that captures frames into @stream_fifo
+ * @stream_interval: Period of @stream_timer
+ * @stream_busy: Bit 0 is set while the stream device is open
+ * @stream_wait: Wait queue for stream readers waiting on @stream_fifo
+ * @frames_captured: Number of frames stored in @stream_fifo
+ * @frames_dropped: Number of frames discarded because @stream_fifo was full
+ * @filter_addr: Base address of the ADC_Filter component, or NULL if there
+ *               isn't one
+ * @groups: Attribute groups for the misc device, ending with NULL
  *
  * An adc_controller struct gets created for each adc_controller component in the
  * system.
@@ -36,7 +84,35 @@
 struct adc_controller_dev {
     struct miscdevice miscdev;
     void __iomem *base_addr;
+    phys_addr_t phys_addr;
     struct mutex lock;
+    int irq;
+    struct hrtimer poll_timer;
+    ktime_t poll_interval;
+    unsigned int users;
+    u32 snapshot[NUM_CHANNELS];
+    unsigned long seq;
+    wait_queue_head_t wait;
+    struct miscdevice stream_miscdev;
+    DECLARE_KFIFO_PTR(stream_fifo, struct adc_controller_frame);
+    struct hrtimer stream_timer;
+    ktime_t stream_interval;
+    unsigned long stream_busy;
+    wait_queue_head_t stream_wait;
+    unsigned long frames_captured;
+    unsigned long frames_dropped;
+    void __iomem *filter_addr;
+    const struct attribute_group *groups[3];
+};
+/**
+ * struct adc_controller_file - Per-open state for the adc_controller char
+ *                              device.
+ * @priv: Device this file refers to
+ * @seen_seq: Value of @priv->seq as of this file's last read
+ */
+struct adc_controller_file {
+    struct adc_controller_dev *priv;
+    unsigned long seen_seq;
 };
 /**
  * struct dev_reg_kind_attribute - Struct to store attributes for registers of
@@ -63,6 +139,116 @@ struct dev_reg_tracked_attribute {
 };
 
 
+//-----------------------------------------------------------------------
+// New Sample Detection
+//-----------------------------------------------------------------------
+/**
+ * adc_controller_sample() - Check the channels for new readings.
+ * @priv: Private adc_controller device struct.
+ *
+ * Compares the current channel registers against the last snapshot, and wakes
+ * any waiting readers if they differ. Called from interrupt context, by either
+ * the sample-ready interrupt or the polling timer (never both).
+ */
+static void adc_controller_sample(struct adc_controller_dev *priv)
+{
+    bool changed = false;
+    size_t i;
+
+    for (i = 0; i < NUM_CHANNELS; i++) {
+        u32 reading = ioread32(priv->base_addr + REG_R_CH0_OFFSET + i * sizeof(u32));
+        if (reading != priv->snapshot[i]) {
+            priv->snapshot[i] = reading;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        WRITE_ONCE(priv->seq, priv->seq + 1);
+        wake_up_interruptible(&priv->wait);
+    }
+}
+
+/**
+ * adc_controller_irq() - Sample-ready interrupt handler.
+ * @irq: Unused.
+ * @dev_id: Private adc_controller device struct.
+ *
+ * Return: IRQ_HANDLED.
+ */
+static irqreturn_t adc_controller_irq(int irq, void *dev_id)
+{
+    adc_controller_sample(dev_id);
+    return IRQ_HANDLED;
+}
+
+/**
+ * adc_controller_poll_timer() - Polling timer callback.
+ * @timer: The poll_timer member of the adc_controller device struct.
+ *
+ * Intel's ADC IP has no completion interrupt, so we watch its registers from
+ * the kernel instead. This is far cheaper than having user-space re-read every
+ * channel, and lets readers sleep until something actually changes.
+ *
+ * Return: HRTIMER_RESTART, to keep polling.
+ */
+static enum hrtimer_restart adc_controller_poll_timer(struct hrtimer *timer)
+{
+    struct adc_controller_dev *priv = container_of(timer,
+            struct adc_controller_dev, poll_timer);
+
+    adc_controller_sample(priv);
+    hrtimer_forward_now(timer, READ_ONCE(priv->poll_interval));
+    return HRTIMER_RESTART;
+}
+
+
+//-----------------------------------------------------------------------
+// Sample Stream Capture
+//-----------------------------------------------------------------------
+/**
+ * adc_controller_capture() - Capture one frame into the sample stream.
+ * @priv: Private adc_controller device struct.
+ * @now: Timestamp to record for the frame.
+ *
+ * If the ring buffer is full, the frame is dropped (and counted), so that a
+ * slow reader sees a gap rather than stale data from the past.
+ */
+static void adc_controller_capture(struct adc_controller_dev *priv, ktime_t now)
+{
+    struct adc_controller_frame frame;
+    size_t i;
+
+    frame.timestamp_ns = ktime_to_ns(now);
+    for (i = 0; i < NUM_CHANNELS; i++) {
+        frame.channels[i] = ioread32(priv->base_addr + REG_R_CH0_OFFSET + i * sizeof(u32));
+    }
+
+    if (kfifo_put(&priv->stream_fifo, frame)) {
+        WRITE_ONCE(priv->frames_captured, priv->frames_captured + 1);
+        wake_up_interruptible(&priv->stream_wait);
+    } else {
+        WRITE_ONCE(priv->frames_dropped, priv->frames_dropped + 1);
+    }
+}
+
+/**
+ * adc_controller_stream_timer() - Sample stream timer callback.
+ * @timer: The stream_timer member of the adc_controller device struct.
+ *
+ * Return: HRTIMER_RESTART, to keep sampling.
+ */
+static enum hrtimer_restart adc_controller_stream_timer(struct hrtimer *timer)
+{
+    struct adc_controller_dev *priv = container_of(timer,
+            struct adc_controller_dev, stream_timer);
+
+    adc_controller_capture(priv, ktime_get());
+    hrtimer_forward_now(timer, READ_ONCE(priv->stream_interval));
+    return HRTIMER_RESTART;
+}
+
+
 //-----------------------------------------------------------------------
 // REG0 Write: Update register write function store()
 //-----------------------------------------------------------------------
@@ -189,211 +375,1172 @@ static ssize_t channel_show(struct device *dev,
 
 
 //-----------------------------------------------------------------------
-// sysfs Attributes
-//-----------------------------------------------------------------------
-#define DEVICE_ATTR_RO_KIND(_name, _kind, _reg_offset) \
-struct dev_reg_kind_attribute dev_attr_##_name = \
-    { __ATTR(_name, 0444, _kind##_show, NULL), _reg_offset }
-#define DEVICE_ATTR_TRACKED(_mode, _name, _init_state, _init_value) \
-struct dev_reg_tracked_attribute dev_attr_##_name = \
-    { __ATTR_##_mode(_name), _init_state, _init_value }
-// Define sysfs attributes
-static DEVICE_ATTR_WO(update);
-static DEVICE_ATTR_TRACKED(RW, auto_update, false, 0);
-static DEVICE_ATTR_RO_KIND(channel_0, channel, REG_R_CH0_OFFSET);
-static DEVICE_ATTR_RO_KIND(channel_1, channel, REG_R_CH1_OFFSET);
-static DEVICE_ATTR_RO_KIND(channel_2, channel, REG_R_CH2_OFFSET);
-static DEVICE_ATTR_RO_KIND(channel_3, channel, REG_R_CH3_OFFSET);
-static DEVICE_ATTR_RO_KIND(channel_4, channel, REG_R_CH4_OFFSET);
-static DEVICE_ATTR_RO_KIND(channel_5, channel, REG_R_CH5_OFFSET);
-static DEVICE_ATTR_RO_KIND(channel_6, channel, REG_R_CH6_OFFSET);
-static DEVICE_ATTR_RO_KIND(channel_7, channel, REG_R_CH7_OFFSET);
-
-// Create an attribute group so the device core can export the attributes for
-// us.
-static struct attribute *adc_controller_attrs[] = {
-    &dev_attr_update.attr,
-    &dev_attr_auto_update.attr.attr,
-    &dev_attr_channel_0.attr.attr,
-    &dev_attr_channel_1.attr.attr,
-    &dev_attr_channel_2.attr.attr,
-    &dev_attr_channel_3.attr.attr,
-    &dev_attr_channel_4.attr.attr,
-    &dev_attr_channel_5.attr.attr,
-    &dev_attr_channel_6.attr.attr,
-    &dev_attr_channel_7.attr.attr,
-    NULL,
-};
-ATTRIBUTE_GROUPS(adc_controller);
-
-
-//-----------------------------------------------------------------------
-// File Operations read()
+// Poll interval functions show() and store()
 //-----------------------------------------------------------------------
 /**
- * adc_controller_read() - Read method for the adc_controller char device
- * @file: Pointer to the char device file struct.
- * @buf: User-space buffer to read the value into.
- * @count: The number of bytes being requested.
- * @offset: The byte offset in the file being read from.
+ * poll_interval_us_show() - Return the sample polling interval to user-space.
+ * @dev: Device structure for the adc_controller component. This device struct
+ *       is embedded in the adc_controller's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
  *
- * Return: On success, the number of bytes written is returned and the offset
- *         @offset is advanced by this number. On error, a negative error value
- *         is returned.
+ * Return: The number of bytes read.
  */
-static ssize_t adc_controller_read(struct file *file, char __user *buf,
-    size_t count, loff_t *offset)
+static ssize_t poll_interval_us_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
 {
-    size_t ret;
-    u32 val;
-
-    loff_t pos = *offset;
+    struct adc_controller_dev *priv = dev_get_drvdata(dev);
 
-    /* Get the device's private data from the file struct's private_data field.
-     * The private_data field is equal to the miscdev field in the
-     * adc_controller_dev struct. container_of returns the adc_controller_dev
-     * struct that contains the miscdev in private_data.
-     */
-    struct adc_controller_dev *priv = container_of(file->private_data,
-            struct adc_controller_dev, miscdev);
+    return scnprintf(buf, PAGE_SIZE, "%lld\n", ktime_to_us(READ_ONCE(priv->poll_interval)));
+}
 
-    // Check file offset to make sure we are reading to a valid location.
-    if (pos < 0) {
-        // We can't read from a negative file position.
-        return -EINVAL;
-    }
-    if (pos >= SPAN) {
-        // We can't read from a position past the end of our device.
-        return 0;
-    }
-    if ((pos % 0x4) != 0) {
-        /* Prevent unaligned access. Even though the hardware technically
-         * supports unaligned access, we want to ensure that we only access
-         * 32-bit-aligned addresses because our registers are 32-bit-aligned.
-         */
-        pr_warn("adc_controller_read: unaligned access\n");
-        return -EFAULT;
-    }
+/**
+ * poll_interval_us_store() - Set the sample polling interval.
+ * @dev: Device structure for the adc_controller component. This device struct
+ *       is embedded in the adc_controller's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that contains the interval, in microseconds.
+ * @size: The number of bytes being written.
+ *
+ * The new interval takes effect after the timer's next expiry. It has no
+ * effect when the IP provides a sample-ready interrupt.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t poll_interval_us_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct adc_controller_dev *priv = dev_get_drvdata(dev);
 
-    // If the user didn't request any bytes, don't return any bytes :)
-    if (count == 0) {
-        return 0;
+    // Parse the string we received as a u32
+    // See https://elixir.bootlin.com/linux/latest/source/lib/kstrtox.c#L289
+    u32 interval_us;
+    int ret = kstrtou32(buf, 0, &interval_us);
+    if (ret < 0) {
+        // kstrtou32 returned an error
+        return ret;
     }
-
-    // Read the value at offset pos.
-    val = ioread32(priv->base_addr + pos);
-
-    ret = copy_to_user(buf, &val, sizeof(val));
-    if (ret == sizeof(val)) {
-        // Nothing was copied to the user.
-        pr_warn("adc_controller_read: nothing copied\n");
-        return -EFAULT;
+    if (interval_us < MIN_POLL_INTERVAL_US) {
+        // Don't let the timer monopolize the CPU
+        return -EINVAL;
     }
 
-    // Increment the file offset by the number of bytes we read.
-    *offset = pos + sizeof(val);
+    WRITE_ONCE(priv->poll_interval, us_to_ktime(interval_us));
 
-    return sizeof(val);
+    // Write was succesful, so we return the number of bytes we wrote.
+    return size;
 }
 
+
 //-----------------------------------------------------------------------
-// File Operations write()
+// Sample stream rate functions show() and store()
 //-----------------------------------------------------------------------
 /**
- * adc_controller_write() - Write method for the adc_controller char device
- * @file: Pointer to the char device file struct.
- * @buf: User-space buffer to read the value from.
- * @count: The number of bytes being written.
- * @offset: The byte offset in the file being written to.
+ * sample_rate_hz_show() - Return the sample stream rate to user-space.
+ * @dev: Device structure for the adc_controller component. This device struct
+ *       is embedded in the adc_controller's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
  *
- * Return: On success, the number of bytes written is returned and the offset
- *         @offset is advanced by this number. On error, a negative error value
- *         is returned.
+ * Return: The number of bytes read.
  */
-static ssize_t adc_controller_write(struct file *file, const char __user *buf,
-    size_t count, loff_t *offset)
+static ssize_t sample_rate_hz_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
 {
-    size_t ret;
-    u32 val;
-
-    loff_t pos = *offset;
+    struct adc_controller_dev *priv = dev_get_drvdata(dev);
 
-    /* Get the device's private data from the file struct's private_data field.
-     * The private_data field is equal to the miscdev field in the
-     * adc_controller_dev struct. container_of returns the adc_controller_dev
-     * struct that contains the miscdev in private_data.
-     */
-    struct adc_controller_dev *priv = container_of(file->private_data,
-            struct adc_controller_dev, miscdev);
+    return scnprintf(buf, PAGE_SIZE, "%llu\n",
+            div64_u64(NSEC_PER_SEC, ktime_to_ns(READ_ONCE(priv->stream_interval))));
+}
 
-    // Check file offset to make sure we are writing to a valid location.
-    if (pos < 0) {
-        // We can't write to a negative file position.
-        return -EINVAL;
-    }
-    if (pos >= SPAN) {
-        // We can't write to a position past the end of our device.
-        return 0;
-    }
-    if ((pos % 0x4) != 0) {
-        /* Prevent unaligned access. Even though the hardware technically
-         * supports unaligned access, we want to ensure that we only access
-         * 32-bit-aligned addresses because our registers are 32-bit-aligned.
-         */
-        pr_warn("adc_controller_write: unaligned access\n");
-        return -EFAULT;
-    }
+/**
+ * sample_rate_hz_store() - Set the sample stream rate.
+ * @dev: Device structure for the adc_controller component. This device struct
+ *       is embedded in the adc_controller's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that contains the rate, in Hz.
+ * @size: The number of bytes being written.
+ *
+ * The new rate takes effect after the stream timer's next expiry.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t sample_rate_hz_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct adc_controller_dev *priv = dev_get_drvdata(dev);
 
-    // If the user didn't request to write anything, return 0.
-    if (count == 0) {
-        return 0;
+    // Parse the string we received as a u32
+    // See https://elixir.bootlin.com/linux/latest/source/lib/kstrtox.c#L289
+    u32 rate;
+    int ret = kstrtou32(buf, 0, &rate);
+    if (ret < 0) {
+        // kstrtou32 returned an error
+        return ret;
     }
-
-    mutex_lock(&priv->lock);
-
-    ret = copy_from_user(&val, buf, sizeof(val));
-    if (ret == sizeof(val)) {
-        // Nothing was copied from the user.
-        pr_warn("adc_controller_write: nothing copied from user space\n");
-        ret = -EFAULT;
-        goto unlock;
+    if (rate == 0 || rate > MAX_SAMPLE_RATE_HZ) {
+        return -EINVAL;
     }
 
-    // Write the value we were given at the address offset given by pos.
-    iowrite32(val, priv->base_addr + pos);
-
-    // Increment the file offset by the number of bytes we wrote.
-    *offset = pos + sizeof(val);
-
-    // Return the number of bytes we wrote.
-    ret = sizeof(val);
+    WRITE_ONCE(priv->stream_interval, ns_to_ktime(NSEC_PER_SEC / rate));
 
-unlock:
-    mutex_unlock(&priv->lock);
-    return ret;
+    // Write was succesful, so we return the number of bytes we wrote.
+    return size;
 }
 
-
 //-----------------------------------------------------------------------
-// File Operations Supported
+// Sample stream counter functions show()
 //-----------------------------------------------------------------------
 /**
- * adc_controller_fops - File operations supported by the adc_controller driver
- * @owner: The adc_controller driver owns the file operations; this ensures that
- *         the driver can't be removed while the character device is still in
- *         use.
- * @read: The read function.
- * @write: The write function.
- * @llseek: We use the kernel's default_llseek() function; this allows users to
- *          change what position they are writing/reading to/from.
+ * frames_captured_show() - Return the number of frames captured to user-space.
+ * @dev: Device structure for the adc_controller component. This device struct
+ *       is embedded in the adc_controller's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
  */
-static const struct file_operations adc_controller_fops = {
-    .owner = THIS_MODULE,
-    .read = adc_controller_read,
-    .write = adc_controller_write,
-    .llseek = default_llseek,
+static ssize_t frames_captured_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct adc_controller_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%lu\n", READ_ONCE(priv->frames_captured));
+}
+
+/**
+ * frames_dropped_show() - Return the number of frames dropped to user-space.
+ * @dev: Device structure for the adc_controller component. This device struct
+ *       is embedded in the adc_controller's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t frames_dropped_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct adc_controller_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%lu\n", READ_ONCE(priv->frames_dropped));
+}
+
+
+//-----------------------------------------------------------------------
+// Fabric filter configuration
+//-----------------------------------------------------------------------
+/**
+ * adc_controller_filter_encode() - Pack filter settings into a config register.
+ * @filter: Settings to pack; @filter->channel is ignored.
+ * @config: Where to store the register value.
+ *
+ * Return: Zero on success, or -EINVAL if the settings are out of range.
+ */
+static int adc_controller_filter_encode(const struct adc_controller_filter *filter,
+    u32 *config)
+{
+    switch (filter->mode) {
+    case ADC_CONTROLLER_FILTER_BYPASS:
+        *config = ADC_CONTROLLER_FILTER_BYPASS;
+        return 0;
+    case ADC_CONTROLLER_FILTER_IIR:
+        if (filter->alpha == 0 || filter->alpha > ADC_CONTROLLER_FILTER_MAX_ALPHA) {
+            // A zero weight would freeze the output
+            return -EINVAL;
+        }
+        *config = ADC_CONTROLLER_FILTER_IIR | (filter->alpha << FILTER_ALPHA_SHIFT);
+        return 0;
+    case ADC_CONTROLLER_FILTER_BOXCAR:
+        if (filter->length > ADC_CONTROLLER_FILTER_MAX_LENGTH) {
+            return -EINVAL;
+        }
+        *config = ADC_CONTROLLER_FILTER_BOXCAR | (filter->length << FILTER_LENGTH_SHIFT);
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+/**
+ * adc_controller_filter_decode() - Unpack a config register into settings.
+ * @config: Register value.
+ * @filter: Where to store the settings; @filter->channel is left alone.
+ */
+static void adc_controller_filter_decode(u32 config, struct adc_controller_filter *filter)
+{
+    filter->mode = config & FILTER_MODE;
+    filter->length = filter->mode == ADC_CONTROLLER_FILTER_BOXCAR
+        ? (config & FILTER_LENGTH) >> FILTER_LENGTH_SHIFT : 0;
+    filter->alpha = filter->mode == ADC_CONTROLLER_FILTER_IIR
+        ? config >> FILTER_ALPHA_SHIFT : 0;
+}
+
+/**
+ * adc_controller_filter_parse() - Parse filter settings written to sysfs.
+ * @buf: "off", "iir <alpha>", or "boxcar <length>", optionally followed by a
+ *       newline.
+ * @filter: Where to store the settings; the values are not range checked.
+ *
+ * The number goes through kstrtou32(), like the other store handlers, so
+ * trailing junk such as "iir 3xyz" or a value that overflows is rejected.
+ *
+ * Return: Zero on success, or a negative error code if @buf doesn't parse.
+ */
+static int adc_controller_filter_parse(const char *buf, struct adc_controller_filter *filter)
+{
+    size_t len;
+
+    if (sysfs_streq(buf, "off")) {
+        filter->mode = ADC_CONTROLLER_FILTER_BYPASS;
+        return 0;
+    }
+    len = str_has_prefix(buf, "iir ");
+    if (len) {
+        filter->mode = ADC_CONTROLLER_FILTER_IIR;
+        return kstrtou32(buf + len, 0, &filter->alpha);
+    }
+    len = str_has_prefix(buf, "boxcar ");
+    if (len) {
+        filter->mode = ADC_CONTROLLER_FILTER_BOXCAR;
+        return kstrtou32(buf + len, 0, &filter->length);
+    }
+    return -EINVAL;
+}
+
+/**
+ * filter_show() - Return one channel's filter settings to user-space.
+ * @dev: Device structure for the adc_controller component. This device struct
+ *       is embedded in the adc_controller's platform device struct.
+ * @attr: Device attribute structure for the channel's config register.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * The settings read as "off", "iir <alpha>", or "boxcar <length>", in the
+ * format filter_store() takes.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t filter_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct adc_controller_dev *priv = dev_get_drvdata(dev);
+    struct dev_reg_kind_attribute *filter_reg_attr
+        = container_of(attr, struct dev_reg_kind_attribute, attr);
+    struct adc_controller_filter filter;
+
+    adc_controller_filter_decode(ioread32(priv->filter_addr + filter_reg_attr->reg_offset),
+            &filter);
+
+    switch (filter.mode) {
+    case ADC_CONTROLLER_FILTER_IIR:
+        return scnprintf(buf, PAGE_SIZE, "iir %u\n", filter.alpha);
+    case ADC_CONTROLLER_FILTER_BOXCAR:
+        return scnprintf(buf, PAGE_SIZE, "boxcar %u\n", filter.length);
+    default:
+        return scnprintf(buf, PAGE_SIZE, "off\n");
+    }
+}
+
+/**
+ * filter_store() - Change one channel's filter settings.
+ * @dev: Device structure for the adc_controller component. This device struct
+ *       is embedded in the adc_controller's platform device struct.
+ * @attr: Device attribute structure for the channel's config register.
+ * @buf: Buffer that contains "off", "iir <alpha>" with alpha from 1 to 65535
+ *       (in 1/65536), or "boxcar <length>" averaging 2^length readings.
+ * @size: The number of bytes being written.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t filter_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct adc_controller_dev *priv = dev_get_drvdata(dev);
+    struct dev_reg_kind_attribute *filter_reg_attr
+        = container_of(attr, struct dev_reg_kind_attribute, attr);
+    struct adc_controller_filter filter = { 0 };
+    u32 config;
+    int ret;
+
+    ret = adc_controller_filter_parse(buf, &filter);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = adc_controller_filter_encode(&filter, &config);
+    if (ret < 0) {
+        return ret;
+    }
+
+    iowrite32(config, priv->filter_addr + filter_reg_attr->reg_offset);
+
+    return size;
+}
+
+/**
+ * filtered_show() - Return a channel's filtered reading to user-space.
+ * @dev: Device structure for the adc_controller component. This device struct
+ *       is embedded in the adc_controller's platform device struct.
+ * @attr: Device attribute structure for the channel's output register.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t filtered_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct adc_controller_dev *priv = dev_get_drvdata(dev);
+    struct dev_reg_kind_attribute *filtered_reg_attr
+        = container_of(attr, struct dev_reg_kind_attribute, attr);
+
+    u32 reading = ioread32(priv->filter_addr + filtered_reg_attr->reg_offset);
+
+    return scnprintf(buf, PAGE_SIZE, "0x%X\n", reading);
+}
+
+/**
+ * filter_rate_hz_show() - Return how often the filters take readings.
+ * @dev: Device structure for the adc_controller component. This device struct
+ *       is embedded in the adc_controller's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t filter_rate_hz_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct adc_controller_dev *priv = dev_get_drvdata(dev);
+
+    u32 divider = ioread32(priv->filter_addr + REG_FILTER_DIVIDER_OFFSET);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", divider ? FILTER_CLOCK_HZ / divider : 0);
+}
+
+/**
+ * filter_rate_hz_store() - Set how often the filters take readings.
+ * @dev: Device structure for the adc_controller component. This device struct
+ *       is embedded in the adc_controller's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that contains the rate, in Hz; zero stops the filters.
+ * @size: The number of bytes being written.
+ *
+ * Filtered channels are read once per filter step, so this is also their
+ * sample rate, and sets the time constant of the IIR filters. Unfiltered
+ * channels are read continuously, whatever the rate.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t filter_rate_hz_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct adc_controller_dev *priv = dev_get_drvdata(dev);
+
+    u32 rate;
+    int ret = kstrtou32(buf, 0, &rate);
+    if (ret < 0) {
+        return ret;
+    }
+    if (rate > MAX_FILTER_RATE_HZ) {
+        return -EINVAL;
+    }
+
+    iowrite32(rate ? FILTER_CLOCK_HZ / rate : 0,
+            priv->filter_addr + REG_FILTER_DIVIDER_OFFSET);
+
+    return size;
+}
+
+
+//-----------------------------------------------------------------------
+// mmap() register offset function show()
+//-----------------------------------------------------------------------
+/**
+ * mmap_offset_show() - Return the registers' offset within their mmap() page.
+ * @dev: Device structure for the adc_controller component. This device struct
+ *       is embedded in the adc_controller's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Our register span is smaller than a page, and need not start on a page
+ * boundary. User-space maps the whole page, then uses this offset to find the
+ * registers within it.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t mmap_offset_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct adc_controller_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "0x%lX\n", offset_in_page(priv->phys_addr));
+}
+
+
+//-----------------------------------------------------------------------
+// sysfs Attributes
+//-----------------------------------------------------------------------
+#define DEVICE_ATTR_RO_KIND(_name, _kind, _reg_offset) \
+struct dev_reg_kind_attribute dev_attr_##_name = \
+    { __ATTR(_name, 0444, _kind##_show, NULL), _reg_offset }
+#define DEVICE_ATTR_RW_KIND(_name, _kind, _reg_offset) \
+struct dev_reg_kind_attribute dev_attr_##_name = \
+    { __ATTR(_name, 0644, _kind##_show, _kind##_store), _reg_offset }
+#define DEVICE_ATTR_TRACKED(_mode, _name, _init_state, _init_value) \
+struct dev_reg_tracked_attribute dev_attr_##_name = \
+    { __ATTR_##_mode(_name), _init_state, _init_value }
+// Define sysfs attributes
+static DEVICE_ATTR_WO(update);
+static DEVICE_ATTR_RO(mmap_offset);
+static DEVICE_ATTR_RW(poll_interval_us);
+static DEVICE_ATTR_RW(sample_rate_hz);
+static DEVICE_ATTR_RO(frames_captured);
+static DEVICE_ATTR_RO(frames_dropped);
+static DEVICE_ATTR_TRACKED(RW, auto_update, false, 0);
+static DEVICE_ATTR_RO_KIND(channel_0, channel, REG_R_CH0_OFFSET);
+static DEVICE_ATTR_RO_KIND(channel_1, channel, REG_R_CH1_OFFSET);
+static DEVICE_ATTR_RO_KIND(channel_2, channel, REG_R_CH2_OFFSET);
+static DEVICE_ATTR_RO_KIND(channel_3, channel, REG_R_CH3_OFFSET);
+static DEVICE_ATTR_RO_KIND(channel_4, channel, REG_R_CH4_OFFSET);
+static DEVICE_ATTR_RO_KIND(channel_5, channel, REG_R_CH5_OFFSET);
+static DEVICE_ATTR_RO_KIND(channel_6, channel, REG_R_CH6_OFFSET);
+static DEVICE_ATTR_RO_KIND(channel_7, channel, REG_R_CH7_OFFSET);
+
+// Create an attribute group so the device core can export the attributes for
+// us.
+static struct attribute *adc_controller_attrs[] = {
+    &dev_attr_mmap_offset.attr,
+    &dev_attr_poll_interval_us.attr,
+    &dev_attr_sample_rate_hz.attr,
+    &dev_attr_frames_captured.attr,
+    &dev_attr_frames_dropped.attr,
+    &dev_attr_update.attr,
+    &dev_attr_auto_update.attr.attr,
+    &dev_attr_channel_0.attr.attr,
+    &dev_attr_channel_1.attr.attr,
+    &dev_attr_channel_2.attr.attr,
+    &dev_attr_channel_3.attr.attr,
+    &dev_attr_channel_4.attr.attr,
+    &dev_attr_channel_5.attr.attr,
+    &dev_attr_channel_6.attr.attr,
+    &dev_attr_channel_7.attr.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(adc_controller);
+
+// Fabric filter attributes, only exported if there's an ADC_Filter component
+static DEVICE_ATTR_RW(filter_rate_hz);
+static DEVICE_ATTR_RW_KIND(filter_0, filter, REG_FILTER_CONFIG_OFFSET(0));
+static DEVICE_ATTR_RW_KIND(filter_1, filter, REG_FILTER_CONFIG_OFFSET(1));
+static DEVICE_ATTR_RW_KIND(filter_2, filter, REG_FILTER_CONFIG_OFFSET(2));
+static DEVICE_ATTR_RW_KIND(filter_3, filter, REG_FILTER_CONFIG_OFFSET(3));
+static DEVICE_ATTR_RW_KIND(filter_4, filter, REG_FILTER_CONFIG_OFFSET(4));
+static DEVICE_ATTR_RW_KIND(filter_5, filter, REG_FILTER_CONFIG_OFFSET(5));
+static DEVICE_ATTR_RW_KIND(filter_6, filter, REG_FILTER_CONFIG_OFFSET(6));
+static DEVICE_ATTR_RW_KIND(filter_7, filter, REG_FILTER_CONFIG_OFFSET(7));
+static DEVICE_ATTR_RO_KIND(filtered_0, filtered, REG_FILTER_OUT_OFFSET(0));
+static DEVICE_ATTR_RO_KIND(filtered_1, filtered, REG_FILTER_OUT_OFFSET(1));
+static DEVICE_ATTR_RO_KIND(filtered_2, filtered, REG_FILTER_OUT_OFFSET(2));
+static DEVICE_ATTR_RO_KIND(filtered_3, filtered, REG_FILTER_OUT_OFFSET(3));
+static DEVICE_ATTR_RO_KIND(filtered_4, filtered, REG_FILTER_OUT_OFFSET(4));
+static DEVICE_ATTR_RO_KIND(filtered_5, filtered, REG_FILTER_OUT_OFFSET(5));
+static DEVICE_ATTR_RO_KIND(filtered_6, filtered, REG_FILTER_OUT_OFFSET(6));
+static DEVICE_ATTR_RO_KIND(filtered_7, filtered, REG_FILTER_OUT_OFFSET(7));
+
+static struct attribute *adc_controller_filter_attrs[] = {
+    &dev_attr_filter_rate_hz.attr,
+    &dev_attr_filter_0.attr.attr,
+    &dev_attr_filter_1.attr.attr,
+    &dev_attr_filter_2.attr.attr,
+    &dev_attr_filter_3.attr.attr,
+    &dev_attr_filter_4.attr.attr,
+    &dev_attr_filter_5.attr.attr,
+    &dev_attr_filter_6.attr.attr,
+    &dev_attr_filter_7.attr.attr,
+    &dev_attr_filtered_0.attr.attr,
+    &dev_attr_filtered_1.attr.attr,
+    &dev_attr_filtered_2.attr.attr,
+    &dev_attr_filtered_3.attr.attr,
+    &dev_attr_filtered_4.attr.attr,
+    &dev_attr_filtered_5.attr.attr,
+    &dev_attr_filtered_6.attr.attr,
+    &dev_attr_filtered_7.attr.attr,
+    NULL,
+};
+static const struct attribute_group adc_controller_filter_group = {
+    .attrs = adc_controller_filter_attrs,
+};
+
+
+//-----------------------------------------------------------------------
+// File Operations read()
+//-----------------------------------------------------------------------
+/**
+ * adc_controller_read() - Read method for the adc_controller char device
+ * @file: Pointer to the char device file struct.
+ * @buf: User-space buffer to read the value into.
+ * @count: The number of bytes being requested.
+ * @offset: The byte offset in the file being read from.
+ *
+ * Return: On success, the number of bytes written is returned and the offset
+ *         @offset is advanced by this number. On error, a negative error value
+ *         is returned.
+ */
+static ssize_t adc_controller_read(struct file *file, char __user *buf,
+    size_t count, loff_t *offset)
+{
+    size_t ret;
+    size_t len, i;
+    u32 vals[SPAN / sizeof(u32)];
+
+    loff_t pos = *offset;
+
+    /* Get the device's private data from our per-open state, which
+     * adc_controller_open() stored in the file struct's private_data field.
+     */
+    struct adc_controller_file *f = file->private_data;
+    struct adc_controller_dev *priv = f->priv;
+
+    // Check file offset to make sure we are reading to a valid location.
+    if (pos < 0) {
+        // We can't read from a negative file position.
+        return -EINVAL;
+    }
+    if (pos >= SPAN) {
+        // We can't read from a position past the end of our device.
+        return 0;
+    }
+    if ((pos % 0x4) != 0) {
+        /* Prevent unaligned access. Even though the hardware technically
+         * supports unaligned access, we want to ensure that we only access
+         * 32-bit-aligned addresses because our registers are 32-bit-aligned.
+         */
+        pr_warn("adc_controller_read: unaligned access\n");
+        return -EFAULT;
+    }
+
+    // If the user didn't request any bytes, don't return any bytes :)
+    if (count == 0) {
+        return 0;
+    }
+
+    /* Transfer as many whole registers as the user asked for, stopping at the
+     * end of our span. This lets a single read() return a burst of
+     * consecutive registers instead of just one.
+     */
+    len = min_t(size_t, count, SPAN - pos) & ~(sizeof(u32) - 1);
+    if (len == 0) {
+        // The user's buffer can't hold even one register.
+        return -EINVAL;
+    }
+
+    /* A blocking read from the start of the device waits until the channels
+     * have changed since this file's last read. Non-blocking reads always
+     * return the current register values, as before.
+     */
+    if (pos == 0 && !(file->f_flags & O_NONBLOCK)) {
+        if (wait_event_interruptible(priv->wait, READ_ONCE(priv->seq) != f->seen_seq)) {
+            return -ERESTARTSYS;
+        }
+    }
+    f->seen_seq = READ_ONCE(priv->seq);
+
+    // Read the burst under one lock so it forms a consistent snapshot.
+    mutex_lock(&priv->lock);
+    for (i = 0; i < len / sizeof(u32); i++) {
+        vals[i] = ioread32(priv->base_addr + pos + i * sizeof(u32));
+    }
+    mutex_unlock(&priv->lock);
+
+    ret = copy_to_user(buf, vals, len);
+    if (ret == len) {
+        // Nothing was copied to the user.
+        pr_warn("adc_controller_read: nothing copied\n");
+        return -EFAULT;
+    }
+    len -= ret;
+
+    // Increment the file offset by the number of bytes we read.
+    *offset = pos + len;
+
+    return len;
+}
+
+//-----------------------------------------------------------------------
+// File Operations write()
+//-----------------------------------------------------------------------
+/**
+ * adc_controller_write() - Write method for the adc_controller char device
+ * @file: Pointer to the char device file struct.
+ * @buf: User-space buffer to read the value from.
+ * @count: The number of bytes being written.
+ * @offset: The byte offset in the file being written to.
+ *
+ * Return: On success, the number of bytes written is returned and the offset
+ *         @offset is advanced by this number. On error, a negative error value
+ *         is returned.
+ */
+static ssize_t adc_controller_write(struct file *file, const char __user *buf,
+    size_t count, loff_t *offset)
+{
+    size_t ret;
+    size_t len, i;
+    u32 vals[SPAN / sizeof(u32)];
+
+    loff_t pos = *offset;
+
+    /* Get the device's private data from our per-open state, which
+     * adc_controller_open() stored in the file struct's private_data field.
+     */
+    struct adc_controller_file *f = file->private_data;
+    struct adc_controller_dev *priv = f->priv;
+
+    // Check file offset to make sure we are writing to a valid location.
+    if (pos < 0) {
+        // We can't write to a negative file position.
+        return -EINVAL;
+    }
+    if (pos >= SPAN) {
+        // We can't write to a position past the end of our device.
+        return 0;
+    }
+    if ((pos % 0x4) != 0) {
+        /* Prevent unaligned access. Even though the hardware technically
+         * supports unaligned access, we want to ensure that we only access
+         * 32-bit-aligned addresses because our registers are 32-bit-aligned.
+         */
+        pr_warn("adc_controller_write: unaligned access\n");
+        return -EFAULT;
+    }
+
+    // If the user didn't request to write anything, return 0.
+    if (count == 0) {
+        return 0;
+    }
+
+    // As with reads, accept a burst of whole registers up to the span's end.
+    len = min_t(size_t, count, SPAN - pos) & ~(sizeof(u32) - 1);
+    if (len == 0) {
+        // The user didn't give us even one full register.
+        return -EINVAL;
+    }
+
+    /* Fetch the whole burst before taking the lock, since copy_from_user()
+     * may fault and sleep.
+     */
+    ret = copy_from_user(vals, buf, len);
+    if (ret) {
+        // We need every byte of the burst, or we'd write garbage.
+        pr_warn("adc_controller_write: failed to copy from user space\n");
+        return -EFAULT;
+    }
+
+    // Write the values we were given, starting at the offset given by pos.
+    mutex_lock(&priv->lock);
+    for (i = 0; i < len / sizeof(u32); i++) {
+        iowrite32(vals[i], priv->base_addr + pos + i * sizeof(u32));
+    }
+    mutex_unlock(&priv->lock);
+
+    // Increment the file offset by the number of bytes we wrote.
+    *offset = pos + len;
+
+    // Return the number of bytes we wrote.
+    return len;
+}
+
+
+//-----------------------------------------------------------------------
+// File Operations open()
+//-----------------------------------------------------------------------
+/**
+ * adc_controller_open() - Open method for the adc_controller char device
+ * @inode: Unused.
+ * @file: Pointer to the char device file struct. On entry, its private_data
+ *        field points to our miscdev.
+ *
+ * Allocates per-open state, and starts watching for new samples if this is
+ * the first open file.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int adc_controller_open(struct inode *inode, struct file *file)
+{
+    struct adc_controller_dev *priv = container_of(file->private_data,
+            struct adc_controller_dev, miscdev);
+    struct adc_controller_file *f;
+
+    f = kzalloc(sizeof(*f), GFP_KERNEL);
+    if (!f) {
+        return -ENOMEM;
+    }
+    f->priv = priv;
+    // Treat the current readings as unseen, so the first read doesn't block.
+    f->seen_seq = READ_ONCE(priv->seq) - 1;
+    file->private_data = f;
+
+    mutex_lock(&priv->lock);
+    if (priv->users++ == 0 && priv->irq < 0) {
+        hrtimer_start(&priv->poll_timer, priv->poll_interval, HRTIMER_MODE_REL);
+    }
+    mutex_unlock(&priv->lock);
+
+    return 0;
+}
+
+//-----------------------------------------------------------------------
+// File Operations release()
+//-----------------------------------------------------------------------
+/**
+ * adc_controller_release() - Release method for the adc_controller char device
+ * @inode: Unused.
+ * @file: Pointer to the char device file struct.
+ *
+ * Frees per-open state, and stops watching for new samples once nobody is
+ * left to care.
+ *
+ * Return: Zero.
+ */
+static int adc_controller_release(struct inode *inode, struct file *file)
+{
+    struct adc_controller_file *f = file->private_data;
+    struct adc_controller_dev *priv = f->priv;
+
+    mutex_lock(&priv->lock);
+    if (--priv->users == 0 && priv->irq < 0) {
+        hrtimer_cancel(&priv->poll_timer);
+    }
+    mutex_unlock(&priv->lock);
+
+    kfree(f);
+    return 0;
+}
+
+//-----------------------------------------------------------------------
+// File Operations poll()
+//-----------------------------------------------------------------------
+/**
+ * adc_controller_poll() - Poll method for the adc_controller char device
+ * @file: Pointer to the char device file struct.
+ * @wait: Poll table to register our wait queue with.
+ *
+ * The device is readable once the channels have changed since this file's
+ * last read, and always writable.
+ *
+ * Return: Mask of ready events.
+ */
+static __poll_t adc_controller_poll(struct file *file, poll_table *wait)
+{
+    struct adc_controller_file *f = file->private_data;
+    struct adc_controller_dev *priv = f->priv;
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+    poll_wait(file, &priv->wait, wait);
+    if (READ_ONCE(priv->seq) != f->seen_seq) {
+        mask |= EPOLLIN | EPOLLRDNORM;
+    }
+    return mask;
+}
+
+
+//-----------------------------------------------------------------------
+// File Operations mmap()
+//-----------------------------------------------------------------------
+/**
+ * adc_controller_mmap() - Mmap method for the adc_controller char device
+ * @file: Pointer to the char device file struct.
+ * @vma: Virtual memory area being mapped.
+ *
+ * Maps the page containing our registers into user-space, so that registers
+ * can be accessed without a system call. Hardware registers are mapped
+ * uncached; the simulated register page is ordinary memory.
+ *
+ * Note that any other components sharing the registers' page are mapped as
+ * well. The char device is only accessible to root by default.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int adc_controller_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    unsigned long size = vma->vm_end - vma->vm_start;
+    struct adc_controller_file *f = file->private_data;
+    struct adc_controller_dev *priv = f->priv;
+
+    // Only the single page holding our registers can be mapped.
+    if (vma->vm_pgoff != 0 || size > PAGE_SIZE) {
+        return -EINVAL;
+    }
+
+    if (simulate) {
+        return remap_pfn_range(vma, vma->vm_start,
+                PHYS_PFN(priv->phys_addr), size, vma->vm_page_prot);
+    }
+
+    vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+    return io_remap_pfn_range(vma, vma->vm_start,
+            PHYS_PFN(priv->phys_addr), size, vma->vm_page_prot);
+}
+
+
+//-----------------------------------------------------------------------
+// File Operations ioctl()
+//-----------------------------------------------------------------------
+/**
+ * adc_controller_ioctl() - ioctl method for the adc_controller char device
+ * @file: Pointer to the char device file struct.
+ * @cmd: The ioctl command; see adc_controller_ioctl.h.
+ * @arg: User-space pointer to the command's argument.
+ *
+ * Return: Zero on success, or a negative error value. Devices without a
+ *         fabric filter return -ENOTTY for the filter commands.
+ */
+static long adc_controller_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct adc_controller_file *f = file->private_data;
+    struct adc_controller_dev *priv = f->priv;
+    struct adc_controller_filter filter;
+    void __iomem *config_addr;
+    u32 config;
+    int ret;
+
+    if (!priv->filter_addr) {
+        return -ENOTTY;
+    }
+
+    switch (cmd) {
+    case ADC_CONTROLLER_IOC_GET_FILTER:
+    case ADC_CONTROLLER_IOC_SET_FILTER:
+        if (copy_from_user(&filter, (void __user *)arg, sizeof(filter))) {
+            return -EFAULT;
+        }
+        if (filter.channel >= NUM_CHANNELS) {
+            return -EINVAL;
+        }
+        config_addr = priv->filter_addr + REG_FILTER_CONFIG_OFFSET(filter.channel);
+        break;
+    default:
+        return -ENOTTY;
+    }
+
+    if (cmd == ADC_CONTROLLER_IOC_SET_FILTER) {
+        ret = adc_controller_filter_encode(&filter, &config);
+        if (ret < 0) {
+            return ret;
+        }
+        iowrite32(config, config_addr);
+        return 0;
+    }
+
+    adc_controller_filter_decode(ioread32(config_addr), &filter);
+    if (copy_to_user((void __user *)arg, &filter, sizeof(filter))) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+
+//-----------------------------------------------------------------------
+// File Operations Supported
+//-----------------------------------------------------------------------
+/**
+ * adc_controller_fops - File operations supported by the adc_controller driver
+ * @owner: The adc_controller driver owns the file operations; this ensures that
+ *         the driver can't be removed while the character device is still in
+ *         use.
+ * @open: The open function.
+ * @release: The release function.
+ * @read: The read function.
+ * @write: The write function.
+ * @poll: The poll function.
+ * @mmap: The mmap function.
+ * @unlocked_ioctl: The ioctl function.
+ * @compat_ioctl: Our ioctl arguments are pointers to fixed-layout structs, so
+ *                32-bit callers on a 64-bit kernel need no translation.
+ * @llseek: We use the kernel's default_llseek() function; this allows users to
+ *          change what position they are writing/reading to/from.
+ */
+static const struct file_operations adc_controller_fops = {
+    .owner = THIS_MODULE,
+    .open = adc_controller_open,
+    .release = adc_controller_release,
+    .read = adc_controller_read,
+    .write = adc_controller_write,
+    .poll = adc_controller_poll,
+    .mmap = adc_controller_mmap,
+    .unlocked_ioctl = adc_controller_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .llseek = default_llseek,
+};
+
+
+//-----------------------------------------------------------------------
+// Sample Stream File Operations
+//-----------------------------------------------------------------------
+/**
+ * adc_controller_stream_open() - Open method for the sample stream device
+ * @inode: Pointer to the char device inode.
+ * @file: Pointer to the char device file struct.
+ *
+ * Only one reader may stream at a time, which keeps the ring buffer
+ * single-consumer. Opening discards any old frames and starts sampling.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int adc_controller_stream_open(struct inode *inode, struct file *file)
+{
+    struct adc_controller_dev *priv = container_of(file->private_data,
+            struct adc_controller_dev, stream_miscdev);
+
+    if (test_and_set_bit(0, &priv->stream_busy)) {
+        return -EBUSY;
+    }
+
+    kfifo_reset(&priv->stream_fifo);
+    hrtimer_start(&priv->stream_timer, priv->stream_interval, HRTIMER_MODE_REL);
+
+    return stream_open(inode, file);
+}
+
+/**
+ * adc_controller_stream_release() - Release method for the sample stream
+ *                                   device
+ * @inode: Unused.
+ * @file: Pointer to the char device file struct.
+ *
+ * Return: Zero.
+ */
+static int adc_controller_stream_release(struct inode *inode, struct file *file)
+{
+    struct adc_controller_dev *priv = container_of(file->private_data,
+            struct adc_controller_dev, stream_miscdev);
+
+    hrtimer_cancel(&priv->stream_timer);
+    clear_bit(0, &priv->stream_busy);
+
+    return 0;
+}
+
+/**
+ * adc_controller_stream_read() - Read method for the sample stream device
+ * @file: Pointer to the char device file struct.
+ * @buf: User-space buffer to read frames into.
+ * @count: The number of bytes being requested; at least one frame.
+ * @offset: Unused; the stream isn't seekable.
+ *
+ * Drains as many whole frames as fit in @buf, blocking until at least one is
+ * available unless the file is non-blocking.
+ *
+ * Return: On success, the number of bytes read. On error, a negative error
+ *         value is returned.
+ */
+static ssize_t adc_controller_stream_read(struct file *file, char __user *buf,
+    size_t count, loff_t *offset)
+{
+    struct adc_controller_dev *priv = container_of(file->private_data,
+            struct adc_controller_dev, stream_miscdev);
+    unsigned int copied;
+    int ret;
+
+    if (count < sizeof(struct adc_controller_frame)) {
+        return -EINVAL;
+    }
+
+    if (kfifo_is_empty(&priv->stream_fifo)) {
+        if (file->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(priv->stream_wait,
+                    !kfifo_is_empty(&priv->stream_fifo))) {
+            return -ERESTARTSYS;
+        }
+    }
+
+    // Only hand out whole frames.
+    count -= count % sizeof(struct adc_controller_frame);
+    ret = kfifo_to_user(&priv->stream_fifo, buf, count, &copied);
+
+    return ret ? ret : copied;
+}
+
+/**
+ * adc_controller_stream_poll() - Poll method for the sample stream device
+ * @file: Pointer to the char device file struct.
+ * @wait: Poll table to register our wait queue with.
+ *
+ * Return: EPOLLIN if any frames are buffered, otherwise zero.
+ */
+static __poll_t adc_controller_stream_poll(struct file *file, poll_table *wait)
+{
+    struct adc_controller_dev *priv = container_of(file->private_data,
+            struct adc_controller_dev, stream_miscdev);
+
+    poll_wait(file, &priv->stream_wait, wait);
+    return kfifo_is_empty(&priv->stream_fifo) ? 0 : EPOLLIN | EPOLLRDNORM;
+}
+
+/**
+ * adc_controller_stream_fops - File operations supported by the sample stream
+ *                              device
+ * @owner: The adc_controller driver owns the file operations.
+ * @open: The open function.
+ * @release: The release function.
+ * @read: The read function.
+ * @poll: The poll function.
+ * @llseek: The stream isn't seekable.
+ */
+static const struct file_operations adc_controller_stream_fops = {
+    .owner = THIS_MODULE,
+    .open = adc_controller_stream_open,
+    .release = adc_controller_stream_release,
+    .read = adc_controller_stream_read,
+    .poll = adc_controller_stream_poll,
+    .llseek = no_llseek,
+};
+
+
+//-----------------------------------------------------------------------
+// IIO Front-End
+//-----------------------------------------------------------------------
+#if IS_ENABLED(CONFIG_IIO_TRIGGERED_BUFFER)
+
+/* Each channel is a 12-bit unsigned conversion; the LTC2308 on the DE10-Nano
+ * has a 4.096 V full-scale range, so one count is one millivolt.
+ */
+#define ADC_CONTROLLER_IIO_CHANNEL(n) {                                  \
+    .type = IIO_VOLTAGE,                                                 \
+    .indexed = 1,                                                        \
+    .channel = (n),                                                      \
+    .address = REG_R_CH0_OFFSET + (n) * sizeof(u32),                     \
+    .info_mask_separate = BIT(IIO_CHAN_INFO_RAW),                        \
+    .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),                \
+    .scan_index = (n),                                                   \
+    .scan_type = {                                                       \
+        .sign = 'u',                                                     \
+        .realbits = 12,                                                  \
+        .storagebits = 16,                                               \
+        .endianness = IIO_CPU,                                           \
+    },                                                                   \
+}
+
+static const struct iio_chan_spec adc_controller_iio_channels[] = {
+    ADC_CONTROLLER_IIO_CHANNEL(0),
+    ADC_CONTROLLER_IIO_CHANNEL(1),
+    ADC_CONTROLLER_IIO_CHANNEL(2),
+    ADC_CONTROLLER_IIO_CHANNEL(3),
+    ADC_CONTROLLER_IIO_CHANNEL(4),
+    ADC_CONTROLLER_IIO_CHANNEL(5),
+    ADC_CONTROLLER_IIO_CHANNEL(6),
+    ADC_CONTROLLER_IIO_CHANNEL(7),
+    IIO_CHAN_SOFT_TIMESTAMP(NUM_CHANNELS),
+};
+static_assert(ARRAY_SIZE(adc_controller_iio_channels) == NUM_CHANNELS + 1);
+
+/**
+ * adc_controller_iio_read_raw() - Read a channel value or the channel scale.
+ * @indio_dev: The IIO device; its private data points to our device struct.
+ * @chan: The channel being read.
+ * @val: Integer part of the result.
+ * @val2: Unused.
+ * @mask: Which value to read (IIO_CHAN_INFO_*).
+ *
+ * Return: An IIO_VAL_* type on success, or a negative error value.
+ */
+static int adc_controller_iio_read_raw(struct iio_dev *indio_dev,
+    struct iio_chan_spec const *chan, int *val, int *val2, long mask)
+{
+    struct adc_controller_dev *priv = *(struct adc_controller_dev **)iio_priv(indio_dev);
+
+    switch (mask) {
+    case IIO_CHAN_INFO_RAW:
+        *val = ioread32(priv->base_addr + chan->address);
+        return IIO_VAL_INT;
+    case IIO_CHAN_INFO_SCALE:
+        *val = 1;
+        return IIO_VAL_INT;
+    default:
+        return -EINVAL;
+    }
+}
+
+static const struct iio_info adc_controller_iio_info = {
+    .read_raw = adc_controller_iio_read_raw,
 };
 
+/**
+ * adc_controller_iio_trigger_handler() - Push one scan into the IIO buffer.
+ * @irq: Unused.
+ * @p: The IIO poll function that fired.
+ *
+ * Runs in a thread for each trigger event, reading only the enabled channels.
+ *
+ * Return: IRQ_HANDLED.
+ */
+static irqreturn_t adc_controller_iio_trigger_handler(int irq, void *p)
+{
+    struct iio_poll_func *pf = p;
+    struct iio_dev *indio_dev = pf->indio_dev;
+    struct adc_controller_dev *priv = *(struct adc_controller_dev **)iio_priv(indio_dev);
+    struct {
+        u16 channels[NUM_CHANNELS];
+        s64 timestamp __aligned(8);
+    } scan = { };
+    unsigned int bit, i = 0;
+
+    for_each_set_bit(bit, indio_dev->active_scan_mask, indio_dev->masklength) {
+        scan.channels[i++] = ioread32(priv->base_addr
+                + adc_controller_iio_channels[bit].address);
+    }
+    iio_push_to_buffers_with_timestamp(indio_dev, &scan, pf->timestamp);
+
+    iio_trigger_notify_done(indio_dev->trig);
+    return IRQ_HANDLED;
+}
+
+/**
+ * adc_controller_iio_register() - Register an IIO device for the channels.
+ * @pdev: Platform device structure for the adc_controller.
+ * @priv: Private adc_controller device struct.
+ *
+ * The IIO device is device-managed, so it goes away along with @pdev.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int adc_controller_iio_register(struct platform_device *pdev,
+    struct adc_controller_dev *priv)
+{
+    struct iio_dev *indio_dev;
+    int ret;
+
+    indio_dev = devm_iio_device_alloc(&pdev->dev, sizeof(priv));
+    if (!indio_dev) {
+        return -ENOMEM;
+    }
+    *(struct adc_controller_dev **)iio_priv(indio_dev) = priv;
+
+    indio_dev->name = "adc_controller";
+    indio_dev->info = &adc_controller_iio_info;
+    indio_dev->modes = INDIO_DIRECT_MODE;
+    indio_dev->channels = adc_controller_iio_channels;
+    indio_dev->num_channels = ARRAY_SIZE(adc_controller_iio_channels);
+
+    ret = devm_iio_triggered_buffer_setup(&pdev->dev, indio_dev,
+            iio_pollfunc_store_time, adc_controller_iio_trigger_handler, NULL);
+    if (ret) {
+        return ret;
+    }
+
+    return devm_iio_device_register(&pdev->dev, indio_dev);
+}
+
+#else
+
+static int adc_controller_iio_register(struct platform_device *pdev,
+    struct adc_controller_dev *priv)
+{
+    pr_err("IIO support requires CONFIG_IIO_TRIGGERED_BUFFER\n");
+    return -EOPNOTSUPP;
+}
+
+#endif
+
 
 //-----------------------------------------------------------------------
 // Platform Driver Probe (Initialization) Function
@@ -423,16 +1570,85 @@ static int adc_controller_probe(struct platform_device *pdev)
         pr_err("Failed to allocate kernel memory for adc_controller\n");
         return -ENOMEM;
     }
+    mutex_init(&priv->lock);
 
-    /* Request and remap the device's memory region. Requesting the region
-     * makes sure nobody else can use that memory. The memory is remapped into
-     * the kernel's virtual address space becuase we don't have access to
-     * physical memory locations.
-     */
-    priv->base_addr = devm_platform_ioremap_resource(pdev, 0);
-    if (IS_ERR(priv->base_addr)) {
-        pr_err("Failed to request/remap platform device resource (adc_controller)\n");
-        return PTR_ERR(priv->base_addr);
+    // Attach the adc_controller's private data to the platform device's
+    // struct, before any of its attributes can be read.
+    platform_set_drvdata(pdev, priv);
+
+    if (simulate) {
+        /* Use a zeroed page of ordinary memory as our "registers". It's
+         * page-aligned, so mmap() can hand it out directly.
+         */
+        unsigned long page = devm_get_free_pages(&pdev->dev, GFP_KERNEL | __GFP_ZERO, 0);
+        if (!page) {
+            pr_err("Failed to allocate simulated registers for adc_controller\n");
+            return -ENOMEM;
+        }
+        priv->base_addr = (void __iomem *)page;
+        priv->phys_addr = virt_to_phys((void *)page);
+        // Simulate a filter too, where it sits in the real system
+        priv->filter_addr = priv->base_addr + SIM_FILTER_OFFSET;
+    } else {
+        struct resource *res;
+
+        /* Request and remap the device's memory region. Requesting the region
+         * makes sure nobody else can use that memory. The memory is remapped into
+         * the kernel's virtual address space becuase we don't have access to
+         * physical memory locations.
+         */
+        priv->base_addr = devm_platform_get_and_ioremap_resource(pdev, 0, &res);
+        if (IS_ERR(priv->base_addr)) {
+            pr_err("Failed to request/remap platform device resource (adc_controller)\n");
+            return PTR_ERR(priv->base_addr);
+        }
+        priv->phys_addr = res->start;
+
+        // The fabric filter, if any, is the device's second register region
+        if (platform_get_resource(pdev, IORESOURCE_MEM, 1)) {
+            priv->filter_addr = devm_platform_ioremap_resource(pdev, 1);
+            if (IS_ERR(priv->filter_addr)) {
+                pr_err("Failed to request/remap filter resource (adc_controller)\n");
+                return PTR_ERR(priv->filter_addr);
+            }
+        }
+    }
+    priv->groups[0] = &adc_controller_group;
+    priv->groups[1] = priv->filter_addr ? &adc_controller_filter_group : NULL;
+    priv->groups[2] = NULL;
+    if (priv->filter_addr) {
+        // The platform device gets the fixed attributes from the driver core
+        ret = devm_device_add_group(&pdev->dev, &adc_controller_filter_group);
+        if (ret) {
+            pr_err("Failed to create filter attributes for adc_controller\n");
+            return ret;
+        }
+    }
+
+    // Set up new-sample detection, preferring an interrupt if we have one
+    init_waitqueue_head(&priv->wait);
+    hrtimer_init(&priv->poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    priv->poll_timer.function = adc_controller_poll_timer;
+    priv->poll_interval = us_to_ktime(DEFAULT_POLL_INTERVAL_US);
+    priv->irq = simulate ? -ENXIO : platform_get_irq_optional(pdev, 0);
+    if (priv->irq >= 0) {
+        ret = devm_request_irq(&pdev->dev, priv->irq, adc_controller_irq, 0,
+                "adc_controller", priv);
+        if (ret) {
+            pr_err("Failed to request sample-ready interrupt for adc_controller\n");
+            return ret;
+        }
+    }
+
+    // Set up the sample stream; it only runs while the stream device is open
+    init_waitqueue_head(&priv->stream_wait);
+    hrtimer_init(&priv->stream_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    priv->stream_timer.function = adc_controller_stream_timer;
+    priv->stream_interval = ns_to_ktime(NSEC_PER_SEC / DEFAULT_SAMPLE_RATE_HZ);
+    ret = kfifo_alloc(&priv->stream_fifo, STREAM_FIFO_FRAMES, GFP_KERNEL);
+    if (ret) {
+        pr_err("Failed to allocate sample stream buffer for adc_controller\n");
+        return ret;
     }
 
     // Initialize the misc device parameters
@@ -440,22 +1656,46 @@ static int adc_controller_probe(struct platform_device *pdev)
     priv->miscdev.name = "adc_controller";
     priv->miscdev.fops = &adc_controller_fops;
     priv->miscdev.parent = &pdev->dev;
-    priv->miscdev.groups = adc_controller_groups;
+    priv->miscdev.groups = priv->groups;
 
     // Register the misc device; this creates a char dev at /dev/adc_controller
     ret = misc_register(&priv->miscdev);
     if (ret) {
         pr_err("Failed to register misc device for adc_controller\n");
-        return ret;
+        goto err_free_fifo;
     }
 
-    // Attach the adc_controller's private data to the platform device's
-    // struct.
-    platform_set_drvdata(pdev, priv);
+    // Register the stream device at /dev/adc_controller_stream
+    priv->stream_miscdev.minor = MISC_DYNAMIC_MINOR;
+    priv->stream_miscdev.name = "adc_controller_stream";
+    priv->stream_miscdev.fops = &adc_controller_stream_fops;
+    priv->stream_miscdev.parent = &pdev->dev;
+    ret = misc_register(&priv->stream_miscdev);
+    if (ret) {
+        pr_err("Failed to register stream misc device for adc_controller\n");
+        goto err_deregister;
+    }
+
+    // Optionally expose the channels through IIO as well
+    if (iio) {
+        ret = adc_controller_iio_register(pdev, priv);
+        if (ret) {
+            pr_err("Failed to register IIO device for adc_controller\n");
+            goto err_deregister_stream;
+        }
+    }
 
     pr_info("adc_controller probed successfully\n");
 
     return 0;
+
+err_deregister_stream:
+    misc_deregister(&priv->stream_miscdev);
+err_deregister:
+    misc_deregister(&priv->miscdev);
+err_free_fifo:
+    kfifo_free(&priv->stream_fifo);
+    return ret;
 }
 
 //-----------------------------------------------------------------------
@@ -473,9 +1713,15 @@ static int adc_controller_remove(struct platform_device *pdev)
     // Get the adc_controller's private data from the platform device.
     struct adc_controller_dev *priv = platform_get_drvdata(pdev);
 
-    // Deregister the misc device and remove the /dev/adc_controller file.
+    // Deregister the misc devices and remove their /dev files.
+    misc_deregister(&priv->stream_miscdev);
     misc_deregister(&priv->miscdev);
 
+    // Make sure the timers and stream buffer can't outlive us.
+    hrtimer_cancel(&priv->poll_timer);
+    hrtimer_cancel(&priv->stream_timer);
+    kfifo_free(&priv->stream_fifo);
+
     pr_info("adc_controller removed successfully\n");
 
     return 0;
@@ -523,12 +1769,54 @@ static struct platform_driver adc_controller_driver = {
     },
 };
 
-/* We don't need to do anything special in module init/exit. This macro
- * automatically handles module init/exit.
+//-----------------------------------------------------------------------
+// Module Init/Exit
+//-----------------------------------------------------------------------
+// Stand-in platform device, only created when simulating
+static struct platform_device *adc_controller_sim_pdev;
+
+/**
+ * adc_controller_init() - Register the platform driver
+ *
+ * In simulation mode, there's no device tree node to match against, so we
+ * also register a platform device by name to trigger a probe.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int __init adc_controller_init(void)
+{
+    int ret = platform_driver_register(&adc_controller_driver);
+    if (ret || !simulate) {
+        return ret;
+    }
+
+    adc_controller_sim_pdev = platform_device_register_simple("adc_controller",
+            PLATFORM_DEVID_NONE, NULL, 0);
+    if (IS_ERR(adc_controller_sim_pdev)) {
+        platform_driver_unregister(&adc_controller_driver);
+        return PTR_ERR(adc_controller_sim_pdev);
+    }
+    return 0;
+}
+module_init(adc_controller_init);
+
+/**
+ * adc_controller_exit() - Unregister the platform driver (and stand-in device)
  */
-module_platform_driver(adc_controller_driver);
+static void __exit adc_controller_exit(void)
+{
+    if (adc_controller_sim_pdev) {
+        platform_device_unregister(adc_controller_sim_pdev);
+    }
+    platform_driver_unregister(&adc_controller_driver);
+}
+module_exit(adc_controller_exit);
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("Lucas Ritzdorf");  // Adapted from Ross Snider and Trevor Vannoy's Echo Driver
 MODULE_DESCRIPTION("ADC Controller for DE-Series Boards driver");
 MODULE_VERSION("1.0");
+
+#ifdef ADC_CONTROLLER_KUNIT_TEST
+#include "adc_controller_test.c"
+#endif
@@ -0,0 +1,40 @@
+#ifndef ADC_CONTROLLER_IOCTL_H
+#define ADC_CONTROLLER_IOCTL_H
+
+// ioctl interface for the adc_controller char device, shared with user-space
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+// Filter modes
+#define ADC_CONTROLLER_FILTER_BYPASS 0 // Pass readings through unchanged
+#define ADC_CONTROLLER_FILTER_IIR 1 // First-order IIR: y += alpha * (x - y)
+#define ADC_CONTROLLER_FILTER_BOXCAR 2 // Mean of each 2^length readings
+
+// Limits on the filter parameters
+#define ADC_CONTROLLER_FILTER_MAX_LENGTH 15
+#define ADC_CONTROLLER_FILTER_MAX_ALPHA 0xFFFF
+
+/**
+ * struct adc_controller_filter - Fabric filter settings for one channel.
+ * @channel: ADC channel, from 0 to 7
+ * @mode: One of the ADC_CONTROLLER_FILTER_* modes
+ * @length: Box-car filters only: log2 of the number of readings averaged
+ * @alpha: IIR filters only: weight of each new reading, in 1/65536
+ *
+ * Reconfiguring a channel restarts its filter from the next reading.
+ */
+struct adc_controller_filter {
+    __u32 channel;
+    __u32 mode;
+    __u32 length;
+    __u32 alpha;
+};
+
+#define ADC_CONTROLLER_IOC_MAGIC 'A'
+// Read one channel's filter settings; @channel selects the channel
+#define ADC_CONTROLLER_IOC_GET_FILTER _IOWR(ADC_CONTROLLER_IOC_MAGIC, 1, struct adc_controller_filter)
+// Change one channel's filter settings
+#define ADC_CONTROLLER_IOC_SET_FILTER _IOW(ADC_CONTROLLER_IOC_MAGIC, 2, struct adc_controller_filter)
+
+#endif
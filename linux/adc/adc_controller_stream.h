@@ -0,0 +1,22 @@
+#ifndef ADC_CONTROLLER_STREAM_H
+#define ADC_CONTROLLER_STREAM_H
+
+// Sample stream format for /dev/adc_controller_stream, shared with user-space
+
+#include <linux/types.h>
+
+#define ADC_CONTROLLER_STREAM_CHANNELS 8
+
+/**
+ * struct adc_controller_frame - One timestamped sample of every channel.
+ * @timestamp_ns: CLOCK_MONOTONIC time at which the channels were read
+ * @channels: Channel register values, in channel order
+ *
+ * read() on the stream device returns a whole number of these.
+ */
+struct adc_controller_frame {
+    __s64 timestamp_ns;
+    __u32 channels[ADC_CONTROLLER_STREAM_CHANNELS];
+};
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * KUnit tests for the adc_controller sample stream and filter settings.
+ *
+ * This file is #included at the end of adc_controller_de.c when the module is
+ * built with `make KUNIT=1`, so it can reach the driver's static functions.
+ * The tests run against plain memory standing in for the registers, so no
+ * hardware (or simulated device) is needed. Load the module on a kernel with
+ * CONFIG_KUNIT enabled and the results appear in the kernel log.
+ */
+
+#include <kunit/test.h>
+
+/**
+ * struct adc_controller_test_ctx - Per-test state.
+ * @priv: Device struct set up just enough to capture frames
+ * @regs: Stand-in register file
+ */
+struct adc_controller_test_ctx {
+    struct adc_controller_dev priv;
+    u32 regs[SPAN / sizeof(u32)];
+};
+
+static int adc_controller_test_init(struct kunit *test)
+{
+    struct adc_controller_test_ctx *ctx;
+    size_t i;
+
+    ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ctx);
+
+    ctx->priv.base_addr = (void __iomem *)ctx->regs;
+    init_waitqueue_head(&ctx->priv.stream_wait);
+    KUNIT_ASSERT_EQ(test, kfifo_alloc(&ctx->priv.stream_fifo, STREAM_FIFO_FRAMES,
+                GFP_KERNEL), 0);
+
+    for (i = 0; i < NUM_CHANNELS; i++) {
+        ctx->regs[i] = 0x100 * i + 1;
+    }
+
+    test->priv = ctx;
+    return 0;
+}
+
+static void adc_controller_test_exit(struct kunit *test)
+{
+    struct adc_controller_test_ctx *ctx = test->priv;
+
+    kfifo_free(&ctx->priv.stream_fifo);
+}
+
+// Frames carry every channel and the timestamp they were captured with
+static void adc_controller_test_capture(struct kunit *test)
+{
+    struct adc_controller_test_ctx *ctx = test->priv;
+    struct adc_controller_frame frame;
+    size_t i;
+
+    adc_controller_capture(&ctx->priv, ns_to_ktime(1000));
+    ctx->regs[3] = 0xfff;
+    adc_controller_capture(&ctx->priv, ns_to_ktime(2000));
+
+    KUNIT_EXPECT_EQ(test, READ_ONCE(ctx->priv.frames_captured), 2UL);
+    KUNIT_EXPECT_EQ(test, READ_ONCE(ctx->priv.frames_dropped), 0UL);
+
+    KUNIT_ASSERT_TRUE(test, kfifo_get(&ctx->priv.stream_fifo, &frame));
+    KUNIT_EXPECT_EQ(test, frame.timestamp_ns, 1000LL);
+    for (i = 0; i < NUM_CHANNELS; i++) {
+        KUNIT_EXPECT_EQ(test, frame.channels[i], (u32)(0x100 * i + 1));
+    }
+
+    KUNIT_ASSERT_TRUE(test, kfifo_get(&ctx->priv.stream_fifo, &frame));
+    KUNIT_EXPECT_EQ(test, frame.timestamp_ns, 2000LL);
+    KUNIT_EXPECT_EQ(test, frame.channels[3], 0xfffU);
+
+    KUNIT_EXPECT_TRUE(test, kfifo_is_empty(&ctx->priv.stream_fifo));
+}
+
+// A full buffer drops (and counts) new frames, keeping the oldest ones
+static void adc_controller_test_overflow(struct kunit *test)
+{
+    struct adc_controller_test_ctx *ctx = test->priv;
+    struct adc_controller_frame frame;
+    size_t i;
+
+    for (i = 0; i < STREAM_FIFO_FRAMES + 10; i++) {
+        adc_controller_capture(&ctx->priv, ns_to_ktime(i));
+    }
+
+    KUNIT_EXPECT_EQ(test, READ_ONCE(ctx->priv.frames_captured),
+            (unsigned long)STREAM_FIFO_FRAMES);
+    KUNIT_EXPECT_EQ(test, READ_ONCE(ctx->priv.frames_dropped), 10UL);
+    KUNIT_ASSERT_TRUE(test, kfifo_get(&ctx->priv.stream_fifo, &frame));
+    KUNIT_EXPECT_EQ(test, frame.timestamp_ns, 0LL);
+
+    // Having drained one frame, there's room for exactly one more
+    adc_controller_capture(&ctx->priv, ns_to_ktime(i));
+    adc_controller_capture(&ctx->priv, ns_to_ktime(i + 1));
+    KUNIT_EXPECT_EQ(test, READ_ONCE(ctx->priv.frames_dropped), 11UL);
+}
+
+// A consumer that drains in batches keeps up without losing frames
+static void adc_controller_test_throughput(struct kunit *test)
+{
+    struct adc_controller_test_ctx *ctx = test->priv;
+    struct adc_controller_frame frames[64];
+    unsigned long total = 64 * STREAM_FIFO_FRAMES;
+    unsigned long drained = 0;
+    s64 prev = -1;
+    ktime_t start, elapsed;
+    unsigned long i;
+    unsigned int n, j;
+
+    start = ktime_get();
+    for (i = 0; i < total; i++) {
+        adc_controller_capture(&ctx->priv, ns_to_ktime(i));
+        if (kfifo_len(&ctx->priv.stream_fifo) >= STREAM_FIFO_FRAMES / 2) {
+            n = kfifo_out(&ctx->priv.stream_fifo, frames, ARRAY_SIZE(frames));
+            for (j = 0; j < n; j++) {
+                KUNIT_ASSERT_EQ(test, frames[j].timestamp_ns, prev + 1);
+                prev = frames[j].timestamp_ns;
+            }
+            drained += n;
+        }
+    }
+    elapsed = ktime_sub(ktime_get(), start);
+    drained += kfifo_len(&ctx->priv.stream_fifo);
+
+    KUNIT_EXPECT_EQ(test, READ_ONCE(ctx->priv.frames_dropped), 0UL);
+    KUNIT_EXPECT_EQ(test, drained, total);
+    kunit_info(test, "%lu frames in %lld ns (%lld ns/frame)\n", total,
+            ktime_to_ns(elapsed), div64_s64(ktime_to_ns(elapsed), total));
+}
+
+// Filter settings survive a trip through the config register
+static void adc_controller_test_filter_encode(struct kunit *test)
+{
+    static const struct adc_controller_filter filters[] = {
+        { .mode = ADC_CONTROLLER_FILTER_BYPASS },
+        { .mode = ADC_CONTROLLER_FILTER_IIR, .alpha = 1 },
+        { .mode = ADC_CONTROLLER_FILTER_IIR, .alpha = ADC_CONTROLLER_FILTER_MAX_ALPHA },
+        { .mode = ADC_CONTROLLER_FILTER_BOXCAR, .length = 0 },
+        { .mode = ADC_CONTROLLER_FILTER_BOXCAR, .length = ADC_CONTROLLER_FILTER_MAX_LENGTH },
+    };
+    struct adc_controller_filter decoded;
+    u32 config;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(filters); i++) {
+        KUNIT_ASSERT_EQ(test, adc_controller_filter_encode(&filters[i], &config), 0);
+        adc_controller_filter_decode(config, &decoded);
+        KUNIT_EXPECT_EQ(test, decoded.mode, filters[i].mode);
+        KUNIT_EXPECT_EQ(test, decoded.length, filters[i].length);
+        KUNIT_EXPECT_EQ(test, decoded.alpha, filters[i].alpha);
+    }
+
+    // The fields land where the hardware expects them
+    KUNIT_ASSERT_EQ(test, adc_controller_filter_encode(&filters[2], &config), 0);
+    KUNIT_EXPECT_EQ(test, config, 0xFFFF0001U);
+    KUNIT_ASSERT_EQ(test, adc_controller_filter_encode(&filters[4], &config), 0);
+    KUNIT_EXPECT_EQ(test, config, 0xF02U);
+}
+
+// Out-of-range settings are rejected rather than truncated
+static void adc_controller_test_filter_invalid(struct kunit *test)
+{
+    static const struct adc_controller_filter filters[] = {
+        { .mode = 3 },
+        { .mode = ADC_CONTROLLER_FILTER_IIR, .alpha = 0 },
+        { .mode = ADC_CONTROLLER_FILTER_IIR, .alpha = ADC_CONTROLLER_FILTER_MAX_ALPHA + 1 },
+        { .mode = ADC_CONTROLLER_FILTER_BOXCAR, .length = ADC_CONTROLLER_FILTER_MAX_LENGTH + 1 },
+    };
+    u32 config;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(filters); i++) {
+        KUNIT_EXPECT_EQ(test, adc_controller_filter_encode(&filters[i], &config), -EINVAL);
+    }
+}
+
+// Writes to filter_N parse whole, with at most a trailing newline
+static void adc_controller_test_filter_parse(struct kunit *test)
+{
+    static const char * const invalid[] = {
+        "", "on", "iir", "iir ", "iir 3xyz", "iir 3 4", "iir -1", "iir 4294967296",
+        "boxcar 2\n\n", "boxcar x", "off now",
+    };
+    struct adc_controller_filter filter = { 0 };
+    size_t i;
+
+    KUNIT_ASSERT_EQ(test, adc_controller_filter_parse("off\n", &filter), 0);
+    KUNIT_EXPECT_EQ(test, filter.mode, (u32)ADC_CONTROLLER_FILTER_BYPASS);
+    KUNIT_ASSERT_EQ(test, adc_controller_filter_parse("iir 4096", &filter), 0);
+    KUNIT_EXPECT_EQ(test, filter.mode, (u32)ADC_CONTROLLER_FILTER_IIR);
+    KUNIT_EXPECT_EQ(test, filter.alpha, 4096U);
+    KUNIT_ASSERT_EQ(test, adc_controller_filter_parse("boxcar 2\n", &filter), 0);
+    KUNIT_EXPECT_EQ(test, filter.mode, (u32)ADC_CONTROLLER_FILTER_BOXCAR);
+    KUNIT_EXPECT_EQ(test, filter.length, 2U);
+
+    for (i = 0; i < ARRAY_SIZE(invalid); i++) {
+        KUNIT_EXPECT_LT_MSG(test, adc_controller_filter_parse(invalid[i], &filter), 0,
+            "accepted \"%s\"", invalid[i]);
+    }
+}
+
+static struct kunit_case adc_controller_test_cases[] = {
+    KUNIT_CASE(adc_controller_test_capture),
+    KUNIT_CASE(adc_controller_test_overflow),
+    KUNIT_CASE(adc_controller_test_throughput),
+    KUNIT_CASE(adc_controller_test_filter_encode),
+    KUNIT_CASE(adc_controller_test_filter_invalid),
+    KUNIT_CASE(adc_controller_test_filter_parse),
+    {}
+};
+
+static struct kunit_suite adc_controller_test_suite = {
+    .name = "adc_controller",
+    .init = adc_controller_test_init,
+    .exit = adc_controller_test_exit,
+    .test_cases = adc_controller_test_cases,
+};
+
+kunit_test_suite(adc_controller_test_suite);
@@ -12,8 +12,32 @@
 #define REG_R_CH5_OFFSET 0x14
 #define REG_R_CH6_OFFSET 0x18
 #define REG_R_CH7_OFFSET 0x1C
+#define NUM_CHANNELS 8
 
 // Memory span of all registers (used or not) in the component
 #define SPAN 0x20
 
+// New-sample polling interval, when the IP has no sample-ready interrupt
+#define DEFAULT_POLL_INTERVAL_US 1000
+#define MIN_POLL_INTERVAL_US 20
+
+// Sample stream defaults and limits
+#define STREAM_FIFO_FRAMES 1024 // Must be a power of two
+#define DEFAULT_SAMPLE_RATE_HZ 1000
+#define MAX_SAMPLE_RATE_HZ 50000
+
+// ADC_Filter component, in the device's second register region
+#define REG_FILTER_OUT_OFFSET(n) (0x4 * (n)) // Filtered readings, read-only
+#define REG_FILTER_CONFIG_OFFSET(n) (0x20 + 0x4 * (n))
+#define REG_FILTER_DIVIDER_OFFSET 0x40 // Clocks between filter steps; zero stops them
+#define FILTER_MODE 0x3
+#define FILTER_LENGTH_SHIFT 8
+#define FILTER_LENGTH 0xF00
+#define FILTER_ALPHA_SHIFT 16
+// Filter clock (the fabric's system clock), and the fastest useful sweep rate
+#define FILTER_CLOCK_HZ 50000000
+#define MAX_FILTER_RATE_HZ 100000
+// Where the filter sits relative to the ADC, for simulated registers
+#define SIM_FILTER_OFFSET 0x100
+
 #endif
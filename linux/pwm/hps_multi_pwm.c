@@ -12,23 +12,86 @@
 #include <linux/fs.h>
 #include <linux/kernel.h>
 #include <linux/uaccess.h>
+#include <linux/mm.h>
+#include <linux/moduleparam.h>
+#include <linux/property.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/pwm.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/poll.h>
+#include <linux/dma-mapping.h>
+#include <linux/iopoll.h>
+#include <linux/bitops.h>
+#include <linux/string.h>
 
 //-----------------------------------------------------------------------
 // DEFINE STATEMENTS
 //-----------------------------------------------------------------------
 #include "reg_offsets.h"
+#include "hps_multi_pwm_ioctl.h"
+
+// Back the registers with plain memory instead of hardware, for testing
+static bool simulate;
+module_param(simulate, bool, 0444);
+MODULE_PARM_DESC(simulate, "Back the registers with plain memory and create a stand-in device");
+// Channel count reported by the simulated capability register
+static uint sim_channels = DEFAULT_NUM_CHANNELS;
+module_param(sim_channels, uint, 0444);
+MODULE_PARM_DESC(sim_channels, "Number of channels to simulate (default 3)");
+// Size of the frame ring the component fetches from
+static uint ring_frames = DEFAULT_RING_FRAMES;
+module_param(ring_frames, uint, 0444);
+MODULE_PARM_DESC(ring_frames, "Number of frames in the sequencer's ring buffer (default 1024)");
 
 
 //-----------------------------------------------------------------------
 // HPS_Multi_PWM device structure
 //-----------------------------------------------------------------------
+/**
+ * struct dev_reg_kind_attribute - Struct to store attributes for registers of
+ *                                 a similar kind.
+ * @attr: Normal device attribute struct
+ * @reg_offset: Offset to the specific register being represented
+ */
+struct dev_reg_kind_attribute {
+    struct device_attribute attr;
+    unsigned int reg_offset;
+};
 /**
  * struct hps_multi_pwm_dev - Private hps_multi_pwm device struct.
  * @miscdev: miscdevice used to create a char device for the hps_multi_pwm
  *           component
  * @base_addr: Base address of the hps_multi_pwm component
- * @lock: mutex used to prevent concurrent writes to the hps_multi_pwm
- *        component
+ * @phys_addr: Physical address of the registers, used for mmap()
+ * @lock: mutex used to keep burst reads and writes of the hps_multi_pwm
+ *        component from interleaving
+ * @chip: PWM framework chip, for in-kernel consumers and /sys/class/pwm
+ * @duty_mult: Reciprocal of the period used to scale duty cycles, in UQ2.12
+ *             per nanosecond, shifted left by DUTY_MULT_SHIFT
+ * @duty_mult_period: Period register value that @duty_mult was computed for
+ * @num_channels: Number of duty cycle registers, discovered at probe time
+ * @duty_cycle_attrs: One sysfs attribute per duty cycle register, followed by
+ *                    one per passthrough configuration register if @passthrough
+ * @duty_cycle_group: Attribute group holding @duty_cycle_attrs
+ * @groups: Attribute groups for the misc device, ending with NULL
+ * @passthrough: Whether the component can drive duty cycles from the ADC
+ * @gamma_table: Copy of the gamma correction table last loaded, or NULL if
+ *               the component has no table; protected by @lock
+ * @seq_depth: Entries in each sequencer FIFO, or zero if the component has no
+ *             sequencer
+ * @seq_miscdev: miscdevice for streaming frames into the sequencer
+ * @seq_irq: Low-water interrupt, or negative if there isn't one
+ * @seq_poll_timer: Timer used to watch for low water when there's no interrupt
+ * @seq_busy: Bit 0 is set while the sequencer device is open
+ * @seq_wait: Wait queue for writers waiting on FIFO space
+ * @ring_buf: Coherent buffer holding the frame ring, or NULL if the component
+ *            can't fetch frames from memory
+ * @ring_dma: Bus address of @ring_buf
+ * @ring_len: Size of @ring_buf, in bytes, rounded up to whole pages
+ * @ring_running: Whether the fetcher has been started since the sequencer
+ *                device was last opened; protected by @lock
  *
  * An hps_multi_pwm struct gets created for each hps_multi_pwm component in the
  * system.
@@ -36,17 +99,27 @@
 struct hps_multi_pwm_dev {
     struct miscdevice miscdev;
     void __iomem *base_addr;
+    phys_addr_t phys_addr;
     struct mutex lock;
-};
-/**
- * struct dev_reg_kind_attribute - Struct to store attributes for registers of
- *                                 a similar kind.
- * @attr: Normal device attribute struct
- * @reg_offset: Offset to the specific register being represented
- */
-struct dev_reg_kind_attribute {
-    struct device_attribute attr;
-    unsigned int reg_offset;
+    struct pwm_chip chip;
+    u32 duty_mult;
+    u32 duty_mult_period;
+    unsigned int num_channels;
+    struct dev_reg_kind_attribute *duty_cycle_attrs;
+    struct attribute_group duty_cycle_group;
+    const struct attribute_group *groups[6];
+    bool passthrough;
+    u16 *gamma_table;
+    unsigned int seq_depth;
+    struct miscdevice seq_miscdev;
+    int seq_irq;
+    struct hrtimer seq_poll_timer;
+    unsigned long seq_busy;
+    wait_queue_head_t seq_wait;
+    void *ring_buf;
+    dma_addr_t ring_dma;
+    size_t ring_len;
+    bool ring_running;
 };
 
 
@@ -108,7 +181,7 @@ static ssize_t period_store(struct device *dev,
 
 
 //-----------------------------------------------------------------------
-// REGs 1-3: Duty cycle register read function show()
+// REGs 1-N: Duty cycle register read function show()
 //-----------------------------------------------------------------------
 /**
  * duty_cycle_show() - Return the duty cycle value to user-space via sysfs.
@@ -132,7 +205,7 @@ static ssize_t duty_cycle_show(struct device *dev,
 }
 
 //-----------------------------------------------------------------------
-// REGs 1-3: Duty cycle register write function store()
+// REGs 1-N: Duty cycle register write function store()
 //-----------------------------------------------------------------------
 /**
  * duty_cycle_store() - Store the duty cycle value.
@@ -168,211 +241,1739 @@ static ssize_t duty_cycle_store(struct device *dev,
 
 
 //-----------------------------------------------------------------------
-// sysfs Attributes
+// ADC passthrough functions show() and store()
 //-----------------------------------------------------------------------
-#define DEVICE_ATTR_RW_KIND(_name, _kind, _reg_offset) \
-struct dev_reg_kind_attribute dev_attr_##_name = \
-    { __ATTR(_name, 0644, _kind##_show, _kind##_store), _reg_offset }
-// Define sysfs attributes
-static DEVICE_ATTR_RW(period);
-static DEVICE_ATTR_RW_KIND(duty_cycle_1, duty_cycle, REG_DC1_OFFSET);
-static DEVICE_ATTR_RW_KIND(duty_cycle_2, duty_cycle, REG_DC2_OFFSET);
-static DEVICE_ATTR_RW_KIND(duty_cycle_3, duty_cycle, REG_DC3_OFFSET);
+/**
+ * passthrough_show() - Return whether ADC passthrough is enabled.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t passthrough_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
 
-// Create an attribute group so the device core can export the attributes for
-// us.
-static struct attribute *hps_multi_pwm_attrs[] = {
-    &dev_attr_period.attr,
-    &dev_attr_duty_cycle_1.attr.attr,
-    &dev_attr_duty_cycle_2.attr.attr,
-    &dev_attr_duty_cycle_3.attr.attr,
-    NULL,
-};
-ATTRIBUTE_GROUPS(hps_multi_pwm);
+    u32 ctrl = ioread32(priv->base_addr + REG_PASS_CTRL_OFFSET);
 
+    return scnprintf(buf, PAGE_SIZE, "%u\n", ctrl & 0x1);
+}
 
-//-----------------------------------------------------------------------
-// File Operations read()
-//-----------------------------------------------------------------------
 /**
- * hps_multi_pwm_read() - Read method for the hps_multi_pwm char device
- * @file: Pointer to the char device file struct.
- * @buf: User-space buffer to read the value into.
- * @count: The number of bytes being requested.
- * @offset: The byte offset in the file being read from.
+ * passthrough_store() - Enable or disable ADC passthrough.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that contains a boolean.
+ * @size: The number of bytes being written.
  *
- * Return: On success, the number of bytes written is returned and the offset
- *         @offset is advanced by this number. On error, a negative error value
- *         is returned.
+ * While enabled, every channel configured with passthrough_N follows its ADC
+ * channel, and ignores other writes to its duty cycle.
+ *
+ * Return: The number of bytes stored.
  */
-static ssize_t hps_multi_pwm_read(struct file *file, char __user *buf,
-    size_t count, loff_t *offset)
+static ssize_t passthrough_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
 {
-    size_t ret;
-    u32 val;
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
 
-    loff_t pos = *offset;
+    bool enable;
+    int ret = kstrtobool(buf, &enable);
+    if (ret < 0) {
+        return ret;
+    }
 
-    /* Get the device's private data from the file struct's private_data field.
-     * The private_data field is equal to the miscdev field in the
-     * hps_multi_pwm_dev struct. container_of returns the hps_multi_pwm_dev
-     * struct that contains the miscdev in private_data.
-     */
-    struct hps_multi_pwm_dev *priv = container_of(file->private_data,
-            struct hps_multi_pwm_dev, miscdev);
+    iowrite32(enable, priv->base_addr + REG_PASS_CTRL_OFFSET);
 
-    // Check file offset to make sure we are reading to a valid location.
-    if (pos < 0) {
-        // We can't read from a negative file position.
-        return -EINVAL;
-    }
-    if (pos >= SPAN) {
-        // We can't read from a position past the end of our device.
-        return 0;
-    }
-    if ((pos % 0x4) != 0) {
-        /* Prevent unaligned access. Even though the hardware technically
-         * supports unaligned access, we want to ensure that we only access
-         * 32-bit-aligned addresses because our registers are 32-bit-aligned.
-         */
-        pr_warn("hps_multi_pwm_read: unaligned access\n");
-        return -EFAULT;
-    }
+    return size;
+}
 
-    // If the user didn't request any bytes, don't return any bytes :)
-    if (count == 0) {
-        return 0;
+/**
+ * pass_config_show() - Return one channel's passthrough configuration.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Attribute embedded in a dev_reg_kind_attribute.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * The configuration reads as "off", or as "<source> <gain> <offset>" in the
+ * format pass_config_store() takes.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t pass_config_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
+    struct dev_reg_kind_attribute *reg_attr
+        = container_of(attr, struct dev_reg_kind_attribute, attr);
+
+    u32 config = ioread32(priv->base_addr + reg_attr->reg_offset);
+
+    if (!(config & PASS_ON)) {
+        return scnprintf(buf, PAGE_SIZE, "off\n");
     }
+    return scnprintf(buf, PAGE_SIZE, "%u %d %d\n", config & PASS_SOURCE,
+            sign_extend32((config >> PASS_GAIN_SHIFT) & PASS_FIELD_MASK, 13),
+            sign_extend32((config >> PASS_OFFSET_SHIFT) & PASS_FIELD_MASK, 13));
+}
 
-    // Read the value at offset pos.
-    val = ioread32(priv->base_addr + pos);
+/**
+ * pass_config_store() - Configure one channel's passthrough.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Attribute embedded in a dev_reg_kind_attribute.
+ * @buf: Buffer that contains "off", or "<source> <gain> <offset>".
+ * @size: The number of bytes being written.
+ *
+ * The source is an ADC channel, from 0 to 7. The gain is in 1/1024 and the
+ * offset in duty cycle units (1/4096), both from -8192 to 8191, so "0 1024 0"
+ * copies ADC channel 0 and "0 -1024 4096" inverts it.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t pass_config_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
+    struct dev_reg_kind_attribute *reg_attr
+        = container_of(attr, struct dev_reg_kind_attribute, attr);
 
-    ret = copy_to_user(buf, &val, sizeof(val));
-    if (ret == sizeof(val)) {
-        // Nothing was copied to the user.
-        pr_warn("hps_multi_pwm_read: nothing copied\n");
-        return -EFAULT;
+    unsigned int source;
+    int gain, offset, len;
+    u32 config;
+
+    if (sysfs_streq(buf, "off")) {
+        config = 0;
+    } else {
+        // Only a trailing newline may follow the offset
+        if (sscanf(buf, "%u %d %d%n", &source, &gain, &offset, &len) != 3
+                || !sysfs_streq(buf + len, "")) {
+            return -EINVAL;
+        }
+        if (source >= ADC_CHANNELS
+                || gain < PASS_FIELD_MIN || gain > PASS_FIELD_MAX
+                || offset < PASS_FIELD_MIN || offset > PASS_FIELD_MAX) {
+            return -EINVAL;
+        }
+        config = source | PASS_ON
+            | (((u32)offset & PASS_FIELD_MASK) << PASS_OFFSET_SHIFT)
+            | (((u32)gain & PASS_FIELD_MASK) << PASS_GAIN_SHIFT);
     }
 
-    // Increment the file offset by the number of bytes we read.
-    *offset = pos + sizeof(val);
+    iowrite32(config, priv->base_addr + reg_attr->reg_offset);
 
-    return sizeof(val);
+    return size;
 }
 
+
 //-----------------------------------------------------------------------
-// File Operations write()
+// Gamma correction bypass functions show() and store()
 //-----------------------------------------------------------------------
 /**
- * hps_multi_pwm_write() - Write method for the hps_multi_pwm char device
- * @file: Pointer to the char device file struct.
- * @buf: User-space buffer to read the value from.
- * @count: The number of bytes being written.
- * @offset: The byte offset in the file being written to.
+ * gamma_bypass_show() - Return whether the gamma correction table is bypassed.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
  *
- * Return: On success, the number of bytes written is returned and the offset
- *         @offset is advanced by this number. On error, a negative error value
- *         is returned.
+ * Return: The number of bytes read.
  */
-static ssize_t hps_multi_pwm_write(struct file *file, const char __user *buf,
-    size_t count, loff_t *offset)
+static ssize_t gamma_bypass_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
 {
-    size_t ret;
-    u32 val;
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
 
-    loff_t pos = *offset;
+    u32 ctrl = ioread32(priv->base_addr + REG_GAMMA_CTRL_OFFSET);
 
-    /* Get the device's private data from the file struct's private_data field.
-     * The private_data field is equal to the miscdev field in the
-     * hps_multi_pwm_dev struct. container_of returns the hps_multi_pwm_dev
-     * struct that contains the miscdev in private_data.
-     */
-    struct hps_multi_pwm_dev *priv = container_of(file->private_data,
-            struct hps_multi_pwm_dev, miscdev);
+    return scnprintf(buf, PAGE_SIZE, "%u\n", ctrl & GAMMA_CTRL_BYPASS);
+}
 
-    // Check file offset to make sure we are writing to a valid location.
-    if (pos < 0) {
-        // We can't write to a negative file position.
-        return -EINVAL;
-    }
-    if (pos >= SPAN) {
-        // We can't write to a position past the end of our device.
-        return 0;
-    }
-    if ((pos % 0x4) != 0) {
-        /* Prevent unaligned access. Even though the hardware technically
-         * supports unaligned access, we want to ensure that we only access
-         * 32-bit-aligned addresses because our registers are 32-bit-aligned.
-         */
-        pr_warn("hps_multi_pwm_write: unaligned access\n");
-        return -EFAULT;
-    }
+/**
+ * gamma_bypass_store() - Bypass or apply the gamma correction table.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that contains a boolean.
+ * @size: The number of bytes being written.
+ *
+ * The change takes effect on every channel at the next period boundary.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t gamma_bypass_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
 
-    // If the user didn't request to write anything, return 0.
-    if (count == 0) {
-        return 0;
+    bool bypass;
+    int ret = kstrtobool(buf, &bypass);
+    if (ret < 0) {
+        return ret;
     }
 
-    mutex_lock(&priv->lock);
-
-    ret = copy_from_user(&val, buf, sizeof(val));
-    if (ret == sizeof(val)) {
-        // Nothing was copied from the user.
-        pr_warn("hps_multi_pwm_write: nothing copied from user space\n");
-        ret = -EFAULT;
-        goto unlock;
-    }
+    iowrite32(bypass ? GAMMA_CTRL_BYPASS : 0, priv->base_addr + REG_GAMMA_CTRL_OFFSET);
 
-    // Write the value we were given at the address offset given by pos.
-    iowrite32(val, priv->base_addr + pos);
+    return size;
+}
 
-    // Increment the file offset by the number of bytes we wrote.
-    *offset = pos + sizeof(val);
 
-    // Return the number of bytes we wrote.
-    ret = sizeof(val);
+//-----------------------------------------------------------------------
+// mmap() register offset function show()
+//-----------------------------------------------------------------------
+/**
+ * mmap_offset_show() - Return the registers' offset within their mmap() page.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Our register span (SPAN) is a whole page, and Platform Designer aligns each
+ * component's base address to its span, so this is zero for our registers.
+ * It's published anyway, as it is for the ADC, so user-space finds the
+ * registers the same way for both devices instead of assuming the alignment.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t mmap_offset_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
 
-unlock:
-    mutex_unlock(&priv->lock);
-    return ret;
+    return scnprintf(buf, PAGE_SIZE, "0x%lX\n", offset_in_page(priv->phys_addr));
 }
 
 
 //-----------------------------------------------------------------------
-// File Operations Supported
+// Channel count function show()
 //-----------------------------------------------------------------------
 /**
- * hps_multi_pwm_fops - File operations supported by the hps_multi_pwm driver
- * @owner: The hps_multi_pwm driver owns the file operations; this ensures that
- *         the driver can't be removed while the character device is still in
- *         use.
- * @read: The read function.
- * @write: The write function.
- * @llseek: We use the kernel's default_llseek() function; this allows users to
- *          change what position they are writing/reading to/from.
+ * num_channels_show() - Return the number of duty cycle registers.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
  */
-static const struct file_operations hps_multi_pwm_fops = {
-    .owner = THIS_MODULE,
-    .read = hps_multi_pwm_read,
-    .write = hps_multi_pwm_write,
-    .llseek = default_llseek,
-};
+static ssize_t num_channels_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", priv->num_channels);
+}
 
 
 //-----------------------------------------------------------------------
-// Platform Driver Probe (Initialization) Function
+// Sequencer functions show() and store()
 //-----------------------------------------------------------------------
 /**
- * hps_multi_pwm_probe() - Initialize device when a match is found
- * @pdev: Platform device structure associated with our hps_multi_pwm
- *        device; pdev is automatically created by the driver core based upon
- *        our hps_multi_pwm device tree node.
+ * seq_divider_show() - Return the number of PWM periods per sequencer step.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
  *
- * When a device that is compatible with this hps_multi_pwm driver is found,
- * the driver's probe function is called. This probe function gets called by
- * the kernel when an hps_multi_pwm device is found in the device tree.
+ * Return: The number of bytes read.
  */
-static int hps_multi_pwm_probe(struct platform_device *pdev)
+static ssize_t seq_divider_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
+
+    u32 divider = ioread32(priv->base_addr + REG_SEQ_DIVIDER_OFFSET);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", divider);
+}
+
+/**
+ * seq_divider_store() - Set the number of PWM periods per sequencer step.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that contains the divider, from 1 to 65535.
+ * @size: The number of bytes being written.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t seq_divider_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
+
+    u16 divider;
+    int ret = kstrtou16(buf, 0, &divider);
+    if (ret < 0) {
+        return ret;
+    }
+    if (divider == 0) {
+        // The hardware would treat this as 1; don't pretend otherwise
+        return -EINVAL;
+    }
+
+    iowrite32(divider, priv->base_addr + REG_SEQ_DIVIDER_OFFSET);
+
+    return size;
+}
+
+/**
+ * seq_low_water_show() - Return the sequencer's low-water mark.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t seq_low_water_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
+
+    u32 low_water = ioread32(priv->base_addr + REG_SEQ_LOW_WATER_OFFSET);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", low_water);
+}
+
+/**
+ * seq_low_water_store() - Set the sequencer's low-water mark.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that contains the mark, in frames.
+ * @size: The number of bytes being written.
+ *
+ * Writers blocked on a full sequencer are woken once the fullest FIFO drains
+ * to this level, so it must leave them some room.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t seq_low_water_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
+
+    u32 low_water;
+    int ret = kstrtou32(buf, 0, &low_water);
+    if (ret < 0) {
+        return ret;
+    }
+    if (low_water >= priv->seq_depth) {
+        return -EINVAL;
+    }
+
+    iowrite32(low_water, priv->base_addr + REG_SEQ_LOW_WATER_OFFSET);
+
+    return size;
+}
+
+/**
+ * seq_depth_show() - Return the number of frames each FIFO can hold.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t seq_depth_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", priv->seq_depth);
+}
+
+/**
+ * seq_level_show() - Return the number of frames queued in the sequencer.
+ * @dev: Device structure for the hps_multi_pwm component. This device struct
+ *       is embedded in the hps_multi_pwm's platform device struct.
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * This is the level of the fullest FIFO, which is what limits new writes.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t seq_level_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct hps_multi_pwm_dev *priv = dev_get_drvdata(dev);
+
+    u32 status = ioread32(priv->base_addr + REG_SEQ_STATUS_OFFSET);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", status & SEQ_STATUS_LEVEL);
+}
+
+
+//-----------------------------------------------------------------------
+// sysfs Attributes
+//-----------------------------------------------------------------------
+// Define sysfs attributes; duty cycles are created at probe time, once we
+// know how many channels there are
+static DEVICE_ATTR_RW(period);
+static DEVICE_ATTR_RO(mmap_offset);
+static DEVICE_ATTR_RO(num_channels);
+static DEVICE_ATTR_RW(seq_divider);
+static DEVICE_ATTR_RW(seq_low_water);
+static DEVICE_ATTR_RO(seq_depth);
+static DEVICE_ATTR_RO(seq_level);
+static DEVICE_ATTR_RW(passthrough);
+static DEVICE_ATTR_RW(gamma_bypass);
+
+// Create an attribute group so the device core can export the attributes for
+// us.
+static struct attribute *hps_multi_pwm_attrs[] = {
+    &dev_attr_mmap_offset.attr,
+    &dev_attr_num_channels.attr,
+    &dev_attr_period.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(hps_multi_pwm);
+
+// Sequencer attributes, only exported if the component has a sequencer
+static struct attribute *hps_multi_pwm_seq_attrs[] = {
+    &dev_attr_seq_depth.attr,
+    &dev_attr_seq_divider.attr,
+    &dev_attr_seq_level.attr,
+    &dev_attr_seq_low_water.attr,
+    NULL,
+};
+static const struct attribute_group hps_multi_pwm_seq_group = {
+    .attrs = hps_multi_pwm_seq_attrs,
+};
+
+// Passthrough attributes, only exported if the component has passthrough
+static struct attribute *hps_multi_pwm_pass_attrs[] = {
+    &dev_attr_passthrough.attr,
+    NULL,
+};
+static const struct attribute_group hps_multi_pwm_pass_group = {
+    .attrs = hps_multi_pwm_pass_attrs,
+};
+
+// Gamma correction attributes, only exported if the component has a table
+static struct attribute *hps_multi_pwm_gamma_attrs[] = {
+    &dev_attr_gamma_bypass.attr,
+    NULL,
+};
+static const struct attribute_group hps_multi_pwm_gamma_group = {
+    .attrs = hps_multi_pwm_gamma_attrs,
+};
+
+/**
+ * hps_multi_pwm_init_reg_attr() - Fill in one per-channel register attribute.
+ * @pdev: Platform device structure for the hps_multi_pwm.
+ * @reg_attr: Attribute to fill in.
+ * @name: Base name; the one-based channel number gets appended.
+ * @channel: Zero-based channel index.
+ * @reg_offset: Offset of the channel's register.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int hps_multi_pwm_init_reg_attr(struct platform_device *pdev,
+    struct dev_reg_kind_attribute *reg_attr, const char *name,
+    unsigned int channel, unsigned int reg_offset)
+{
+    reg_attr->attr.attr.name = devm_kasprintf(&pdev->dev, GFP_KERNEL, "%s_%u", name, channel + 1);
+    if (!reg_attr->attr.attr.name) {
+        return -ENOMEM;
+    }
+    sysfs_attr_init(&reg_attr->attr.attr);
+    reg_attr->attr.attr.mode = 0644;
+    reg_attr->reg_offset = reg_offset;
+    return 0;
+}
+
+/**
+ * hps_multi_pwm_create_attrs() - Create one duty cycle attribute per channel.
+ * @pdev: Platform device structure for the hps_multi_pwm.
+ * @priv: Private hps_multi_pwm device struct, with @num_channels,
+ *        @seq_depth, @passthrough, and @gamma_table set.
+ *
+ * The attributes are named duty_cycle_1 to duty_cycle_N (plus passthrough_1 to
+ * passthrough_N, if the component has passthrough), and are exported on both
+ * the misc device and the platform device, alongside the fixed ones and any
+ * optional groups. Everything is device-managed, so it goes away along with
+ * @pdev.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int hps_multi_pwm_create_attrs(struct platform_device *pdev,
+    struct hps_multi_pwm_dev *priv)
+{
+    unsigned int num_attrs = priv->num_channels * (priv->passthrough ? 2 : 1);
+    unsigned int num_groups = 0;
+    struct attribute **attrs;
+    unsigned int i;
+    int ret;
+
+    priv->duty_cycle_attrs = devm_kcalloc(&pdev->dev, num_attrs,
+            sizeof(*priv->duty_cycle_attrs), GFP_KERNEL);
+    attrs = devm_kcalloc(&pdev->dev, num_attrs + 1, sizeof(*attrs), GFP_KERNEL);
+    if (!priv->duty_cycle_attrs || !attrs) {
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < num_attrs; i++) {
+        struct dev_reg_kind_attribute *reg_attr = &priv->duty_cycle_attrs[i];
+        unsigned int channel = i % priv->num_channels;
+
+        if (i < priv->num_channels) {
+            ret = hps_multi_pwm_init_reg_attr(pdev, reg_attr, "duty_cycle",
+                    channel, REG_DC_OFFSET(channel));
+            reg_attr->attr.show = duty_cycle_show;
+            reg_attr->attr.store = duty_cycle_store;
+        } else {
+            ret = hps_multi_pwm_init_reg_attr(pdev, reg_attr, "passthrough",
+                    channel, REG_PASS_CONFIG_OFFSET(channel));
+            reg_attr->attr.show = pass_config_show;
+            reg_attr->attr.store = pass_config_store;
+        }
+        if (ret) {
+            return ret;
+        }
+        attrs[i] = &reg_attr->attr.attr;
+    }
+    priv->duty_cycle_group.attrs = attrs;
+
+    priv->groups[num_groups++] = &hps_multi_pwm_group;
+    priv->groups[num_groups++] = &priv->duty_cycle_group;
+    if (priv->seq_depth) {
+        priv->groups[num_groups++] = &hps_multi_pwm_seq_group;
+    }
+    if (priv->passthrough) {
+        priv->groups[num_groups++] = &hps_multi_pwm_pass_group;
+    }
+    if (priv->gamma_table) {
+        priv->groups[num_groups++] = &hps_multi_pwm_gamma_group;
+    }
+    priv->groups[num_groups] = NULL;
+
+    // The platform device gets the fixed attributes from the driver core
+    for (i = 1; i < num_groups; i++) {
+        ret = devm_device_add_group(&pdev->dev, priv->groups[i]);
+        if (ret) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+
+//-----------------------------------------------------------------------
+// Burst buffers
+//-----------------------------------------------------------------------
+/**
+ * hps_multi_pwm_burst_len() - Clamp a burst to what we'll transfer at once.
+ * @priv: Private hps_multi_pwm device struct.
+ * @pos: Byte offset of the first register.
+ * @count: The number of bytes requested.
+ *
+ * A burst may cover the period and every duty cycle register, however many
+ * channels there are, but never runs past the end of our span.
+ *
+ * Return: The number of bytes to transfer, a whole number of registers.
+ */
+static size_t hps_multi_pwm_burst_len(struct hps_multi_pwm_dev *priv,
+    loff_t pos, size_t count)
+{
+    size_t max_len = max_t(size_t, MAX_BURST_REGS, priv->num_channels + 1) * sizeof(u32);
+
+    return min_t(size_t, min_t(size_t, count, SPAN - pos), max_len) & ~(sizeof(u32) - 1);
+}
+
+/**
+ * hps_multi_pwm_get_burst_buf() - Find room for a burst of register values.
+ * @stack_buf: Caller's buffer of MAX_BURST_REGS registers.
+ * @len: Size of the burst in bytes.
+ *
+ * Short bursts use the caller's buffer, so the common case doesn't allocate.
+ *
+ * Return: A buffer of at least @len bytes, or NULL if allocation failed.
+ */
+static u32 *hps_multi_pwm_get_burst_buf(u32 *stack_buf, size_t len)
+{
+    if (len <= MAX_BURST_REGS * sizeof(u32)) {
+        return stack_buf;
+    }
+    return kmalloc(len, GFP_KERNEL);
+}
+
+/**
+ * hps_multi_pwm_put_burst_buf() - Release a buffer from hps_multi_pwm_get_burst_buf().
+ * @buf: The buffer to release.
+ * @stack_buf: Caller's buffer, as passed to hps_multi_pwm_get_burst_buf().
+ */
+static void hps_multi_pwm_put_burst_buf(u32 *buf, u32 *stack_buf)
+{
+    if (buf != stack_buf) {
+        kfree(buf);
+    }
+}
+
+
+//-----------------------------------------------------------------------
+// File Operations read()
+//-----------------------------------------------------------------------
+/**
+ * hps_multi_pwm_read() - Read method for the hps_multi_pwm char device
+ * @file: Pointer to the char device file struct.
+ * @buf: User-space buffer to read the value into.
+ * @count: The number of bytes being requested.
+ * @offset: The byte offset in the file being read from.
+ *
+ * Return: On success, the number of bytes written is returned and the offset
+ *         @offset is advanced by this number. On error, a negative error value
+ *         is returned.
+ */
+static ssize_t hps_multi_pwm_read(struct file *file, char __user *buf,
+    size_t count, loff_t *offset)
+{
+    size_t ret;
+    size_t len, i;
+    u32 stack_vals[MAX_BURST_REGS];
+    u32 *vals;
+
+    loff_t pos = *offset;
+
+    /* Get the device's private data from the file struct's private_data field.
+     * The private_data field is equal to the miscdev field in the
+     * hps_multi_pwm_dev struct. container_of returns the hps_multi_pwm_dev
+     * struct that contains the miscdev in private_data.
+     */
+    struct hps_multi_pwm_dev *priv = container_of(file->private_data,
+            struct hps_multi_pwm_dev, miscdev);
+
+    // Check file offset to make sure we are reading to a valid location.
+    if (pos < 0) {
+        // We can't read from a negative file position.
+        return -EINVAL;
+    }
+    if (pos >= SPAN) {
+        // We can't read from a position past the end of our device.
+        return 0;
+    }
+    if ((pos % 0x4) != 0) {
+        /* Prevent unaligned access. Even though the hardware technically
+         * supports unaligned access, we want to ensure that we only access
+         * 32-bit-aligned addresses because our registers are 32-bit-aligned.
+         */
+        pr_warn("hps_multi_pwm_read: unaligned access\n");
+        return -EFAULT;
+    }
+
+    // If the user didn't request any bytes, don't return any bytes :)
+    if (count == 0) {
+        return 0;
+    }
+
+    /* Transfer as many whole registers as the user asked for, stopping at the
+     * end of our span (or our burst limit). This lets a single read() return
+     * a burst of consecutive registers instead of just one.
+     */
+    len = hps_multi_pwm_burst_len(priv, pos, count);
+    if (len == 0) {
+        // The user's buffer can't hold even one register.
+        return -EINVAL;
+    }
+    vals = hps_multi_pwm_get_burst_buf(stack_vals, len);
+    if (!vals) {
+        return -ENOMEM;
+    }
+
+    // Read the burst under one lock so it forms a consistent snapshot.
+    mutex_lock(&priv->lock);
+    for (i = 0; i < len / sizeof(u32); i++) {
+        vals[i] = ioread32(priv->base_addr + pos + i * sizeof(u32));
+    }
+    mutex_unlock(&priv->lock);
+
+    ret = copy_to_user(buf, vals, len);
+    hps_multi_pwm_put_burst_buf(vals, stack_vals);
+    if (ret == len) {
+        // Nothing was copied to the user.
+        pr_warn("hps_multi_pwm_read: nothing copied\n");
+        return -EFAULT;
+    }
+    len -= ret;
+
+    // Increment the file offset by the number of bytes we read.
+    *offset = pos + len;
+
+    return len;
+}
+
+//-----------------------------------------------------------------------
+// File Operations write()
+//-----------------------------------------------------------------------
+/**
+ * hps_multi_pwm_write() - Write method for the hps_multi_pwm char device
+ * @file: Pointer to the char device file struct.
+ * @buf: User-space buffer to read the value from.
+ * @count: The number of bytes being written.
+ * @offset: The byte offset in the file being written to.
+ *
+ * Return: On success, the number of bytes written is returned and the offset
+ *         @offset is advanced by this number. On error, a negative error value
+ *         is returned.
+ */
+static ssize_t hps_multi_pwm_write(struct file *file, const char __user *buf,
+    size_t count, loff_t *offset)
+{
+    size_t ret;
+    size_t len, i;
+    u32 stack_vals[MAX_BURST_REGS];
+    u32 *vals;
+
+    loff_t pos = *offset;
+
+    /* Get the device's private data from the file struct's private_data field.
+     * The private_data field is equal to the miscdev field in the
+     * hps_multi_pwm_dev struct. container_of returns the hps_multi_pwm_dev
+     * struct that contains the miscdev in private_data.
+     */
+    struct hps_multi_pwm_dev *priv = container_of(file->private_data,
+            struct hps_multi_pwm_dev, miscdev);
+
+    // Check file offset to make sure we are writing to a valid location.
+    if (pos < 0) {
+        // We can't write to a negative file position.
+        return -EINVAL;
+    }
+    if (pos >= SPAN) {
+        // We can't write to a position past the end of our device.
+        return 0;
+    }
+    if ((pos % 0x4) != 0) {
+        /* Prevent unaligned access. Even though the hardware technically
+         * supports unaligned access, we want to ensure that we only access
+         * 32-bit-aligned addresses because our registers are 32-bit-aligned.
+         */
+        pr_warn("hps_multi_pwm_write: unaligned access\n");
+        return -EFAULT;
+    }
+
+    // If the user didn't request to write anything, return 0.
+    if (count == 0) {
+        return 0;
+    }
+
+    // As with reads, accept a burst of whole registers up to the span's end.
+    len = hps_multi_pwm_burst_len(priv, pos, count);
+    if (len == 0) {
+        // The user didn't give us even one full register.
+        return -EINVAL;
+    }
+    vals = hps_multi_pwm_get_burst_buf(stack_vals, len);
+    if (!vals) {
+        return -ENOMEM;
+    }
+
+    /* Fetch the whole burst before taking the lock, since copy_from_user()
+     * may fault and sleep.
+     */
+    ret = copy_from_user(vals, buf, len);
+    if (ret) {
+        // We need every byte of the burst, or we'd write garbage.
+        pr_warn("hps_multi_pwm_write: failed to copy from user space\n");
+        hps_multi_pwm_put_burst_buf(vals, stack_vals);
+        return -EFAULT;
+    }
+
+    // Write the values we were given, starting at the offset given by pos.
+    mutex_lock(&priv->lock);
+    for (i = 0; i < len / sizeof(u32); i++) {
+        iowrite32(vals[i], priv->base_addr + pos + i * sizeof(u32));
+    }
+    mutex_unlock(&priv->lock);
+    hps_multi_pwm_put_burst_buf(vals, stack_vals);
+
+    // Increment the file offset by the number of bytes we wrote.
+    *offset = pos + len;
+
+    // Return the number of bytes we wrote.
+    return len;
+}
+
+
+//-----------------------------------------------------------------------
+// File Operations unlocked_ioctl()
+//-----------------------------------------------------------------------
+/**
+ * hps_multi_pwm_apply() - Atomically apply a complete PWM configuration.
+ * @priv: Private hps_multi_pwm device struct.
+ * @uconfig: User-space configuration to apply.
+ *
+ * The hardware treats the period and duty cycle registers as a shadow set, so
+ * we hold off its commit while writing them. Releasing the hold makes all of
+ * the new values take effect together at the next period boundary, so that
+ * outputs never show a mix of old and new settings.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static long hps_multi_pwm_apply(struct hps_multi_pwm_dev *priv,
+    struct hps_multi_pwm_config __user *uconfig)
+{
+    u32 period, num_channels;
+    u32 stack_duty_cycles[MAX_BURST_REGS];
+    u32 *duty_cycles;
+    size_t i;
+
+    // Fetch the fixed header first, to learn how many duty cycles follow.
+    if (get_user(period, &uconfig->period) ||
+            get_user(num_channels, &uconfig->num_channels)) {
+        return -EFAULT;
+    }
+    if (num_channels > priv->num_channels) {
+        return -EINVAL;
+    }
+    duty_cycles = hps_multi_pwm_get_burst_buf(stack_duty_cycles,
+            num_channels * sizeof(duty_cycles[0]));
+    if (!duty_cycles) {
+        return -ENOMEM;
+    }
+    if (copy_from_user(duty_cycles, uconfig->duty_cycles,
+                num_channels * sizeof(duty_cycles[0]))) {
+        hps_multi_pwm_put_burst_buf(duty_cycles, stack_duty_cycles);
+        return -EFAULT;
+    }
+
+    mutex_lock(&priv->lock);
+    iowrite32(CTRL_HOLD, priv->base_addr + REG_CTRL_OFFSET);
+    iowrite32(period, priv->base_addr + REG_PERIOD_OFFSET);
+    for (i = 0; i < num_channels; i++) {
+        iowrite32(duty_cycles[i], priv->base_addr + REG_DC_OFFSET(i));
+    }
+    iowrite32(0, priv->base_addr + REG_CTRL_OFFSET);
+    mutex_unlock(&priv->lock);
+
+    hps_multi_pwm_put_burst_buf(duty_cycles, stack_duty_cycles);
+    return 0;
+}
+
+/**
+ * hps_multi_pwm_gamma_load() - Write a whole gamma table to the hardware.
+ * @priv: Private hps_multi_pwm device struct, with @lock held.
+ * @table: HPS_MULTI_PWM_GAMMA_ENTRIES table entries.
+ *
+ * The data port advances its index after every entry, so the table goes out
+ * as one run of writes to the same register.
+ */
+static void hps_multi_pwm_gamma_load(struct hps_multi_pwm_dev *priv,
+    const u16 *table)
+{
+    size_t i;
+
+    iowrite32(0, priv->base_addr + REG_GAMMA_INDEX_OFFSET);
+    for (i = 0; i < HPS_MULTI_PWM_GAMMA_ENTRIES; i++) {
+        iowrite32(table[i], priv->base_addr + REG_GAMMA_DATA_OFFSET);
+    }
+    memcpy(priv->gamma_table, table, HPS_MULTI_PWM_GAMMA_ENTRIES * sizeof(table[0]));
+}
+
+/**
+ * hps_multi_pwm_set_gamma() - Load a gamma table from user-space.
+ * @priv: Private hps_multi_pwm device struct.
+ * @ugamma: User-space table.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static long hps_multi_pwm_set_gamma(struct hps_multi_pwm_dev *priv,
+    struct hps_multi_pwm_gamma __user *ugamma)
+{
+    struct hps_multi_pwm_gamma *gamma;
+
+    if (!priv->gamma_table) {
+        return -ENOTTY;
+    }
+    // Too big for the stack
+    gamma = memdup_user(ugamma, sizeof(*gamma));
+    if (IS_ERR(gamma)) {
+        return PTR_ERR(gamma);
+    }
+
+    mutex_lock(&priv->lock);
+    hps_multi_pwm_gamma_load(priv, gamma->table);
+    mutex_unlock(&priv->lock);
+
+    kfree(gamma);
+    return 0;
+}
+
+/**
+ * hps_multi_pwm_get_gamma() - Copy the current gamma table to user-space.
+ * @priv: Private hps_multi_pwm device struct.
+ * @ugamma: User-space table.
+ *
+ * The hardware's table is write-only, so this returns our copy of it.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static long hps_multi_pwm_get_gamma(struct hps_multi_pwm_dev *priv,
+    struct hps_multi_pwm_gamma __user *ugamma)
+{
+    long ret = 0;
+
+    if (!priv->gamma_table) {
+        return -ENOTTY;
+    }
+
+    mutex_lock(&priv->lock);
+    if (copy_to_user(ugamma->table, priv->gamma_table, sizeof(ugamma->table))) {
+        ret = -EFAULT;
+    }
+    mutex_unlock(&priv->lock);
+
+    return ret;
+}
+
+/**
+ * hps_multi_pwm_ioctl() - Ioctl method for the hps_multi_pwm char device
+ * @file: Pointer to the char device file struct.
+ * @cmd: Ioctl command number, from hps_multi_pwm_ioctl.h.
+ * @arg: Command argument; a user-space pointer for all current commands.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static long hps_multi_pwm_ioctl(struct file *file, unsigned int cmd,
+    unsigned long arg)
+{
+    struct hps_multi_pwm_dev *priv = container_of(file->private_data,
+            struct hps_multi_pwm_dev, miscdev);
+
+    switch (cmd) {
+    case HPS_MULTI_PWM_IOC_APPLY:
+        return hps_multi_pwm_apply(priv, (void __user *)arg);
+    case HPS_MULTI_PWM_IOC_SET_GAMMA:
+        return hps_multi_pwm_set_gamma(priv, (void __user *)arg);
+    case HPS_MULTI_PWM_IOC_GET_GAMMA:
+        return hps_multi_pwm_get_gamma(priv, (void __user *)arg);
+    default:
+        return -ENOTTY;
+    }
+}
+
+
+//-----------------------------------------------------------------------
+// PWM Framework Provider
+//-----------------------------------------------------------------------
+#if IS_ENABLED(CONFIG_PWM)
+
+/* The period register holds milliseconds in UQ10.7, i.e. units of 1/128 ms.
+ * Converting from nanoseconds is a multiply by 128/10^6, which we do as a
+ * fixed-point multiply and shift. The multiplier is rounded up so that exact
+ * periods (1 ms, for example) don't truncate to one unit less.
+ */
+#define PERIOD_NS_SHIFT 40
+#define PERIOD_NS_MULT ((u32)DIV_ROUND_UP_ULL(128ULL << PERIOD_NS_SHIFT, NSEC_PER_MSEC))
+#define PERIOD_MAX 0x1FFFF // 17-bit register
+// Duty cycle registers hold a fraction of the period in UQ2.12
+#define DUTY_ONE 0x1000
+#define DUTY_MULT_SHIFT 32
+
+/**
+ * hps_multi_pwm_period_to_ns() - Convert a period register value to ns.
+ * @period: Period in milliseconds, UQ10.7.
+ *
+ * Return: The period in nanoseconds (10^6 / 128 = 15625 / 2 per unit).
+ */
+static inline u64 hps_multi_pwm_period_to_ns(u32 period)
+{
+    return ((u64)period * 15625) >> 1;
+}
+
+/**
+ * hps_multi_pwm_ns_to_period() - Convert a period in ns to a register value.
+ * @ns: Period in nanoseconds.
+ *
+ * Return: The longest period register value not exceeding @ns, saturated to
+ *         the register's range.
+ */
+static inline u32 hps_multi_pwm_ns_to_period(u64 ns)
+{
+    return min_t(u64, mul_u64_u32_shr(ns, PERIOD_NS_MULT, PERIOD_NS_SHIFT), PERIOD_MAX);
+}
+
+static inline struct hps_multi_pwm_dev *to_hps_multi_pwm_dev(struct pwm_chip *chip)
+{
+    return container_of(chip, struct hps_multi_pwm_dev, chip);
+}
+
+/**
+ * hps_multi_pwm_chip_apply() - Apply a PWM state to one channel.
+ * @chip: PWM chip embedded in our device struct.
+ * @pwm: The channel being configured.
+ * @state: Requested state.
+ *
+ * All channels share one period, so it may only change while no other channel
+ * is enabled. The period and duty cycle are written under hold, so that they
+ * take effect together at the next period boundary. Duty cycles are scaled by
+ * a reciprocal of the period, which is only recomputed when the period changes.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int hps_multi_pwm_chip_apply(struct pwm_chip *chip, struct pwm_device *pwm,
+    const struct pwm_state *state)
+{
+    struct hps_multi_pwm_dev *priv = to_hps_multi_pwm_dev(chip);
+    void __iomem *duty_reg = priv->base_addr + REG_DC_OFFSET(pwm->hwpwm);
+    u32 period, duty;
+    unsigned int i;
+    int ret = 0;
+
+    if (state->polarity != PWM_POLARITY_NORMAL) {
+        return -EINVAL;
+    }
+
+    if (!state->enabled) {
+        mutex_lock(&priv->lock);
+        iowrite32(0, duty_reg);
+        mutex_unlock(&priv->lock);
+        return 0;
+    }
+
+    period = hps_multi_pwm_ns_to_period(state->period);
+    if (period == 0) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&priv->lock);
+
+    if (period != ioread32(priv->base_addr + REG_PERIOD_OFFSET)) {
+        for (i = 0; i < chip->npwm; i++) {
+            if (i != pwm->hwpwm && pwm_is_enabled(&chip->pwms[i])) {
+                ret = -EBUSY;
+                goto out;
+            }
+        }
+    }
+
+    if (period != priv->duty_mult_period) {
+        priv->duty_mult = div64_u64((u64)DUTY_ONE << DUTY_MULT_SHIFT,
+                hps_multi_pwm_period_to_ns(period));
+        priv->duty_mult_period = period;
+    }
+    duty = min_t(u64, mul_u64_u32_shr(state->duty_cycle, priv->duty_mult, DUTY_MULT_SHIFT),
+            DUTY_ONE);
+
+    iowrite32(CTRL_HOLD, priv->base_addr + REG_CTRL_OFFSET);
+    iowrite32(period, priv->base_addr + REG_PERIOD_OFFSET);
+    iowrite32(duty, duty_reg);
+    iowrite32(0, priv->base_addr + REG_CTRL_OFFSET);
+
+out:
+    mutex_unlock(&priv->lock);
+    return ret;
+}
+
+/**
+ * hps_multi_pwm_chip_get_state() - Read back one channel's hardware state.
+ * @chip: PWM chip embedded in our device struct.
+ * @pwm: The channel being read.
+ * @state: State to fill in.
+ */
+static void hps_multi_pwm_chip_get_state(struct pwm_chip *chip, struct pwm_device *pwm,
+    struct pwm_state *state)
+{
+    struct hps_multi_pwm_dev *priv = to_hps_multi_pwm_dev(chip);
+    u32 period = ioread32(priv->base_addr + REG_PERIOD_OFFSET);
+    u32 duty = ioread32(priv->base_addr + REG_DC_OFFSET(pwm->hwpwm));
+
+    state->period = hps_multi_pwm_period_to_ns(period);
+    state->duty_cycle = (state->period * min_t(u32, duty, DUTY_ONE)) >> 12;
+    state->polarity = PWM_POLARITY_NORMAL;
+    state->enabled = period != 0 && duty != 0;
+}
+
+static const struct pwm_ops hps_multi_pwm_chip_ops = {
+    .apply = hps_multi_pwm_chip_apply,
+    .get_state = hps_multi_pwm_chip_get_state,
+    .owner = THIS_MODULE,
+};
+
+/**
+ * hps_multi_pwm_chip_register() - Register with the PWM framework.
+ * @pdev: Platform device structure for the hps_multi_pwm.
+ * @priv: Private hps_multi_pwm device struct.
+ *
+ * The chip is device-managed, so it goes away along with @pdev.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int hps_multi_pwm_chip_register(struct platform_device *pdev,
+    struct hps_multi_pwm_dev *priv)
+{
+    priv->chip.dev = &pdev->dev;
+    priv->chip.ops = &hps_multi_pwm_chip_ops;
+    priv->chip.npwm = priv->num_channels;
+
+    return devm_pwmchip_add(&pdev->dev, &priv->chip);
+}
+
+#else
+
+static int hps_multi_pwm_chip_register(struct platform_device *pdev,
+    struct hps_multi_pwm_dev *priv)
+{
+    pr_warn("Built without CONFIG_PWM; not registering a PWM chip\n");
+    return 0;
+}
+
+#endif
+
+
+//-----------------------------------------------------------------------
+// File Operations mmap()
+//-----------------------------------------------------------------------
+/**
+ * hps_multi_pwm_mmap() - Mmap method for the hps_multi_pwm char device
+ * @file: Pointer to the char device file struct.
+ * @vma: Virtual memory area being mapped.
+ *
+ * Maps the page containing our registers into user-space, so that registers
+ * can be accessed without a system call. Hardware registers are mapped
+ * uncached; the simulated register page is ordinary memory.
+ *
+ * Note that any other components sharing the registers' page are mapped as
+ * well. The char device is only accessible to root by default.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int hps_multi_pwm_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    unsigned long size = vma->vm_end - vma->vm_start;
+    struct hps_multi_pwm_dev *priv = container_of(file->private_data,
+            struct hps_multi_pwm_dev, miscdev);
+
+    // Only the single page holding our registers can be mapped.
+    if (vma->vm_pgoff != 0 || size > PAGE_SIZE) {
+        return -EINVAL;
+    }
+
+    if (simulate) {
+        return remap_pfn_range(vma, vma->vm_start,
+                PHYS_PFN(priv->phys_addr), size, vma->vm_page_prot);
+    }
+
+    vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+    return io_remap_pfn_range(vma, vma->vm_start,
+            PHYS_PFN(priv->phys_addr), size, vma->vm_page_prot);
+}
+
+
+//-----------------------------------------------------------------------
+// File Operations Supported
+//-----------------------------------------------------------------------
+/**
+ * hps_multi_pwm_fops - File operations supported by the hps_multi_pwm driver
+ * @owner: The hps_multi_pwm driver owns the file operations; this ensures that
+ *         the driver can't be removed while the character device is still in
+ *         use.
+ * @read: The read function.
+ * @write: The write function.
+ * @mmap: The mmap function.
+ * @unlocked_ioctl: The ioctl function.
+ * @compat_ioctl: Our ioctl arguments are pointers to fixed-layout structs, so
+ *                32-bit callers on a 64-bit kernel need no translation.
+ * @llseek: We use the kernel's default_llseek() function; this allows users to
+ *          change what position they are writing/reading to/from.
+ */
+static const struct file_operations hps_multi_pwm_fops = {
+    .owner = THIS_MODULE,
+    .read = hps_multi_pwm_read,
+    .write = hps_multi_pwm_write,
+    .mmap = hps_multi_pwm_mmap,
+    .unlocked_ioctl = hps_multi_pwm_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .llseek = default_llseek,
+};
+
+
+//-----------------------------------------------------------------------
+// Duty Cycle Sequencer
+//-----------------------------------------------------------------------
+/**
+ * hps_multi_pwm_seq_room() - Count the frames the sequencer can accept.
+ * @priv: Private hps_multi_pwm device struct.
+ *
+ * Every frame has a value for every channel, so the fullest FIFO decides.
+ *
+ * Return: The number of frames that can be queued without overflowing.
+ */
+static u32 hps_multi_pwm_seq_room(struct hps_multi_pwm_dev *priv)
+{
+    u32 level = ioread32(priv->base_addr + REG_SEQ_STATUS_OFFSET) & SEQ_STATUS_LEVEL;
+
+    return level < priv->seq_depth ? priv->seq_depth - level : 0;
+}
+
+/**
+ * hps_multi_pwm_seq_low() - Check whether the sequencer is at low water.
+ * @priv: Private hps_multi_pwm device struct.
+ *
+ * We compare the level against the mark ourselves, rather than using the
+ * status register's flag, so that simulated registers behave the same way.
+ *
+ * Return: True if the fullest FIFO is at or below the low-water mark.
+ */
+static bool hps_multi_pwm_seq_low(struct hps_multi_pwm_dev *priv)
+{
+    u32 level = ioread32(priv->base_addr + REG_SEQ_STATUS_OFFSET) & SEQ_STATUS_LEVEL;
+
+    return level <= ioread32(priv->base_addr + REG_SEQ_LOW_WATER_OFFSET);
+}
+
+/**
+ * hps_multi_pwm_seq_arm() - Ask to be woken at low water.
+ * @priv: Private hps_multi_pwm device struct.
+ *
+ * The interrupt is level-triggered, so its handler disables it again; anyone
+ * about to wait for room must re-enable it first. Without an interrupt, the
+ * polling timer is always watching while the sequencer device is open.
+ */
+static void hps_multi_pwm_seq_arm(struct hps_multi_pwm_dev *priv)
+{
+    if (priv->seq_irq >= 0) {
+        iowrite32(1, priv->base_addr + REG_SEQ_IRQ_EN_OFFSET);
+    }
+}
+
+/**
+ * hps_multi_pwm_seq_irq() - Low-water interrupt handler.
+ * @irq: Unused.
+ * @dev_id: Private hps_multi_pwm device struct.
+ *
+ * Return: IRQ_HANDLED.
+ */
+static irqreturn_t hps_multi_pwm_seq_irq(int irq, void *dev_id)
+{
+    struct hps_multi_pwm_dev *priv = dev_id;
+
+    iowrite32(0, priv->base_addr + REG_SEQ_IRQ_EN_OFFSET);
+    wake_up_interruptible(&priv->seq_wait);
+    return IRQ_HANDLED;
+}
+
+/**
+ * hps_multi_pwm_seq_poll_timer() - Low-water polling timer callback.
+ * @timer: The seq_poll_timer member of the hps_multi_pwm device struct.
+ *
+ * Stands in for the low-water interrupt on device trees that don't wire it up,
+ * and when simulating.
+ *
+ * Return: HRTIMER_RESTART, to keep polling.
+ */
+static enum hrtimer_restart hps_multi_pwm_seq_poll_timer(struct hrtimer *timer)
+{
+    struct hps_multi_pwm_dev *priv = container_of(timer,
+            struct hps_multi_pwm_dev, seq_poll_timer);
+
+    if (hps_multi_pwm_seq_low(priv)) {
+        wake_up_interruptible(&priv->seq_wait);
+    }
+    hrtimer_forward_now(timer, us_to_ktime(SEQ_POLL_INTERVAL_US));
+    return HRTIMER_RESTART;
+}
+
+/**
+ * hps_multi_pwm_ring_stop() - Stop fetching frames from the ring.
+ * @priv: Private hps_multi_pwm device struct. The caller holds @priv->lock.
+ *
+ * The fetcher always finishes the frame it's working on, so we wait for that
+ * before anyone flushes the FIFOs or reuses the ring.
+ *
+ * Return: Zero on success, or -ETIMEDOUT if the fetcher seems stuck.
+ */
+static int hps_multi_pwm_ring_stop(struct hps_multi_pwm_dev *priv)
+{
+    u32 ctrl;
+
+    iowrite32(0, priv->base_addr + REG_RING_CTRL_OFFSET);
+    priv->ring_running = false;
+    return readx_poll_timeout(ioread32, priv->base_addr + REG_RING_CTRL_OFFSET, ctrl,
+            !(ctrl & RING_CTRL_BUSY), 1, RING_STOP_TIMEOUT_US);
+}
+
+/**
+ * hps_multi_pwm_ring_info() - Report the ring's size, head and tail.
+ * @priv: Private hps_multi_pwm device struct.
+ * @uring: User-space struct to fill in.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static long hps_multi_pwm_ring_info(struct hps_multi_pwm_dev *priv,
+    struct hps_multi_pwm_ring __user *uring)
+{
+    struct hps_multi_pwm_ring ring = {
+        .frames = ring_frames,
+        .frame_size = priv->num_channels * sizeof(u32),
+    };
+
+    // Until the fetcher starts, the registers may hold an old session's state
+    mutex_lock(&priv->lock);
+    if (priv->ring_running) {
+        ring.head = ioread32(priv->base_addr + REG_RING_HEAD_OFFSET);
+        ring.tail = ioread32(priv->base_addr + REG_RING_TAIL_OFFSET);
+    }
+    mutex_unlock(&priv->lock);
+
+    return copy_to_user(uring, &ring, sizeof(ring)) ? -EFAULT : 0;
+}
+
+/**
+ * hps_multi_pwm_ring_publish() - Hand filled ring slots to the hardware.
+ * @priv: Private hps_multi_pwm device struct.
+ * @head: Slot after the last one filled.
+ *
+ * The first publish after open() points the fetcher at the ring and starts it
+ * from slot zero. After that, each publish is a single register write, however
+ * many frames it covers.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static long hps_multi_pwm_ring_publish(struct hps_multi_pwm_dev *priv, u32 head)
+{
+    if (head >= ring_frames) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&priv->lock);
+    iowrite32(head, priv->base_addr + REG_RING_HEAD_OFFSET);
+    if (!priv->ring_running) {
+        iowrite32(lower_32_bits(priv->ring_dma), priv->base_addr + REG_RING_BASE_OFFSET);
+        iowrite32(ring_frames, priv->base_addr + REG_RING_FRAMES_OFFSET);
+        iowrite32(RING_CTRL_ENABLE, priv->base_addr + REG_RING_CTRL_OFFSET);
+        priv->ring_running = true;
+    }
+    mutex_unlock(&priv->lock);
+
+    return 0;
+}
+
+/**
+ * hps_multi_pwm_seq_ioctl() - Ioctl method for the sequencer device
+ * @file: Pointer to the char device file struct.
+ * @cmd: Ioctl command number, from hps_multi_pwm_ioctl.h.
+ * @arg: Command argument.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static long hps_multi_pwm_seq_ioctl(struct file *file, unsigned int cmd,
+    unsigned long arg)
+{
+    struct hps_multi_pwm_dev *priv = container_of(file->private_data,
+            struct hps_multi_pwm_dev, seq_miscdev);
+    u32 head;
+
+    if (!priv->ring_buf) {
+        return -ENOTTY;
+    }
+
+    switch (cmd) {
+    case HPS_MULTI_PWM_IOC_RING_INFO:
+        return hps_multi_pwm_ring_info(priv, (void __user *)arg);
+    case HPS_MULTI_PWM_IOC_RING_PUBLISH:
+        if (get_user(head, (u32 __user *)arg)) {
+            return -EFAULT;
+        }
+        return hps_multi_pwm_ring_publish(priv, head);
+    default:
+        return -ENOTTY;
+    }
+}
+
+/**
+ * hps_multi_pwm_seq_mmap() - Mmap method for the sequencer device
+ * @file: Pointer to the char device file struct.
+ * @vma: Virtual memory area being mapped.
+ *
+ * Maps the frame ring into user-space, so frames can be filled in place and
+ * fetched by the hardware without any copying.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int hps_multi_pwm_seq_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    unsigned long size = vma->vm_end - vma->vm_start;
+    struct hps_multi_pwm_dev *priv = container_of(file->private_data,
+            struct hps_multi_pwm_dev, seq_miscdev);
+
+    if (!priv->ring_buf) {
+        return -ENODEV;
+    }
+    if (vma->vm_pgoff != 0 || size > priv->ring_len) {
+        return -EINVAL;
+    }
+
+    return dma_mmap_coherent(priv->seq_miscdev.parent, vma, priv->ring_buf,
+            priv->ring_dma, size);
+}
+
+/**
+ * hps_multi_pwm_seq_open() - Open method for the sequencer device
+ * @inode: Pointer to the char device inode.
+ * @file: Pointer to the char device file struct.
+ *
+ * Only one writer may stream at a time, so frames from different writers
+ * can't interleave. Opening discards anything left queued by the last one,
+ * whether in the FIFOs or the ring.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int hps_multi_pwm_seq_open(struct inode *inode, struct file *file)
+{
+    struct hps_multi_pwm_dev *priv = container_of(file->private_data,
+            struct hps_multi_pwm_dev, seq_miscdev);
+    int ret = 0;
+
+    if (test_and_set_bit(0, &priv->seq_busy)) {
+        return -EBUSY;
+    }
+
+    mutex_lock(&priv->lock);
+    if (priv->ring_buf) {
+        ret = hps_multi_pwm_ring_stop(priv);
+    }
+    if (!ret) {
+        iowrite32(CTRL_FLUSH, priv->base_addr + REG_CTRL_OFFSET);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        pr_err("Ring fetcher for hps_multi_pwm didn't stop\n");
+        clear_bit(0, &priv->seq_busy);
+        return ret;
+    }
+    if (priv->seq_irq < 0) {
+        hrtimer_start(&priv->seq_poll_timer, us_to_ktime(SEQ_POLL_INTERVAL_US),
+                HRTIMER_MODE_REL);
+    }
+
+    return stream_open(inode, file);
+}
+
+/**
+ * hps_multi_pwm_seq_release() - Release method for the sequencer device
+ * @inode: Unused.
+ * @file: Pointer to the char device file struct.
+ *
+ * Frames already queued keep playing, including any published to the ring;
+ * the next open() discards any leftovers.
+ *
+ * Return: Zero.
+ */
+static int hps_multi_pwm_seq_release(struct inode *inode, struct file *file)
+{
+    struct hps_multi_pwm_dev *priv = container_of(file->private_data,
+            struct hps_multi_pwm_dev, seq_miscdev);
+
+    hrtimer_cancel(&priv->seq_poll_timer);
+    iowrite32(0, priv->base_addr + REG_SEQ_IRQ_EN_OFFSET);
+    clear_bit(0, &priv->seq_busy);
+
+    return 0;
+}
+
+/**
+ * hps_multi_pwm_seq_wait_room() - Wait until the sequencer has room.
+ * @priv: Private hps_multi_pwm device struct.
+ * @nonblock: Fail instead of waiting.
+ *
+ * Return: The number of frames that can be queued, or a negative error value.
+ */
+static long hps_multi_pwm_seq_wait_room(struct hps_multi_pwm_dev *priv, bool nonblock)
+{
+    u32 room = hps_multi_pwm_seq_room(priv);
+
+    if (room) {
+        return room;
+    }
+    if (nonblock) {
+        return -EAGAIN;
+    }
+    hps_multi_pwm_seq_arm(priv);
+    if (wait_event_interruptible(priv->seq_wait, hps_multi_pwm_seq_room(priv) != 0)) {
+        return -ERESTARTSYS;
+    }
+    return hps_multi_pwm_seq_room(priv);
+}
+
+/**
+ * hps_multi_pwm_seq_write() - Write method for the sequencer device
+ * @file: Pointer to the char device file struct.
+ * @buf: User-space buffer of frames, each holding one duty cycle register
+ *       value (u32, UQ2.12) per channel, in channel order.
+ * @count: The number of bytes being written; at least one frame.
+ * @offset: Unused; the stream isn't seekable.
+ *
+ * Queues whole frames, one step of the sequence each. Like a pipe, a blocking
+ * write waits for room until every frame is queued, so a whole fade can be
+ * handed over at once; a non-blocking write queues what fits. Each frame is
+ * written under hold, so the hardware never steps through half of one.
+ *
+ * Return: On success, the number of bytes queued. On error, a negative error
+ *         value is returned.
+ */
+static ssize_t hps_multi_pwm_seq_write(struct file *file, const char __user *buf,
+    size_t count, loff_t *offset)
+{
+    struct hps_multi_pwm_dev *priv = container_of(file->private_data,
+            struct hps_multi_pwm_dev, seq_miscdev);
+    size_t frame_len = priv->num_channels * sizeof(u32);
+    size_t frames, done, i;
+    u32 stack_vals[MAX_BURST_REGS];
+    u32 *vals;
+    long room = 0;
+
+    if (count < frame_len) {
+        return -EINVAL;
+    }
+    if (READ_ONCE(priv->ring_running)) {
+        // Frames pushed now would land in the middle of the ring's
+        return -EBUSY;
+    }
+    frames = count / frame_len;
+
+    vals = hps_multi_pwm_get_burst_buf(stack_vals, frame_len);
+    if (!vals) {
+        return -ENOMEM;
+    }
+
+    for (done = 0; done < frames; done++, room--) {
+        if (room == 0) {
+            room = hps_multi_pwm_seq_wait_room(priv, file->f_flags & O_NONBLOCK);
+            if (room < 0) {
+                break;
+            }
+        }
+
+        if (copy_from_user(vals, buf + done * frame_len, frame_len)) {
+            room = -EFAULT;
+            break;
+        }
+
+        mutex_lock(&priv->lock);
+        iowrite32(CTRL_HOLD, priv->base_addr + REG_CTRL_OFFSET);
+        for (i = 0; i < priv->num_channels; i++) {
+            iowrite32(vals[i], priv->base_addr + REG_SEQ_FIFO_OFFSET(i));
+        }
+        iowrite32(0, priv->base_addr + REG_CTRL_OFFSET);
+        mutex_unlock(&priv->lock);
+    }
+    hps_multi_pwm_put_burst_buf(vals, stack_vals);
+
+    // Report partial progress; errors only matter if nothing was queued
+    if (done) {
+        return done * frame_len;
+    }
+    return room;
+}
+
+/**
+ * hps_multi_pwm_seq_poll() - Poll method for the sequencer device
+ * @file: Pointer to the char device file struct.
+ * @wait: Poll table to register our wait queue with.
+ *
+ * Return: EPOLLOUT at or below the low-water mark, otherwise zero.
+ */
+static __poll_t hps_multi_pwm_seq_poll(struct file *file, poll_table *wait)
+{
+    struct hps_multi_pwm_dev *priv = container_of(file->private_data,
+            struct hps_multi_pwm_dev, seq_miscdev);
+
+    poll_wait(file, &priv->seq_wait, wait);
+    if (hps_multi_pwm_seq_low(priv)) {
+        return EPOLLOUT | EPOLLWRNORM;
+    }
+    hps_multi_pwm_seq_arm(priv);
+    return 0;
+}
+
+/**
+ * hps_multi_pwm_seq_fops - File operations supported by the sequencer device
+ * @owner: The hps_multi_pwm driver owns the file operations.
+ * @open: The open function.
+ * @release: The release function.
+ * @write: The write function.
+ * @poll: The poll function.
+ * @mmap: The mmap function, for the frame ring.
+ * @unlocked_ioctl: The ioctl function, for the frame ring.
+ * @compat_ioctl: As for the main device, no translation is needed.
+ * @llseek: The stream isn't seekable.
+ */
+static const struct file_operations hps_multi_pwm_seq_fops = {
+    .owner = THIS_MODULE,
+    .open = hps_multi_pwm_seq_open,
+    .release = hps_multi_pwm_seq_release,
+    .write = hps_multi_pwm_seq_write,
+    .poll = hps_multi_pwm_seq_poll,
+    .mmap = hps_multi_pwm_seq_mmap,
+    .unlocked_ioctl = hps_multi_pwm_seq_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .llseek = no_llseek,
+};
+
+/**
+ * hps_multi_pwm_seq_init() - Set up the sequencer, if the component has one.
+ * @pdev: Platform device structure for the hps_multi_pwm.
+ * @priv: Private hps_multi_pwm device struct, with registers mapped.
+ *
+ * The FIFO depth comes from the capability register; bitstreams without a
+ * sequencer read it as zero. The low-water interrupt is optional, with a
+ * polling timer as the fallback. The low-water mark starts at half full.
+ *
+ * If the component can fetch frames itself, we also allocate the ring it
+ * fetches from. It's coherent memory, so neither side needs to flush caches.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int hps_multi_pwm_seq_init(struct platform_device *pdev,
+    struct hps_multi_pwm_dev *priv)
+{
+    u32 caps = ioread32(priv->base_addr + REG_CAPS_OFFSET);
+    int ret;
+
+    priv->seq_depth = caps >> CAPS_FIFO_DEPTH_SHIFT;
+    if (!priv->seq_depth) {
+        return 0;
+    }
+
+    if (caps & CAPS_RING) {
+        if (ring_frames < 2 || ring_frames > MAX_RING_FRAMES) {
+            pr_err("Invalid ring size %u\n", ring_frames);
+            return -EINVAL;
+        }
+        // The fetcher has 32-bit addresses
+        ret = dma_set_mask_and_coherent(&pdev->dev, DMA_BIT_MASK(32));
+        if (ret) {
+            return ret;
+        }
+        priv->ring_len = PAGE_ALIGN(ring_frames * priv->num_channels * sizeof(u32));
+        priv->ring_buf = dmam_alloc_coherent(&pdev->dev, priv->ring_len,
+                &priv->ring_dma, GFP_KERNEL);
+        if (!priv->ring_buf) {
+            pr_err("Failed to allocate frame ring for hps_multi_pwm\n");
+            return -ENOMEM;
+        }
+    }
+
+    init_waitqueue_head(&priv->seq_wait);
+    hrtimer_init(&priv->seq_poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    priv->seq_poll_timer.function = hps_multi_pwm_seq_poll_timer;
+    iowrite32(0, priv->base_addr + REG_SEQ_IRQ_EN_OFFSET);
+    iowrite32(priv->seq_depth / 2, priv->base_addr + REG_SEQ_LOW_WATER_OFFSET);
+
+    priv->seq_irq = simulate ? -ENXIO : platform_get_irq_optional(pdev, 0);
+    if (priv->seq_irq >= 0) {
+        ret = devm_request_irq(&pdev->dev, priv->seq_irq, hps_multi_pwm_seq_irq, 0,
+                "hps_multi_pwm", priv);
+        if (ret) {
+            pr_err("Failed to request low-water interrupt for hps_multi_pwm\n");
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+
+//-----------------------------------------------------------------------
+// Gamma Correction
+//-----------------------------------------------------------------------
+/**
+ * hps_multi_pwm_gamma_init() - Set up the gamma correction table, if any.
+ * @pdev: Platform device structure for the hps_multi_pwm.
+ * @priv: Private hps_multi_pwm device struct, with registers mapped.
+ *
+ * The table's block RAM has no reset value, so we load an identity table.
+ * The table stays bypassed, as the hardware resets it, until user-space says
+ * otherwise.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int hps_multi_pwm_gamma_init(struct platform_device *pdev,
+    struct hps_multi_pwm_dev *priv)
+{
+    u16 *identity;
+    size_t i;
+
+    if (!(ioread32(priv->base_addr + REG_CAPS_OFFSET) & CAPS_GAMMA)) {
+        return 0;
+    }
+
+    priv->gamma_table = devm_kcalloc(&pdev->dev, HPS_MULTI_PWM_GAMMA_ENTRIES,
+            sizeof(*priv->gamma_table), GFP_KERNEL);
+    identity = kcalloc(HPS_MULTI_PWM_GAMMA_ENTRIES, sizeof(*identity), GFP_KERNEL);
+    if (!priv->gamma_table || !identity) {
+        kfree(identity);
+        return -ENOMEM;
+    }
+    for (i = 0; i < HPS_MULTI_PWM_GAMMA_ENTRIES; i++) {
+        identity[i] = i;
+    }
+
+    mutex_lock(&priv->lock);
+    hps_multi_pwm_gamma_load(priv, identity);
+    mutex_unlock(&priv->lock);
+
+    kfree(identity);
+    return 0;
+}
+
+
+//-----------------------------------------------------------------------
+// Channel Discovery
+//-----------------------------------------------------------------------
+/**
+ * hps_multi_pwm_discover_channels() - Find out how many channels we have.
+ * @pdev: Platform device structure for the hps_multi_pwm.
+ * @priv: Private hps_multi_pwm device struct, with registers mapped.
+ *
+ * A "lr,num-channels" device tree property takes precedence, for components
+ * whose bitstream we can't (or don't want to) trust. Otherwise we read the
+ * component's capability register. Bitstreams predating that register read
+ * it as zero, so we fall back to the original three channels.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int hps_multi_pwm_discover_channels(struct platform_device *pdev,
+    struct hps_multi_pwm_dev *priv)
+{
+    u32 num_channels;
+
+    if (device_property_read_u32(&pdev->dev, "lr,num-channels", &num_channels)) {
+        num_channels = ioread32(priv->base_addr + REG_CAPS_OFFSET) & CAPS_NUM_CHANNELS;
+        if (num_channels == 0) {
+            num_channels = DEFAULT_NUM_CHANNELS;
+        }
+    }
+    if (num_channels == 0 || num_channels > HPS_MULTI_PWM_MAX_CHANNELS) {
+        pr_err("Invalid channel count %u\n", num_channels);
+        return -EINVAL;
+    }
+
+    priv->num_channels = num_channels;
+    return 0;
+}
+
+
+//-----------------------------------------------------------------------
+// Platform Driver Probe (Initialization) Function
+//-----------------------------------------------------------------------
+/**
+ * hps_multi_pwm_probe() - Initialize device when a match is found
+ * @pdev: Platform device structure associated with our hps_multi_pwm
+ *        device; pdev is automatically created by the driver core based upon
+ *        our hps_multi_pwm device tree node.
+ *
+ * When a device that is compatible with this hps_multi_pwm driver is found,
+ * the driver's probe function is called. This probe function gets called by
+ * the kernel when an hps_multi_pwm device is found in the device tree.
+ */
+static int hps_multi_pwm_probe(struct platform_device *pdev)
 {
     struct hps_multi_pwm_dev *priv;
     int ret;
@@ -387,16 +1988,62 @@ static int hps_multi_pwm_probe(struct platform_device *pdev)
         pr_err("Failed to allocate kernel memory for hps_multi_pwm\n");
         return -ENOMEM;
     }
+    mutex_init(&priv->lock);
 
-    /* Request and remap the device's memory region. Requesting the region
-     * makes sure nobody else can use that memory. The memory is remapped into
-     * the kernel's virtual address space becuase we don't have access to
-     * physical memory locations.
+    /* Attach the hps_multi_pwm's private data to the platform device's
+     * struct. Do this first, since our per-channel attributes become visible
+     * as soon as they're created.
      */
-    priv->base_addr = devm_platform_ioremap_resource(pdev, 0);
-    if (IS_ERR(priv->base_addr)) {
-        pr_err("Failed to request/remap platform device resource (hps_multi_pwm)\n");
-        return PTR_ERR(priv->base_addr);
+    platform_set_drvdata(pdev, priv);
+
+    if (simulate) {
+        /* Use a zeroed page of ordinary memory as our "registers". It's
+         * page-aligned, so mmap() can hand it out directly.
+         */
+        unsigned long page = devm_get_free_pages(&pdev->dev, GFP_KERNEL | __GFP_ZERO, 0);
+        if (!page) {
+            pr_err("Failed to allocate simulated registers for hps_multi_pwm\n");
+            return -ENOMEM;
+        }
+        priv->base_addr = (void __iomem *)page;
+        priv->phys_addr = virt_to_phys((void *)page);
+        // Report the channel count and FIFO depth like the real capability register
+        iowrite32((SIM_FIFO_DEPTH << CAPS_FIFO_DEPTH_SHIFT) | sim_channels,
+                priv->base_addr + REG_CAPS_OFFSET);
+    } else {
+        struct resource *res;
+
+        /* Request and remap the device's memory region. Requesting the region
+         * makes sure nobody else can use that memory. The memory is remapped into
+         * the kernel's virtual address space becuase we don't have access to
+         * physical memory locations.
+         */
+        priv->base_addr = devm_platform_get_and_ioremap_resource(pdev, 0, &res);
+        if (IS_ERR(priv->base_addr)) {
+            pr_err("Failed to request/remap platform device resource (hps_multi_pwm)\n");
+            return PTR_ERR(priv->base_addr);
+        }
+        priv->phys_addr = res->start;
+    }
+
+    // Size everything per-channel to match the hardware
+    ret = hps_multi_pwm_discover_channels(pdev, priv);
+    if (ret) {
+        return ret;
+    }
+    ret = hps_multi_pwm_seq_init(pdev, priv);
+    if (ret) {
+        return ret;
+    }
+    priv->passthrough = ioread32(priv->base_addr + REG_CAPS_OFFSET) & CAPS_PASSTHROUGH;
+    ret = hps_multi_pwm_gamma_init(pdev, priv);
+    if (ret) {
+        return ret;
+    }
+    ret = hps_multi_pwm_create_attrs(pdev, priv);
+    if (ret) {
+        pr_err("Failed to create sysfs attributes for hps_multi_pwm\n");
+        return ret;
     }
 
     // Initialize the misc device parameters
@@ -404,7 +2051,7 @@ static int hps_multi_pwm_probe(struct platform_device *pdev)
     priv->miscdev.name = "hps_multi_pwm";
     priv->miscdev.fops = &hps_multi_pwm_fops;
     priv->miscdev.parent = &pdev->dev;
-    priv->miscdev.groups = hps_multi_pwm_groups;
+    priv->miscdev.groups = priv->groups;
 
     // Register the misc device; this creates a char dev at /dev/hps_multi_pwm
     ret = misc_register(&priv->miscdev);
@@ -413,13 +2060,37 @@ static int hps_multi_pwm_probe(struct platform_device *pdev)
         return ret;
     }
 
-    // Attach the hps_multi_pwm's private data to the platform device's
-    // struct.
-    platform_set_drvdata(pdev, priv);
+    // Register the sequencer device at /dev/hps_multi_pwm_seq, if we have one
+    if (priv->seq_depth) {
+        priv->seq_miscdev.minor = MISC_DYNAMIC_MINOR;
+        priv->seq_miscdev.name = "hps_multi_pwm_seq";
+        priv->seq_miscdev.fops = &hps_multi_pwm_seq_fops;
+        priv->seq_miscdev.parent = &pdev->dev;
+        ret = misc_register(&priv->seq_miscdev);
+        if (ret) {
+            pr_err("Failed to register sequencer misc device for hps_multi_pwm\n");
+            goto err_deregister;
+        }
+    }
+
+    // Register with the PWM framework as well, for in-kernel consumers
+    ret = hps_multi_pwm_chip_register(pdev, priv);
+    if (ret) {
+        pr_err("Failed to register PWM chip for hps_multi_pwm\n");
+        goto err_deregister_seq;
+    }
 
-    pr_info("hps_multi_pwm probed successfully\n");
+    pr_info("hps_multi_pwm probed successfully with %u channels\n", priv->num_channels);
 
     return 0;
+
+err_deregister_seq:
+    if (priv->seq_depth) {
+        misc_deregister(&priv->seq_miscdev);
+    }
+err_deregister:
+    misc_deregister(&priv->miscdev);
+    return ret;
 }
 
 //-----------------------------------------------------------------------
@@ -437,7 +2108,18 @@ static int hps_multi_pwm_remove(struct platform_device *pdev)
     // Get the hps_multi_pwm's private data from the platform device.
     struct hps_multi_pwm_dev *priv = platform_get_drvdata(pdev);
 
-    // Deregister the misc device and remove the /dev/hps_multi_pwm file.
+    // Deregister the misc devices and remove their /dev files.
+    if (priv->seq_depth) {
+        misc_deregister(&priv->seq_miscdev);
+        // Make sure the polling timer can't outlive us, and the hardware
+        // doesn't keep reading the ring once it's freed.
+        hrtimer_cancel(&priv->seq_poll_timer);
+        if (priv->ring_buf) {
+            mutex_lock(&priv->lock);
+            hps_multi_pwm_ring_stop(priv);
+            mutex_unlock(&priv->lock);
+        }
+    }
     misc_deregister(&priv->miscdev);
 
     pr_info("hps_multi_pwm removed successfully\n");
@@ -487,10 +2169,48 @@ static struct platform_driver hps_multi_pwm_driver = {
     },
 };
 
-/* We don't need to do anything special in module init/exit. This macro
- * automatically handles module init/exit.
+//-----------------------------------------------------------------------
+// Module Init/Exit
+//-----------------------------------------------------------------------
+// Stand-in platform device, only created when simulating
+static struct platform_device *hps_multi_pwm_sim_pdev;
+
+/**
+ * hps_multi_pwm_init() - Register the platform driver
+ *
+ * In simulation mode, there's no device tree node to match against, so we
+ * also register a platform device by name to trigger a probe.
+ *
+ * Return: Zero on success, or a negative error value.
+ */
+static int __init hps_multi_pwm_init(void)
+{
+    int ret = platform_driver_register(&hps_multi_pwm_driver);
+    if (ret || !simulate) {
+        return ret;
+    }
+
+    hps_multi_pwm_sim_pdev = platform_device_register_simple("hps_multi_pwm",
+            PLATFORM_DEVID_NONE, NULL, 0);
+    if (IS_ERR(hps_multi_pwm_sim_pdev)) {
+        platform_driver_unregister(&hps_multi_pwm_driver);
+        return PTR_ERR(hps_multi_pwm_sim_pdev);
+    }
+    return 0;
+}
+module_init(hps_multi_pwm_init);
+
+/**
+ * hps_multi_pwm_exit() - Unregister the platform driver (and stand-in device)
  */
-module_platform_driver(hps_multi_pwm_driver);
+static void __exit hps_multi_pwm_exit(void)
+{
+    if (hps_multi_pwm_sim_pdev) {
+        platform_device_unregister(hps_multi_pwm_sim_pdev);
+    }
+    platform_driver_unregister(&hps_multi_pwm_driver);
+}
+module_exit(hps_multi_pwm_exit);
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("Lucas Ritzdorf");  // Adapted from Ross Snider and Trevor Vannoy's Echo Driver
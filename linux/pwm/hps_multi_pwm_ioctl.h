@@ -0,0 +1,74 @@
+#ifndef HPS_MULTI_PWM_IOCTL_H
+#define HPS_MULTI_PWM_IOCTL_H
+
+// ioctl interface for the hps_multi_pwm char device, shared with user-space
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+// Upper bound on duty cycle registers in the component's register map
+#define HPS_MULTI_PWM_MAX_CHANNELS 255
+
+/**
+ * struct hps_multi_pwm_config - Complete PWM configuration, applied atomically.
+ * @period: Period register value (milliseconds, UQ10.7)
+ * @num_channels: Number of valid entries in @duty_cycles, starting at channel 1
+ * @duty_cycles: Duty cycle register values (UQ2.12)
+ *
+ * Only the first @num_channels duty cycles are read, so callers need not
+ * allocate the whole array.
+ */
+struct hps_multi_pwm_config {
+    __u32 period;
+    __u32 num_channels;
+    __u32 duty_cycles[HPS_MULTI_PWM_MAX_CHANNELS];
+};
+
+#define HPS_MULTI_PWM_IOC_MAGIC 'P'
+// Write a period and set of duty cycles, taking effect together at the next
+// PWM period boundary
+#define HPS_MULTI_PWM_IOC_APPLY _IOW(HPS_MULTI_PWM_IOC_MAGIC, 1, struct hps_multi_pwm_config)
+
+/**
+ * struct hps_multi_pwm_ring - State of the sequencer's frame ring.
+ * @frames: Number of frame slots in the ring; one always stays empty
+ * @frame_size: Bytes per frame: one __u32 duty cycle per channel
+ * @head: Next slot user-space will fill, as last published
+ * @tail: Next slot the hardware will fetch
+ *
+ * The ring is mmap()ed from /dev/hps_multi_pwm_seq. Slots from @tail up to
+ * (but not including) @head are owned by the hardware; the rest are free.
+ */
+struct hps_multi_pwm_ring {
+    __u32 frames;
+    __u32 frame_size;
+    __u32 head;
+    __u32 tail;
+};
+
+// Read the ring's size and current head and tail (sequencer device only)
+#define HPS_MULTI_PWM_IOC_RING_INFO _IOR(HPS_MULTI_PWM_IOC_MAGIC, 2, struct hps_multi_pwm_ring)
+// Hand the slots up to a new head to the hardware, starting the fetcher on
+// first use (sequencer device only)
+#define HPS_MULTI_PWM_IOC_RING_PUBLISH _IOW(HPS_MULTI_PWM_IOC_MAGIC, 3, __u32)
+
+// Entries in the gamma correction table
+#define HPS_MULTI_PWM_GAMMA_ENTRIES 4096
+
+/**
+ * struct hps_multi_pwm_gamma - Gamma correction table.
+ * @table: Duty cycle (UQ2.12) the outputs use for each duty cycle register
+ *         value below full scale; larger entries saturate to full scale
+ *
+ * A full-scale duty cycle always passes through unchanged.
+ */
+struct hps_multi_pwm_gamma {
+    __u16 table[HPS_MULTI_PWM_GAMMA_ENTRIES];
+};
+
+// Load the whole gamma correction table in one go
+#define HPS_MULTI_PWM_IOC_SET_GAMMA _IOW(HPS_MULTI_PWM_IOC_MAGIC, 4, struct hps_multi_pwm_gamma)
+// Read back the gamma correction table last loaded
+#define HPS_MULTI_PWM_IOC_GET_GAMMA _IOR(HPS_MULTI_PWM_IOC_MAGIC, 5, struct hps_multi_pwm_gamma)
+
+#endif
@@ -3,11 +3,70 @@
 
 // Define register offsets for the component
 #define REG_PERIOD_OFFSET 0x0
-#define REG_DC1_OFFSET 0x4
-#define REG_DC2_OFFSET 0x8
-#define REG_DC3_OFFSET 0xC
+#define REG_DC_OFFSET(n) (0x4 * ((n) + 1)) // Zero-based channel index
+
+// Control/status block
+#define REG_CTRL_OFFSET 0x400
+#define CTRL_HOLD 0x1 // Defer commit of period and duty cycles while set
+#define CTRL_FLUSH 0x2 // Empty every sequencer FIFO (self-clearing)
+// Read-only capabilities: the component's NUM_CHANNELS and FIFO_DEPTH generics
+#define REG_CAPS_OFFSET 0x404
+#define CAPS_NUM_CHANNELS 0xFF
+#define CAPS_RING 0x100 // Component can fetch frames from a ring in memory
+#define CAPS_PASSTHROUGH 0x200 // Component can drive duty cycles from the ADC
+#define CAPS_GAMMA 0x400 // Component has a gamma correction table
+#define CAPS_FIFO_DEPTH_SHIFT 16 // Zero if the component has no sequencer
+// Channel count assumed for bitstreams without a capability register
+#define DEFAULT_NUM_CHANNELS 3
+
+// Duty cycle sequencer
+#define REG_SEQ_DIVIDER_OFFSET 0x408 // PWM periods per step
+#define REG_SEQ_LOW_WATER_OFFSET 0x40C
+#define REG_SEQ_STATUS_OFFSET 0x410
+#define SEQ_STATUS_LEVEL 0xFFFF // Level of the fullest FIFO
+#define SEQ_STATUS_LOW 0x10000 // Fullest level is at or below the low-water mark
+#define SEQ_STATUS_OVERFLOW 0x20000 // A write was dropped (sticky until flushed)
+#define REG_SEQ_IRQ_EN_OFFSET 0x414
+#define REG_SEQ_FIFO_OFFSET(n) (0x800 + 0x4 * (n)) // Write queues, read gives level
+// Frame ring in memory, fetched into the sequencer FIFOs
+#define REG_RING_BASE_OFFSET 0x418 // Bus address of the first frame
+#define REG_RING_FRAMES_OFFSET 0x41C
+#define REG_RING_HEAD_OFFSET 0x420 // Frame index software will fill next
+#define REG_RING_TAIL_OFFSET 0x424 // Frame index hardware will fetch next
+#define REG_RING_CTRL_OFFSET 0x428
+#define RING_CTRL_ENABLE 0x1 // Enabling resets the tail to zero
+#define RING_CTRL_BUSY 0x2 // A frame is partway through being fetched
+#define MAX_RING_FRAMES 0xFFFF
+// Default ring size, in frames
+#define DEFAULT_RING_FRAMES 1024
+// How long to wait for the fetcher to finish a frame when stopping it
+#define RING_STOP_TIMEOUT_US 100
+// FIFO depth reported by the simulated capability register
+#define SIM_FIFO_DEPTH 256
+// Low-water polling interval, when there's no sequencer interrupt
+#define SEQ_POLL_INTERVAL_US 1000
+
+// ADC passthrough: duty cycle = reading * gain / 1024 + offset, saturated
+#define REG_PASS_CTRL_OFFSET 0x42C // Bit 0 enables all configured channels
+#define REG_PASS_CONFIG_OFFSET(n) (0xC00 + 0x4 * (n)) // Zero-based channel index
+#define PASS_SOURCE 0x7 // ADC channel
+#define PASS_ON 0x8
+#define PASS_OFFSET_SHIFT 4 // Signed 14-bit, in duty cycle units (1/4096)
+#define PASS_GAIN_SHIFT 18 // Signed 14-bit, in 1/1024
+#define PASS_FIELD_MASK 0x3FFF
+#define PASS_FIELD_MIN (-0x2000)
+#define PASS_FIELD_MAX 0x1FFF
+#define ADC_CHANNELS 8
+
+// Gamma correction table, between the duty cycle registers and the outputs
+#define REG_GAMMA_CTRL_OFFSET 0x430
+#define GAMMA_CTRL_BYPASS 0x1 // Outputs ignore the table; set at reset
+#define REG_GAMMA_INDEX_OFFSET 0x434 // Table entry the data port writes next
+#define REG_GAMMA_DATA_OFFSET 0x438 // Writes an entry, then advances the index
 
 // Memory span of all registers (used or not) in the component
-#define SPAN 0x10
+#define SPAN 0x1000
+// Number of registers moved by one read() or write() without allocating
+#define MAX_BURST_REGS 64
 
 #endif
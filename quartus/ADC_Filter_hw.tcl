@@ -0,0 +1,160 @@
+# TCL File Generated by Component Editor 21.1
+# Thu Nov 09 03:10:16 MST 2023
+# DO NOT MODIFY
+
+
+# 
+# ADC_Filter "ADC_Filter" v1.0
+# Lucas Ritzdorf 2023.11.09.03:10:16
+# ADC Channel Filter
+# 
+
+# 
+# request TCL package from ACDS 16.1
+# 
+package require -exact qsys 16.1
+
+
+# 
+# module ADC_Filter
+# 
+set_module_property DESCRIPTION "ADC Channel Filter"
+set_module_property NAME ADC_Filter
+set_module_property VERSION 1.0
+set_module_property INTERNAL false
+set_module_property OPAQUE_ADDRESS_MAP true
+set_module_property GROUP Peripherals
+set_module_property AUTHOR "Lucas Ritzdorf"
+set_module_property DISPLAY_NAME ADC_Filter
+set_module_property INSTANTIATE_IN_SYSTEM_MODULE true
+set_module_property EDITABLE true
+set_module_property REPORT_TO_TALKBACK false
+set_module_property ALLOW_GREYBOX_GENERATION false
+set_module_property REPORT_HIERARCHY false
+
+
+# 
+# file sets
+# 
+add_fileset QUARTUS_SYNTH QUARTUS_SYNTH "" ""
+set_fileset_property QUARTUS_SYNTH TOP_LEVEL ADC_Filter
+set_fileset_property QUARTUS_SYNTH ENABLE_RELATIVE_INCLUDE_PATHS false
+set_fileset_property QUARTUS_SYNTH ENABLE_FILE_OVERWRITE_MODE false
+add_fileset_file adc_filter.vhd VHDL PATH ../hw/adc_filter.vhd TOP_LEVEL_FILE
+
+
+# 
+# parameters
+# 
+add_parameter SYS_CLKs_sec POSITIVE 50000000
+set_parameter_property SYS_CLKs_sec DEFAULT_VALUE 50000000
+set_parameter_property SYS_CLKs_sec DISPLAY_NAME SYS_CLKs_sec
+set_parameter_property SYS_CLKs_sec TYPE POSITIVE
+set_parameter_property SYS_CLKs_sec UNITS None
+set_parameter_property SYS_CLKs_sec ALLOWED_RANGES 1:2147483647
+set_parameter_property SYS_CLKs_sec HDL_PARAMETER true
+
+
+# 
+# display items
+# 
+
+
+# 
+# connection point clock
+# 
+add_interface clock clock end
+set_interface_property clock clockRate 0
+set_interface_property clock ENABLED true
+set_interface_property clock EXPORT_OF ""
+set_interface_property clock PORT_NAME_MAP ""
+set_interface_property clock CMSIS_SVD_VARIABLES ""
+set_interface_property clock SVD_ADDRESS_GROUP ""
+
+add_interface_port clock clk clk Input 1
+
+
+# 
+# connection point reset
+# 
+add_interface reset reset end
+set_interface_property reset associatedClock clock
+set_interface_property reset synchronousEdges DEASSERT
+set_interface_property reset ENABLED true
+set_interface_property reset EXPORT_OF ""
+set_interface_property reset PORT_NAME_MAP ""
+set_interface_property reset CMSIS_SVD_VARIABLES ""
+set_interface_property reset SVD_ADDRESS_GROUP ""
+
+add_interface_port reset reset reset Input 1
+
+
+# 
+# connection point s1
+# 
+add_interface s1 avalon end
+set_interface_property s1 addressUnits WORDS
+set_interface_property s1 associatedClock clock
+set_interface_property s1 associatedReset reset
+set_interface_property s1 bitsPerSymbol 8
+set_interface_property s1 burstOnBurstBoundariesOnly false
+set_interface_property s1 burstcountUnits WORDS
+set_interface_property s1 explicitAddressSpan 0
+set_interface_property s1 holdTime 0
+set_interface_property s1 linewrapBursts false
+set_interface_property s1 maximumPendingReadTransactions 0
+set_interface_property s1 maximumPendingWriteTransactions 0
+set_interface_property s1 readLatency 0
+set_interface_property s1 readWaitTime 1
+set_interface_property s1 setupTime 0
+set_interface_property s1 timingUnits Cycles
+set_interface_property s1 writeWaitTime 0
+set_interface_property s1 ENABLED true
+set_interface_property s1 EXPORT_OF ""
+set_interface_property s1 PORT_NAME_MAP ""
+set_interface_property s1 CMSIS_SVD_VARIABLES ""
+set_interface_property s1 SVD_ADDRESS_GROUP ""
+
+add_interface_port s1 avs_s1_read read Input 1
+add_interface_port s1 avs_s1_write write Input 1
+add_interface_port s1 avs_s1_address address Input 5
+add_interface_port s1 avs_s1_readdata readdata Output 32
+add_interface_port s1 avs_s1_writedata writedata Input 32
+set_interface_assignment s1 embeddedsw.configuration.isFlash 0
+set_interface_assignment s1 embeddedsw.configuration.isMemoryDevice 0
+set_interface_assignment s1 embeddedsw.configuration.isNonVolatileStorage 0
+set_interface_assignment s1 embeddedsw.configuration.isPrintableDevice 0
+
+
+# 
+# connection point adc
+# 
+add_interface adc avalon start
+set_interface_property adc addressUnits SYMBOLS
+set_interface_property adc associatedClock clock
+set_interface_property adc associatedReset reset
+set_interface_property adc bitsPerSymbol 8
+set_interface_property adc burstOnBurstBoundariesOnly false
+set_interface_property adc burstcountUnits WORDS
+set_interface_property adc doStreamReads false
+set_interface_property adc doStreamWrites false
+set_interface_property adc holdTime 0
+set_interface_property adc linewrapBursts false
+set_interface_property adc maximumPendingReadTransactions 0
+set_interface_property adc maximumPendingWriteTransactions 0
+set_interface_property adc readLatency 0
+set_interface_property adc readWaitTime 1
+set_interface_property adc setupTime 0
+set_interface_property adc timingUnits Cycles
+set_interface_property adc writeWaitTime 0
+set_interface_property adc ENABLED true
+set_interface_property adc EXPORT_OF ""
+set_interface_property adc PORT_NAME_MAP ""
+set_interface_property adc CMSIS_SVD_VARIABLES ""
+set_interface_property adc SVD_ADDRESS_GROUP ""
+
+add_interface_port adc avm_adc_address address Output 5
+add_interface_port adc avm_adc_read read Output 1
+add_interface_port adc avm_adc_readdata readdata Input 32
+add_interface_port adc avm_adc_waitrequest waitrequest Input 1
+add_interface_port adc avm_adc_readdatavalid readdatavalid Input 1
@@ -47,8 +47,8 @@ add_fileset_file hps_multi_pwm.vhd VHDL PATH ../hw/hps_multi_pwm.vhd TOP_LEVEL_F
 # 
 # parameters
 # 
-add_parameter ADDR_WIDTH POSITIVE 1 ""
-set_parameter_property ADDR_WIDTH DEFAULT_VALUE 1
+add_parameter ADDR_WIDTH POSITIVE 10 ""
+set_parameter_property ADDR_WIDTH DEFAULT_VALUE 10
 set_parameter_property ADDR_WIDTH DISPLAY_NAME ADDR_WIDTH
 set_parameter_property ADDR_WIDTH TYPE POSITIVE
 set_parameter_property ADDR_WIDTH UNITS None
@@ -63,6 +63,14 @@ set_parameter_property NUM_CHANNELS UNITS None
 set_parameter_property NUM_CHANNELS ALLOWED_RANGES 1:2147483647
 set_parameter_property NUM_CHANNELS DESCRIPTION ""
 set_parameter_property NUM_CHANNELS HDL_PARAMETER true
+add_parameter FIFO_DEPTH POSITIVE 256 ""
+set_parameter_property FIFO_DEPTH DEFAULT_VALUE 256
+set_parameter_property FIFO_DEPTH DISPLAY_NAME FIFO_DEPTH
+set_parameter_property FIFO_DEPTH TYPE POSITIVE
+set_parameter_property FIFO_DEPTH UNITS None
+set_parameter_property FIFO_DEPTH ALLOWED_RANGES {2 4 8 16 32 64 128 256 512 1024 2048 4096 8192 16384 32768}
+set_parameter_property FIFO_DEPTH DESCRIPTION ""
+set_parameter_property FIFO_DEPTH HDL_PARAMETER true
 add_parameter SYS_CLKs_sec POSITIVE 50000000
 set_parameter_property SYS_CLKs_sec DEFAULT_VALUE 50000000
 set_parameter_property SYS_CLKs_sec DISPLAY_NAME SYS_CLKs_sec
@@ -143,6 +151,92 @@ set_interface_assignment s1 embeddedsw.configuration.isNonVolatileStorage 0
 set_interface_assignment s1 embeddedsw.configuration.isPrintableDevice 0
 
 
+# 
+# connection point m1
+# 
+add_interface m1 avalon start
+set_interface_property m1 addressUnits SYMBOLS
+set_interface_property m1 associatedClock clock
+set_interface_property m1 associatedReset reset
+set_interface_property m1 bitsPerSymbol 8
+set_interface_property m1 burstOnBurstBoundariesOnly false
+set_interface_property m1 burstcountUnits WORDS
+set_interface_property m1 doStreamReads false
+set_interface_property m1 doStreamWrites false
+set_interface_property m1 holdTime 0
+set_interface_property m1 linewrapBursts false
+set_interface_property m1 maximumPendingReadTransactions 0
+set_interface_property m1 maximumPendingWriteTransactions 0
+set_interface_property m1 readLatency 0
+set_interface_property m1 readWaitTime 1
+set_interface_property m1 setupTime 0
+set_interface_property m1 timingUnits Cycles
+set_interface_property m1 writeWaitTime 0
+set_interface_property m1 ENABLED true
+set_interface_property m1 EXPORT_OF ""
+set_interface_property m1 PORT_NAME_MAP ""
+set_interface_property m1 CMSIS_SVD_VARIABLES ""
+set_interface_property m1 SVD_ADDRESS_GROUP ""
+
+add_interface_port m1 avm_m1_address address Output 32
+add_interface_port m1 avm_m1_read read Output 1
+add_interface_port m1 avm_m1_readdata readdata Input 32
+add_interface_port m1 avm_m1_waitrequest waitrequest Input 1
+add_interface_port m1 avm_m1_readdatavalid readdatavalid Input 1
+
+
+# 
+# connection point adc
+# 
+add_interface adc avalon start
+set_interface_property adc addressUnits SYMBOLS
+set_interface_property adc associatedClock clock
+set_interface_property adc associatedReset reset
+set_interface_property adc bitsPerSymbol 8
+set_interface_property adc burstOnBurstBoundariesOnly false
+set_interface_property adc burstcountUnits WORDS
+set_interface_property adc doStreamReads false
+set_interface_property adc doStreamWrites false
+set_interface_property adc holdTime 0
+set_interface_property adc linewrapBursts false
+set_interface_property adc maximumPendingReadTransactions 0
+set_interface_property adc maximumPendingWriteTransactions 0
+set_interface_property adc readLatency 0
+set_interface_property adc readWaitTime 1
+set_interface_property adc setupTime 0
+set_interface_property adc timingUnits Cycles
+set_interface_property adc writeWaitTime 0
+set_interface_property adc ENABLED true
+set_interface_property adc EXPORT_OF ""
+set_interface_property adc PORT_NAME_MAP ""
+set_interface_property adc CMSIS_SVD_VARIABLES ""
+set_interface_property adc SVD_ADDRESS_GROUP ""
+
+add_interface_port adc avm_adc_address address Output 5
+add_interface_port adc avm_adc_read read Output 1
+add_interface_port adc avm_adc_readdata readdata Input 32
+add_interface_port adc avm_adc_waitrequest waitrequest Input 1
+add_interface_port adc avm_adc_readdatavalid readdatavalid Input 1
+
+
+# 
+# connection point irq
+# 
+add_interface irq interrupt end
+set_interface_property irq associatedAddressablePoint s1
+set_interface_property irq associatedClock clock
+set_interface_property irq associatedReset reset
+set_interface_property irq bridgedReceiverOffset ""
+set_interface_property irq bridgesToReceiver ""
+set_interface_property irq ENABLED true
+set_interface_property irq EXPORT_OF ""
+set_interface_property irq PORT_NAME_MAP ""
+set_interface_property irq CMSIS_SVD_VARIABLES ""
+set_interface_property irq SVD_ADDRESS_GROUP ""
+
+add_interface_port irq irq irq Output 1
+
+
 # 
 # connection point pwms
 # 
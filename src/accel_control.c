@@ -8,99 +8,146 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <glob.h>
+#include <math.h>
 #include <fcntl.h>
 #include <libevdev-1.0/libevdev/libevdev.h>
 #include <signal.h>
-#include <math.h>
-#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "backend.h"
+#include "accel_input.h"
+#include "accel_pipeline.h"
+#include "control_shm.h"
+#include "orientation.h"
+#include "rt.h"
 
 // Configuration constants
 #define SYSID_VERSION 0x3ADC37ED
-#define ADC_PATH "/sys/class/misc/adc_controller"
-#define PWM_PATH "/sys/class/misc/hps_multi_pwm"
 #define ACCEL_INPUT_DEV "/dev/input/event0"
 #define PERIOD 0x100 // 2ms
-#define NUM_CHANNELS 3
+#define NUM_CHANNELS 3 // Red, green, and blue
+#define DEFAULT_TICK_HZ 1000 // Control loop rate
+#define MAX_TICK_HZ 100000
 
 
 // Preprocessor macros for stringification
 #define xstr(s) str(s)
 #define str(s) #s
 
-// Interrupt tracker for main loop
-static volatile sig_atomic_t interrupted = false;
-// And its associated handler function
-static void ctrl_c(int _) {
+// Control loop, stopped by the signal handler
+static struct accel_pipeline pipeline;
+static void stop(int _) {
     (void)_;
-    interrupted = true;
+    accel_pipeline_stop(&pipeline);
 }
 
-// Helper function, so we don't have to seek and flush repeatedly
-int dev_fprintf(FILE *restrict stream, const char *restrict format, ...) {
-    rewind(stream);
-    va_list args;
-    va_start(args, format);
-    int bytes = vfprintf(stream, format, args);
-    va_end(args);
-    fflush(stream);
-    return bytes;
+// Monotonic timestamp helper, in seconds
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
-// Helper function, so we don't have to seek repeatedly
-int dev_fscanf(FILE *restrict stream, const char *restrict format, ...) {
-    freopen(NULL, "r", stream);  // Must re-open device file to update its contents
-    va_list args;
-    va_start(args, format);
-    int result = vfscanf(stream, format, args);
-    va_end(args);
-    return result;
+/* Parse the orientation filter option, "weight[,decimation]", where weight is
+ * that of each new sample, from 0 (exclusive) to 1. Returns -1 if the option
+ * is malformed.
+ */
+static int parse_filter_option(const char *arg, struct orient_config *config) {
+    char *end;
+    double weight = strtod(arg, &end);
+    if (end == arg || !(weight > 0 && weight <= 1)) return -1;
+    config->gain = lround(weight * ORIENT_GAIN_ONE);
+    if (config->gain == 0) config->gain = 1;
+    if (*end == ',') {
+        const char *decimation = end + 1;
+        config->decimation = strtoul(decimation, &end, 0);
+        if (end == decimation || config->decimation == 0) return -1;
+    }
+    return *end == '\0' ? 0 : -1;
 }
 
-// HSL to RGB conversion helper
-void hsl2rgb(const float *hsl, float *rgb) {
-    // Based on https://en.wikipedia.org/wiki/HSL_and_HSV#HSL_to_RGB
-    float chroma = (1 - fabsf(2 * hsl[2] - 1)) * hsl[1];
-    float h_prime = hsl[0] / (M_PI/3);
-    float other_comp = chroma * (1 - fabsf(fmodf(h_prime, 2) - 1));
-    // Assign color components
-    if        (h_prime < 1) {
-        rgb[0] = chroma;
-        rgb[1] = other_comp;
-        rgb[2] = 0;
-    } else if (h_prime < 2) {
-        rgb[0] = other_comp;
-        rgb[1] = chroma;
-        rgb[2] = 0;
-    } else if (h_prime < 3) {
-        rgb[0] = 0;
-        rgb[1] = chroma;
-        rgb[2] = other_comp;
-    } else if (h_prime < 4) {
-        rgb[0] = 0;
-        rgb[1] = other_comp;
-        rgb[2] = chroma;
-    } else if (h_prime < 5) {
-        rgb[0] = other_comp;
-        rgb[1] = 0;
-        rgb[2] = chroma;
-    } else  /* h_prime < 6 */ {
-        rgb[0] = chroma;
-        rgb[1] = 0;
-        rgb[2] = other_comp;
-    }
-    // Match lightness
-    float m = hsl[2] - (chroma/2);
-    rgb[0] += m;
-    rgb[1] += m;
-    rgb[2] += m;
-    return;
+// Print mean and maximum latency, in microseconds
+static void print_latency(const char *what, const struct pipeline_latency *lat) {
+    if (lat->count == 0) return;
+    printf("%s latency: mean %.1f us, max %.1f us over %lu samples\n",
+           what, lat->sum_ns / lat->count * 1e-3, lat->max_ns * 1e-3, lat->count);
 }
 
 
 int main(int argc, char** argv) {
 
-    { // Check System ID
+    // Parse command-line options
+    unsigned long tick_hz = DEFAULT_TICK_HZ;
+    const char *backend_name = DEFAULT_BACKEND;
+    const char *input_path = ACCEL_INPUT_DEV;
+    bool threaded = true;
+    const char *shm_name = NULL;
+    bool detach = false;
+    int rt_priority = 0;
+    bool filtered = false;
+    struct orient_config filter_config;
+    orient_default_config(&filter_config);
+    int opt;
+    while ((opt = getopt(argc, argv, "r:b:i:sS:DR:f:")) != -1) {
+        switch (opt) {
+            case 'b':
+                backend_name = optarg;
+                break;
+            case 'i':
+                // Accelerometer input; an evdev device, or a pipe ("-" for stdin)
+                input_path = optarg;
+                break;
+            case 'r':
+                // Control tick rate, in Hz
+                tick_hz = strtoul(optarg, NULL, 0);
+                if (tick_hz == 0 || tick_hz > MAX_TICK_HZ) {
+                    fprintf(stderr, "Tick rate must be between 1 and " xstr(MAX_TICK_HZ) " Hz!\n");
+                    return 1;
+                }
+                break;
+            case 's':
+                // Run every stage on one thread, as before the pipeline split
+                threaded = false;
+                break;
+            case 'S':
+                // Shared-memory telemetry and command segment, e.g. /accel_control
+                shm_name = optarg;
+                break;
+            case 'D':
+                // Run as a daemon, in the background
+                detach = true;
+                break;
+            case 'R':
+                // Real-time mode, at this SCHED_FIFO priority
+                rt_priority = strtol(optarg, NULL, 0);
+                if (rt_priority < 1 || rt_priority > 99) {
+                    fprintf(stderr, "Real-time priority must be between 1 and 99!\n");
+                    return 1;
+                }
+                break;
+            case 'f':
+                // Orientation filter, instead of raw readings
+                if (parse_filter_option(optarg, &filter_config) < 0) {
+                    fprintf(stderr, "Filter must be given as weight[,decimation], with weight in (0, 1]!\n");
+                    return 1;
+                }
+                filtered = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r tick_hz] [-i input] [-s] [-S shm_name] [-D] [-R rt_priority]"
+                                " [-f weight[,decimation]] [-b ", argv[0]);
+                backend_print_names(stderr);
+                fprintf(stderr, "]\n");
+                return 1;
+        }
+    }
+
+    if (backend_needs_hardware(backend_name)) { // Check System ID
         // Scan for valid device files
         glob_t globbuf;
         if (glob("/sys/bus/platform/devices/*.sysid/sysid/id", GLOB_NOSORT, NULL, &globbuf) == GLOB_NOMATCH) {
@@ -133,150 +180,124 @@ int main(int argc, char** argv) {
         printf("Found matching System ID 0x%X\n", SYSID_VERSION);
     }
 
-    struct libevdev *accel = NULL;
+    struct accel_input accel = { .dev = NULL, .fd = -1 };
     { // Verify accelerometer presence
-        int accel_fd = open(ACCEL_INPUT_DEV, O_RDONLY|O_NONBLOCK);
-        if (libevdev_new_from_fd(accel_fd, &accel) < 0) {
-            fprintf(stderr, "Failed to initialize libedvev interface for " ACCEL_INPUT_DEV "!\n");
+        struct stat input_stat;
+        if (strcmp(input_path, "-") == 0) {
+            accel.fd = STDIN_FILENO;
+            fcntl(accel.fd, F_SETFL, fcntl(accel.fd, F_GETFL) | O_NONBLOCK);
+        } else {
+            accel.fd = open(input_path, O_RDONLY|O_NONBLOCK);
+        }
+        if (accel.fd < 0 || fstat(accel.fd, &input_stat) < 0) {
+            fprintf(stderr, "Failed to open accelerometer input %s!\n", input_path);
             return 3;
         }
-        if (!libevdev_has_event_code(accel, EV_ABS, ABS_X) ||
-            !libevdev_has_event_code(accel, EV_ABS, ABS_Y) ||
-            !libevdev_has_event_code(accel, EV_ABS, ABS_Z) ||
-            !libevdev_has_event_type(accel, EV_KEY)
-           ) {
-            fprintf(stderr, "Input device does not look like an accelerometer!\n");
-            return 2;
+        if (!S_ISCHR(input_stat.st_mode)) {
+            // Not a device; take raw events, trusting the sender to be an accelerometer
+            printf("Reading raw accelerometer events from %s\n", input_path);
+        } else {
+            if (libevdev_new_from_fd(accel.fd, &accel.dev) < 0) {
+                fprintf(stderr, "Failed to initialize libedvev interface for %s!\n", input_path);
+                return 3;
+            }
+            if (!libevdev_has_event_code(accel.dev, EV_ABS, ABS_X) ||
+                !libevdev_has_event_code(accel.dev, EV_ABS, ABS_Y) ||
+                !libevdev_has_event_code(accel.dev, EV_ABS, ABS_Z) ||
+                !libevdev_has_event_type(accel.dev, EV_KEY)
+               ) {
+                fprintf(stderr, "Input device does not look like an accelerometer!\n");
+                return 2;
+            }
+            printf("Found suitable accelerometer \"%s\" on %s\n", libevdev_get_name(accel.dev), input_path);
         }
-        printf("Found suitable accelerometer \"%s\" on " ACCEL_INPUT_DEV "\n", libevdev_get_name(accel));
+    }
+
+    // Smooth the orientation as readings arrive, rather than using each raw
+    struct orient_filter filter;
+    if (filtered) {
+        orient_init(&filter, &filter_config);
+        accel.filter = &filter;
     }
 
     // Initialization
-    FILE *period_f = fopen(PWM_PATH "/period", "w");
-    if (period_f == NULL) {
-        perror("Failed to open PWM period file");
+    struct backend hw;
+    if (backend_open(&hw, backend_name, NUM_CHANNELS) < 0) {
         return 3;
     }
     int rc = 0;
-    FILE *channels[NUM_CHANNELS] = {NULL};
-    FILE *duty_cycles[NUM_CHANNELS] = {NULL};
-    for (unsigned int i = 0; i < NUM_CHANNELS; i++) {
-        char adcfile[sizeof(ADC_PATH) + 20];
-        char pwmfile[sizeof(PWM_PATH) + 20];
-        // Loop-open channel files...
-        snprintf(adcfile, sizeof(adcfile), ADC_PATH "/channel_%d", i);
-        channels[i] = fopen(adcfile, "r");
-        if (channels[i] == NULL) {
-            perror("Failed to open ADC channel");
-            rc = 3;
-            goto cleanup_files;
-        }
-        // ...and duty cycle files
-        snprintf(pwmfile, sizeof(pwmfile), PWM_PATH "/duty_cycle_%d", i+1);
-        duty_cycles[i] = fopen(pwmfile, "w");
-        if (duty_cycles[i] == NULL) {
-            perror("Failed to open PWM interface");
-            rc = 3;
-            goto cleanup_files;
-        }
-    }
 
     // Initialize hardware
-    bool accel_mode = false;
-    libevdev_disable_event_type(accel, EV_ABS); // No accelerometer updates for now
-    dev_fprintf(period_f, xstr(PERIOD));
-
-    // Prepare to catch interrupts
-    signal(SIGINT, ctrl_c);
-
-    printf("Control loop running; interrupt to exit...\n");
-    printf("ADC mode\r"); fflush(stdout);
-    int accel_vec[3] = {0};
-    // Main control loop
-    while (!interrupted) {
+    backend_write_period(&hw, PERIOD);
 
-        // Handle any pending accelerometer events
-        while (libevdev_has_event_pending(accel)) {
-            struct input_event event;
-            libevdev_next_event(accel, LIBEVDEV_READ_FLAG_NORMAL, &event);
-            switch (event.type) {
-                case EV_KEY:
-                    // Tap event; switch control modes
-                    if (event.value == 1) {
-                        if (accel_mode) {
-                            accel_mode = false;
-                            libevdev_disable_event_type(accel, EV_ABS);
-                            printf("ADC mode  \r"); fflush(stdout);
-                        } else {
-                            accel_mode = true;
-                            libevdev_enable_event_type(accel, EV_ABS);
-                            printf("Accel mode\r"); fflush(stdout);
-                        }
-                    }
-                    break;
-                case EV_ABS:
-                    // Accelerometer event; record updated values
-                    /* This won't trigger if we're not in "accelerometer mode,"
-                     * since we disable the corresponding event type.
-                     */
-                    switch (event.code) {
-                        case ABS_X:
-                            accel_vec[0] = event.value;
-                            break;
-                        case ABS_Y:
-                            accel_vec[1] = event.value;
-                            break;
-                        case ABS_Z:
-                            accel_vec[2] = event.value;
-                            break;
-                        default: break;
-                    }
-                default: break;
-            }
+    /* Split the control loop into input, transform and actuator stages, each
+     * on its own thread (unless asked not to), so a slow PWM write can't hold
+     * up handling the accelerometer.
+     */
+    pipeline = (struct accel_pipeline){
+        .accel = &accel,
+        .hw = &hw,
+        .period = PERIOD,
+        .tick_hz = tick_hz,
+        .threaded = threaded,
+        .rt_priority = rt_priority,
+        .verbose = !detach,
+    };
+    if (shm_name != NULL) {
+        // Let tools watch and reconfigure us while we run
+        pipeline.shm = control_shm_create(shm_name);
+        if (pipeline.shm == NULL) {
+            perror("Failed to create shared-memory segment");
+            rc = 4;
+            goto cleanup_hw;
         }
+        printf("Publishing telemetry and taking commands on %s\n", shm_name);
+    }
+    // Keep stdin, which may be the accelerometer; redirect output as needed
+    if (detach && daemon(0, 1) < 0) {
+        perror("Failed to detach");
+        rc = 4;
+        goto cleanup_shm;
+    }
+    // Readers check we're still alive by our process ID, which detaching changed
+    if (detach && pipeline.shm != NULL) control_shm_adopt(pipeline.shm);
+    // After detaching, since memory locks aren't inherited across fork()
+    if (rt_priority > 0) rt_lock_memory();
+    if (accel_pipeline_init(&pipeline) < 0) {
+        rc = 4;
+        goto cleanup_shm;
+    }
 
-        // Control the PWM module
-        if (accel_mode) {
-            // Calculate roll and pitch angles
-            float roll = atan2(-(float)accel_vec[1], (float)accel_vec[2]);
-            float pitch = atan2(-(float)accel_vec[0], sqrt(powf(accel_vec[1], 2) + powf(accel_vec[2], 2)));
-            // Transform to HSL...
-            float hsl[3], rgb[3];
-            // roll -> hue, saturation = 1, pitch -> lightness
-            hsl[0] = roll + M_PI;
-            hsl[1] = 1;
-            hsl[2] = (pitch / (M_PI)) + 0.5;
-            // ...and then to RGB
-            hsl2rgb(hsl, rgb);
-            // Write RGB values to PWM controller
-            for (unsigned int i = 0; i < 3; i++) {
-                dev_fprintf(duty_cycles[i], "%u", (int)(rgb[i] * pow(2, 12)));
-            }
-        } else {
-            /* Both register sets are fixed-point, and happen to have the same
-             * number of fractional bits. Were this not the case, bit shifting
-             * would be needed.
-             */
-            for (unsigned int i = 0; i < NUM_CHANNELS; i++) {
-                // Loop-write channels and duty cycles
-                unsigned int reading = 0;
-                dev_fscanf(channels[i], "%i", &reading);
-                dev_fprintf(duty_cycles[i], "%u", reading);
-            }
-        }
+    // Prepare to catch interrupts, and (as a daemon) requests to stop
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
 
-        // NOTE: No waiting here. Time to eat the CPU for breakfast!
-    }
-    printf("\nCaught interrupt; exiting...\n");
+    printf("Control loop running at %lu Hz (%s backend, %s%s); interrupt to exit...\n",
+           tick_hz, backend_name, threaded ? "threaded" : "serial", rt_priority > 0 ? ", real-time" : "");
+    double start = now_sec();
+    if (accel_pipeline_run(&pipeline) < 0) rc = 4;
+    double elapsed = now_sec() - start;
+    if (pipeline.ended) printf("\nAccelerometer input ended");
+    else printf("\nCaught signal");
+    printf("; exiting...\n");
+    printf("%lu PWM updates in %.3f s (%.1f updates/s, %s backend)\n",
+           pipeline.updates, elapsed, pipeline.updates / elapsed, backend_name);
+    print_latency("Input", &pipeline.input_latency);
+    print_latency("Output", &pipeline.output_latency);
+    if (threaded) printf("%lu superseded PWM updates skipped\n", pipeline.dropped);
+    rt_jitter_print(&pipeline.tick_jitter, stdout, "Tick");
+    accel_pipeline_destroy(&pipeline);
 
     // Cleanup
-    dev_fprintf(period_f, "0");
-cleanup_files:
-    for (unsigned int i = 0; i < NUM_CHANNELS; i++) {
-        // Loop-close channels and duty cycles
-        if (channels[i] != NULL) fclose(channels[i]);
-        if (duty_cycles[i] != NULL) fclose(duty_cycles[i]);
+cleanup_shm:
+    if (pipeline.shm != NULL) {
+        control_shm_close(pipeline.shm);
+        control_shm_unlink(shm_name);
     }
-    fclose(period_f);
+cleanup_hw:
+    backend_write_period(&hw, 0);
+    backend_close(&hw);
+    if (accel.dev != NULL) libevdev_free(accel.dev);
+    close(accel.fd);
     return rc;
 }
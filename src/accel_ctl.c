@@ -0,0 +1,157 @@
+/* Monitoring and control tool for a running accel_control.
+ * Reads telemetry from, and sends commands to, the shared-memory segment
+ * accel_control publishes with -S.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "control_shm.h"
+
+#define DEFAULT_WATCH_HZ 10
+#define SEND_RETRIES 100 // Milliseconds to wait for room in a full queue
+
+
+// Interrupt tracker for watch mode
+static volatile sig_atomic_t interrupted = false;
+static void ctrl_c(int _) {
+    (void)_;
+    interrupted = true;
+}
+
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Returns -1 if the daemon is gone
+static int print_status(struct control_shm *shm) {
+    struct control_telemetry t;
+    if (control_shm_read(shm, &t) < 0) {
+        fprintf(stderr, "accel_control (pid %u) exited while publishing telemetry\n", shm->pid);
+        return -1;
+    }
+    printf("accel_control (pid %u): %s mode, period 0x%X\n",
+           shm->pid, t.accel_mode ? "accelerometer" : "ADC", t.period);
+    printf("  %-12s", t.accel_mode ? "accel" : "adc");
+    for (unsigned int i = 0; i < CONTROL_CHANNELS; i++) printf(" %8d", t.inputs[i]);
+    printf("\n  %-12s", "duty cycles");
+    for (unsigned int i = 0; i < CONTROL_CHANNELS; i++) printf(" %#8x", t.duty_cycles[i]);
+    printf("\n  %-12s", "map");
+    for (unsigned int i = 0; i < CONTROL_CHANNELS; i++) printf(" %8u", t.map[i]);
+    printf("\n  %llu writes (%llu superseded), %llu commands\n",
+           (unsigned long long)t.updates, (unsigned long long)t.dropped, (unsigned long long)t.commands);
+    printf("  latency %.1f us (mean %.1f us, max %.1f us)\n",
+           t.latency_ns * 1e-3, t.latency_mean_ns * 1e-3, t.latency_max_ns * 1e-3);
+    if (t.timestamp_ns != 0) {
+        printf("  last write %.3f s ago\n", (double)(realtime_ns() - t.timestamp_ns) * 1e-9);
+    }
+    return 0;
+}
+
+// Queue a command, waiting a little for room if the daemon is behind
+static int send_command(struct control_shm *shm, const struct control_command *cmd) {
+    for (unsigned int i = 0; i < SEND_RETRIES; i++) {
+        if (control_shm_send(shm, cmd) == 0) return 0;
+        usleep(1000);
+    }
+    fprintf(stderr, "Command queue is full; is accel_control running?\n");
+    return -1;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-S shm_name] status | watch [hz] | mode accel|adc | period <value> | map <src>,<src>,<src>\n", name);
+}
+
+
+int main(int argc, char** argv) {
+
+    // Parse command-line options
+    const char *shm_name = CONTROL_SHM_DEFAULT_NAME;
+    int opt;
+    while ((opt = getopt(argc, argv, "S:")) != -1) {
+        switch (opt) {
+            case 'S':
+                shm_name = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *verb = argv[optind];
+    const char *arg = optind + 1 < argc ? argv[optind + 1] : NULL;
+
+    // Only commands need write access, which only accel_control's user has
+    bool monitor = strcmp(verb, "status") == 0 || strcmp(verb, "watch") == 0;
+    struct control_shm *shm = control_shm_open(shm_name, !monitor);
+    if (shm == NULL) {
+        fprintf(stderr, "Failed to open %s (is accel_control running with -S?): %s\n", shm_name, strerror(errno));
+        return 3;
+    }
+
+    int rc = 0;
+    struct control_command cmd = {0};
+    if (strcmp(verb, "status") == 0) {
+        if (print_status(shm) < 0) rc = 5;
+        goto cleanup;
+    } else if (strcmp(verb, "watch") == 0) {
+        unsigned long hz = arg != NULL ? strtoul(arg, NULL, 0) : DEFAULT_WATCH_HZ;
+        if (hz == 0) {
+            usage(argv[0]);
+            rc = 1;
+            goto cleanup;
+        }
+        signal(SIGINT, ctrl_c);
+        while (!interrupted) {
+            printf("\033[H\033[J");  // Clear the terminal
+            if (print_status(shm) < 0) {
+                rc = 5;
+                break;
+            }
+            fflush(stdout);
+            usleep(1000000 / hz);
+        }
+        goto cleanup;
+    } else if (strcmp(verb, "mode") == 0 && arg != NULL) {
+        cmd.type = CONTROL_CMD_MODE;
+        if (strcmp(arg, "accel") == 0) cmd.args[0] = 1;
+        else if (strcmp(arg, "adc") == 0) cmd.args[0] = 0;
+        else goto bad_args;
+    } else if (strcmp(verb, "period") == 0 && arg != NULL) {
+        cmd.type = CONTROL_CMD_PERIOD;
+        cmd.args[0] = strtoul(arg, NULL, 0);
+    } else if (strcmp(verb, "map") == 0 && arg != NULL) {
+        cmd.type = CONTROL_CMD_MAP;
+        const char *p = arg;
+        for (unsigned int i = 0; i < CONTROL_CHANNELS; i++) {
+            char *end;
+            cmd.args[i] = strtoul(p, &end, 0);
+            if (end == p || cmd.args[i] >= CONTROL_CHANNELS) goto bad_args;
+            p = end + (*end == ',');
+        }
+    } else {
+    bad_args:
+        usage(argv[0]);
+        rc = 1;
+        goto cleanup;
+    }
+    if (send_command(shm, &cmd) < 0) rc = 4;
+
+cleanup:
+    control_shm_close(shm);
+    return rc;
+}
@@ -0,0 +1,120 @@
+/* Accelerometer event input for the controller programs.
+ * EELE 467
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "accel_input.h"
+
+
+static uint64_t event_ns(const struct input_event *event) {
+    return event->input_event_sec * 1000000000ULL + event->input_event_usec * 1000ULL;
+}
+
+static bool key_down(const unsigned char *keys, unsigned int code) {
+    return keys[code / 8] & (1 << (code % 8));
+}
+
+static void count_tap(struct accel_update *update, uint64_t ns) {
+    update->taps++;
+    update->tap_ns = ns;
+}
+
+// Pass on a complete reading, unless the filter is holding its output back
+static void commit(struct accel_input *in, struct accel_update *update, uint64_t ns) {
+    if (in->filter != NULL && !orient_update(in->filter, in->accel_vec, in->filtered)) return;
+    update->reports++;
+    update->report_ns = ns;
+}
+
+/* Catch up after dropped events by asking the device for its current state,
+ * as though the missing events had arrived. Raw streams have no state to ask
+ * for, so they just resume with the next report.
+ */
+static void resync(struct accel_input *in, struct accel_update *update, uint64_t ns) {
+    bool axes = true;
+    for (unsigned int i = 0; i < 3; i++) {
+        struct input_absinfo abs;
+        if (ioctl(in->fd, EVIOCGABS(ABS_X + i), &abs) < 0) {
+            axes = false;
+            break;
+        }
+        in->accel_vec[i] = abs.value;
+    }
+    if (axes) commit(in, update, ns);
+
+    // Any key that went down while we weren't looking was a tap we missed
+    unsigned char keys[sizeof(in->keys)];
+    if (ioctl(in->fd, EVIOCGKEY(sizeof(keys)), keys) < 0) return;
+    for (unsigned int code = 0; code < KEY_CNT; code++) {
+        if (key_down(keys, code) && !key_down(in->keys, code)) count_tap(update, ns);
+    }
+    memcpy(in->keys, keys, sizeof(keys));
+}
+
+int accel_read(struct accel_input *in, struct accel_update *update) {
+    memset(update, 0, sizeof(*update));
+
+    // Read into the buffer, after any partial event left over from a raw
+    // stream, and parse the events where they land
+    ssize_t len = read(in->fd, (char *)in->events + in->partial, sizeof(in->events) - in->partial);
+    if (len < 0 && (errno == EAGAIN || errno == EINTR)) return 0;
+    if (len <= 0) return -1;
+    len += in->partial;
+    size_t count = len / sizeof(struct input_event);
+
+    for (const struct input_event *event = in->events; event < in->events + count; event++) {
+        // After the kernel drops events, everything up to the next SYN_REPORT
+        // is unreliable
+        if (in->dropped && event->type != EV_SYN) continue;
+        switch (event->type) {
+            case EV_KEY:
+                if (event->code >= KEY_CNT) break;
+                if (event->value == 1) {
+                    count_tap(update, event_ns(event));
+                    in->keys[event->code / 8] |= 1 << (event->code % 8);
+                } else if (event->value == 0) {
+                    in->keys[event->code / 8] &= ~(1 << (event->code % 8));
+                }
+                break;
+            case EV_ABS:
+                if (event->code > ABS_Z) break;
+                in->frame[event->code - ABS_X] = event->value;
+                in->frame_axes |= 1 << (event->code - ABS_X);
+                break;
+            case EV_SYN:
+                if (event->code == SYN_DROPPED) {
+                    // The report in progress is incomplete, and so are any
+                    // until the next SYN_REPORT
+                    in->dropped = true;
+                    in->frame_axes = 0;
+                } else if (event->code == SYN_REPORT) {
+                    if (in->dropped) {
+                        in->dropped = false;
+                        resync(in, update, event_ns(event));
+                    } else if (in->frame_axes != 0) {
+                        // Axes the report didn't mention haven't changed
+                        for (unsigned int i = 0; i < 3; i++) {
+                            if (in->frame_axes & (1 << i)) in->accel_vec[i] = in->frame[i];
+                        }
+                        commit(in, update, event_ns(event));
+                    }
+                    in->frame_axes = 0;
+                }
+                break;
+            default: break;
+        }
+    }
+
+    if (update->reports > 0) {
+        memcpy(update->accel_vec, in->filter != NULL ? in->filtered : in->accel_vec, sizeof(update->accel_vec));
+    }
+
+    // Keep the start of an event split across reads, for next time
+    in->partial = len - count * sizeof(struct input_event);
+    if (in->partial > 0) memmove(in->events, in->events + count, in->partial);
+    return 1;
+}
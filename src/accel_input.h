@@ -0,0 +1,77 @@
+/* Accelerometer event input for the controller programs.
+ * Events are read straight from the file descriptor, a batch per system call,
+ * and coalesced as they're parsed: only the newest complete X/Y/Z report in a
+ * batch matters (or, with an orientation filter, the newest output after every
+ * report has been through it), along with any taps.
+ * EELE 467
+ */
+
+#ifndef ACCEL_INPUT_H
+#define ACCEL_INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/input.h>
+
+#include "orientation.h"
+
+#define ACCEL_BATCH_EVENTS 64 // Events read per system call
+
+struct libevdev;
+
+/**
+ * struct accel_input - Accelerometer event source.
+ * @dev: libevdev handle for an evdev device, used only to check its
+ *       capabilities, or NULL for a raw stream of struct input_event (e.g. a
+ *       pipe from accel_sim)
+ * @fd: File descriptor events are read from
+ * @filter: Optional; every complete report is run through this orientation
+ *          filter, and its (decimated) outputs passed on instead
+ *
+ * The remaining members are private, and must start zeroed.
+ */
+struct accel_input {
+    struct libevdev *dev;
+    int fd;
+    struct orient_filter *filter;
+
+    struct input_event events[ACCEL_BATCH_EVENTS];
+    size_t partial;            // Bytes of an incomplete event left over
+    int frame[3];              // Axes of the report in progress
+    unsigned int frame_axes;   // Which of them it has updated
+    int accel_vec[3];          // Latest complete report
+    int filtered[3];           // Latest output of the filter
+    bool dropped;              // Discarding events until the next SYN_REPORT
+    unsigned char keys[KEY_CNT / 8];
+};
+
+/**
+ * struct accel_update - What one batch of events amounted to.
+ * @accel_vec: Newest complete X/Y/Z reading, if @reports is nonzero
+ * @reports: Number of reports (up to each SYN_REPORT) folded into @accel_vec;
+ *           with a filter, the number of its outputs
+ * @report_ns: Timestamp of the newest of them
+ * @taps: Number of taps
+ * @tap_ns: Timestamp of the newest of them
+ *
+ * Timestamps are 0 for events that weren't stamped.
+ */
+struct accel_update {
+    int accel_vec[3];
+    unsigned int reports;
+    uint64_t report_ns;
+    unsigned int taps;
+    uint64_t tap_ns;
+};
+
+/* Read and coalesce one batch of pending events: returns 1 if any were read
+ * (which needn't have added up to an update), 0 if none are pending, or -1
+ * once the input has ended.
+ * After the kernel drops events (SYN_DROPPED), the rest of that report is
+ * discarded and the axes and keys are re-read from the device, so a report
+ * never mixes old and new values, and taps aren't lost.
+ */
+int accel_read(struct accel_input *in, struct accel_update *update);
+
+#endif
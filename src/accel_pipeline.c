@@ -0,0 +1,609 @@
+/* Input, transform and actuator stages of accel_control.
+ *
+ * The input stage drains accelerometer events and handles taps, the transform
+ * stage turns the latest orientation (or ADC reading) into duty cycles, and
+ * the actuator stage writes them out. Run serially, a stalled write holds up
+ * everything behind it; run threaded, each stage only ever picks up the newest
+ * value from the one before, so a stall just means intermediate values get
+ * skipped.
+ * EELE 467
+ */
+
+#define _GNU_SOURCE  // For pthread_setaffinity_np()
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "accel_pipeline.h"
+#include "color.h"
+
+#define RING_SLOTS 8
+#define MAX_READY 8
+
+
+// What the input stage hands to the transform stage
+struct accel_state {
+    int accel_vec[3];
+    bool accel_mode;
+    unsigned long readings;  // Accelerometer reports seen, to spot fresh data
+    uint64_t event_ns;       // Timestamp of the newest of them
+};
+
+// What the transform stage hands to the actuator stage
+struct duty_frame {
+    uint32_t duty_cycles[PIPELINE_CHANNELS];
+    uint64_t event_ns;  // Timestamp of the input behind these duty cycles
+    // The rest is only for telemetry, except the period, which the actuator
+    // writes when it changes
+    uint32_t period;
+    uint32_t map[PIPELINE_CHANNELS];
+    int32_t inputs[PIPELINE_CHANNELS];
+    bool accel_mode;
+    unsigned long commands;
+};
+
+// The transform stage's own state
+struct transform {
+    struct accel_state state;              // Latest from the input stage
+    unsigned long seen;                    // Readings already transformed
+    bool accel_mode;                       // Mode the ADC watch is set up for
+    bool valid;                            // Set once raw holds anything
+    uint32_t raw[PIPELINE_CHANNELS];       // Duty cycles, before mapping
+    int32_t inputs[PIPELINE_CHANNELS];     // What they came from
+    uint32_t map[PIPELINE_CHANNELS];       // Source of each channel, in raw
+    uint32_t period;
+    unsigned long commands;
+};
+
+// Mode change requests from commands, for the input stage
+enum {
+    MODE_REQUEST_NONE,
+    MODE_REQUEST_ADC,
+    MODE_REQUEST_ACCEL,
+};
+
+// Wall-clock timestamp, in nanoseconds, comparable with event timestamps
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Timestamp on the control tick's clock, in nanoseconds
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void record_latency(struct pipeline_latency *lat, uint64_t since_ns) {
+    uint64_t now = realtime_ns();
+    uint64_t ns = now > since_ns ? now - since_ns : 0;
+    uint32_t sample = ns > UINT32_MAX ? UINT32_MAX : ns;
+    if (lat->count < lat->capacity) lat->samples[lat->count] = sample;
+    lat->count++;
+    lat->sum_ns += sample;
+    lat->last_ns = sample;
+    if (sample > lat->max_ns) lat->max_ns = sample;
+}
+
+// Create an epoll instance watching each of fds that's valid, for reading
+static int watch_all(const int *fds, unsigned int n) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("Failed to create epoll instance");
+        return -1;
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        if (fds[i] < 0) continue;
+        struct epoll_event watch = { .events = EPOLLIN, .data.fd = fds[i] };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[i], &watch) < 0) {
+            perror("Failed to watch control loop wakeup source");
+            close(epoll_fd);
+            return -1;
+        }
+    }
+    return epoll_fd;
+}
+
+// Enable or disable wakeups for new ADC readings
+static void watch_adc(int epoll_fd, int adc_fd, bool enable) {
+    if (adc_fd < 0) return;
+    struct epoll_event watch = { .events = enable ? EPOLLIN : 0, .data.fd = adc_fd };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, adc_fd, &watch);
+}
+
+// Sleep until something's ready; returns 0 if interrupted, or -1 on failure
+static int wait_ready(int epoll_fd, struct epoll_event *ready) {
+    int nready = epoll_wait(epoll_fd, ready, MAX_READY, -1);
+    if (nready < 0) {
+        if (errno == EINTR) return 0;  // Probably our SIGINT; the stop fd follows
+        perror("epoll_wait failed");
+    }
+    return nready;
+}
+
+// Acknowledge an eventfd or timerfd; returns false if it wasn't readable
+static bool acknowledge(int fd) {
+    uint64_t count;
+    return read(fd, &count, sizeof(count)) > 0;
+}
+
+// Acknowledge the control tick, recording how late we are for the latest
+// deadline it's been through; returns false if it hadn't expired
+static bool take_tick(struct accel_pipeline *p) {
+    uint64_t expirations;
+    if (read(p->tick_fd, &expirations, sizeof(expirations)) <= 0) return false;
+    // Missed ticks are simply coalesced, but count as overruns
+    p->ticks += expirations;
+    p->tick_jitter.overruns += expirations - 1;
+    uint64_t deadline_ns = p->tick_start_ns + p->ticks * p->tick_ns;
+    uint64_t now_ns = monotonic_ns();
+    rt_jitter_record(&p->tick_jitter, now_ns > deadline_ns ? now_ns - deadline_ns : 0);
+    return true;
+}
+
+
+//-----------------------------------------------------------------------
+// Stages, shared by the serial and threaded loops
+//-----------------------------------------------------------------------
+
+static void set_mode(struct accel_pipeline *p, struct accel_state *state, bool accel_mode) {
+    state->accel_mode = accel_mode;
+    if (p->verbose) {
+        printf(accel_mode ? "Accel mode\r" : "ADC mode  \r");
+        fflush(stdout);
+    }
+}
+
+/* Handle any pending accelerometer events, switching modes on taps (or when a
+ * command asks to). Returns 1 if the state changed, 0 if not, or -1 once a raw
+ * stream has ended.
+ */
+static int input_step(struct accel_pipeline *p, struct accel_state *state) {
+    int changed = 0;
+    int request = atomic_exchange_explicit(&p->mode_request, MODE_REQUEST_NONE, memory_order_relaxed);
+    if (request != MODE_REQUEST_NONE && (request == MODE_REQUEST_ACCEL) != state->accel_mode) {
+        set_mode(p, state, request == MODE_REQUEST_ACCEL);
+        changed = 1;
+    }
+
+    // Each batch boils down to its taps and newest report
+    struct accel_update update;
+    int have_events;
+    while ((have_events = accel_read(p->accel, &update)) > 0) {
+        if (update.taps > 0) {
+            // Tap events; switch control modes, once for each
+            if (update.taps % 2) set_mode(p, state, !state->accel_mode);
+            record_latency(&p->input_latency, update.tap_ns != 0 ? update.tap_ns : realtime_ns());
+            changed = 1;
+        }
+        if (update.reports > 0 && state->accel_mode) {
+            // Accelerometer reports; only the newest matters
+            uint64_t event_ns = update.report_ns != 0 ? update.report_ns : realtime_ns();
+            memcpy(state->accel_vec, update.accel_vec, sizeof(state->accel_vec));
+            state->readings += update.reports;
+            state->event_ns = event_ns;
+            record_latency(&p->input_latency, event_ns);
+            changed = 1;
+        }
+    }
+    return have_events < 0 ? -1 : changed;
+}
+
+// Apply one command; returns true if the duty cycles need rewriting
+static bool apply_command(struct accel_pipeline *p, struct transform *t, const struct control_command *cmd) {
+    switch (cmd->type) {
+        case CONTROL_CMD_MODE:
+            // The input stage owns the mode, so pass it on, and wake it up
+            atomic_store_explicit(&p->mode_request, cmd->args[0] ? MODE_REQUEST_ACCEL : MODE_REQUEST_ADC,
+                                  memory_order_relaxed);
+            eventfd_write(p->wake_fd, 1);
+            t->commands++;
+            return false;
+        case CONTROL_CMD_PERIOD:
+            t->period = cmd->args[0];
+            t->commands++;
+            return true;
+        case CONTROL_CMD_MAP:
+            for (unsigned int i = 0; i < PIPELINE_CHANNELS; i++) {
+                if (cmd->args[i] >= PIPELINE_CHANNELS) goto invalid;
+            }
+            for (unsigned int i = 0; i < PIPELINE_CHANNELS; i++) t->map[i] = cmd->args[i];
+            t->commands++;
+            return true;
+        default:
+        invalid:
+            if (p->verbose) fprintf(stderr, "Ignoring invalid command %u\n", cmd->type);
+            return false;
+    }
+}
+
+/* Work out new duty cycles, if they're due: in accelerometer mode, on control
+ * ticks when the orientation has changed since the last time; in ADC mode,
+ * when new readings arrive, or on ticks if the backend can't signal them.
+ * Commands are taken on ticks, and settings changes rewrite the last duty
+ * cycles. Returns true if frame was filled in.
+ */
+static bool transform_step(struct accel_pipeline *p, struct transform *t, int epoll_fd,
+                           bool tick, bool adc_ready, struct duty_frame *frame) {
+    const struct accel_state *state = &t->state;
+    bool rewrite = false;
+    if (tick && p->shm != NULL) {
+        struct control_command cmd;
+        while (control_shm_receive(p->shm, &cmd)) rewrite |= apply_command(p, t, &cmd);
+    }
+    if (state->accel_mode != t->accel_mode) {
+        t->accel_mode = state->accel_mode;
+        watch_adc(epoll_fd, p->adc_fd, !t->accel_mode);
+        rewrite = true;  // So the telemetry shows the new mode
+    }
+
+    if (state->accel_mode && tick && state->readings != t->seen) {
+        t->seen = state->readings;
+        // Transform orientation to HSL, and then to RGB
+        accel_to_duty_cycles(state->accel_vec, t->raw);
+        for (unsigned int i = 0; i < PIPELINE_CHANNELS; i++) t->inputs[i] = state->accel_vec[i];
+        frame->event_ns = state->event_ns;
+    } else if (!state->accel_mode && (p->adc_fd >= 0 ? adc_ready : tick)) {
+        /* Both register sets are fixed-point, and happen to have the same
+         * number of fractional bits. Were this not the case, bit shifting
+         * would be needed.
+         */
+        frame->event_ns = realtime_ns();
+        for (unsigned int i = 0; i < PIPELINE_CHANNELS; i++) t->raw[i] = 0;
+        backend_read_channels(p->hw, t->raw);
+        for (unsigned int i = 0; i < PIPELINE_CHANNELS; i++) t->inputs[i] = t->raw[i];
+    } else if (rewrite && t->valid) {
+        frame->event_ns = realtime_ns();
+    } else {
+        return false;
+    }
+    t->valid = true;
+
+    for (unsigned int i = 0; i < PIPELINE_CHANNELS; i++) {
+        frame->duty_cycles[i] = t->raw[t->map[i]];
+        frame->map[i] = t->map[i];
+        frame->inputs[i] = t->inputs[i];
+    }
+    frame->period = t->period;
+    frame->accel_mode = state->accel_mode;
+    frame->commands = t->commands;
+    return true;
+}
+
+static void transform_init(struct accel_pipeline *p, struct transform *t) {
+    *t = (struct transform){ .period = p->period };
+    for (unsigned int i = 0; i < PIPELINE_CHANNELS; i++) t->map[i] = i;
+}
+
+static void publish_telemetry(struct accel_pipeline *p, const struct duty_frame *frame) {
+    const struct pipeline_latency *lat = &p->output_latency;
+    struct control_telemetry telemetry = {
+        .timestamp_ns = realtime_ns(),
+        .accel_mode = frame->accel_mode,
+        .period = frame->period,
+        .updates = p->updates,
+        .dropped = p->threaded ? p->outputs.dropped : 0,
+        .commands = frame->commands,
+        .latency_ns = lat->last_ns,
+        .latency_mean_ns = lat->count > 0 ? lat->sum_ns / lat->count : 0,
+        .latency_max_ns = lat->max_ns,
+    };
+    for (unsigned int i = 0; i < PIPELINE_CHANNELS; i++) {
+        telemetry.map[i] = frame->map[i];
+        telemetry.inputs[i] = frame->inputs[i];
+        telemetry.duty_cycles[i] = frame->duty_cycles[i];
+    }
+    control_shm_publish(p->shm, &telemetry);
+}
+
+static void actuator_step(struct accel_pipeline *p, const struct duty_frame *frame) {
+    if (frame->period != p->period_written) {
+        backend_write_period(p->hw, frame->period);
+        p->period_written = frame->period;
+    }
+    // Write RGB values to PWM controller
+    backend_write_duty_cycles(p->hw, frame->duty_cycles);
+    record_latency(&p->output_latency, frame->event_ns);
+    p->updates++;
+    if (p->shm != NULL) publish_telemetry(p, frame);
+}
+
+
+//-----------------------------------------------------------------------
+// Serial loop: every stage in turn, on the calling thread
+//-----------------------------------------------------------------------
+static int run_serial(struct accel_pipeline *p) {
+    int fds[] = { p->stop_fd, p->accel->fd, p->tick_fd, p->adc_fd, p->wake_fd };
+    int epoll_fd = watch_all(fds, sizeof(fds) / sizeof(fds[0]));
+    if (epoll_fd < 0) return -1;
+
+    if (p->rt_priority > 0) rt_enter(p->rt_priority, rt_default_cpu(), "control loop");
+
+    struct transform t;
+    transform_init(p, &t);
+    int rc = 0;
+    for (;;) {
+        // Sleep until the accelerometer has something to say, or we're due for
+        // a control update
+        struct epoll_event ready[MAX_READY];
+        int nready = wait_ready(epoll_fd, ready);
+        if (nready < 0) {
+            rc = -1;
+            break;
+        }
+        bool stop = false, tick = false, adc_ready = false;
+        for (int i = 0; i < nready; i++) {
+            if (ready[i].data.fd == p->stop_fd) stop = true;
+            else if (ready[i].data.fd == p->tick_fd) tick = take_tick(p);
+            // Cleared when we read the channels
+            else if (ready[i].data.fd == p->adc_fd) adc_ready = true;
+            else if (ready[i].data.fd == p->wake_fd) acknowledge(p->wake_fd);
+        }
+        if (stop) break;
+
+        if (input_step(p, &t.state) < 0) {
+            p->ended = true;
+            break;
+        }
+        struct duty_frame frame;
+        if (transform_step(p, &t, epoll_fd, tick, adc_ready, &frame)) actuator_step(p, &frame);
+    }
+    close(epoll_fd);
+    return rc;
+}
+
+
+//-----------------------------------------------------------------------
+// Threaded loop: one thread per stage, handing off through the rings
+//-----------------------------------------------------------------------
+static void *input_thread(void *arg) {
+    struct accel_pipeline *p = arg;
+    // run_threaded() pins each thread to its core
+    if (p->rt_priority > 0) rt_enter(p->rt_priority, -1, "input thread");
+    int fds[] = { p->stop_fd, p->accel->fd, p->wake_fd };
+    int epoll_fd = watch_all(fds, sizeof(fds) / sizeof(fds[0]));
+    if (epoll_fd < 0) return (void *)-1;
+
+    struct accel_state state = {0};
+    intptr_t rc = 0;
+    for (;;) {
+        struct epoll_event ready[MAX_READY];
+        int nready = wait_ready(epoll_fd, ready);
+        if (nready < 0) {
+            rc = -1;
+            break;
+        }
+        bool stop = false;
+        for (int i = 0; i < nready; i++) {
+            if (ready[i].data.fd == p->stop_fd) stop = true;
+            else if (ready[i].data.fd == p->wake_fd) acknowledge(p->wake_fd);
+        }
+        if (stop) break;
+
+        int changed = input_step(p, &state);
+        if (changed < 0) {
+            // A raw stream has ended, so there's nothing left to control
+            p->ended = true;
+            accel_pipeline_stop(p);
+            break;
+        }
+        if (changed) {
+            spsc_publish(&p->inputs, &state);
+            eventfd_write(p->input_fd, 1);
+        }
+    }
+    close(epoll_fd);
+    return (void *)rc;
+}
+
+static void *transform_thread(void *arg) {
+    struct accel_pipeline *p = arg;
+    if (p->rt_priority > 0) rt_enter(p->rt_priority, -1, "transform thread");
+    int fds[] = { p->stop_fd, p->input_fd, p->tick_fd, p->adc_fd };
+    int epoll_fd = watch_all(fds, sizeof(fds) / sizeof(fds[0]));
+    if (epoll_fd < 0) return (void *)-1;
+
+    struct transform t;
+    transform_init(p, &t);
+    intptr_t rc = 0;
+    for (;;) {
+        struct epoll_event ready[MAX_READY];
+        int nready = wait_ready(epoll_fd, ready);
+        if (nready < 0) {
+            rc = -1;
+            break;
+        }
+        bool stop = false, tick = false, adc_ready = false;
+        for (int i = 0; i < nready; i++) {
+            if (ready[i].data.fd == p->stop_fd) stop = true;
+            else if (ready[i].data.fd == p->tick_fd) tick = take_tick(p);
+            else if (ready[i].data.fd == p->adc_fd) adc_ready = true;
+            else if (ready[i].data.fd == p->input_fd) acknowledge(p->input_fd);
+        }
+        if (stop) break;
+
+        spsc_take_latest(&p->inputs, &t.state);
+        struct duty_frame frame;
+        if (transform_step(p, &t, epoll_fd, tick, adc_ready, &frame)) {
+            spsc_publish(&p->outputs, &frame);
+            eventfd_write(p->output_fd, 1);
+        }
+    }
+    close(epoll_fd);
+    return (void *)rc;
+}
+
+static void *actuator_thread(void *arg) {
+    struct accel_pipeline *p = arg;
+    if (p->rt_priority > 0) rt_enter(p->rt_priority, -1, "actuator thread");
+    int fds[] = { p->stop_fd, p->output_fd };
+    int epoll_fd = watch_all(fds, sizeof(fds) / sizeof(fds[0]));
+    if (epoll_fd < 0) return (void *)-1;
+
+    intptr_t rc = 0;
+    for (;;) {
+        struct epoll_event ready[MAX_READY];
+        int nready = wait_ready(epoll_fd, ready);
+        if (nready < 0) {
+            rc = -1;
+            break;
+        }
+        bool stop = false;
+        for (int i = 0; i < nready; i++) {
+            if (ready[i].data.fd == p->stop_fd) stop = true;
+            else if (ready[i].data.fd == p->output_fd) acknowledge(p->output_fd);
+        }
+        if (stop) break;
+
+        // Anything published while the last write was stalled is superseded
+        struct duty_frame frame;
+        if (spsc_take_latest(&p->outputs, &frame)) actuator_step(p, &frame);
+    }
+    close(epoll_fd);
+    return (void *)rc;
+}
+
+/* Pin each stage's thread to its own core, where there are enough. On the
+ * DE10-Nano's two cores, the input and transform threads share core 0,
+ * leaving core 1 to the actuator, whose writes are the ones that stall.
+ */
+static void pin_thread(pthread_t thread, unsigned int stage, bool verbose) {
+    static const unsigned int cores[] = { 0, 2, 1 };  // Input, transform, actuator
+    long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nprocs <= 1) return;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cores[stage] % nprocs, &cpus);
+    int err = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+    if (err != 0 && verbose) {
+        fprintf(stderr, "Failed to pin control thread %u: %s\n", stage, strerror(err));
+    }
+}
+
+static int run_threaded(struct accel_pipeline *p) {
+    void *(*const stages[])(void *) = { input_thread, transform_thread, actuator_thread };
+    const unsigned int num_stages = sizeof(stages) / sizeof(stages[0]);
+    pthread_t threads[num_stages];
+    unsigned int started;
+    int rc = 0;
+    // Locked memory covers every thread's whole stack, so keep them small
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (p->rt_priority > 0) pthread_attr_setstacksize(&attr, RT_THREAD_STACK);
+    for (started = 0; started < num_stages; started++) {
+        int err = pthread_create(&threads[started], &attr, stages[started], p);
+        if (err != 0) {
+            fprintf(stderr, "Failed to start control thread: %s\n", strerror(err));
+            rc = -1;
+            accel_pipeline_stop(p);
+            break;
+        }
+        pin_thread(threads[started], started, p->verbose);
+    }
+    pthread_attr_destroy(&attr);
+    for (unsigned int i = 0; i < started; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        if (ret != NULL) {
+            // Take the others down with it
+            rc = -1;
+            accel_pipeline_stop(p);
+        }
+    }
+    p->dropped = p->outputs.dropped;
+    return rc;
+}
+
+
+int accel_pipeline_init(struct accel_pipeline *p) {
+    p->input_latency.count = p->output_latency.count = 0;
+    p->input_latency.sum_ns = p->output_latency.sum_ns = 0;
+    p->input_latency.max_ns = p->output_latency.max_ns = 0;
+    p->input_latency.last_ns = p->output_latency.last_ns = 0;
+    p->updates = p->dropped = 0;
+    p->ended = false;
+    rt_jitter_init(&p->tick_jitter);
+    p->ticks = 0;
+    p->stop_fd = -1;
+    p->adc_fd = backend_event_fd(p->hw);
+    p->tick_fd = p->input_fd = p->output_fd = p->wake_fd = -1;
+    atomic_init(&p->mode_request, MODE_REQUEST_NONE);
+    p->period_written = p->period;
+    p->inputs.seqs = p->outputs.seqs = NULL;
+    p->inputs.data = p->outputs.data = NULL;
+
+    // Never read, so it stays readable for every thread once written
+    p->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (p->stop_fd < 0) goto fail;
+    p->tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (p->tick_fd < 0) goto fail;
+    p->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (p->wake_fd < 0) goto fail;
+    if (p->threaded) {
+        p->input_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        p->output_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (p->input_fd < 0 || p->output_fd < 0) goto fail;
+        if (spsc_init(&p->inputs, RING_SLOTS, sizeof(struct accel_state)) < 0) goto fail;
+        if (spsc_init(&p->outputs, RING_SLOTS, sizeof(struct duty_frame)) < 0) goto fail;
+    }
+    return 0;
+
+fail:
+    perror("Failed to set up control loop");
+    accel_pipeline_destroy(p);
+    return -1;
+}
+
+int accel_pipeline_run(struct accel_pipeline *p) {
+    /* Arm the control tick on absolute deadlines, from a start time we know,
+     * so each tick's lateness can be measured; epoll stands in for
+     * clock_nanosleep() here, since the loops wait on other fds too.
+     */
+    p->tick_ns = 1000000000ULL / p->tick_hz;
+    p->tick_start_ns = monotonic_ns();
+    uint64_t first_ns = p->tick_start_ns + p->tick_ns;
+    struct itimerspec tick_spec = {
+        .it_interval = { .tv_sec = p->tick_ns / 1000000000ULL, .tv_nsec = p->tick_ns % 1000000000ULL },
+        .it_value    = { .tv_sec = first_ns / 1000000000ULL, .tv_nsec = first_ns % 1000000000ULL },
+    };
+    timerfd_settime(p->tick_fd, TFD_TIMER_ABSTIME, &tick_spec, NULL);
+
+    if (p->shm != NULL) {
+        // Let tools see the starting settings before the first write
+        struct duty_frame frame = { .period = p->period };
+        for (unsigned int i = 0; i < PIPELINE_CHANNELS; i++) frame.map[i] = i;
+        publish_telemetry(p, &frame);
+    }
+    if (p->verbose) {
+        printf("ADC mode\r");
+        fflush(stdout);
+    }
+    return p->threaded ? run_threaded(p) : run_serial(p);
+}
+
+void accel_pipeline_stop(struct accel_pipeline *p) {
+    eventfd_write(p->stop_fd, 1);
+}
+
+void accel_pipeline_destroy(struct accel_pipeline *p) {
+    int *fds[] = { &p->stop_fd, &p->tick_fd, &p->input_fd, &p->output_fd, &p->wake_fd };
+    for (unsigned int i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] >= 0) close(*fds[i]);
+        *fds[i] = -1;
+    }
+    spsc_free(&p->inputs);
+    spsc_free(&p->outputs);
+}
@@ -0,0 +1,110 @@
+/* Input, transform and actuator stages of accel_control.
+ * The stages run either in series on one thread, or on three threads pinned
+ * to separate cores and connected by latest-value-wins rings, so a slow PWM
+ * write never holds up reading the accelerometer.
+ * EELE 467
+ */
+
+#ifndef ACCEL_PIPELINE_H
+#define ACCEL_PIPELINE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "accel_input.h"
+#include "backend.h"
+#include "control_shm.h"
+#include "rt.h"
+#include "spsc.h"
+
+#define PIPELINE_CHANNELS 3 // Red, green, and blue
+
+/**
+ * struct pipeline_latency - Latency statistics for one point in the pipeline.
+ * @count: Number of latencies recorded
+ * @sum_ns: Sum of all recorded latencies
+ * @max_ns: Largest recorded latency
+ * @last_ns: Latest recorded latency
+ * @samples: Optional; the first @capacity latencies are stored here
+ * @capacity: Size of @samples
+ *
+ * Latencies are measured from the accelerometer event's own timestamp, which
+ * (like evdev's and accel_sim's) comes from CLOCK_REALTIME.
+ */
+struct pipeline_latency {
+    unsigned long count;
+    double sum_ns;
+    uint32_t max_ns;
+    uint32_t last_ns;
+    uint32_t *samples;
+    size_t capacity;
+};
+
+/**
+ * struct accel_pipeline - accel_control's control loop.
+ * @accel: Accelerometer input
+ * @hw: Open backend, with PIPELINE_CHANNELS channels
+ * @period: PWM period, already written; commands may change it later
+ * @shm: Optional; shared-memory segment to publish telemetry to after each
+ *       write, and take commands from on each tick
+ * @tick_hz: Control tick rate; accelerometer updates are written at most
+ *           this often, as are ADC readings if the backend can't signal them
+ * @threaded: Run each stage on its own thread
+ * @rt_priority: If nonzero, run the loop's threads at this SCHED_FIFO
+ *               priority, with their stacks pre-faulted; memory should already
+ *               be locked
+ * @verbose: Print mode changes and warnings
+ * @input_latency: From each event to the input stage handling it
+ * @output_latency: From the newest event behind each PWM write to the write
+ *                  completing (in ADC mode, from reading the ADC instead)
+ * @updates: Number of PWM writes
+ * @dropped: Writes skipped because a newer one superseded them (threaded only)
+ * @ended: Set if the run stopped because a raw input stream ended
+ * @tick_jitter: How late each control tick was handled, against its deadline
+ *
+ * The remaining members are private.
+ */
+struct accel_pipeline {
+    struct accel_input *accel;
+    struct backend *hw;
+    uint32_t period;
+    struct control_shm *shm;
+    unsigned long tick_hz;
+    bool threaded;
+    int rt_priority;
+    bool verbose;
+    struct pipeline_latency input_latency;
+    struct pipeline_latency output_latency;
+    unsigned long updates;
+    unsigned long dropped;
+    bool ended;
+    struct rt_jitter tick_jitter;
+
+    int stop_fd;
+    int adc_fd;
+    int tick_fd;
+    int input_fd;
+    int output_fd;
+    int wake_fd;
+    uint64_t tick_start_ns;
+    uint64_t tick_ns;
+    uint64_t ticks;
+    _Atomic int mode_request;
+    uint32_t period_written;
+    struct spsc_ring inputs;
+    struct spsc_ring outputs;
+};
+
+// Prepare a pipeline whose public configuration members are set; returns -1
+// with errno set on failure
+int accel_pipeline_init(struct accel_pipeline *p);
+// Run until accel_pipeline_stop() is called or the input ends; returns -1 on
+// failure
+int accel_pipeline_run(struct accel_pipeline *p);
+// Ask a running pipeline to stop; async-signal-safe
+void accel_pipeline_stop(struct accel_pipeline *p);
+void accel_pipeline_destroy(struct accel_pipeline *p);
+
+#endif
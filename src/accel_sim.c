@@ -0,0 +1,167 @@
+/* Synthetic accelerometer, for running accel_control without hardware.
+ * Emits a tap (to switch accel_control into accelerometer mode), then a slow
+ * tumble: roll spins through a full circle while pitch rocks back and forth.
+ * Events go to stdout as raw struct input_event, ready to pipe into
+ * `accel_control -i -`, or to a uinput device with -u.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <libevdev-1.0/libevdev/libevdev.h>
+#include <libevdev-1.0/libevdev/libevdev-uinput.h>
+
+// Configuration constants
+#define DEFAULT_RATE_HZ 100 // Like the ADXL345's default output data rate
+#define COUNTS_PER_G 256    // ADXL345 full-resolution scale
+#define ABS_LIMIT 512       // +/-2 g
+#define ROLL_HZ 0.25
+#define PITCH_HZ 0.1
+#define PITCH_AMPLITUDE (M_PI / 5)
+
+
+// Interrupt tracker for main loop
+static volatile sig_atomic_t interrupted = false;
+// And its associated handler function
+static void ctrl_c(int _) {
+    (void)_;
+    interrupted = true;
+}
+
+// Event sink: a uinput device, or raw events on stdout
+static struct libevdev_uinput *uidev = NULL;
+
+// Emit a batch of events, timestamped now; returns -1 if the reader went away
+static int emit(struct input_event *events, unsigned int count) {
+    if (uidev != NULL) {
+        for (unsigned int i = 0; i < count; i++) {
+            if (libevdev_uinput_write_event(uidev, events[i].type, events[i].code, events[i].value) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    for (unsigned int i = 0; i < count; i++) {
+        events[i].input_event_sec = now.tv_sec;
+        events[i].input_event_usec = now.tv_nsec / 1000;
+    }
+    // Small enough to be written to a pipe atomically
+    size_t len = count * sizeof(*events);
+    return write(STDOUT_FILENO, events, len) == (ssize_t)len ? 0 : -1;
+}
+
+// Set up a uinput device that looks like the DE10-Nano's accelerometer
+static int create_uinput(void) {
+    struct libevdev *dev = libevdev_new();
+    libevdev_set_name(dev, "accel_sim");
+    struct input_absinfo abs = { .minimum = -ABS_LIMIT, .maximum = ABS_LIMIT - 1 };
+    libevdev_enable_event_code(dev, EV_ABS, ABS_X, &abs);
+    libevdev_enable_event_code(dev, EV_ABS, ABS_Y, &abs);
+    libevdev_enable_event_code(dev, EV_ABS, ABS_Z, &abs);
+    libevdev_enable_event_code(dev, EV_KEY, BTN_TOUCH, NULL);
+    int ret = libevdev_uinput_create_from_device(dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &uidev);
+    libevdev_free(dev);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to create uinput device: %s\n", strerror(-ret));
+        return -1;
+    }
+    fprintf(stderr, "Created %s\n", libevdev_uinput_get_devnode(uidev));
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+
+    // Parse command-line options
+    double rate_hz = DEFAULT_RATE_HZ;
+    double duration = 0;
+    bool use_uinput = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:t:u")) != -1) {
+        switch (opt) {
+            case 'r':
+                rate_hz = strtod(optarg, NULL);
+                break;
+            case 't':
+                // Run time in seconds; zero means until interrupted
+                duration = strtod(optarg, NULL);
+                break;
+            case 'u':
+                use_uinput = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r rate_hz] [-t seconds] [-u]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (rate_hz <= 0) {
+        fprintf(stderr, "Rate must be positive!\n");
+        return 1;
+    }
+    if (!use_uinput && isatty(STDOUT_FILENO)) {
+        fprintf(stderr, "Refusing to write binary events to a terminal; pipe them somewhere, or use -u\n");
+        return 1;
+    }
+    if (use_uinput && create_uinput() < 0) {
+        return 3;
+    }
+
+    // Let write errors tell us the reader has gone
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, ctrl_c);
+
+    // Tap once, to switch into accelerometer mode
+    struct input_event tap[] = {
+        { .type = EV_KEY, .code = BTN_TOUCH, .value = 1 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+        { .type = EV_KEY, .code = BTN_TOUCH, .value = 0 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+    };
+    int rc = emit(tap, sizeof(tap) / sizeof(tap[0])) < 0 ? 4 : 0;
+
+    // Emit readings on an absolute schedule, so timing errors don't accumulate
+    long long interval_ns = 1e9 / rate_hz;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (unsigned long n = 0; rc == 0 && !interrupted; n++) {
+        double t = n / rate_hz;
+        if (duration > 0 && t >= duration) break;
+
+        // Gravity vector for this orientation, matching accel_control's
+        // roll = atan2(-y, z) and pitch = atan2(-x, sqrt(y^2 + z^2))
+        double roll = 2 * M_PI * ROLL_HZ * t;
+        double pitch = PITCH_AMPLITUDE * sin(2 * M_PI * PITCH_HZ * t);
+        struct input_event reading[] = {
+            { .type = EV_ABS, .code = ABS_X, .value = lround(-sin(pitch) * COUNTS_PER_G) },
+            { .type = EV_ABS, .code = ABS_Y, .value = lround(-sin(roll) * cos(pitch) * COUNTS_PER_G) },
+            { .type = EV_ABS, .code = ABS_Z, .value = lround(cos(roll) * cos(pitch) * COUNTS_PER_G) },
+            { .type = EV_SYN, .code = SYN_REPORT },
+        };
+        if (emit(reading, sizeof(reading) / sizeof(reading[0])) < 0) {
+            // Most likely, the reader exited
+            if (errno != EPIPE) perror("Failed to emit events");
+            rc = errno == EPIPE ? 0 : 4;
+            break;
+        }
+
+        next.tv_nsec += interval_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    if (uidev != NULL) libevdev_uinput_destroy(uidev);
+    return rc;
+}
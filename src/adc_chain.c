@@ -0,0 +1,91 @@
+/* Per-channel signal processing for the ADC controller.
+ *
+ * Each reading passes through the stages in order: exponential smoothing in
+ * fixed point, a deadband, a slew-rate limit, and finally gamma correction by
+ * table lookup. Everything but building the tables is integer arithmetic.
+ * EELE 467
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "adc_chain.h"
+
+
+void chain_default_config(struct chain_config *config) {
+    config->alpha = CHAIN_ALPHA_ONE;
+    config->deadband = 0;
+    config->slew = 0;
+    config->gamma = 1.0;
+}
+
+int chain_configure(struct chain *chain, unsigned int channel, const struct chain_config *config) {
+    if (channel >= CHAIN_MAX_CHANNELS || config->alpha == 0 || config->alpha > CHAIN_ALPHA_ONE
+            || !(config->gamma > 0) || !isfinite(config->gamma)) {
+        return -1;
+    }
+    struct chain_channel *ch = &chain->channels[channel];
+    memset(ch, 0, sizeof(*ch));
+    ch->config = *config;
+    for (unsigned int i = 0; i <= CHAIN_DUTY_ONE; i++) {
+        ch->gamma_table[i] = lround(pow((double)i / CHAIN_DUTY_ONE, config->gamma) * CHAIN_DUTY_ONE);
+    }
+    return 0;
+}
+
+int chain_init(struct chain *chain, unsigned int num_channels, const struct chain_config *config) {
+    if (num_channels > CHAIN_MAX_CHANNELS) return -1;
+    chain->num_channels = num_channels;
+    for (unsigned int i = 0; i < num_channels; i++) {
+        if (chain_configure(chain, i, config) < 0) return -1;
+    }
+    return 0;
+}
+
+// Run one reading through a channel's chain, returning its duty cycle
+static uint32_t chain_step(struct chain_channel *ch, uint32_t reading) {
+    const struct chain_config *config = &ch->config;
+    int64_t x = (int64_t)(reading < CHAIN_DUTY_ONE ? reading : CHAIN_DUTY_ONE) << 16;
+
+    // Exponential smoothing; the first reading starts the filter
+    if (!ch->primed) {
+        ch->smoothed = x;
+    } else {
+        ch->smoothed += (x - ch->smoothed) * config->alpha / CHAIN_ALPHA_ONE;
+    }
+    uint32_t smoothed = (ch->smoothed + 0x8000) >> 16;
+
+    // Deadband: only follow the reading once it leaves the band
+    if (!ch->primed || smoothed > ch->held + config->deadband
+            || smoothed + config->deadband < ch->held) {
+        ch->held = smoothed;
+    }
+
+    // Slew-rate limit
+    if (!ch->primed || config->slew == 0) {
+        ch->slewed = ch->held;
+    } else if (ch->held > ch->slewed + config->slew) {
+        ch->slewed += config->slew;
+    } else if (ch->held + config->slew < ch->slewed) {
+        ch->slewed -= config->slew;
+    } else {
+        ch->slewed = ch->held;
+    }
+
+    ch->primed = 1;
+    return ch->gamma_table[ch->slewed];
+}
+
+uint32_t chain_process(struct chain *chain, const uint32_t *readings, uint32_t *duty_cycles) {
+    uint32_t changed = 0;
+    for (unsigned int i = 0; i < chain->num_channels; i++) {
+        struct chain_channel *ch = &chain->channels[i];
+        int first = !ch->primed;
+        duty_cycles[i] = chain_step(ch, readings[i]);
+        if (first || duty_cycles[i] != ch->written) {
+            ch->written = duty_cycles[i];
+            changed |= 1u << i;
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,80 @@
+/* Per-channel signal processing for the ADC controller.
+ * Turns raw ADC readings into PWM duty cycles through exponential smoothing,
+ * a deadband, a slew-rate limit and gamma correction, and reports which
+ * channels' outputs actually changed, so only those need writing.
+ * EELE 467
+ */
+
+#ifndef ADC_CHAIN_H
+#define ADC_CHAIN_H
+
+#include <stdint.h>
+
+#define CHAIN_MAX_CHANNELS 8
+// Full-scale duty cycle (UQ2.12), which the chain's output never exceeds
+#define CHAIN_DUTY_ONE 0x1000
+// Unity smoothing weight, meaning no smoothing
+#define CHAIN_ALPHA_ONE 0x10000
+
+/**
+ * struct chain_config - Settings for one channel's processing chain.
+ * @alpha: Exponential smoothing weight of each new reading, in 1/65536; from
+ *         1 (heaviest) to CHAIN_ALPHA_ONE (none)
+ * @deadband: Hysteresis, in duty cycle counts; the output holds until the
+ *            smoothed reading moves further than this from it
+ * @slew: Largest change in the output per update, in duty cycle counts; zero
+ *        means unlimited
+ * @gamma: Gamma correction exponent; 1.0 leaves the output linear
+ */
+struct chain_config {
+    uint32_t alpha;
+    uint32_t deadband;
+    uint32_t slew;
+    double gamma;
+};
+
+/**
+ * struct chain_channel - Processing state for one channel.
+ * @config: Settings this channel was initialized with
+ * @gamma_table: Gamma-corrected duty cycle for each linear one
+ * @smoothed: Smoothed reading, in UQ2.12 scaled by 2^16
+ * @held: Output of the deadband stage
+ * @slewed: Output of the slew-rate limit stage
+ * @written: Last duty cycle reported as changed
+ * @primed: Set once the first reading has been processed
+ */
+struct chain_channel {
+    struct chain_config config;
+    uint16_t gamma_table[CHAIN_DUTY_ONE + 1];
+    int64_t smoothed;
+    uint32_t held;
+    uint32_t slewed;
+    uint32_t written;
+    int primed;
+};
+
+/**
+ * struct chain - Processing chains for a set of channels.
+ * @num_channels: Number of channels in use
+ * @channels: Per-channel state
+ */
+struct chain {
+    unsigned int num_channels;
+    struct chain_channel channels[CHAIN_MAX_CHANNELS];
+};
+
+// Settings that pass readings through unchanged
+void chain_default_config(struct chain_config *config);
+// Reset channel's state and apply new settings, building its gamma table;
+// returns -1 if the settings are out of range
+int chain_configure(struct chain *chain, unsigned int channel, const struct chain_config *config);
+// Initialize num_channels channels with the same settings; returns -1 if the
+// settings are out of range
+int chain_init(struct chain *chain, unsigned int num_channels, const struct chain_config *config);
+/* Process one set of readings into duty_cycles. Returns a bitmask of the
+ * channels whose duty cycles differ from the last ones returned; every
+ * channel counts as changed the first time.
+ */
+uint32_t chain_process(struct chain *chain, const uint32_t *readings, uint32_t *duty_cycles);
+
+#endif
@@ -7,21 +7,26 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <glob.h>
+#include <math.h>
 #include <signal.h>
-#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include "adc_chain.h"
+#include "backend.h"
+#include "rt.h"
 
 // Configuration constants
 #define SYSID_VERSION 0x3ADC37ED
-#define ADC_PATH "/sys/class/misc/adc_controller"
-#define PWM_PATH "/sys/class/misc/hps_multi_pwm"
 #define PERIOD 0x100 // 2ms
-#define NUM_CHANNELS 3
-
+#define RT_DEFAULT_RATE 1000 // Loop rate in real-time mode, Hz
+#define MAX_RATE 100000
 
-// Preprocessor macros for stringification
-#define xstr(s) str(s)
-#define str(s) #s
 
 // Interrupt tracker for main loop
 static volatile sig_atomic_t interrupted = false;
@@ -31,31 +36,112 @@ static void ctrl_c(int _) {
     interrupted = true;
 }
 
-// Helper function, so we don't have to seek and flush repeatedly
-int dev_fprintf(FILE *restrict stream, const char *restrict format, ...) {
-    rewind(stream);
-    va_list args;
-    va_start(args, format);
-    int bytes = vfprintf(stream, format, args);
-    va_end(args);
-    fflush(stream);
-    return bytes;
+/* Parse a processing chain option, either "value" for every channel or
+ * "channel:value" for one, into the matching field of configs. Returns -1 if
+ * the option is malformed.
+ */
+static int parse_chain_option(int opt, const char *arg, struct chain_config *configs) {
+    unsigned int first = 0, last = CHAIN_MAX_CHANNELS - 1;
+    const char *colon = strchr(arg, ':');
+    char *end;
+    if (colon != NULL) {
+        first = last = strtoul(arg, &end, 0);
+        if (end != colon || first >= CHAIN_MAX_CHANNELS) return -1;
+        arg = colon + 1;
+    }
+    double value = strtod(arg, &end);
+    if (end == arg || *end != '\0' || !(value >= 0) || !isfinite(value)) return -1;
+    for (unsigned int i = first; i <= last; i++) {
+        switch (opt) {
+            case 's':  // Weight of each new reading, from 0 (exclusive) to 1
+                if (value <= 0 || value > 1) return -1;
+                configs[i].alpha = lround(value * CHAIN_ALPHA_ONE);
+                if (configs[i].alpha == 0) configs[i].alpha = 1;
+                break;
+            case 'd':  // Duty cycle counts, up to full scale
+            case 'l':
+                if (value > CHAIN_DUTY_ONE) return -1;
+                if (opt == 'd') configs[i].deadband = value;
+                else configs[i].slew = value;
+                break;
+            case 'g':
+                if (value <= 0) return -1;
+                configs[i].gamma = value;
+                break;
+        }
+    }
+    return 0;
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-b ", name);
+    backend_print_names(stderr);
+    fprintf(stderr, "] [-s [ch:]smoothing] [-d [ch:]deadband] [-l [ch:]slew] [-g [ch:]gamma]"
+                    " [-r rate_hz] [-R rt_priority]\n");
 }
 
-// Helper function, so we don't have to seek repeatedly
-int dev_fscanf(FILE *restrict stream, const char *restrict format, ...) {
-    freopen(NULL, "r", stream);  // Must re-open device file to update its contents
-    va_list args;
-    va_start(args, format);
-    int result = vfscanf(stream, format, args);
-    va_end(args);
-    return result;
+// Monotonic timestamp helper, in seconds
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
 
 int main(int argc, char** argv) {
 
-    { // Check System ID
+    // Parse command-line options
+    const char *backend_name = DEFAULT_BACKEND;
+    struct chain_config configs[CHAIN_MAX_CHANNELS];
+    for (unsigned int i = 0; i < CHAIN_MAX_CHANNELS; i++) {
+        chain_default_config(&configs[i]);
+    }
+    unsigned long rate = 0;
+    int rt_priority = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:s:d:l:g:r:R:")) != -1) {
+        switch (opt) {
+            case 'b':
+                backend_name = optarg;
+                break;
+            case 'r':  // Fixed loop rate, instead of event- or spin-driven
+                rate = strtoul(optarg, NULL, 0);
+                if (rate > 0 && rate <= MAX_RATE) break;
+                fprintf(stderr, "Loop rate must be between 1 and %d Hz!\n", MAX_RATE);
+                goto usage;
+            case 'R':  // Real-time mode, at this SCHED_FIFO priority
+                rt_priority = strtol(optarg, NULL, 0);
+                if (rt_priority >= 1 && rt_priority <= 99) break;
+                fprintf(stderr, "Invalid option -%c %s\n", opt, optarg);
+                goto usage;
+            case 's':
+            case 'd':
+            case 'l':
+            case 'g':
+                if (parse_chain_option(opt, optarg, configs) == 0) break;
+                fprintf(stderr, "Invalid option -%c %s\n", opt, optarg);
+                // fall through
+            default:
+            usage:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    // Per-channel processing between the readings and the duty cycles; set
+    // up now, so bad settings are reported before touching the hardware
+    static struct chain chain;
+    for (unsigned int i = 0; i < CHAIN_MAX_CHANNELS; i++) {
+        if (chain_configure(&chain, i, &configs[i]) < 0) {
+            fprintf(stderr, "Invalid processing settings for channel %u\n", i);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    // Real-time mode runs on a fixed schedule, so it can meet deadlines
+    if (rt_priority > 0 && rate == 0) rate = RT_DEFAULT_RATE;
+
+    if (backend_needs_hardware(backend_name)) { // Check System ID
         // Scan for valid device files
         glob_t globbuf;
         if (glob("/sys/bus/platform/devices/*.sysid/sysid/id", GLOB_NOSORT, NULL, &globbuf) == GLOB_NOMATCH) {
@@ -88,61 +174,70 @@ int main(int argc, char** argv) {
     }
 
     // Initialization
-    FILE *period_f = fopen(PWM_PATH "/period", "w");
-    if (period_f == NULL) {
-        perror("Failed to open PWM period file");
+    struct backend hw;
+    // Drive as many PWM channels as we have ADC channels for
+    if (backend_open(&hw, backend_name, BACKEND_ALL_CHANNELS) < 0) {
         return 3;
     }
-    FILE *channels[NUM_CHANNELS] = {NULL};
-    FILE *duty_cycles[NUM_CHANNELS] = {NULL};
-    for (unsigned int i = 0; i < NUM_CHANNELS; i++) {
-        char adcfile[sizeof(ADC_PATH) + 20];
-        char pwmfile[sizeof(PWM_PATH) + 20];
-        // Loop-open channel files...
-        snprintf(adcfile, sizeof(adcfile), ADC_PATH "/channel_%d", i);
-        channels[i] = fopen(adcfile, "r");
-        if (channels[i] == NULL) {
-            perror("Failed to open ADC channel");
-            goto cleanup_files;
-        }
-        // ...and duty cycle files
-        snprintf(pwmfile, sizeof(pwmfile), PWM_PATH "/duty_cycle_%d", i+1);
-        duty_cycles[i] = fopen(pwmfile, "w");
-        if (duty_cycles[i] == NULL) {
-            perror("Failed to open PWM interface");
-            goto cleanup_files;
-        }
-    }
-    dev_fprintf(period_f, xstr(PERIOD));
+    backend_write_period(&hw, PERIOD);
+
+    chain.num_channels = hw.num_channels;
 
     // Prepare to catch interrupts
     signal(SIGINT, ctrl_c);
 
+    // Lock memory and claim a core before the loop starts, so it never has
+    // to page or migrate mid-period
+    if (rt_priority > 0) {
+        rt_lock_memory();
+        rt_enter(rt_priority, rt_default_cpu(), "control loop");
+    }
+
     // Main control loop
-    printf("Control loop running; interrupt to exit...\n");
+    printf("Control loop running on %u channels (%s backend); interrupt to exit...\n",
+           hw.num_channels, backend_name);
     fflush(stdout);
+    struct pollfd adc_event = { .fd = backend_event_fd(&hw), .events = POLLIN };
+    unsigned long iterations = 0, writes = 0;
+    struct rt_timer timer;
+    struct rt_jitter jitter;
+    rt_jitter_init(&jitter);
+    if (rate > 0 && rt_timer_start(&timer, rate) < 0) {
+        fprintf(stderr, "Can't run the loop at %lu Hz: %s\n", rate, strerror(errno));
+        backend_close(&hw);
+        return 3;
+    }
+    double start = now_sec();
     while (!interrupted) {
+        if (rate > 0) {
+            // Run once per period, on absolute deadlines
+            if (rt_timer_wait(&timer, &jitter) < 0) continue;
+        } else if (adc_event.fd >= 0 && poll(&adc_event, 1, -1) < 0) {
+            // If the backend can tell us when readings change, sleep until they do
+            continue;  // Probably our SIGINT; re-check flag
+        }
+
         /* Both register sets are fixed-point, and happen to have the same
          * number of fractional bits. Were this not the case, bit shifting
-         * would be needed.
+         * would be needed. Only channels whose outputs changed get written.
          */
-        for (unsigned int i = 0; i < NUM_CHANNELS; i++) {
-            // Loop-write channels and duty cycles
-            unsigned int reading = 0;
-            dev_fscanf(channels[i], "%i", &reading);
-            dev_fprintf(duty_cycles[i], "%u", reading);
-        }
-        // NOTE: No waiting here. Time to eat the CPU for breakfast!
+        uint32_t readings[ADC_NUM_CHANNELS] = {0};
+        uint32_t duty_cycles[ADC_NUM_CHANNELS];
+        backend_read_channels(&hw, readings);
+        uint32_t changed = chain_process(&chain, readings, duty_cycles);
+        backend_write_changed(&hw, duty_cycles, changed);
+        writes += __builtin_popcount(changed);
+        iterations++;
+        // NOTE: Without an event fd, no waiting here. Time to eat the CPU for breakfast!
     }
+    double elapsed = now_sec() - start;
+    printf("\n%lu iterations in %.3f s (%.1f loops/s, %s backend)\n",
+           iterations, elapsed, iterations / elapsed, backend_name);
+    printf("%lu of %lu duty cycle writes needed\n", writes, iterations * hw.num_channels);
+    rt_jitter_print(&jitter, stdout, "Loop");
 
     // Cleanup
-    dev_fprintf(period_f, "0");
-cleanup_files:
-    for (unsigned int i = 0; i < NUM_CHANNELS; i++) {
-        // Loop-close channels and duty cycles
-        if (channels[i] != NULL) fclose(channels[i]);
-        if (duty_cycles[i] != NULL) fclose(duty_cycles[i]);
-    }
-    fclose(period_f);
+    backend_write_period(&hw, 0);
+    backend_close(&hw);
     return 0;
 }
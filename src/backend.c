@@ -0,0 +1,425 @@
+/* Hardware access backends for the controller programs.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+
+#include "backend.h"
+#include "sim.h"
+#include "../linux/pwm/hps_multi_pwm_ioctl.h"
+
+
+//-----------------------------------------------------------------------
+// sysfs backend: text attribute files, one per register
+//-----------------------------------------------------------------------
+struct sysfs_priv {
+    FILE *period;
+    FILE *channels[ADC_NUM_CHANNELS];
+    FILE *duty_cycles[ADC_NUM_CHANNELS];
+};
+
+// Helper function, so we don't have to seek and flush repeatedly
+static int dev_fprintf(FILE *restrict stream, const char *restrict format, ...) {
+    rewind(stream);
+    va_list args;
+    va_start(args, format);
+    int bytes = vfprintf(stream, format, args);
+    va_end(args);
+    fflush(stream);
+    return bytes;
+}
+
+// Helper function, so we don't have to seek repeatedly
+static int dev_fscanf(FILE *restrict stream, const char *restrict format, ...) {
+    freopen(NULL, "r", stream);  // Must re-open device file to update its contents
+    va_list args;
+    va_start(args, format);
+    int result = vfscanf(stream, format, args);
+    va_end(args);
+    return result;
+}
+
+static void sysfs_close(struct backend *be) {
+    struct sysfs_priv *priv = be->priv;
+    if (priv == NULL) return;
+    for (unsigned int i = 0; i < be->num_channels; i++) {
+        // Loop-close channels and duty cycles
+        if (priv->channels[i] != NULL) fclose(priv->channels[i]);
+        if (priv->duty_cycles[i] != NULL) fclose(priv->duty_cycles[i]);
+    }
+    if (priv->period != NULL) fclose(priv->period);
+    free(priv);
+    be->priv = NULL;
+}
+
+static int sysfs_open(struct backend *be) {
+    struct sysfs_priv *priv = calloc(1, sizeof(*priv));
+    if (priv == NULL) return -1;
+    be->priv = priv;
+
+    priv->period = fopen(PWM_PATH "/period", "w");
+    if (priv->period == NULL) {
+        perror("Failed to open PWM period file");
+        return -1;
+    }
+    for (unsigned int i = 0; i < be->num_channels; i++) {
+        char adcfile[sizeof(ADC_PATH) + 20];
+        char pwmfile[sizeof(PWM_PATH) + 20];
+        // Loop-open channel files...
+        snprintf(adcfile, sizeof(adcfile), ADC_PATH "/channel_%d", i);
+        priv->channels[i] = fopen(adcfile, "r");
+        if (priv->channels[i] == NULL) {
+            perror("Failed to open ADC channel");
+            return -1;
+        }
+        // ...and duty cycle files
+        snprintf(pwmfile, sizeof(pwmfile), PWM_PATH "/duty_cycle_%d", i+1);
+        priv->duty_cycles[i] = fopen(pwmfile, "w");
+        if (priv->duty_cycles[i] == NULL) {
+            perror("Failed to open PWM interface");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int sysfs_read_channels(struct backend *be, uint32_t *readings) {
+    struct sysfs_priv *priv = be->priv;
+    for (unsigned int i = 0; i < be->num_channels; i++) {
+        if (dev_fscanf(priv->channels[i], "%i", &readings[i]) != 1) return -1;
+    }
+    return 0;
+}
+
+static int sysfs_write_duty_cycles(struct backend *be, const uint32_t *duty_cycles) {
+    struct sysfs_priv *priv = be->priv;
+    for (unsigned int i = 0; i < be->num_channels; i++) {
+        if (dev_fprintf(priv->duty_cycles[i], "%u", duty_cycles[i]) < 0) return -1;
+    }
+    return 0;
+}
+
+static int sysfs_write_changed(struct backend *be, const uint32_t *duty_cycles, uint32_t mask) {
+    struct sysfs_priv *priv = be->priv;
+    for (unsigned int i = 0; i < be->num_channels; i++) {
+        if (!(mask & (1u << i))) continue;
+        if (dev_fprintf(priv->duty_cycles[i], "%u", duty_cycles[i]) < 0) return -1;
+    }
+    return 0;
+}
+
+static int sysfs_write_period(struct backend *be, uint32_t period) {
+    struct sysfs_priv *priv = be->priv;
+    return dev_fprintf(priv->period, "%u", period) < 0 ? -1 : 0;
+}
+
+static const struct backend_ops sysfs_ops = {
+    .name = "sysfs",
+    .open = sysfs_open,
+    .read_channels = sysfs_read_channels,
+    .write_duty_cycles = sysfs_write_duty_cycles,
+    .write_changed = sysfs_write_changed,
+    .write_period = sysfs_write_period,
+    .close = sysfs_close,
+};
+
+
+//-----------------------------------------------------------------------
+// dev backend: raw 32-bit register values through the char devices
+//-----------------------------------------------------------------------
+struct dev_priv {
+    int adc_fd;
+    int pwm_fd;
+    struct hps_multi_pwm_config config;
+};
+
+// Write one register, treating short writes as errors
+static int dev_write_reg(int fd, uint32_t val, off_t offset) {
+    ssize_t ret = pwrite(fd, &val, sizeof(val), offset);
+    if (ret == sizeof(val)) return 0;
+    if (ret >= 0) errno = EIO;
+    return -1;
+}
+
+static void dev_close(struct backend *be) {
+    struct dev_priv *priv = be->priv;
+    if (priv == NULL) return;
+    if (priv->adc_fd >= 0) close(priv->adc_fd);
+    if (priv->pwm_fd >= 0) close(priv->pwm_fd);
+    free(priv);
+    be->priv = NULL;
+}
+
+static int dev_open(struct backend *be) {
+    struct dev_priv *priv = calloc(1, sizeof(*priv));
+    if (priv == NULL) return -1;
+    priv->adc_fd = priv->pwm_fd = -1;
+    priv->config.num_channels = be->num_channels;
+    be->priv = priv;
+
+    /* Non-blocking, so reads always return the current readings; callers
+     * wanting to sleep until they change can poll our event fd instead
+     */
+    priv->adc_fd = open(ADC_DEV, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (priv->adc_fd < 0) {
+        perror("Failed to open " ADC_DEV);
+        return -1;
+    }
+    priv->pwm_fd = open(PWM_DEV, O_WRONLY | O_CLOEXEC);
+    if (priv->pwm_fd < 0) {
+        perror("Failed to open " PWM_DEV);
+        return -1;
+    }
+    return 0;
+}
+
+static int dev_read_channels(struct backend *be, uint32_t *readings) {
+    struct dev_priv *priv = be->priv;
+    // Channel registers are contiguous, so one burst read fetches them all
+    size_t len = be->num_channels * sizeof(*readings);
+    ssize_t ret = pread(priv->adc_fd, readings, len, ADC_REG_CH_OFFSET(0));
+    if (ret == (ssize_t)len) return 0;
+    if (ret >= 0) errno = EIO;
+    return -1;
+}
+
+static int dev_write_duty_cycles(struct backend *be, const uint32_t *duty_cycles) {
+    struct dev_priv *priv = be->priv;
+    /* Apply the period and every duty cycle in one ioctl, which also makes
+     * them take effect together at the next PWM period boundary
+     */
+    for (unsigned int i = 0; i < be->num_channels; i++) {
+        priv->config.duty_cycles[i] = duty_cycles[i];
+    }
+    return ioctl(priv->pwm_fd, HPS_MULTI_PWM_IOC_APPLY, &priv->config);
+}
+
+static int dev_write_period(struct backend *be, uint32_t period) {
+    struct dev_priv *priv = be->priv;
+    priv->config.period = period;
+    return dev_write_reg(priv->pwm_fd, period, PWM_REG_PERIOD_OFFSET);
+}
+
+static int dev_event_fd(struct backend *be) {
+    struct dev_priv *priv = be->priv;
+    // The ADC driver flags new readings via poll(), cleared by our reads
+    return priv->adc_fd;
+}
+
+static const struct backend_ops dev_ops = {
+    .name = "dev",
+    .open = dev_open,
+    .read_channels = dev_read_channels,
+    .write_duty_cycles = dev_write_duty_cycles,
+    .write_period = dev_write_period,
+    .event_fd = dev_event_fd,
+    .close = dev_close,
+};
+
+
+//-----------------------------------------------------------------------
+// mmap backend: registers mapped straight into our address space
+//-----------------------------------------------------------------------
+struct mmap_priv {
+    void *adc_page;
+    void *pwm_page;
+    size_t page_size;
+    volatile uint32_t *adc_regs;
+    volatile uint32_t *pwm_regs;
+};
+
+// Map the register page of a device, returning a pointer to its registers
+static volatile uint32_t *mmap_regs(const char *devfile, const char *offset_file,
+                                    size_t page_size, void **page) {
+    // Find where the registers sit within their page
+    FILE *offset_f = fopen(offset_file, "r");
+    if (offset_f == NULL) {
+        perror("Failed to open mmap offset file");
+        return NULL;
+    }
+    unsigned int offset = 0;
+    int matched = fscanf(offset_f, "%i", &offset);
+    fclose(offset_f);
+    if (matched != 1 || offset >= page_size) {
+        fprintf(stderr, "Invalid mmap offset in %s\n", offset_file);
+        return NULL;
+    }
+
+    // Map the page itself; the mapping outlives the file descriptor
+    int fd = open(devfile, O_RDWR | O_SYNC | O_CLOEXEC);
+    if (fd < 0) {
+        perror("Failed to open register device");
+        return NULL;
+    }
+    *page = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (*page == MAP_FAILED) {
+        perror("Failed to map registers");
+        *page = NULL;
+        return NULL;
+    }
+    return (volatile uint32_t *)((char *)*page + offset);
+}
+
+static void mmap_close(struct backend *be) {
+    struct mmap_priv *priv = be->priv;
+    if (priv == NULL) return;
+    if (priv->adc_page != NULL) munmap(priv->adc_page, priv->page_size);
+    if (priv->pwm_page != NULL) munmap(priv->pwm_page, priv->page_size);
+    free(priv);
+    be->priv = NULL;
+}
+
+static int mmap_open(struct backend *be) {
+    struct mmap_priv *priv = calloc(1, sizeof(*priv));
+    if (priv == NULL) return -1;
+    be->priv = priv;
+    priv->page_size = sysconf(_SC_PAGESIZE);
+
+    priv->adc_regs = mmap_regs(ADC_DEV, ADC_PATH "/mmap_offset", priv->page_size, &priv->adc_page);
+    if (priv->adc_regs == NULL) return -1;
+    priv->pwm_regs = mmap_regs(PWM_DEV, PWM_PATH "/mmap_offset", priv->page_size, &priv->pwm_page);
+    if (priv->pwm_regs == NULL) return -1;
+    return 0;
+}
+
+static int mmap_read_channels(struct backend *be, uint32_t *readings) {
+    struct mmap_priv *priv = be->priv;
+    for (unsigned int i = 0; i < be->num_channels; i++) {
+        readings[i] = priv->adc_regs[ADC_REG_CH_OFFSET(i) / sizeof(uint32_t)];
+    }
+    return 0;
+}
+
+static int mmap_write_duty_cycles(struct backend *be, const uint32_t *duty_cycles) {
+    struct mmap_priv *priv = be->priv;
+    // Hold off the hardware's commit, so the new duty cycles apply together
+    priv->pwm_regs[PWM_REG_CTRL_OFFSET / sizeof(uint32_t)] = PWM_CTRL_HOLD;
+    for (unsigned int i = 0; i < be->num_channels; i++) {
+        priv->pwm_regs[PWM_REG_DC_OFFSET(i) / sizeof(uint32_t)] = duty_cycles[i];
+    }
+    priv->pwm_regs[PWM_REG_CTRL_OFFSET / sizeof(uint32_t)] = 0;
+    return 0;
+}
+
+static int mmap_write_changed(struct backend *be, const uint32_t *duty_cycles, uint32_t mask) {
+    struct mmap_priv *priv = be->priv;
+    priv->pwm_regs[PWM_REG_CTRL_OFFSET / sizeof(uint32_t)] = PWM_CTRL_HOLD;
+    for (unsigned int i = 0; i < be->num_channels; i++) {
+        if (mask & (1u << i)) {
+            priv->pwm_regs[PWM_REG_DC_OFFSET(i) / sizeof(uint32_t)] = duty_cycles[i];
+        }
+    }
+    priv->pwm_regs[PWM_REG_CTRL_OFFSET / sizeof(uint32_t)] = 0;
+    return 0;
+}
+
+static int mmap_write_period(struct backend *be, uint32_t period) {
+    struct mmap_priv *priv = be->priv;
+    priv->pwm_regs[PWM_REG_PERIOD_OFFSET / sizeof(uint32_t)] = period;
+    return 0;
+}
+
+static const struct backend_ops mmap_ops = {
+    .name = "mmap",
+    .open = mmap_open,
+    .read_channels = mmap_read_channels,
+    .write_duty_cycles = mmap_write_duty_cycles,
+    .write_changed = mmap_write_changed,
+    .write_period = mmap_write_period,
+    .close = mmap_close,
+};
+
+
+//-----------------------------------------------------------------------
+// Backend selection
+//-----------------------------------------------------------------------
+// Ask the PWM driver how many channels its hardware has
+static int driver_pwm_channels(void) {
+    FILE *count_f = fopen(PWM_PATH "/num_channels", "r");
+    if (count_f == NULL) {
+        // Drivers without the attribute only support the original three
+        return PWM_DEFAULT_CHANNELS;
+    }
+    unsigned int count = 0;
+    int matched = fscanf(count_f, "%u", &count);
+    fclose(count_f);
+    if (matched != 1 || count == 0) {
+        fprintf(stderr, "Invalid PWM channel count in " PWM_PATH "/num_channels\n");
+        return -1;
+    }
+    return count;
+}
+
+static const struct backend_ops *const backends[] = {
+    &sysfs_ops,
+    &dev_ops,
+    &mmap_ops,
+    &sim_ops,
+};
+#define NUM_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+// Look up a backend by name, ignoring any ":options" suffix
+static const struct backend_ops *backend_find(const char *name) {
+    size_t len = strcspn(name, ":");
+    for (unsigned int i = 0; i < NUM_BACKENDS; i++) {
+        if (strncmp(backends[i]->name, name, len) == 0 && backends[i]->name[len] == '\0') {
+            return backends[i];
+        }
+    }
+    return NULL;
+}
+
+int backend_open(struct backend *be, const char *name, unsigned int num_channels) {
+    const char *args = strchr(name, ':');
+    be->ops = backend_find(name);
+    be->priv = NULL;
+    be->num_channels = num_channels;
+    be->args = args != NULL ? args + 1 : NULL;
+    if (be->ops == NULL) {
+        fprintf(stderr, "Unknown backend \"%s\"! (Expected one of ", name);
+        backend_print_names(stderr);
+        fprintf(stderr, ")\n");
+        return -1;
+    }
+    int pwm_channels = be->ops->pwm_channels ? be->ops->pwm_channels(be) : driver_pwm_channels();
+    if (pwm_channels <= 0) return -1;
+    be->pwm_channels = pwm_channels;
+    if (num_channels == BACKEND_ALL_CHANNELS) {
+        be->num_channels = num_channels = pwm_channels < ADC_NUM_CHANNELS ? pwm_channels : ADC_NUM_CHANNELS;
+    }
+    if (num_channels > ADC_NUM_CHANNELS) {
+        fprintf(stderr, "Backend supports at most %d channels!\n", ADC_NUM_CHANNELS);
+        return -1;
+    }
+    if (num_channels > be->pwm_channels) {
+        fprintf(stderr, "PWM controller only has %u channels!\n", be->pwm_channels);
+        return -1;
+    }
+    if (be->ops->open(be) < 0) {
+        be->ops->close(be);
+        return -1;
+    }
+    return 0;
+}
+
+bool backend_needs_hardware(const char *name) {
+    const struct backend_ops *ops = backend_find(name);
+    // Unknown backends get reported when opened
+    return ops == NULL || !ops->simulated;
+}
+
+void backend_print_names(FILE *stream) {
+    for (unsigned int i = 0; i < NUM_BACKENDS; i++) {
+        fprintf(stream, "%s%s", i ? "|" : "", backends[i]->name);
+    }
+}
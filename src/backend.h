@@ -0,0 +1,124 @@
+/* Hardware access backends for the controller programs.
+ * Each backend knows how to read ADC channels and write PWM registers through
+ * one of the interfaces exposed by our drivers.
+ * EELE 467
+ */
+
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Driver interface locations
+#define ADC_PATH "/sys/class/misc/adc_controller"
+#define PWM_PATH "/sys/class/misc/hps_multi_pwm"
+#define ADC_DEV "/dev/adc_controller"
+#define PWM_DEV "/dev/hps_multi_pwm"
+
+// Register offsets; these mirror linux/adc/reg_offsets.h and
+// linux/pwm/reg_offsets.h, which can't both be included at once
+#define ADC_NUM_CHANNELS 8
+#define ADC_REG_CH_OFFSET(n) (0x4 * (n))
+#define PWM_REG_PERIOD_OFFSET 0x0
+#define PWM_REG_DC_OFFSET(n) (0x4 * ((n) + 1)) // Zero-based channel index
+#define PWM_REG_CTRL_OFFSET 0x400
+#define PWM_CTRL_HOLD 0x1
+#define PWM_REG_CAPS_OFFSET 0x404
+#define PWM_CAPS_NUM_CHANNELS 0xFF
+// PWM channel count assumed when the driver doesn't report one
+#define PWM_DEFAULT_CHANNELS 3
+
+#define DEFAULT_BACKEND "sysfs"
+// Channel count for backend_open(), meaning as many pairs as the hardware has
+#define BACKEND_ALL_CHANNELS 0
+
+
+struct backend;
+
+/**
+ * struct backend_ops - Operations implemented by a hardware backend.
+ * @name: Name used to select the backend at runtime
+ * @open: Acquire resources for the first @be->num_channels channels
+ * @read_channels: Read @be->num_channels ADC channels into @readings
+ * @write_duty_cycles: Write @be->num_channels PWM duty cycles
+ * @write_changed: Optional; write only the duty cycles whose bits are set in
+ *                 @mask. Backends without it write them all.
+ * @write_period: Write the PWM period register
+ * @pwm_channels: Optional; return the number of PWM channels available, or -1.
+ *                Called before @open. Backends without it use the count the
+ *                PWM driver reports through sysfs.
+ * @event_fd: Optional; return a file descriptor that polls readable when new
+ *            ADC readings are available, and is reset by read_channels
+ * @close: Release all resources; must tolerate a partially-opened backend
+ * @simulated: Set if the backend doesn't touch real hardware
+ *
+ * All fallible operations return zero on success, or -1 with errno set.
+ * @read_channels may run on one thread while another writes duty cycles, so
+ * the two must not share unsynchronized state.
+ */
+struct backend_ops {
+    const char *name;
+    int  (*open)(struct backend *be);
+    int  (*read_channels)(struct backend *be, uint32_t *readings);
+    int  (*write_duty_cycles)(struct backend *be, const uint32_t *duty_cycles);
+    int  (*write_changed)(struct backend *be, const uint32_t *duty_cycles, uint32_t mask);
+    int  (*write_period)(struct backend *be, uint32_t period);
+    int  (*pwm_channels)(struct backend *be);
+    int  (*event_fd)(struct backend *be);
+    void (*close)(struct backend *be);
+    bool simulated;
+};
+
+/**
+ * struct backend - An open hardware backend.
+ * @ops: Backend implementation
+ * @num_channels: Number of ADC/PWM channel pairs in use
+ * @pwm_channels: Number of channels the PWM controller provides
+ * @args: Backend-specific options (the text after a ':' in the backend name),
+ *        or NULL if none were given
+ * @priv: Implementation-private state
+ */
+struct backend {
+    const struct backend_ops *ops;
+    unsigned int num_channels;
+    unsigned int pwm_channels;
+    const char *args;
+    void *priv;
+};
+
+
+// Open the backend called name, or print an error and return -1
+// The name may be followed by ":options", which are passed to the backend
+// num_channels may be BACKEND_ALL_CHANNELS; be->num_channels holds the result
+int backend_open(struct backend *be, const char *name, unsigned int num_channels);
+// Check whether the named backend needs the FPGA hardware to be present
+bool backend_needs_hardware(const char *name);
+// List available backend names, separated by '|'
+void backend_print_names(FILE *stream);
+
+static inline int backend_read_channels(struct backend *be, uint32_t *readings) {
+    return be->ops->read_channels(be, readings);
+}
+static inline int backend_write_duty_cycles(struct backend *be, const uint32_t *duty_cycles) {
+    return be->ops->write_duty_cycles(be, duty_cycles);
+}
+// Write the duty cycles of the channels in mask (bit n for channel n), if any
+static inline int backend_write_changed(struct backend *be, const uint32_t *duty_cycles, uint32_t mask) {
+    if (mask == 0) return 0;
+    if (be->ops->write_changed == NULL) return be->ops->write_duty_cycles(be, duty_cycles);
+    return be->ops->write_changed(be, duty_cycles, mask);
+}
+static inline int backend_write_period(struct backend *be, uint32_t period) {
+    return be->ops->write_period(be, period);
+}
+// Returns -1 if the backend can't signal new ADC readings
+static inline int backend_event_fd(struct backend *be) {
+    return be->ops->event_fd ? be->ops->event_fd(be) : -1;
+}
+static inline void backend_close(struct backend *be) {
+    be->ops->close(be);
+}
+
+#endif
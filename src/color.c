@@ -0,0 +1,185 @@
+/* Integer-only color pipeline for the accelerometer controller.
+ *
+ * Angles are kept as fractions of a full turn, scaled by 2^32, so that they
+ * wrap for free in uint32_t arithmetic. atan2() and sqrt() are both done by
+ * interpolating in small precomputed tables, after reducing their arguments
+ * to the range the tables cover. Color components are Q31 fractions until the
+ * final conversion to UQ2.12.
+ * EELE 467
+ */
+
+#include <stdlib.h>
+
+#include "color.h"
+
+#define QUARTER_TURN 0x40000000u
+#define HALF_TURN 0x80000000u
+#define ATAN_TABLE_SIZE 256
+#define SQRT_TABLE_SIZE 192 // Covers [1/4, 1]
+#define SQRT_TABLE_START 64 // Index of 1/4, in 1/256ths
+
+
+/* Precomputed tables, generated with:
+ *   [round(atan(k / 256) / (2 * pi) * 2**32) for k in range(257)]
+ *   [round(sqrt(k / 256) * 2**16) for k in range(64, 257)]
+ * Linear interpolation between entries keeps the error below 2e-6 (radians,
+ * or relative, respectively).
+ */
+// atan(k / ATAN_TABLE_SIZE) in turns, scaled by 2^32; the last entry is
+// repeated, so interpolating at k = ATAN_TABLE_SIZE stays in bounds
+static const uint32_t atan_table[ATAN_TABLE_SIZE + 2] = {
+    0x00000000, 0x0028BE53, 0x00517C55, 0x007A39B4, 0x00A2F61E, 0x00CBB143,
+    0x00F46AD1, 0x011D2276, 0x0145D7E1, 0x016E8AC2, 0x01973AC8, 0x01BFE7A1,
+    0x01E890FD, 0x0211368B, 0x0239D7FC, 0x026274FE, 0x028B0D43, 0x02B3A07A,
+    0x02DC2E54, 0x0304B681, 0x032D38B4, 0x0355B49C, 0x037E29EB, 0x03A69855,
+    0x03CEFF8A, 0x03F75F3D, 0x041FB721, 0x044806EA, 0x04704E4B, 0x04988CF8,
+    0x04C0C2A5, 0x04E8EF07, 0x051111D4, 0x05392AC1, 0x05613984, 0x05893DD4,
+    0x05B13767, 0x05D925F6, 0x06010937, 0x0628E0E5, 0x0650ACB7, 0x06786C67,
+    0x06A01FAF, 0x06C7C649, 0x06EF5FF2, 0x0716EC63, 0x073E6B5B, 0x0765DC95,
+    0x078D3FCF, 0x07B494C6, 0x07DBDB3A, 0x080312EA, 0x082A3B95, 0x085154FC,
+    0x08785EDF, 0x089F5902, 0x08C64325, 0x08ED1D0D, 0x0913E67C, 0x093A9F37,
+    0x09614704, 0x0987DDA7, 0x09AE62E7, 0x09D4D68B, 0x09FB385B, 0x0A218820,
+    0x0A47C5A2, 0x0A6DF0AC, 0x0A940907, 0x0ABA0E80, 0x0AE000E2, 0x0B05DFFA,
+    0x0B2BAB95, 0x0B516382, 0x0B770790, 0x0B9C978D, 0x0BC2134C, 0x0BE77A9B,
+    0x0C0CCD4F, 0x0C320B38, 0x0C57342B, 0x0C7C47FB, 0x0CA1467D, 0x0CC62F87,
+    0x0CEB02EF, 0x0D0FC08D, 0x0D346837, 0x0D58F9C7, 0x0D7D7515, 0x0DA1D9FC,
+    0x0DC62856, 0x0DEA6000, 0x0E0E80D4, 0x0E328AB1, 0x0E567D73, 0x0E7A58FA,
+    0x0E9E1D24, 0x0EC1C9D1, 0x0EE55EE3, 0x0F08DC39, 0x0F2C41B7, 0x0F4F8F3F,
+    0x0F72C4B4, 0x0F95E1FB, 0x0FB8E6F9, 0x0FDBD394, 0x0FFEA7B1, 0x10216337,
+    0x1044060F, 0x10669021, 0x10890156, 0x10AB5998, 0x10CD98D1, 0x10EFBEED,
+    0x1111CBD6, 0x1133BF7A, 0x115599C7, 0x11775AA8, 0x1199020E, 0x11BA8FE7,
+    0x11DC0423, 0x11FD5EB3, 0x121E9F86, 0x123FC690, 0x1260D3C2, 0x1281C70F,
+    0x12A2A06A, 0x12C35FC8, 0x12E4051E, 0x13049060, 0x13250184, 0x13455882,
+    0x1365954F, 0x1385B7E4, 0x13A5C038, 0x13C5AE45, 0x13E58204, 0x14053B6E,
+    0x1424DA7E, 0x14445F2E, 0x1463C97A, 0x1483195F, 0x14A24ED8, 0x14C169E2,
+    0x14E06A7B, 0x14FF50A0, 0x151E1C51, 0x153CCD8C, 0x155B6450, 0x1579E09E,
+    0x15984275, 0x15B689D7, 0x15D4B6C5, 0x15F2C93F, 0x1610C149, 0x162E9EE6,
+    0x164C6217, 0x166A0AE0, 0x16879946, 0x16A50D4C, 0x16C266F7, 0x16DFA64C,
+    0x16FCCB50, 0x1719D60A, 0x1736C67F, 0x17539CB6, 0x177058B6, 0x178CFA85,
+    0x17A9822D, 0x17C5EFB4, 0x17E24323, 0x17FE7C82, 0x181A9BDB, 0x1836A137,
+    0x18528C9F, 0x186E5E1D, 0x188A15BC, 0x18A5B386, 0x18C13785, 0x18DCA1C6,
+    0x18F7F252, 0x19132937, 0x192E4680, 0x19494A38, 0x1964346E, 0x197F052C,
+    0x1999BC81, 0x19B45A79, 0x19CEDF22, 0x19E94A8A, 0x1A039CBE, 0x1A1DD5CD,
+    0x1A37F5C5, 0x1A51FCB4, 0x1A6BEAAA, 0x1A85BFB5, 0x1A9F7BE5, 0x1AB91F49,
+    0x1AD2A9F0, 0x1AEC1BEB, 0x1B057548, 0x1B1EB61A, 0x1B37DE6F, 0x1B50EE58,
+    0x1B69E5E6, 0x1B82C529, 0x1B9B8C33, 0x1BB43B15, 0x1BCCD1E0, 0x1BE550A5,
+    0x1BFDB776, 0x1C160664, 0x1C2E3D81, 0x1C465CE0, 0x1C5E6492, 0x1C7654A9,
+    0x1C8E2D38, 0x1CA5EE52, 0x1CBD9807, 0x1CD52A6C, 0x1CECA593, 0x1D04098F,
+    0x1D1B5672, 0x1D328C4F, 0x1D49AB3B, 0x1D60B347, 0x1D77A487, 0x1D8E7F0F,
+    0x1DA542F1, 0x1DBBF042, 0x1DD28714, 0x1DE9077C, 0x1DFF718C, 0x1E15C55A,
+    0x1E2C02F8, 0x1E422A7A, 0x1E583BF4, 0x1E6E377B, 0x1E841D21, 0x1E99ECFC,
+    0x1EAFA71F, 0x1EC54B9E, 0x1EDADA8D, 0x1EF05401, 0x1F05B80E, 0x1F1B06C8,
+    0x1F304043, 0x1F456493, 0x1F5A73CD, 0x1F6F6E05, 0x1F84534F, 0x1F9923C0,
+    0x1FADDF6B, 0x1FC28667, 0x1FD718C6, 0x1FEB969D, 0x20000000, 0x20000000,
+};
+
+static const uint32_t sqrt_table[SQRT_TABLE_SIZE + 1] = {
+    0x08000, 0x080FF, 0x081FC, 0x082F7, 0x083F0, 0x084E8, 0x085DE, 0x086D2,
+    0x087C4, 0x088B4, 0x089A3, 0x08A90, 0x08B7C, 0x08C66, 0x08D4F, 0x08E36,
+    0x08F1C, 0x09000, 0x090E3, 0x091C4, 0x092A4, 0x09383, 0x09461, 0x0953D,
+    0x09618, 0x096F2, 0x097CA, 0x098A1, 0x09977, 0x09A4C, 0x09B20, 0x09BF3,
+    0x09CC4, 0x09D95, 0x09E64, 0x09F33, 0x0A000, 0x0A0CC, 0x0A198, 0x0A262,
+    0x0A32B, 0x0A3F4, 0x0A4BB, 0x0A581, 0x0A647, 0x0A70B, 0x0A7CF, 0x0A892,
+    0x0A954, 0x0AA15, 0x0AAD5, 0x0AB95, 0x0AC53, 0x0AD11, 0x0ADCE, 0x0AE8A,
+    0x0AF45, 0x0B000, 0x0B0BA, 0x0B173, 0x0B22B, 0x0B2E3, 0x0B399, 0x0B450,
+    0x0B505, 0x0B5BA, 0x0B66E, 0x0B721, 0x0B7D3, 0x0B885, 0x0B937, 0x0B9E7,
+    0x0BA97, 0x0BB46, 0x0BBF5, 0x0BCA3, 0x0BD51, 0x0BDFD, 0x0BEA9, 0x0BF55,
+    0x0C000, 0x0C0AA, 0x0C154, 0x0C1FD, 0x0C2A6, 0x0C34E, 0x0C3F6, 0x0C49C,
+    0x0C543, 0x0C5E9, 0x0C68E, 0x0C733, 0x0C7D7, 0x0C87B, 0x0C91E, 0x0C9C1,
+    0x0CA63, 0x0CB04, 0x0CBA6, 0x0CC46, 0x0CCE6, 0x0CD86, 0x0CE25, 0x0CEC4,
+    0x0CF62, 0x0D000, 0x0D09D, 0x0D13A, 0x0D1D7, 0x0D272, 0x0D30E, 0x0D3A9,
+    0x0D444, 0x0D4DE, 0x0D577, 0x0D611, 0x0D6AA, 0x0D742, 0x0D7DA, 0x0D872,
+    0x0D909, 0x0D9A0, 0x0DA36, 0x0DACC, 0x0DB62, 0x0DBF7, 0x0DC8B, 0x0DD20,
+    0x0DDB4, 0x0DE47, 0x0DEDB, 0x0DF6E, 0x0E000, 0x0E092, 0x0E124, 0x0E1B5,
+    0x0E246, 0x0E2D7, 0x0E367, 0x0E3F7, 0x0E487, 0x0E516, 0x0E5A5, 0x0E633,
+    0x0E6C1, 0x0E74F, 0x0E7DD, 0x0E86A, 0x0E8F7, 0x0E983, 0x0EA0F, 0x0EA9B,
+    0x0EB27, 0x0EBB2, 0x0EC3D, 0x0ECC7, 0x0ED51, 0x0EDDB, 0x0EE65, 0x0EEEE,
+    0x0EF77, 0x0F000, 0x0F088, 0x0F110, 0x0F198, 0x0F220, 0x0F2A7, 0x0F32E,
+    0x0F3B4, 0x0F43B, 0x0F4C1, 0x0F546, 0x0F5CC, 0x0F651, 0x0F6D6, 0x0F75B,
+    0x0F7DF, 0x0F863, 0x0F8E7, 0x0F96A, 0x0F9EE, 0x0FA71, 0x0FAF3, 0x0FB76,
+    0x0FBF8, 0x0FC7A, 0x0FCFB, 0x0FD7D, 0x0FDFE, 0x0FE7F, 0x0FEFF, 0x0FF80,
+    0x10000,
+};
+
+/* Component selectors for each 60-degree hue sector; entry n of a row picks
+ * the red, green, or blue value from {chroma, intermediate, zero} (before the
+ * lightness offset is added). This replaces hsl2rgb()'s if/else ladder.
+ */
+static const uint8_t sector_components[6][3] = {
+    {0, 1, 2},
+    {1, 0, 2},
+    {2, 0, 1},
+    {2, 1, 0},
+    {1, 2, 0},
+    {0, 2, 1},
+};
+
+
+// atan2(y, x) in turns, scaled by 2^32, for |x|, |y| < 2^62
+static uint32_t atan2_turns(int64_t y, int64_t x) {
+    uint64_t ax = llabs(x), ay = llabs(y);
+    if ((ax | ay) == 0) return 0;  // Like atan2(0, 0)
+
+    // Reduce to the first octant, and scale so the ratio fits a 32-bit division
+    uint64_t big = ax > ay ? ax : ay, small = ax > ay ? ay : ax;
+    int shift = (64 - 16) - __builtin_clzll(big);
+    if (shift > 0) {
+        big >>= shift;
+        small >>= shift;
+    }
+    uint32_t ratio = ((uint32_t)small << 16) / (uint32_t)big; // Q16, in [0, 1]
+
+    // Interpolate between table entries
+    uint32_t index = ratio >> 8, frac = ratio & 0xFF;
+    uint32_t angle = atan_table[index]
+                   + (((atan_table[index + 1] - atan_table[index]) * frac) >> 8);
+
+    // Unfold the octant
+    if (ay > ax) angle = QUARTER_TURN - angle;
+    if (x < 0) angle = HALF_TURN - angle;
+    if (y < 0) angle = -angle;
+    return angle;
+}
+
+// sqrt(s), with 8 fractional bits, for s < 2^62
+static uint64_t sqrt_q8(uint64_t s) {
+    if (s == 0) return 0;
+    // Scale by an even power of two into [2^62, 2^64), i.e. [1/4, 1) of 2^64
+    int shift = __builtin_clzll(s) & ~1;
+    uint64_t m = s << shift;
+    uint32_t index = (m >> 56) - SQRT_TABLE_START, frac = (m >> 48) & 0xFF;
+    uint32_t root = sqrt_table[index] + (((sqrt_table[index + 1] - sqrt_table[index]) * frac) >> 8);
+    // root is sqrt(m / 2^64) in Q16, so sqrt(s) = root * 2^(16 - shift/2); we want Q8
+    int scale = 24 - shift / 2;
+    return scale >= 0 ? (uint64_t)root << scale : root >> -scale;
+}
+
+void accel_to_duty_cycles(const int *accel_vec, uint32_t *duty_cycles) {
+    int64_t x = accel_vec[0], y = accel_vec[1], z = accel_vec[2];
+
+    // Roll = atan2(-y, z); pitch = atan2(-x, sqrt(y^2 + z^2))
+    uint32_t roll = atan2_turns(-y, z);
+    int32_t pitch = (int32_t)atan2_turns(-x * 256, sqrt_q8(y * y + z * z)); // Within +/- a quarter turn
+
+    // Hue = roll + pi, in sixths of a turn: the top bits give the sector, and
+    // the rest the position within it
+    uint64_t hue6 = (uint64_t)(uint32_t)(roll + HALF_TURN) * 6;
+    unsigned int sector = hue6 >> 32;
+    int64_t weight = (hue6 >> 1) & 0x7FFFFFFF; // Q31
+
+    // Lightness = pitch / pi + 1/2, in Q31 (2 * quarter turn = 2^31)
+    int64_t lightness = (int64_t)pitch + (1LL << 30);
+    // Chroma = 1 - |2L - 1|, with saturation fixed at 1
+    int64_t chroma = (1LL << 31) - llabs(2 * lightness - (1LL << 31));
+    // Intermediate component rises through even sectors, and falls through odd ones
+    if (sector & 1) weight = (1LL << 31) - weight;
+    int64_t intermediate = (chroma * weight) >> 31;
+    int64_t offset = lightness - chroma / 2;
+
+    // Assemble RGB, and convert Q31 to UQ2.12
+    const int64_t components[3] = { chroma + offset, intermediate + offset, offset };
+    for (unsigned int i = 0; i < 3; i++) {
+        int64_t value = components[sector_components[sector][i]];
+        duty_cycles[i] = value > 0 ? value >> (31 - 12) : 0;
+    }
+}
@@ -0,0 +1,16 @@
+/* Integer-only color pipeline for the accelerometer controller.
+ * EELE 467
+ */
+
+#ifndef COLOR_H
+#define COLOR_H
+
+#include <stdint.h>
+
+/* Derive RGB duty cycles (UQ2.12) straight from raw accelerometer counts,
+ * using only integer arithmetic. Matches accel_to_hsl(), hsl2rgb() and
+ * rgb_to_duty_cycles() to within 1 LSB, for counts of magnitude below 2^24.
+ */
+void accel_to_duty_cycles(const int *accel_vec, uint32_t *duty_cycles);
+
+#endif
@@ -0,0 +1,291 @@
+/* Batch HSL/HSV to RGB conversion, for driving many LEDs at once.
+ *
+ * Rather than picking components by hue sector, every channel uses the same
+ * piecewise-linear formula, which suits SIMD:
+ *   k = (n + H * 6) mod 6, with n = 5, 3, 1 for red, green, blue
+ *   channel = top - C * clamp(min(k, 4 - k), 0, 1)
+ * where C is the chroma and top is the brightest channel's value (L + C/2
+ * for HSL, V for HSV). Everything runs in Q15 in 32-bit lanes, and each
+ * implementation performs the same integer operations, so they all agree
+ * exactly.
+ * Every kernel the target can run is compiled in: NEON when the compiler
+ * targets it (-mfpu=neon on 32-bit ARM), and on x86, AVX2 and SSE4.1 through
+ * target attributes whatever the compiler flags. The fastest one the CPU
+ * supports is picked at startup.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+
+#include "color_batch.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#define ONE COLOR_BATCH_ONE
+#define Q_SHIFT 15
+#define OUT_SHIFT (Q_SHIFT - 12) // Q15 to UQ2.12
+// Hue offsets of the red, green, and blue channels, in sixths of a turn
+static const int32_t channel_offsets[3] = { 5 * ONE, 3 * ONE, 1 * ONE };
+
+
+//-----------------------------------------------------------------------
+// Scalar implementation
+//-----------------------------------------------------------------------
+static inline int32_t min32(int32_t a, int32_t b) { return a < b ? a : b; }
+static inline int32_t max32(int32_t a, int32_t b) { return a > b ? a : b; }
+
+static inline void convert_pixel(const uint16_t *in, uint16_t *out, bool hsv) {
+    int32_t hue3 = (int32_t)in[0] * 3; // Sixths of a turn, in Q15
+    int32_t sat = min32(in[1], ONE), level = min32(in[2], ONE);
+    int32_t chroma, top;
+    if (hsv) {
+        chroma = (level * sat) >> Q_SHIFT;
+        top = level;
+    } else {
+        int32_t spread = 2 * level - ONE;
+        chroma = ((ONE - (spread < 0 ? -spread : spread)) * sat) >> Q_SHIFT;
+        top = level - (chroma >> 1) + chroma;
+    }
+    for (unsigned int i = 0; i < 3; i++) {
+        int32_t k = channel_offsets[i] + hue3;
+        if (k >= 6 * ONE) k -= 6 * ONE;
+        int32_t t = min32(max32(min32(k, 4 * ONE - k), 0), ONE);
+        out[i] = (top - ((chroma * t) >> Q_SHIFT)) >> OUT_SHIFT;
+    }
+}
+
+static void convert_scalar(const uint16_t *in, uint16_t *out, size_t n, bool hsv) {
+    for (size_t i = 0; i < n; i++) {
+        convert_pixel(&in[3 * i], &out[3 * i], hsv);
+    }
+}
+
+void hsl_to_rgb_batch_scalar(const uint16_t *hsl, uint16_t *rgb, size_t n) {
+    convert_scalar(hsl, rgb, n, false);
+}
+
+void hsv_to_rgb_batch_scalar(const uint16_t *hsv, uint16_t *rgb, size_t n) {
+    convert_scalar(hsv, rgb, n, true);
+}
+
+
+//-----------------------------------------------------------------------
+// NEON implementation: 8 pixels per iteration, as two sets of 4 lanes
+//-----------------------------------------------------------------------
+#if defined(HAVE_NEON)
+static inline void convert_lanes(int32x4_t hue, int32x4_t sat, int32x4_t level, bool hsv,
+                                 uint16x4_t *out) {
+    const int32x4_t one = vdupq_n_s32(ONE);
+    int32x4_t hue3 = vmulq_n_s32(hue, 3);
+    int32x4_t chroma, top;
+    if (hsv) {
+        chroma = vshrq_n_s32(vmulq_s32(level, sat), Q_SHIFT);
+        top = level;
+    } else {
+        int32x4_t spread = vabsq_s32(vsubq_s32(vshlq_n_s32(level, 1), one));
+        chroma = vshrq_n_s32(vmulq_s32(vsubq_s32(one, spread), sat), Q_SHIFT);
+        top = vaddq_s32(vsubq_s32(level, vshrq_n_s32(chroma, 1)), chroma);
+    }
+    for (unsigned int i = 0; i < 3; i++) {
+        int32x4_t k = vaddq_s32(vdupq_n_s32(channel_offsets[i]), hue3);
+        uint32x4_t wrap = vcgeq_s32(k, vdupq_n_s32(6 * ONE));
+        k = vsubq_s32(k, vandq_s32(vreinterpretq_s32_u32(wrap), vdupq_n_s32(6 * ONE)));
+        int32x4_t t = vminq_s32(k, vsubq_s32(vdupq_n_s32(4 * ONE), k));
+        t = vminq_s32(vmaxq_s32(t, vdupq_n_s32(0)), one);
+        int32x4_t value = vsubq_s32(top, vshrq_n_s32(vmulq_s32(chroma, t), Q_SHIFT));
+        out[i] = vmovn_u32(vreinterpretq_u32_s32(vshrq_n_s32(value, OUT_SHIFT)));
+    }
+}
+
+static size_t convert_neon(const uint16_t *in, uint16_t *out, size_t n, bool hsv) {
+    const uint16x8_t one = vdupq_n_u16(ONE);
+    size_t i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        // De-interleave 8 pixels, then widen to 32-bit lanes
+        uint16x8x3_t px = vld3q_u16(&in[3 * i]);
+        uint16x8_t sat = vminq_u16(px.val[1], one), level = vminq_u16(px.val[2], one);
+        uint16x4_t lo[3], hi[3];
+        convert_lanes(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(px.val[0]))),
+                      vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(sat))),
+                      vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(level))), hsv, lo);
+        convert_lanes(vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(px.val[0]))),
+                      vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(sat))),
+                      vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(level))), hsv, hi);
+        uint16x8x3_t rgb;
+        for (unsigned int c = 0; c < 3; c++) {
+            rgb.val[c] = vcombine_u16(lo[c], hi[c]);
+        }
+        vst3q_u16(&out[3 * i], rgb);
+    }
+    return i;
+}
+#endif
+
+
+//-----------------------------------------------------------------------
+// AVX2 implementation: 8 pixels per iteration
+//-----------------------------------------------------------------------
+#if defined(HAVE_X86)
+#define AVX2_BLOCK 8
+
+TARGET("avx2") static size_t convert_avx2(const uint16_t *in, uint16_t *out, size_t n, bool hsv) {
+    const __m256i one = _mm256_set1_epi32(ONE);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i six = _mm256_set1_epi32(6 * ONE), four = _mm256_set1_epi32(4 * ONE);
+    size_t i;
+    for (i = 0; i + AVX2_BLOCK <= n; i += AVX2_BLOCK) {
+        const uint16_t *px = &in[3 * i];
+        __m256i hue = _mm256_setr_epi32(px[0], px[3], px[6], px[9], px[12], px[15], px[18], px[21]);
+        __m256i sat = _mm256_setr_epi32(px[1], px[4], px[7], px[10], px[13], px[16], px[19], px[22]);
+        __m256i level = _mm256_setr_epi32(px[2], px[5], px[8], px[11], px[14], px[17], px[20], px[23]);
+        sat = _mm256_min_epi32(sat, one);
+        level = _mm256_min_epi32(level, one);
+
+        __m256i hue3 = _mm256_mullo_epi32(hue, _mm256_set1_epi32(3));
+        __m256i chroma, top;
+        if (hsv) {
+            chroma = _mm256_srai_epi32(_mm256_mullo_epi32(level, sat), Q_SHIFT);
+            top = level;
+        } else {
+            __m256i spread = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_slli_epi32(level, 1), one));
+            chroma = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(one, spread), sat), Q_SHIFT);
+            top = _mm256_add_epi32(_mm256_sub_epi32(level, _mm256_srai_epi32(chroma, 1)), chroma);
+        }
+        int32_t values[3][AVX2_BLOCK];
+        for (unsigned int c = 0; c < 3; c++) {
+            __m256i k = _mm256_add_epi32(_mm256_set1_epi32(channel_offsets[c]), hue3);
+            __m256i wrap = _mm256_cmpgt_epi32(k, _mm256_sub_epi32(six, _mm256_set1_epi32(1)));
+            k = _mm256_sub_epi32(k, _mm256_and_si256(wrap, six));
+            __m256i t = _mm256_min_epi32(k, _mm256_sub_epi32(four, k));
+            t = _mm256_min_epi32(_mm256_max_epi32(t, zero), one);
+            __m256i value = _mm256_sub_epi32(top, _mm256_srai_epi32(_mm256_mullo_epi32(chroma, t), Q_SHIFT));
+            _mm256_storeu_si256((__m256i *)values[c], _mm256_srai_epi32(value, OUT_SHIFT));
+        }
+        // Re-interleave
+        for (unsigned int j = 0; j < AVX2_BLOCK; j++) {
+            out[3 * (i + j) + 0] = values[0][j];
+            out[3 * (i + j) + 1] = values[1][j];
+            out[3 * (i + j) + 2] = values[2][j];
+        }
+    }
+    return i;
+}
+
+
+//-----------------------------------------------------------------------
+// SSE4.1 implementation: 4 pixels per iteration
+//-----------------------------------------------------------------------
+#define SSE_BLOCK 4
+
+TARGET("sse4.1") static size_t convert_sse41(const uint16_t *in, uint16_t *out, size_t n, bool hsv) {
+    const __m128i one = _mm_set1_epi32(ONE);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i six = _mm_set1_epi32(6 * ONE), four = _mm_set1_epi32(4 * ONE);
+    size_t i;
+    for (i = 0; i + SSE_BLOCK <= n; i += SSE_BLOCK) {
+        const uint16_t *px = &in[3 * i];
+        __m128i hue = _mm_setr_epi32(px[0], px[3], px[6], px[9]);
+        __m128i sat = _mm_min_epi32(_mm_setr_epi32(px[1], px[4], px[7], px[10]), one);
+        __m128i level = _mm_min_epi32(_mm_setr_epi32(px[2], px[5], px[8], px[11]), one);
+
+        __m128i hue3 = _mm_mullo_epi32(hue, _mm_set1_epi32(3));
+        __m128i chroma, top;
+        if (hsv) {
+            chroma = _mm_srai_epi32(_mm_mullo_epi32(level, sat), Q_SHIFT);
+            top = level;
+        } else {
+            __m128i spread = _mm_abs_epi32(_mm_sub_epi32(_mm_slli_epi32(level, 1), one));
+            chroma = _mm_srai_epi32(_mm_mullo_epi32(_mm_sub_epi32(one, spread), sat), Q_SHIFT);
+            top = _mm_add_epi32(_mm_sub_epi32(level, _mm_srai_epi32(chroma, 1)), chroma);
+        }
+        int32_t values[3][SSE_BLOCK];
+        for (unsigned int c = 0; c < 3; c++) {
+            __m128i k = _mm_add_epi32(_mm_set1_epi32(channel_offsets[c]), hue3);
+            __m128i wrap = _mm_cmpgt_epi32(k, _mm_sub_epi32(six, _mm_set1_epi32(1)));
+            k = _mm_sub_epi32(k, _mm_and_si128(wrap, six));
+            __m128i t = _mm_min_epi32(k, _mm_sub_epi32(four, k));
+            t = _mm_min_epi32(_mm_max_epi32(t, zero), one);
+            __m128i value = _mm_sub_epi32(top, _mm_srai_epi32(_mm_mullo_epi32(chroma, t), Q_SHIFT));
+            _mm_storeu_si128((__m128i *)values[c], _mm_srai_epi32(value, OUT_SHIFT));
+        }
+        // Re-interleave
+        for (unsigned int j = 0; j < SSE_BLOCK; j++) {
+            out[3 * (i + j) + 0] = values[0][j];
+            out[3 * (i + j) + 1] = values[1][j];
+            out[3 * (i + j) + 2] = values[2][j];
+        }
+    }
+    return i;
+}
+#endif
+
+
+//-----------------------------------------------------------------------
+// Kernels: SIMD for whole blocks, scalar for the remainder
+//-----------------------------------------------------------------------
+#define DEFINE_KERNEL(isa)                                                      \
+    static void hsl_##isa(const uint16_t *hsl, uint16_t *rgb, size_t n) {       \
+        size_t done = convert_##isa(hsl, rgb, n, false);                        \
+        convert_scalar(&hsl[3 * done], &rgb[3 * done], n - done, false);        \
+    }                                                                           \
+    static void hsv_##isa(const uint16_t *hsv, uint16_t *rgb, size_t n) {       \
+        size_t done = convert_##isa(hsv, rgb, n, true);                         \
+        convert_scalar(&hsv[3 * done], &rgb[3 * done], n - done, true);         \
+    }
+
+#if defined(HAVE_NEON)
+DEFINE_KERNEL(neon)
+#endif
+#if defined(HAVE_X86)
+DEFINE_KERNEL(avx2)
+DEFINE_KERNEL(sse41)
+#endif
+
+static const struct color_batch_kernel scalar_kernel = {
+    "scalar", hsl_to_rgb_batch_scalar, hsv_to_rgb_batch_scalar
+};
+
+// Kernels this CPU can run, fastest first, found at startup
+static const struct color_batch_kernel *kernels[4];
+static size_t num_kernels;
+
+__attribute__((constructor)) static void find_kernels(void) {
+#if defined(HAVE_NEON)
+    static const struct color_batch_kernel neon_kernel = { "neon", hsl_neon, hsv_neon };
+    kernels[num_kernels++] = &neon_kernel;
+#endif
+#if defined(HAVE_X86)
+    static const struct color_batch_kernel avx2_kernel = { "avx2", hsl_avx2, hsv_avx2 };
+    static const struct color_batch_kernel sse41_kernel = { "sse4.1", hsl_sse41, hsv_sse41 };
+    // Constructors may run before libgcc has identified the CPU
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) kernels[num_kernels++] = &avx2_kernel;
+    if (__builtin_cpu_supports("sse4.1")) kernels[num_kernels++] = &sse41_kernel;
+#endif
+    kernels[num_kernels++] = &scalar_kernel;
+}
+
+size_t color_batch_kernels(const struct color_batch_kernel *const **list) {
+    *list = kernels;
+    return num_kernels;
+}
+
+const char *color_batch_impl(void) {
+    return kernels[0]->name;
+}
+
+void hsl_to_rgb_batch(const uint16_t *hsl, uint16_t *rgb, size_t n) {
+    kernels[0]->hsl(hsl, rgb, n);
+}
+
+void hsv_to_rgb_batch(const uint16_t *hsv, uint16_t *rgb, size_t n) {
+    kernels[0]->hsv(hsv, rgb, n);
+}
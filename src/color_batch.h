@@ -0,0 +1,54 @@
+/* Batch HSL/HSV to RGB conversion, for driving many LEDs at once.
+ * EELE 467
+ */
+
+#ifndef COLOR_BATCH_H
+#define COLOR_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Pixels are interleaved triples of uint16_t:
+ *   Input: hue, as a fraction of a full turn (Q16), then saturation and
+ *          lightness (or value) in UQ1.15, so 0x8000 is 1.0. Larger values
+ *          saturate to 1.0.
+ *   Output: red, green, and blue, as UQ2.12 PWM duty cycles.
+ * Input and output may be the same buffer. Results are bit-identical whichever
+ * implementation is used. They aren't bit-identical to hsl2rgb() followed by
+ * rgb_to_duty_cycles(), which round differently in floating point: each
+ * channel is within COLOR_BATCH_TOLERANCE of them.
+ */
+#define COLOR_BATCH_ONE 0x8000
+#define COLOR_BATCH_TOLERANCE 1 // LSB of the duty cycle
+
+typedef void (*color_batch_fn)(const uint16_t *in, uint16_t *rgb, size_t n);
+
+/**
+ * struct color_batch_kernel - One implementation of the batch conversions.
+ * @name: Instruction set it uses ("neon", "avx2", "sse4.1" or "scalar")
+ * @hsl: Converts n HSL pixels
+ * @hsv: Converts n HSV pixels
+ */
+struct color_batch_kernel {
+    const char *name;
+    color_batch_fn hsl;
+    color_batch_fn hsv;
+};
+
+// Convert n HSL pixels, with the fastest implementation available
+void hsl_to_rgb_batch(const uint16_t *hsl, uint16_t *rgb, size_t n);
+// Convert n HSV pixels, with the fastest implementation available
+void hsv_to_rgb_batch(const uint16_t *hsv, uint16_t *rgb, size_t n);
+
+// Portable implementations, as a reference for testing
+void hsl_to_rgb_batch_scalar(const uint16_t *hsl, uint16_t *rgb, size_t n);
+void hsv_to_rgb_batch_scalar(const uint16_t *hsv, uint16_t *rgb, size_t n);
+
+/* List the kernels this CPU can run, fastest (the one the functions above use)
+ * first and the scalar one last; returns how many there are.
+ */
+size_t color_batch_kernels(const struct color_batch_kernel *const **list);
+// Name of the kernel used by the non-scalar functions
+const char *color_batch_impl(void);
+
+#endif
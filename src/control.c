@@ -0,0 +1,62 @@
+/* Floating-point color computations for the accelerometer controller.
+ * EELE 467
+ */
+
+#include <math.h>
+
+#include "control.h"
+
+
+void accel_to_hsl(const int *accel_vec, float *hsl) {
+    // Calculate roll and pitch angles
+    float roll = atan2(-(float)accel_vec[1], (float)accel_vec[2]);
+    float pitch = atan2(-(float)accel_vec[0], sqrt(powf(accel_vec[1], 2) + powf(accel_vec[2], 2)));
+    hsl[0] = roll + M_PI;
+    hsl[1] = 1;
+    hsl[2] = (pitch / (M_PI)) + 0.5;
+}
+
+void hsl2rgb(const float *hsl, float *rgb) {
+    // Based on https://en.wikipedia.org/wiki/HSL_and_HSV#HSL_to_RGB
+    float chroma = (1 - fabsf(2 * hsl[2] - 1)) * hsl[1];
+    float h_prime = hsl[0] / (M_PI/3);
+    float other_comp = chroma * (1 - fabsf(fmodf(h_prime, 2) - 1));
+    // Assign color components
+    if        (h_prime < 1) {
+        rgb[0] = chroma;
+        rgb[1] = other_comp;
+        rgb[2] = 0;
+    } else if (h_prime < 2) {
+        rgb[0] = other_comp;
+        rgb[1] = chroma;
+        rgb[2] = 0;
+    } else if (h_prime < 3) {
+        rgb[0] = 0;
+        rgb[1] = chroma;
+        rgb[2] = other_comp;
+    } else if (h_prime < 4) {
+        rgb[0] = 0;
+        rgb[1] = other_comp;
+        rgb[2] = chroma;
+    } else if (h_prime < 5) {
+        rgb[0] = other_comp;
+        rgb[1] = 0;
+        rgb[2] = chroma;
+    } else  /* h_prime < 6 */ {
+        rgb[0] = chroma;
+        rgb[1] = 0;
+        rgb[2] = other_comp;
+    }
+    // Match lightness
+    float m = hsl[2] - (chroma/2);
+    rgb[0] += m;
+    rgb[1] += m;
+    rgb[2] += m;
+    return;
+}
+
+void rgb_to_duty_cycles(const float *rgb, uint32_t *duty_cycles) {
+    for (unsigned int i = 0; i < 3; i++) {
+        duty_cycles[i] = (int)(rgb[i] * pow(2, 12));
+    }
+}
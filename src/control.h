@@ -0,0 +1,20 @@
+/* Floating-point color computations for the accelerometer controller.
+ * accel_control now uses the integer pipeline in color.h; these remain as its
+ * reference, for testing and benchmarking.
+ * EELE 467
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+
+// Derive a color from the accelerometer's orientation: roll -> hue,
+// saturation = 1, pitch -> lightness
+void accel_to_hsl(const int *accel_vec, float *hsl);
+// HSL to RGB conversion helper
+void hsl2rgb(const float *hsl, float *rgb);
+// Scale RGB components in [0, 1] to UQ2.12 PWM duty cycles
+void rgb_to_duty_cycles(const float *rgb, uint32_t *duty_cycles);
+
+#endif
@@ -0,0 +1,548 @@
+/* Control loop benchmark.
+ * Runs the per-update work of accel_control (or adc_control) for a fixed
+ * number of iterations against any backend, timing each stage of the loop.
+ * The pipeline modes instead run accel_control's whole control loop against
+ * readings fed in real time, timing how long each takes to be handled and to
+ * reach the PWM controller. The fusion mode times the orientation filter on
+ * its own, in nanoseconds and CPU cycles per sample.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+#include "backend.h"
+#include "control.h"
+#include "color.h"
+#include "accel_input.h"
+#include "accel_pipeline.h"
+#include "orientation.h"
+
+// Configuration constants
+#define PERIOD 0x100 // 2ms
+#define NUM_CHANNELS 3 // Red, green, and blue
+#define DEFAULT_ITERATIONS 100000
+#define DEFAULT_WARMUP 1000
+#define DEFAULT_BENCH_BACKEND "sim"
+#define NUM_ORIENTATIONS 360 // Synthetic accelerometer readings to cycle through
+#define COUNTS_PER_G 256
+#define DEFAULT_FEED_HZ 1000 // Accelerometer rate in the pipeline modes
+#define PIPELINE_TICK_HZ 1000 // accel_control's default
+#define FUSION_BATCH 16 // Samples per call, about what accel_input sees per read
+#define FUSION_NOISE 8  // Peak-to-peak noise added to the fusion mode's samples
+#define FUSION_JOLT_EVERY 500 // Samples between tap-like jolts
+
+
+// What to benchmark
+enum mode {
+    MODE_ACCEL,       // accel_control, with its integer color pipeline
+    MODE_ACCEL_FLOAT, // accel_control, with the floating-point reference
+    MODE_ADC,         // adc_control
+    MODE_PIPELINE,    // accel_control's threaded control loop, end to end
+    MODE_SERIAL,      // The same loop, on one thread
+    MODE_FUSION,      // The orientation filter alone
+};
+static const char *const mode_names[] = { "accel", "accel-float", "adc", "pipeline", "serial", "fusion" };
+
+// Loop stages, in the order they run
+enum stage {
+    // Accelerometer modes
+    STAGE_DRAIN,       // Reading events from the accelerometer
+    STAGE_COLOR,       // Integer pipeline from orientation to duty cycles
+    STAGE_ORIENTATION, // atan2()/powf() to get roll and pitch
+    STAGE_HSL2RGB,     // Color conversion
+    STAGE_DUTY,        // Scaling to duty cycles
+    // ADC mode
+    STAGE_READ,        // Reading ADC channels
+    // All modes
+    STAGE_WRITE,       // Writing duty cycles
+    STAGE_TOTAL,       // Whole iteration
+    NUM_STAGES,
+};
+static const char *const stage_names[NUM_STAGES] = {
+    "drain", "color", "orientation", "hsl2rgb", "duty", "read", "write", "total",
+};
+
+// Check whether a stage runs in the given mode
+static bool stage_used(enum stage s, enum mode mode) {
+    switch (s) {
+        case STAGE_DRAIN:       return mode != MODE_ADC;
+        case STAGE_COLOR:       return mode == MODE_ACCEL;
+        case STAGE_ORIENTATION:
+        case STAGE_HSL2RGB:
+        case STAGE_DUTY:        return mode == MODE_ACCEL_FLOAT;
+        case STAGE_READ:        return mode == MODE_ADC;
+        default:                return true;
+    }
+}
+
+// Timestamp helper, in nanoseconds
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Latency summary for one stage
+struct stats {
+    double mean;
+    uint32_t p50, p99, p999, max;
+};
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Summarize samples, sorting them in place
+static struct stats summarize(uint32_t *samples, size_t n) {
+    struct stats st = {0};
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) sum += samples[i];
+    st.mean = sum / n;
+    qsort(samples, n, sizeof(*samples), compare_u32);
+    // Nearest-rank percentiles
+    st.p50 = samples[(size_t)ceil(0.5 * n) - 1];
+    st.p99 = samples[(size_t)ceil(0.99 * n) - 1];
+    st.p999 = samples[(size_t)ceil(0.999 * n) - 1];
+    st.max = samples[n - 1];
+    return st;
+}
+
+// Median cost of reading the clock, for judging how far to trust small stages
+static uint32_t timer_overhead(void) {
+    uint32_t samples[1001];
+    for (unsigned int i = 0; i < 1001; i++) {
+        uint64_t t0 = now_ns();
+        samples[i] = now_ns() - t0;
+    }
+    return summarize(samples, 1001).p50;
+}
+
+// Print the report's header line, then one line per stage with print_stats()
+static void print_header(bool json, enum mode mode, const char *backend_name, const char *unit,
+                         unsigned long count, double elapsed, uint32_t overhead) {
+    if (json) {
+        printf("{\"mode\":\"%s\",\"backend\":\"%s\",\"%s\":%lu,\"elapsed_s\":%.6f,"
+               "\"%s_per_s\":%.1f,\"timer_overhead_ns\":%u,\"stages\":{",
+               mode_names[mode], backend_name, unit, count, elapsed, unit, count / elapsed, overhead);
+    } else {
+        printf("%s mode, %s backend: %lu %s in %.3f s (%.1f %s/s)\n",
+               mode_names[mode], backend_name, count, unit, elapsed, count / elapsed, unit);
+        printf("Timer overhead %u ns; latencies in ns:\n", overhead);
+        printf("%-12s %10s %10s %10s %10s %10s\n", "stage", "mean", "p50", "p99", "p999", "max");
+    }
+}
+static void print_stats(bool json, bool first, const char *name, struct stats st) {
+    if (json) {
+        printf("%s\"%s\":{\"mean_ns\":%.1f,\"p50_ns\":%u,\"p99_ns\":%u,\"p999_ns\":%u,\"max_ns\":%u}",
+               first ? "" : ",", name, st.mean, st.p50, st.p99, st.p999, st.max);
+    } else {
+        printf("%-12s %10.1f %10u %10u %10u %10u\n", name, st.mean, st.p50, st.p99, st.p999, st.max);
+    }
+}
+
+
+//-----------------------------------------------------------------------
+// Pipeline modes
+//-----------------------------------------------------------------------
+
+// Readings for the feeder thread to write into the event pipe
+struct feed {
+    int fd;
+    unsigned long count;
+    unsigned long rate_hz;
+    struct input_event (*readings)[4];
+};
+
+// Stamp an event with the current time, as evdev would
+static void stamp(struct input_event *event) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    event->input_event_sec = ts.tv_sec;
+    event->input_event_usec = ts.tv_nsec / 1000;
+}
+
+/* Tap once to enter accelerometer mode, then write readings at a fixed rate,
+ * like accel_sim; closing the pipe afterwards stops the control loop.
+ */
+static void *feed_readings(void *arg) {
+    struct feed *feed = arg;
+    struct input_event tap[2] = {
+        { .type = EV_KEY, .code = BTN_TOUCH, .value = 1 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+    };
+    stamp(&tap[0]);
+    tap[1].time = tap[0].time;
+    if (write(feed->fd, tap, sizeof(tap)) < 0) feed->count = 0;
+
+    long interval_ns = 1000000000L / feed->rate_hz;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (unsigned long n = 0; n < feed->count; n++) {
+        next.tv_nsec += interval_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        struct input_event reading[4];
+        memcpy(reading, feed->readings[n % NUM_ORIENTATIONS], sizeof(reading));
+        stamp(&reading[0]);
+        for (unsigned int i = 1; i < 4; i++) reading[i].time = reading[0].time;
+        if (write(feed->fd, reading, sizeof(reading)) < 0) break;
+    }
+    close(feed->fd);
+    return NULL;
+}
+
+/* Run accel_control's control loop, threaded or not, on readings fed through
+ * a pipe in real time. Returns -1 on failure.
+ */
+static int bench_pipeline(struct backend *hw, const char *backend_name, enum mode mode,
+                          unsigned long count, unsigned long rate_hz, bool json,
+                          struct input_event (*readings)[4]) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+        perror("Failed to create event pipe");
+        return -1;
+    }
+    fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+    struct accel_input accel = { .dev = NULL, .fd = pipe_fds[0] };
+
+    // One input latency per reading plus the tap; at most one write per tick
+    double duration = (double)count / rate_hz;
+    size_t output_capacity = ceil(duration * PIPELINE_TICK_HZ) + 2;
+    struct accel_pipeline p = {
+        .accel = &accel,
+        .hw = hw,
+        .tick_hz = PIPELINE_TICK_HZ,
+        .threaded = mode == MODE_PIPELINE,
+        .input_latency = { .samples = calloc(count + 1, sizeof(uint32_t)), .capacity = count + 1 },
+        .output_latency = { .samples = calloc(output_capacity, sizeof(uint32_t)), .capacity = output_capacity },
+    };
+    int rc = 0;
+    if (p.input_latency.samples == NULL || p.output_latency.samples == NULL) {
+        perror("Failed to allocate sample storage");
+        rc = -1;
+        goto cleanup;
+    }
+    if (accel_pipeline_init(&p) < 0) {
+        rc = -1;
+        goto cleanup;
+    }
+
+    struct feed feed = { .fd = pipe_fds[1], .count = count, .rate_hz = rate_hz, .readings = readings };
+    pthread_t feeder;
+    int err = pthread_create(&feeder, NULL, feed_readings, &feed);
+    if (err != 0) {
+        fprintf(stderr, "Failed to start feeder thread: %s\n", strerror(err));
+        accel_pipeline_destroy(&p);
+        rc = -1;
+        goto cleanup;
+    }
+    pipe_fds[1] = -1;  // The feeder closes it
+    uint64_t start = now_ns();
+    if (accel_pipeline_run(&p) < 0) rc = -1;
+    double elapsed = (now_ns() - start) * 1e-9;
+    pthread_join(feeder, NULL);
+    accel_pipeline_destroy(&p);
+
+    if (rc == 0 && p.input_latency.count > 0 && p.output_latency.count > 0) {
+        // Report results
+        print_header(json, mode, backend_name, "writes", p.updates, elapsed, timer_overhead());
+        size_t n = p.input_latency.count < p.input_latency.capacity ? p.input_latency.count : p.input_latency.capacity;
+        print_stats(json, true, "input", summarize(p.input_latency.samples, n));
+        n = p.output_latency.count < p.output_latency.capacity ? p.output_latency.count : p.output_latency.capacity;
+        print_stats(json, false, "output", summarize(p.output_latency.samples, n));
+        if (json) printf("},\"readings\":%lu,\"superseded\":%lu}\n", count, p.dropped);
+        else printf("%lu readings at %lu Hz; %lu superseded writes skipped\n", count, rate_hz, p.dropped);
+    }
+
+cleanup:
+    free(p.input_latency.samples);
+    free(p.output_latency.samples);
+    close(pipe_fds[0]);
+    if (pipe_fds[1] >= 0) close(pipe_fds[1]);
+    return rc;
+}
+
+//-----------------------------------------------------------------------
+// Fusion mode
+//-----------------------------------------------------------------------
+
+// Count the calling thread's CPU cycles, where perf events allow; returns -1
+// if they don't
+static int open_cycle_counter(void) {
+    struct perf_event_attr attr = {
+        .type = PERF_TYPE_HARDWARE,
+        .size = sizeof(attr),
+        .config = PERF_COUNT_HW_CPU_CYCLES,
+        .exclude_kernel = 1,
+        .exclude_hv = 1,
+    };
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t read_cycles(int fd) {
+    uint64_t cycles = 0;
+    if (fd < 0 || read(fd, &cycles, sizeof(cycles)) != sizeof(cycles)) return 0;
+    return cycles;
+}
+
+/* Run the orientation filter over noisy, tumbling readings, a batch at a time
+ * as accel_input feeds it. A sample takes far less than the clock's
+ * resolution, so only the whole run is timed. Returns -1 on failure.
+ */
+static int bench_fusion(unsigned long count, unsigned long warmup, bool json) {
+    int (*samples)[3] = malloc(count * sizeof(*samples));
+    if (samples == NULL) {
+        perror("Failed to allocate samples");
+        return -1;
+    }
+    uint32_t noise = 1;
+    for (unsigned long n = 0; n < count; n++) {
+        double roll = 2 * M_PI * (n % NUM_ORIENTATIONS) / NUM_ORIENTATIONS;
+        double pitch = (M_PI / 4) * sin(3 * roll);
+        const double g[3] = { -sin(pitch), -sin(roll) * cos(pitch), cos(roll) * cos(pitch) };
+        for (unsigned int i = 0; i < 3; i++) {
+            noise = noise * 1103515245 + 12345;  // Cheap and repeatable
+            samples[n][i] = lround(g[i] * COUNTS_PER_G) + (int)(noise >> 16) % (FUSION_NOISE + 1) - FUSION_NOISE / 2;
+        }
+        // Exercise the rejection path now and then
+        if (n % FUSION_JOLT_EVERY == 0) samples[n][2] += COUNTS_PER_G;
+    }
+
+    struct orient_config config;
+    orient_default_config(&config);
+    struct orient_filter filter;
+    orient_init(&filter, &config);
+    int gravity[3];
+    orient_process(&filter, (const int (*)[3])samples, warmup < count ? warmup : count, gravity);
+
+    int cycles_fd = open_cycle_counter();
+    int cycles_errno = errno;
+    uint64_t cycles = read_cycles(cycles_fd);
+    uint64_t start = now_ns();
+    unsigned long outputs = 0;
+    for (unsigned long n = 0; n < count; n += FUSION_BATCH) {
+        unsigned int batch = count - n < FUSION_BATCH ? count - n : FUSION_BATCH;
+        outputs += orient_process(&filter, (const int (*)[3])samples + n, batch, gravity);
+    }
+    double elapsed = (now_ns() - start) * 1e-9;
+    cycles = read_cycles(cycles_fd) - cycles;
+    if (cycles_fd >= 0) close(cycles_fd);
+
+    if (json) {
+        printf("{\"mode\":\"fusion\",\"samples\":%lu,\"elapsed_s\":%.6f,\"samples_per_s\":%.1f,"
+               "\"ns_per_sample\":%.2f,", count, elapsed, count / elapsed, elapsed * 1e9 / count);
+        if (cycles > 0) printf("\"cycles_per_sample\":%.2f}\n", (double)cycles / count);
+        else printf("\"cycles_per_sample\":null}\n");
+    } else {
+        printf("fusion mode: %lu samples in %.3f s (%.1f samples/s), %lu outputs\n",
+               count, elapsed, count / elapsed, outputs);
+        printf("%.2f ns/sample", elapsed * 1e9 / count);
+        if (cycles > 0) printf(", %.2f cycles/sample\n", (double)cycles / count);
+        else printf(" (cycle counter unavailable: %s)\n", strerror(cycles_fd < 0 ? cycles_errno : EIO));
+    }
+    free(samples);
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+
+    // Parse command-line options
+    unsigned long iterations = DEFAULT_ITERATIONS;
+    unsigned long warmup = DEFAULT_WARMUP;
+    const char *backend_name = DEFAULT_BENCH_BACKEND;
+    unsigned long feed_hz = DEFAULT_FEED_HZ;
+    enum mode mode = MODE_ACCEL;
+    bool json = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:m:b:r:j")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = strtoul(optarg, NULL, 0);
+                break;
+            case 'w':
+                warmup = strtoul(optarg, NULL, 0);
+                break;
+            case 'm':
+                if (strcmp(optarg, "accel") == 0) mode = MODE_ACCEL;
+                else if (strcmp(optarg, "accel-float") == 0) mode = MODE_ACCEL_FLOAT;
+                else if (strcmp(optarg, "adc") == 0) mode = MODE_ADC;
+                else if (strcmp(optarg, "pipeline") == 0) mode = MODE_PIPELINE;
+                else if (strcmp(optarg, "serial") == 0) mode = MODE_SERIAL;
+                else if (strcmp(optarg, "fusion") == 0) mode = MODE_FUSION;
+                else goto usage;
+                break;
+            case 'r':
+                // Accelerometer rate for the pipeline modes, in Hz
+                feed_hz = strtoul(optarg, NULL, 0);
+                if (feed_hz == 0) goto usage;
+                break;
+            case 'b':
+                backend_name = optarg;
+                break;
+            case 'j':
+                json = true;
+                break;
+            default:
+            usage:
+                fprintf(stderr, "Usage: %s [-n iterations] [-w warmup] [-m accel|accel-float|adc|pipeline|serial|fusion] [-r rate] [-j] [-b ", argv[0]);
+                backend_print_names(stderr);
+                fprintf(stderr, "]\n");
+                return 1;
+        }
+    }
+    if (iterations == 0) {
+        fprintf(stderr, "Need at least one iteration!\n");
+        return 1;
+    }
+
+    if (mode == MODE_FUSION) {
+        // Pure computation; no backend needed
+        return bench_fusion(iterations, warmup, json) < 0 ? 4 : 0;
+    }
+
+    // Initialization
+    struct backend hw;
+    if (backend_open(&hw, backend_name, NUM_CHANNELS) < 0) {
+        return 3;
+    }
+    backend_write_period(&hw, PERIOD);
+    int rc = 0;
+
+    /* Feed the accelerometer stage through a pipe, as accel_control sees
+     * events from accel_sim. Each iteration gets one reading's worth, written
+     * outside the timed region.
+     */
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+        perror("Failed to create event pipe");
+        rc = 4;
+        goto cleanup_hw;
+    }
+    fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+    struct accel_input accel = { .dev = NULL, .fd = pipe_fds[0] };
+    struct input_event readings[NUM_ORIENTATIONS][4];
+    for (unsigned int i = 0; i < NUM_ORIENTATIONS; i++) {
+        // Roll through a full circle, with some pitch, so every hue gets used
+        double roll = 2 * M_PI * i / NUM_ORIENTATIONS;
+        double pitch = (M_PI / 4) * sin(3 * roll);
+        struct input_event reading[4] = {
+            { .type = EV_ABS, .code = ABS_X, .value = lround(-sin(pitch) * COUNTS_PER_G) },
+            { .type = EV_ABS, .code = ABS_Y, .value = lround(-sin(roll) * cos(pitch) * COUNTS_PER_G) },
+            { .type = EV_ABS, .code = ABS_Z, .value = lround(cos(roll) * cos(pitch) * COUNTS_PER_G) },
+            { .type = EV_SYN, .code = SYN_REPORT },
+        };
+        memcpy(readings[i], reading, sizeof(reading));
+    }
+    if (mode == MODE_PIPELINE || mode == MODE_SERIAL) {
+        // Each iteration is one reading, fed in real time
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        if (bench_pipeline(&hw, backend_name, mode, iterations, feed_hz, json, readings) < 0) rc = 4;
+        goto cleanup_hw;
+    }
+
+    uint32_t *samples[NUM_STAGES];
+    for (unsigned int s = 0; s < NUM_STAGES; s++) {
+        samples[s] = calloc(iterations, sizeof(uint32_t));
+        if (samples[s] == NULL) {
+            perror("Failed to allocate sample storage");
+            rc = 4;
+            goto cleanup_samples;
+        }
+    }
+
+    // Main benchmark loop; warm-up iterations run the same code, unrecorded
+    int accel_vec[3] = {0};
+    uint64_t start = 0;
+    for (unsigned long n = 0; n < warmup + iterations; n++) {
+        uint64_t t[NUM_STAGES + 1] = {0};
+        if (n == warmup) start = now_ns();
+
+        if (mode != MODE_ADC) {
+            if (write(pipe_fds[1], readings[n % NUM_ORIENTATIONS], sizeof(readings[0])) < 0) {
+                perror("Failed to feed event pipe");
+                rc = 4;
+                break;
+            }
+            t[STAGE_DRAIN] = now_ns();
+            struct accel_update update;
+            while (accel_read(&accel, &update) > 0) {
+                if (update.reports > 0) memcpy(accel_vec, update.accel_vec, sizeof(accel_vec));
+            }
+            uint32_t duty_cycles[NUM_CHANNELS];
+            if (mode == MODE_ACCEL) {
+                t[STAGE_COLOR] = now_ns();
+                accel_to_duty_cycles(accel_vec, duty_cycles);
+            } else {
+                t[STAGE_ORIENTATION] = now_ns();
+                float hsl[3], rgb[3];
+                accel_to_hsl(accel_vec, hsl);
+                t[STAGE_HSL2RGB] = now_ns();
+                hsl2rgb(hsl, rgb);
+                t[STAGE_DUTY] = now_ns();
+                rgb_to_duty_cycles(rgb, duty_cycles);
+            }
+            t[STAGE_WRITE] = now_ns();
+            backend_write_duty_cycles(&hw, duty_cycles);
+        } else {
+            t[STAGE_READ] = now_ns();
+            uint32_t channels[NUM_CHANNELS] = {0};
+            backend_read_channels(&hw, channels);
+            t[STAGE_WRITE] = now_ns();
+            backend_write_duty_cycles(&hw, channels);
+        }
+        t[STAGE_TOTAL] = now_ns();
+
+        if (n < warmup) continue;
+        // Each stage runs until the next one that ran starts
+        uint64_t first = mode != MODE_ADC ? t[STAGE_DRAIN] : t[STAGE_READ];
+        for (unsigned int s = 0; s < STAGE_TOTAL; s++) {
+            if (t[s] == 0) continue;
+            unsigned int next = s + 1;
+            while (t[next] == 0) next++;
+            samples[s][n - warmup] = t[next] - t[s];
+        }
+        samples[STAGE_TOTAL][n - warmup] = t[STAGE_TOTAL] - first;
+    }
+    double elapsed = (now_ns() - start) * 1e-9;
+
+    if (rc == 0) {
+        // Report results
+        print_header(json, mode, backend_name, "iterations", iterations, elapsed, timer_overhead());
+        bool first_stage = true;
+        for (unsigned int s = 0; s < NUM_STAGES; s++) {
+            // Skip stages other modes use
+            if (!stage_used(s, mode)) continue;
+            print_stats(json, first_stage, stage_names[s], summarize(samples[s], iterations));
+            first_stage = false;
+        }
+        if (json) printf("}}\n");
+    }
+
+    // Cleanup
+cleanup_samples:
+    for (unsigned int s = 0; s < NUM_STAGES; s++) free(samples[s]);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+cleanup_hw:
+    backend_write_period(&hw, 0);
+    backend_close(&hw);
+    return rc;
+}
@@ -0,0 +1,142 @@
+/* Shared-memory control interface for accel_control.
+ * EELE 467
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "control_shm.h"
+
+
+static struct control_shm *control_shm_map(const char *name, int flags) {
+    int fd = shm_open(name, flags, 0644);
+    if (fd < 0) return NULL;
+    if ((flags & O_CREAT) && ftruncate(fd, sizeof(struct control_shm)) < 0) {
+        close(fd);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct control_shm)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    int prot = (flags & O_ACCMODE) == O_RDONLY ? PROT_READ : PROT_READ | PROT_WRITE;
+    void *shm = mmap(NULL, sizeof(struct control_shm), prot, MAP_SHARED, fd, 0);
+    close(fd);  // The mapping keeps the segment alive
+    return shm == MAP_FAILED ? NULL : shm;
+}
+
+struct control_shm *control_shm_create(const char *name) {
+    struct control_shm *shm = control_shm_map(name, O_RDWR | O_CREAT);
+    if (shm == NULL) return NULL;
+
+    // Invalidate the segment while (re)initializing it, for tools already
+    // watching it
+    atomic_store_explicit(&shm->magic, 0, memory_order_relaxed);
+    atomic_init(&shm->telemetry_seq, 0);
+    memset(&shm->telemetry, 0, sizeof(shm->telemetry));
+    atomic_init(&shm->cmd_tail, 0);
+    atomic_init(&shm->cmd_head, 0);
+    for (uint32_t i = 0; i < CONTROL_QUEUE_SLOTS; i++) {
+        atomic_init(&shm->cmd_slots[i].seq, i);
+    }
+    shm->version = CONTROL_SHM_VERSION;
+    shm->pid = getpid();
+    atomic_store_explicit(&shm->magic, CONTROL_SHM_MAGIC, memory_order_release);
+    return shm;
+}
+
+void control_shm_adopt(struct control_shm *shm) {
+    shm->pid = getpid();
+}
+
+struct control_shm *control_shm_open(const char *name, bool writable) {
+    struct control_shm *shm = control_shm_map(name, writable ? O_RDWR : O_RDONLY);
+    if (shm == NULL) return NULL;
+    uint32_t magic = atomic_load_explicit(&shm->magic, memory_order_acquire);
+    if (magic != CONTROL_SHM_MAGIC || shm->version != CONTROL_SHM_VERSION) {
+        control_shm_close(shm);
+        errno = EPROTO;
+        return NULL;
+    }
+    return shm;
+}
+
+void control_shm_close(struct control_shm *shm) {
+    munmap(shm, sizeof(*shm));
+}
+
+void control_shm_unlink(const char *name) {
+    shm_unlink(name);
+}
+
+void control_shm_publish(struct control_shm *shm, const struct control_telemetry *telemetry) {
+    uint32_t seq = atomic_load_explicit(&shm->telemetry_seq, memory_order_relaxed);
+    atomic_store_explicit(&shm->telemetry_seq, seq + 1, memory_order_relaxed);
+    // Order the odd sequence number before the new contents
+    atomic_thread_fence(memory_order_release);
+    memcpy(&shm->telemetry, telemetry, sizeof(*telemetry));
+    atomic_store_explicit(&shm->telemetry_seq, seq + 2, memory_order_release);
+}
+
+int control_shm_read(struct control_shm *shm, struct control_telemetry *telemetry) {
+    for (unsigned int spins = 1;; spins++) {
+        uint32_t before = atomic_load_explicit(&shm->telemetry_seq, memory_order_acquire);
+        if (before & 1) {
+            // Mid-update. The daemon only holds the sequence number odd for a
+            // copy, so if it stays odd, make sure there's still a daemon to
+            // finish the update (EPERM means it's alive, but not ours to signal)
+            if (spins % CONTROL_READ_SPINS == 0) {
+                if (kill((pid_t)shm->pid, 0) < 0 && errno == ESRCH) return -1;
+                sched_yield();
+            }
+            continue;
+        }
+        memcpy(telemetry, &shm->telemetry, sizeof(*telemetry));
+        // Order the copy before re-checking the sequence number
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shm->telemetry_seq, memory_order_relaxed) == before) return 0;
+    }
+}
+
+int control_shm_send(struct control_shm *shm, const struct control_command *cmd) {
+    uint32_t pos = atomic_load_explicit(&shm->cmd_tail, memory_order_relaxed);
+    for (;;) {
+        struct control_slot *slot = &shm->cmd_slots[pos % CONTROL_QUEUE_SLOTS];
+        uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            // Free for this position; claim it, unless another sender beat us
+            if (atomic_compare_exchange_weak_explicit(&shm->cmd_tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                slot->cmd = *cmd;
+                atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+                return 0;
+            }
+        } else if (diff < 0) {
+            // Still holding the command from a lap ago
+            errno = EAGAIN;
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&shm->cmd_tail, memory_order_relaxed);
+        }
+    }
+}
+
+bool control_shm_receive(struct control_shm *shm, struct control_command *cmd) {
+    uint32_t pos = atomic_load_explicit(&shm->cmd_head, memory_order_relaxed);
+    struct control_slot *slot = &shm->cmd_slots[pos % CONTROL_QUEUE_SLOTS];
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1) return false;
+    *cmd = slot->cmd;
+    // Free the slot for the next lap
+    atomic_store_explicit(&slot->seq, pos + CONTROL_QUEUE_SLOTS, memory_order_release);
+    atomic_store_explicit(&shm->cmd_head, pos + 1, memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,124 @@
+/* Shared-memory control interface for accel_control.
+ * The daemon publishes telemetry under a seqlock, and takes commands from a
+ * lock-free queue, both in one POSIX shared-memory segment; neither side
+ * needs a system call to use it once mapped.
+ * EELE 467
+ */
+
+#ifndef CONTROL_SHM_H
+#define CONTROL_SHM_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CONTROL_SHM_DEFAULT_NAME "/accel_control"
+#define CONTROL_SHM_MAGIC 0x4C544341 // "ACTL"
+#define CONTROL_SHM_VERSION 1
+#define CONTROL_CHANNELS 3 // Red, green, and blue
+#define CONTROL_QUEUE_SLOTS 16 // Power of two
+#define CONTROL_READ_SPINS 1000 // Tries at a mid-update snapshot between checks on the daemon
+
+/**
+ * struct control_telemetry - Snapshot of the control loop, as of its last write.
+ * @timestamp_ns: When the write completed (CLOCK_REALTIME)
+ * @accel_mode: Nonzero in accelerometer mode, zero in ADC mode
+ * @period: PWM period register value
+ * @map: Source of each PWM channel's duty cycle: the index of the color
+ *       component (accelerometer mode) or ADC channel (ADC mode) it follows
+ * @inputs: Accelerometer X, Y and Z counts, or ADC channel readings
+ * @duty_cycles: Duty cycles written
+ * @updates: PWM writes so far
+ * @dropped: Writes skipped because newer duty cycles superseded them
+ * @commands: Commands applied so far
+ * @latency_ns: Latency of the last write, from the input behind it
+ * @latency_mean_ns: Mean of all write latencies
+ * @latency_max_ns: Largest write latency
+ */
+struct control_telemetry {
+    uint64_t timestamp_ns;
+    uint32_t accel_mode;
+    uint32_t period;
+    uint32_t map[CONTROL_CHANNELS];
+    int32_t inputs[CONTROL_CHANNELS];
+    uint32_t duty_cycles[CONTROL_CHANNELS];
+    uint64_t updates;
+    uint64_t dropped;
+    uint64_t commands;
+    uint32_t latency_ns;
+    uint32_t latency_mean_ns;
+    uint32_t latency_max_ns;
+};
+
+enum control_command_type {
+    CONTROL_CMD_MODE = 1, // args[0]: nonzero for accelerometer mode, zero for ADC
+    CONTROL_CMD_PERIOD,   // args[0]: PWM period register value
+    CONTROL_CMD_MAP,      // args: source of each channel, as in control_telemetry.map
+};
+
+struct control_command {
+    uint32_t type;
+    uint32_t args[CONTROL_CHANNELS];
+};
+
+// One command queue entry
+struct control_slot {
+    _Atomic uint32_t seq;
+    struct control_command cmd;
+};
+
+/**
+ * struct control_shm - Layout of the shared-memory segment.
+ * @magic: CONTROL_SHM_MAGIC, once the daemon has initialized the segment
+ * @version: CONTROL_SHM_VERSION
+ * @pid: Daemon's process ID
+ * @telemetry_seq: Seqlock sequence number; odd while @telemetry is written
+ * @telemetry: Latest telemetry
+ * @cmd_tail: Next queue position for senders to claim
+ * @cmd_head: Next queue position for the daemon to take
+ * @cmd_slots: Command queue; each slot's sequence number says whether it's
+ *             free for position n (n), or holds the command for it (n + 1)
+ *
+ * The command queue is a bounded multi-producer queue, so any number of
+ * tools may send commands at once. A sender that dies between claiming a
+ * slot and filling it stalls the queue until the daemon restarts.
+ *
+ * The daemon creates the segment with mode 0644, so any user may map it
+ * read-only to watch the telemetry, but only the daemon's user may map it
+ * writable to send commands.
+ */
+struct control_shm {
+    _Atomic uint32_t magic;
+    uint32_t version;
+    uint32_t pid;
+    _Alignas(64) _Atomic uint32_t telemetry_seq;
+    struct control_telemetry telemetry;
+    _Alignas(64) _Atomic uint32_t cmd_tail;
+    _Alignas(64) _Atomic uint32_t cmd_head;
+    struct control_slot cmd_slots[CONTROL_QUEUE_SLOTS];
+};
+
+// Daemon: create (or take over) and initialize the named segment
+struct control_shm *control_shm_create(const char *name);
+// Daemon: record the calling process as the segment's owner, after it has
+// forked (e.g. by daemon()) away from the one that created it
+void control_shm_adopt(struct control_shm *shm);
+// Tools: map an existing, initialized segment; writable is needed only to
+// send commands
+struct control_shm *control_shm_open(const char *name, bool writable);
+void control_shm_close(struct control_shm *shm);
+// Daemon: remove the segment's name, once finished with it
+void control_shm_unlink(const char *name);
+
+// Daemon: publish new telemetry
+void control_shm_publish(struct control_shm *shm, const struct control_telemetry *telemetry);
+// Tools: take a consistent copy of the latest telemetry; returns -1 with errno
+// ESRCH if the daemon died partway through publishing it
+int control_shm_read(struct control_shm *shm, struct control_telemetry *telemetry);
+
+// Tools: queue a command; returns -1 with errno EAGAIN if the queue is full
+int control_shm_send(struct control_shm *shm, const struct control_command *cmd);
+// Daemon: take the next queued command; returns false if there are none
+bool control_shm_receive(struct control_shm *shm, struct control_command *cmd);
+
+#endif
@@ -0,0 +1,80 @@
+/* Orientation filter for the accelerometer controller.
+ *
+ * The gravity estimate moves towards each sample by a weight that's the
+ * configured gain scaled by the sample's trust, in fixed point throughout.
+ * Trust is judged from the squared magnitude, to avoid a square root, and
+ * scaled by a precomputed reciprocal, to avoid a division per sample.
+ * EELE 467
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "orientation.h"
+
+#define SCALE 0x10000 // Fixed-point scale of the gravity estimate
+
+
+void orient_default_config(struct orient_config *config) {
+    config->gain = ORIENT_GAIN_ONE / 8;
+    config->one_g = ORIENT_DEFAULT_ONE_G;
+    config->reject = ORIENT_GAIN_ONE / 2;
+    config->decimation = 1;
+}
+
+int orient_init(struct orient_filter *filter, const struct orient_config *config) {
+    if (config->gain == 0 || config->gain > ORIENT_GAIN_ONE || config->one_g == 0
+            || config->one_g >= (1 << 24) || config->decimation == 0) {
+        return -1;
+    }
+    memset(filter, 0, sizeof(*filter));
+    filter->config = *config;
+    filter->one_g2 = (int64_t)config->one_g * config->one_g;
+    if (config->reject > 0) {
+        // |a|^2 - g^2 is about 2 g (|a| - g), for samples near 1 g
+        filter->reject_span = ((uint64_t)filter->one_g2 * 2 * config->reject) / ORIENT_GAIN_ONE;
+        if (filter->reject_span == 0) filter->reject_span = 1;
+        filter->reject_recip = (1ULL << 48) / filter->reject_span;
+    }
+    return 0;
+}
+
+bool orient_update(struct orient_filter *filter, const int *sample, int *gravity) {
+    const struct orient_config *config = &filter->config;
+    int64_t x = sample[0], y = sample[1], z = sample[2];
+
+    if (!filter->primed) {
+        // The first sample starts the filter
+        filter->gravity[0] = x * SCALE;
+        filter->gravity[1] = y * SCALE;
+        filter->gravity[2] = z * SCALE;
+        filter->primed = true;
+    } else {
+        // Trust falls linearly from 1 at exactly 1 g to 0 at the rejection span
+        int64_t weight = config->gain;
+        if (filter->reject_span > 0) {
+            uint64_t off = llabs(x * x + y * y + z * z - filter->one_g2);
+            if (off >= filter->reject_span) {
+                weight = 0;
+            } else {
+                int64_t trust = ORIENT_GAIN_ONE - ((off * filter->reject_recip) >> 32);
+                weight = weight * trust / ORIENT_GAIN_ONE;
+            }
+        }
+        filter->gravity[0] += (x * SCALE - filter->gravity[0]) * weight / ORIENT_GAIN_ONE;
+        filter->gravity[1] += (y * SCALE - filter->gravity[1]) * weight / ORIENT_GAIN_ONE;
+        filter->gravity[2] += (z * SCALE - filter->gravity[2]) * weight / ORIENT_GAIN_ONE;
+    }
+
+    if (++filter->phase < config->decimation) return false;
+    filter->phase = 0;
+    for (unsigned int i = 0; i < 3; i++) gravity[i] = (filter->gravity[i] + SCALE / 2) >> 16;
+    return true;
+}
+
+unsigned int orient_process(struct orient_filter *filter, const int (*samples)[3], unsigned int count,
+                            int *gravity) {
+    unsigned int outputs = 0;
+    for (unsigned int n = 0; n < count; n++) outputs += orient_update(filter, samples[n], gravity);
+    return outputs;
+}
@@ -0,0 +1,73 @@
+/* Orientation filter for the accelerometer controller.
+ * Fuses a stream of accelerometer samples into a steady estimate of the
+ * direction of gravity, which is all the orientation the color computations
+ * need, and hands it on at a decimated rate. With no gyroscope to predict
+ * motion between samples, this is a complementary filter whose correction
+ * gain, as in a Mahony filter, trusts each sample less the further its
+ * magnitude is from 1 g, so taps and jolts barely disturb it.
+ * EELE 467
+ */
+
+#ifndef ORIENTATION_H
+#define ORIENTATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Unity gain and trust, meaning no filtering
+#define ORIENT_GAIN_ONE 0x10000
+#define ORIENT_DEFAULT_ONE_G 256 // ADXL345 full-resolution scale
+
+/**
+ * struct orient_config - Settings for the orientation filter.
+ * @gain: Weight of each fully trusted sample, in 1/65536; from 1 (heaviest
+ *        filtering) to ORIENT_GAIN_ONE (none)
+ * @one_g: Counts per g
+ * @reject: How far, in 1/65536 g, a sample's magnitude may be from 1 g before
+ *          it's ignored; its weight falls linearly (in the squared magnitude)
+ *          to zero there. Zero trusts every sample.
+ * @decimation: Samples per output
+ */
+struct orient_config {
+    uint32_t gain;
+    uint32_t one_g;
+    uint32_t reject;
+    unsigned int decimation;
+};
+
+/**
+ * struct orient_filter - Orientation filter state.
+ * @config: Settings the filter was initialized with
+ * @gravity: Estimated gravity vector, in counts scaled by 2^16
+ * @one_g2: Squared magnitude of 1 g, in counts squared
+ * @reject_span: Distance of a sample's squared magnitude from @one_g2 at
+ *               which its weight reaches zero
+ * @reject_recip: 2^48 / @reject_span, so weights need no division
+ * @phase: Samples since the last output
+ * @primed: Set once the first sample has been processed
+ */
+struct orient_filter {
+    struct orient_config config;
+    int64_t gravity[3];
+    int64_t one_g2;
+    uint64_t reject_span;
+    uint64_t reject_recip;
+    unsigned int phase;
+    bool primed;
+};
+
+// Moderate smoothing, ignoring samples half a g or more off, and no decimation
+void orient_default_config(struct orient_config *config);
+// Reset the filter and apply new settings; returns -1 if they're out of range
+int orient_init(struct orient_filter *filter, const struct orient_config *config);
+/* Fold in one sample (X, Y, Z counts, each of magnitude below 2^24). Returns
+ * true, with the estimated gravity vector (in rounded counts) in gravity, on
+ * every config.decimation'th sample.
+ */
+bool orient_update(struct orient_filter *filter, const int *sample, int *gravity);
+// Fold in a batch of samples; returns the number of outputs due, leaving the
+// newest in gravity
+unsigned int orient_process(struct orient_filter *filter, const int (*samples)[3], unsigned int count,
+                            int *gravity);
+
+#endif
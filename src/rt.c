@@ -0,0 +1,158 @@
+/* Real-time support for the controller programs.
+ * EELE 467
+ */
+
+#define _GNU_SOURCE  // For CPU affinity
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+
+
+int rt_lock_memory(void) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        fprintf(stderr, "Warning: can't lock memory (%s); page faults may cause jitter\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Touch a stack's worth of pages now, so (with memory locked) they stay
+// resident and the loop never faults one in
+static void __attribute__((noinline)) rt_prefault_stack(void) {
+    volatile unsigned char stack[RT_STACK_PREFAULT];
+    for (size_t i = 0; i < sizeof(stack); i += 256) stack[i] = 0;
+}
+
+int rt_enter(int priority, int cpu, const char *who) {
+    int failures = 0;
+    rt_prefault_stack();
+
+    struct sched_param param = { .sched_priority = priority };
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) {
+        fprintf(stderr, "Warning: can't run %s at SCHED_FIFO priority %d (%s)\n", who, priority, strerror(err));
+        failures++;
+    }
+
+    if (cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (err != 0) {
+            fprintf(stderr, "Warning: can't pin %s to CPU %d (%s)\n", who, cpu, strerror(err));
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int rt_default_cpu(void) {
+    long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    return nprocs > 1 ? nprocs - 1 : 0;
+}
+
+
+void rt_jitter_init(struct rt_jitter *jitter) {
+    memset(jitter, 0, sizeof(*jitter));
+    jitter->min_ns = UINT64_MAX;
+}
+
+void rt_jitter_record(struct rt_jitter *jitter, uint64_t late_ns) {
+    // Bucket by the bit length of the whole microseconds late
+    uint64_t us = late_ns / 1000;
+    unsigned int bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+    if (bucket >= RT_JITTER_BUCKETS) bucket = RT_JITTER_BUCKETS - 1;
+    jitter->buckets[bucket]++;
+    jitter->count++;
+    jitter->sum_ns += late_ns;
+    if (late_ns < jitter->min_ns) jitter->min_ns = late_ns;
+    if (late_ns > jitter->max_ns) jitter->max_ns = late_ns;
+}
+
+void rt_jitter_print(const struct rt_jitter *jitter, FILE *stream, const char *what) {
+    if (jitter->count == 0) return;
+    fprintf(stream, "%s jitter over %lu periods (%lu overruns): min %.1f us, mean %.1f us, max %.1f us\n",
+            what, jitter->count, jitter->overruns, jitter->min_ns * 1e-3,
+            jitter->sum_ns / jitter->count * 1e-3, jitter->max_ns * 1e-3);
+
+    unsigned int first = 0, last = RT_JITTER_BUCKETS - 1;
+    unsigned long most = 0;
+    while (jitter->buckets[first] == 0) first++;
+    while (jitter->buckets[last] == 0) last--;
+    for (unsigned int b = first; b <= last; b++) {
+        if (jitter->buckets[b] > most) most = jitter->buckets[b];
+    }
+    for (unsigned int b = first; b <= last; b++) {
+        char range[48];
+        if (b == 0) snprintf(range, sizeof(range), "< 1 us");
+        else if (b == RT_JITTER_BUCKETS - 1) snprintf(range, sizeof(range), ">= %lu us", 1UL << (b - 1));
+        else snprintf(range, sizeof(range), "%lu-%lu us", 1UL << (b - 1), 1UL << b);
+        // Bars scale to the fullest bucket; any wakeups at all get one mark
+        int bar = (jitter->buckets[b] * 40 + most - 1) / most;
+        fprintf(stream, "  %16s %10lu %.*s\n", range, jitter->buckets[b], bar,
+                "########################################");
+    }
+}
+
+
+static uint64_t timespec_ns(const struct timespec *ts) {
+    return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+static void timespec_add(struct timespec *ts, long ns) {
+    ts->tv_nsec += ns;
+    while (ts->tv_nsec >= 1000000000L) {
+        ts->tv_nsec -= 1000000000L;
+        ts->tv_sec++;
+    }
+}
+
+int rt_timer_start_at(struct rt_timer *timer, unsigned long rate_hz, const struct timespec *start) {
+    // A zero interval would never leave the first deadline behind
+    if (rate_hz == 0 || rate_hz > 1000000000UL) {
+        errno = EINVAL;
+        return -1;
+    }
+    timer->interval_ns = 1000000000L / rate_hz;
+    timer->next = *start;
+    timespec_add(&timer->next, timer->interval_ns);
+    return 0;
+}
+
+int rt_timer_start(struct rt_timer *timer, unsigned long rate_hz) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return rt_timer_start_at(timer, rate_hz, &now);
+}
+
+void rt_timer_advance(struct rt_timer *timer, const struct timespec *now, struct rt_jitter *jitter) {
+    uint64_t now_ns = timespec_ns(now), deadline_ns = timespec_ns(&timer->next);
+    uint64_t late_ns = now_ns > deadline_ns ? now_ns - deadline_ns : 0;
+    if (jitter != NULL) rt_jitter_record(jitter, late_ns);
+
+    // If we've already missed the following deadlines, skip them rather than
+    // running a burst of back-to-back periods to catch up
+    timespec_add(&timer->next, timer->interval_ns);
+    while (timespec_ns(&timer->next) <= now_ns) {
+        timespec_add(&timer->next, timer->interval_ns);
+        if (jitter != NULL) jitter->overruns++;
+    }
+}
+
+int rt_timer_wait(struct rt_timer *timer, struct rt_jitter *jitter) {
+    // Absolute deadlines don't drift, however long each period's work takes
+    int err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &timer->next, NULL);
+    if (err == EINTR) return -1;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    rt_timer_advance(timer, &now, jitter);
+    return 0;
+}
@@ -0,0 +1,80 @@
+/* Real-time support for the controller programs: memory locking, SCHED_FIFO
+ * scheduling, CPU affinity, absolute-deadline periodic timing, and jitter
+ * statistics.
+ * Everything here degrades to a warning without real-time privileges, so the
+ * same code paths run (less deterministically) on an ordinary Linux host.
+ * EELE 467
+ */
+
+#ifndef RT_H
+#define RT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define RT_STACK_PREFAULT (64 * 1024) // Stack each real-time thread may use
+#define RT_THREAD_STACK (256 * 1024)  // Stack size for real-time threads
+#define RT_JITTER_BUCKETS 22          // Up to about a second
+
+/**
+ * struct rt_jitter - Histogram of how late periodic wakeups were.
+ * @count: Wakeups recorded
+ * @overruns: Periods skipped entirely because the loop fell behind
+ * @min_ns: Smallest lateness
+ * @max_ns: Largest lateness
+ * @sum_ns: Sum of all latenesses
+ * @buckets: Bucket 0 counts wakeups under 1 us late; bucket k counts those
+ *           from 2^(k-1) up to 2^k us late, and the last also anything later
+ */
+struct rt_jitter {
+    unsigned long count;
+    unsigned long overruns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    double sum_ns;
+    unsigned long buckets[RT_JITTER_BUCKETS];
+};
+
+/**
+ * struct rt_timer - Fixed-rate schedule of absolute deadlines.
+ * @next: Next deadline, on CLOCK_MONOTONIC
+ * @interval_ns: Time between deadlines
+ */
+struct rt_timer {
+    struct timespec next;
+    long interval_ns;
+};
+
+// Lock all current and future memory, so page faults can't stall the loop;
+// returns -1 (after warning) if that isn't permitted
+int rt_lock_memory(void);
+// Make the calling thread real-time: pre-fault its stack, switch it to
+// SCHED_FIFO at priority, and pin it to cpu (unless negative). Returns the
+// number of steps that failed, each with a warning naming who.
+int rt_enter(int priority, int cpu, const char *who);
+// The core real-time work should go to: the last one, away from most of the
+// system's housekeeping on core 0
+int rt_default_cpu(void);
+
+void rt_jitter_init(struct rt_jitter *jitter);
+void rt_jitter_record(struct rt_jitter *jitter, uint64_t late_ns);
+// Print a summary and the histogram's non-empty range
+void rt_jitter_print(const struct rt_jitter *jitter, FILE *stream, const char *what);
+
+// Start a schedule at rate_hz, with the first deadline one period from now.
+// Returns -1 with errno EINVAL if rate_hz is zero, or too fast for a period
+// of at least a nanosecond.
+int rt_timer_start(struct rt_timer *timer, unsigned long rate_hz);
+// As rt_timer_start(), but with the first deadline one period after start
+int rt_timer_start_at(struct rt_timer *timer, unsigned long rate_hz, const struct timespec *start);
+// Sleep until the next deadline, recording how late we woke in jitter (if not
+// NULL). Returns -1 if a signal interrupted the sleep, leaving the deadline
+// in place.
+int rt_timer_wait(struct rt_timer *timer, struct rt_jitter *jitter);
+// Move on from the current deadline, given the time now: record how late now
+// is, and skip (as overruns) any deadlines already missed. rt_timer_wait()
+// does this after each sleep.
+void rt_timer_advance(struct rt_timer *timer, const struct timespec *now, struct rt_jitter *jitter);
+
+#endif
@@ -0,0 +1,300 @@
+/* Software simulation backend for the controller programs.
+ * Stands in for the ADC and PWM hardware, so the programs can be run (and
+ * benchmarked) on machines without an FPGA.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "sim.h"
+
+#define SIM_ADC_MAX 0xFFF // 12-bit converter
+#define SIM_DEFAULT_FREQ 1.0
+#define SIM_DEFAULT_CHANNELS 3 // Like the DE10-Nano's RGB LED
+#define SIM_MAX_CHANNELS 255 // Like the PWM component
+#define SIM_TRACE_BUFSIZE (64 * 1024)
+
+
+enum sim_wave {
+    SIM_SINE,
+    SIM_TRIANGLE,
+    SIM_SQUARE,
+    SIM_NOISE,
+    SIM_REPLAY,
+};
+
+struct sim_priv {
+    enum sim_wave wave;
+    double freq;
+    unsigned int noise;
+    uint64_t rng;
+    FILE *replay;
+    char *line;
+    size_t line_size;
+    FILE *trace;
+    int event_fd;
+    struct timespec start;
+    uint32_t period;
+    long stall_us;
+};
+
+// Nanoseconds since the backend was opened
+static long long sim_elapsed_ns(const struct sim_priv *priv) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - priv->start.tv_sec) * 1000000000LL + (now.tv_nsec - priv->start.tv_nsec);
+}
+
+// xorshift64*; plenty random for test signals, and much cheaper than rand()
+static uint32_t sim_random(struct sim_priv *priv) {
+    priv->rng ^= priv->rng >> 12;
+    priv->rng ^= priv->rng << 25;
+    priv->rng ^= priv->rng >> 27;
+    return (priv->rng * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+// Parse one "key=value" option; returns -1 on unknown keys or bad values
+static int sim_parse_option(struct sim_priv *priv, char *opt) {
+    char *value = strchr(opt, '=');
+    if (value == NULL) {
+        fprintf(stderr, "Simulator option \"%s\" needs a value!\n", opt);
+        return -1;
+    }
+    *value++ = '\0';
+
+    if (strcmp(opt, "wave") == 0) {
+        if      (strcmp(value, "sine") == 0)     priv->wave = SIM_SINE;
+        else if (strcmp(value, "triangle") == 0) priv->wave = SIM_TRIANGLE;
+        else if (strcmp(value, "square") == 0)   priv->wave = SIM_SQUARE;
+        else if (strcmp(value, "noise") == 0)    priv->wave = SIM_NOISE;
+        else {
+            fprintf(stderr, "Unknown simulator waveform \"%s\"!\n", value);
+            return -1;
+        }
+    } else if (strcmp(opt, "channels") == 0) {
+        // Already handled by sim_pwm_channels()
+    } else if (strcmp(opt, "freq") == 0) {
+        priv->freq = strtod(value, NULL);
+    } else if (strcmp(opt, "noise") == 0) {
+        priv->noise = strtoul(value, NULL, 0);
+    } else if (strcmp(opt, "replay") == 0) {
+        priv->replay = fopen(value, "r");
+        if (priv->replay == NULL) {
+            perror("Failed to open simulator replay file");
+            return -1;
+        }
+        priv->wave = SIM_REPLAY;
+    } else if (strcmp(opt, "trace") == 0) {
+        priv->trace = fopen(value, "w");
+        if (priv->trace == NULL) {
+            perror("Failed to open simulator trace file");
+            return -1;
+        }
+        setvbuf(priv->trace, NULL, _IOFBF, SIM_TRACE_BUFSIZE);
+    } else if (strcmp(opt, "stall") == 0) {
+        priv->stall_us = strtol(value, NULL, 0);
+        if (priv->stall_us < 0) {
+            fprintf(stderr, "Simulator stall can't be negative!\n");
+            return -1;
+        }
+    } else if (strcmp(opt, "rate") == 0) {
+        double rate = strtod(value, NULL);
+        if (rate <= 0) {
+            fprintf(stderr, "Simulator rate must be positive!\n");
+            return -1;
+        }
+        priv->event_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (priv->event_fd < 0) {
+            perror("Failed to create simulator timer");
+            return -1;
+        }
+        long long interval_ns = 1e9 / rate;
+        struct itimerspec spec = {
+            .it_interval = { .tv_sec = interval_ns / 1000000000LL, .tv_nsec = interval_ns % 1000000000LL },
+            .it_value    = { .tv_sec = interval_ns / 1000000000LL, .tv_nsec = interval_ns % 1000000000LL },
+        };
+        timerfd_settime(priv->event_fd, 0, &spec, NULL);
+    } else {
+        fprintf(stderr, "Unknown simulator option \"%s\"!\n", opt);
+        return -1;
+    }
+    return 0;
+}
+
+// The PWM channel count is needed before opening, so find it separately
+static int sim_pwm_channels(struct backend *be) {
+    unsigned long channels = SIM_DEFAULT_CHANNELS;
+    if (be->args == NULL) return channels;
+    char *args = strdup(be->args);
+    if (args == NULL) return -1;
+    char *saveptr;
+    for (char *opt = strtok_r(args, ",", &saveptr); opt != NULL; opt = strtok_r(NULL, ",", &saveptr)) {
+        if (strncmp(opt, "channels=", strlen("channels=")) == 0) {
+            channels = strtoul(opt + strlen("channels="), NULL, 0);
+        }
+    }
+    free(args);
+    if (channels == 0 || channels > SIM_MAX_CHANNELS) {
+        fprintf(stderr, "Simulator channel count must be from 1 to %d!\n", SIM_MAX_CHANNELS);
+        return -1;
+    }
+    return channels;
+}
+
+static void sim_close(struct backend *be) {
+    struct sim_priv *priv = be->priv;
+    if (priv == NULL) return;
+    if (priv->replay != NULL) fclose(priv->replay);
+    if (priv->trace != NULL) fclose(priv->trace);
+    if (priv->event_fd >= 0) close(priv->event_fd);
+    free(priv->line);
+    free(priv);
+    be->priv = NULL;
+}
+
+static int sim_open(struct backend *be) {
+    struct sim_priv *priv = calloc(1, sizeof(*priv));
+    if (priv == NULL) return -1;
+    be->priv = priv;
+    priv->wave = SIM_SINE;
+    priv->freq = SIM_DEFAULT_FREQ;
+    priv->event_fd = -1;
+    clock_gettime(CLOCK_MONOTONIC, &priv->start);
+    priv->rng = priv->start.tv_nsec | 1;  // Must be nonzero
+
+    if (be->args == NULL) return 0;
+    char *args = strdup(be->args);
+    if (args == NULL) return -1;
+    int ret = 0;
+    char *saveptr;
+    for (char *opt = strtok_r(args, ",", &saveptr); opt != NULL; opt = strtok_r(NULL, ",", &saveptr)) {
+        ret = sim_parse_option(priv, opt);
+        if (ret < 0) break;
+    }
+    free(args);
+
+    if (ret == 0 && priv->trace != NULL) {
+        fprintf(priv->trace, "timestamp_ns,period");
+        for (unsigned int i = 0; i < be->num_channels; i++) {
+            fprintf(priv->trace, ",duty_cycle_%u", i + 1);
+        }
+        fprintf(priv->trace, "\n");
+    }
+    return ret;
+}
+
+// Read the next line of replay readings, looping back at the end of the file
+static int sim_replay_channels(struct backend *be, uint32_t *readings) {
+    struct sim_priv *priv = be->priv;
+    bool rewound = false;
+    for (;;) {
+        if (getline(&priv->line, &priv->line_size, priv->replay) < 0) {
+            // Give up if the whole file has no usable lines
+            if (rewound) {
+                errno = ENODATA;
+                return -1;
+            }
+            rewind(priv->replay);
+            rewound = true;
+            continue;
+        }
+        // Skip comments and blank lines
+        const char *p = priv->line + strspn(priv->line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') continue;
+
+        for (unsigned int i = 0; i < be->num_channels; i++) {
+            char *end;
+            readings[i] = strtoul(p, &end, 0);
+            p = end + strspn(end, ", \t");
+        }
+        return 0;
+    }
+}
+
+static int sim_read_channels(struct backend *be, uint32_t *readings) {
+    struct sim_priv *priv = be->priv;
+
+    // Acknowledge the readings we're about to deliver
+    if (priv->event_fd >= 0) {
+        uint64_t expirations;
+        if (read(priv->event_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) return -1;
+    }
+
+    if (priv->wave == SIM_REPLAY) return sim_replay_channels(be, readings);
+
+    double t = sim_elapsed_ns(priv) * 1e-9;
+    for (unsigned int i = 0; i < be->num_channels; i++) {
+        // Spread channels evenly in phase, so they don't all read the same
+        double phase = fmod(t * priv->freq + (double)i / be->num_channels, 1.0);
+        double level;
+        switch (priv->wave) {
+            case SIM_SINE:
+                level = 0.5 + 0.5 * sin(2 * M_PI * phase);
+                break;
+            case SIM_TRIANGLE:
+                level = phase < 0.5 ? 2 * phase : 2 - 2 * phase;
+                break;
+            case SIM_SQUARE:
+                level = phase < 0.5 ? 1 : 0;
+                break;
+            case SIM_NOISE:
+            default:
+                level = (double)sim_random(priv) / UINT32_MAX;
+                break;
+        }
+        long value = lround(level * SIM_ADC_MAX);
+        if (priv->noise > 0) {
+            value += (long)(sim_random(priv) % (2 * priv->noise + 1)) - (long)priv->noise;
+        }
+        readings[i] = value < 0 ? 0 : value > SIM_ADC_MAX ? SIM_ADC_MAX : value;
+    }
+    return 0;
+}
+
+static int sim_write_duty_cycles(struct backend *be, const uint32_t *duty_cycles) {
+    struct sim_priv *priv = be->priv;
+    if (priv->stall_us > 0) {
+        // Like a write stuck behind a busy bus or a slow driver
+        struct timespec stall = { .tv_sec = priv->stall_us / 1000000, .tv_nsec = priv->stall_us % 1000000 * 1000 };
+        while (nanosleep(&stall, &stall) < 0 && errno == EINTR);
+    }
+    if (priv->trace == NULL) return 0;
+    fprintf(priv->trace, "%lld,%u", sim_elapsed_ns(priv), priv->period);
+    for (unsigned int i = 0; i < be->num_channels; i++) {
+        fprintf(priv->trace, ",%u", duty_cycles[i]);
+    }
+    fputc('\n', priv->trace);
+    return 0;
+}
+
+static int sim_write_period(struct backend *be, uint32_t period) {
+    struct sim_priv *priv = be->priv;
+    priv->period = period;
+    return 0;
+}
+
+static int sim_event_fd(struct backend *be) {
+    struct sim_priv *priv = be->priv;
+    // Only available with the rate option; otherwise readings change constantly
+    return priv->event_fd;
+}
+
+const struct backend_ops sim_ops = {
+    .name = "sim",
+    .open = sim_open,
+    .read_channels = sim_read_channels,
+    .write_duty_cycles = sim_write_duty_cycles,
+    .write_period = sim_write_period,
+    .pwm_channels = sim_pwm_channels,
+    .event_fd = sim_event_fd,
+    .close = sim_close,
+    .simulated = true,
+};
@@ -0,0 +1,26 @@
+/* Software simulation backend for the controller programs.
+ * EELE 467
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include "backend.h"
+
+/* Simulated ADC and PWM, selected as "sim" or "sim:<options>", where options
+ * are comma-separated and may include:
+ *   wave=sine|triangle|square|noise  ADC waveform (default sine); channels
+ *                                    are spread evenly in phase
+ *   freq=<Hz>                        Waveform frequency (default 1)
+ *   noise=<counts>                   Uniform noise added to each reading
+ *   replay=<file>                    Replay readings from a file instead, one
+ *                                    line of channel values per read, looping
+ *   rate=<Hz>                        Signal new readings at this rate through
+ *                                    the backend's event fd
+ *   trace=<file>                     Record timestamped PWM writes as CSV
+ *   stall=<us>                       Make each duty cycle write take this long
+ *   channels=<n>                     Number of PWM channels (default 3)
+ */
+extern const struct backend_ops sim_ops;
+
+#endif
@@ -0,0 +1,79 @@
+/* Lock-free single-producer, single-consumer ring with latest-value-wins
+ * semantics.
+ *
+ * Each slot is guarded by its own sequence number, as in a seqlock: the
+ * producer makes it odd, writes the slot, then makes it even again, and the
+ * consumer only accepts a copy if the number was the same, even, and the one
+ * it expected on both sides of the copy.
+ * EELE 467
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spsc.h"
+
+
+int spsc_init(struct spsc_ring *ring, size_t slots, size_t size) {
+    if (slots == 0 || (slots & (slots - 1)) != 0 || size == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    ring->mask = slots - 1;
+    ring->size = size;
+    ring->seqs = calloc(slots, sizeof(*ring->seqs));
+    ring->data = calloc(slots, size);
+    if (ring->seqs == NULL || ring->data == NULL) {
+        spsc_free(ring);
+        return -1;
+    }
+    atomic_init(&ring->head, 0);
+    ring->tail = 0;
+    ring->dropped = 0;
+    return 0;
+}
+
+void spsc_free(struct spsc_ring *ring) {
+    free(ring->seqs);
+    free(ring->data);
+    ring->seqs = NULL;
+    ring->data = NULL;
+}
+
+void spsc_publish(struct spsc_ring *ring, const void *value) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t slot = head & ring->mask;
+    uint32_t seq = 2 * (uint32_t)(head + 1);
+
+    atomic_store_explicit(&ring->seqs[slot], seq - 1, memory_order_relaxed);
+    // Order the odd sequence number before the new contents
+    atomic_thread_fence(memory_order_release);
+    memcpy(ring->data + slot * ring->size, value, ring->size);
+    atomic_store_explicit(&ring->seqs[slot], seq, memory_order_release);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+bool spsc_take_latest(struct spsc_ring *ring, void *value) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == ring->tail) return false;
+
+    for (;;) {
+        size_t slot = (head - 1) & ring->mask;
+        uint32_t expected = 2 * (uint32_t)head;
+        uint32_t before = atomic_load_explicit(&ring->seqs[slot], memory_order_acquire);
+        if (before == expected) {
+            memcpy(value, ring->data + slot * ring->size, ring->size);
+            // Order the copy before re-checking the sequence number
+            atomic_thread_fence(memory_order_acquire);
+            uint32_t after = atomic_load_explicit(&ring->seqs[slot], memory_order_relaxed);
+            if (after == expected) break;
+        }
+        // Lapped by the producer; its newer values will do instead
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    }
+
+    ring->dropped += head - ring->tail - 1;
+    ring->tail = head;
+    return true;
+}
@@ -0,0 +1,50 @@
+/* Lock-free single-producer, single-consumer ring with latest-value-wins
+ * semantics, for handing state between the controller programs' threads.
+ * EELE 467
+ */
+
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * struct spsc_ring - Ring of fixed-size values passed between two threads.
+ * @mask: Number of slots, minus one; the slot count is a power of two
+ * @size: Bytes per value
+ * @seqs: Per-slot sequence numbers: odd while the producer is writing the
+ *        slot, otherwise twice the (one-based) number of the value it holds
+ * @data: Slot storage, @size bytes per slot
+ * @head: Number of values published so far; only the producer writes it
+ * @tail: Number of values the consumer has moved past; consumer-private
+ * @dropped: Values the consumer skipped to reach newer ones; consumer-private
+ *
+ * The producer never waits: it always writes the next slot, overwriting the
+ * oldest value if the consumer hasn't kept up. The consumer only ever takes
+ * the newest value, and detects (and retries after) the producer lapping it
+ * mid-copy, like a seqlock. More slots just make such retries rarer.
+ */
+struct spsc_ring {
+    size_t mask;
+    size_t size;
+    _Atomic uint32_t *seqs;
+    unsigned char *data;
+    _Alignas(64) _Atomic uint64_t head;
+    _Alignas(64) uint64_t tail;
+    uint64_t dropped;
+};
+
+// Allocate a ring of slots values of size bytes each; slots must be a power
+// of two. Returns -1 with errno set on failure.
+int spsc_init(struct spsc_ring *ring, size_t slots, size_t size);
+void spsc_free(struct spsc_ring *ring);
+// Producer: publish a new value
+void spsc_publish(struct spsc_ring *ring, const void *value);
+// Consumer: copy the newest value into value, if any arrived since the last
+// call; returns false if none did
+bool spsc_take_latest(struct spsc_ring *ring, void *value);
+
+#endif
@@ -0,0 +1,131 @@
+/* Test for batched accelerometer event input.
+ * Feeds raw events through a pipe, checking that each batch coalesces to its
+ * newest complete report, that reports and events split across reads are put
+ * back together, that taps are counted, and that everything up to the report
+ * after a SYN_DROPPED is discarded.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../accel_input.h"
+
+#define CHECK_NAME "accel_input"
+#include "check.h"
+
+static int pipe_fds[2];
+static struct accel_input in;
+
+static struct input_event ev(unsigned int type, unsigned int code, int value, unsigned long sec) {
+    struct input_event event = { .type = type, .code = code, .value = value };
+    event.input_event_sec = sec;
+    return event;
+}
+
+static void feed(const struct input_event *events, size_t count) {
+    if (write(pipe_fds[1], events, count * sizeof(*events)) < 0) perror("write");
+}
+
+// Read everything pending, totting up the batches
+static struct accel_update drain(void) {
+    struct accel_update total = {0}, update;
+    while (accel_read(&in, &update) > 0) {
+        if (update.reports > 0) {
+            memcpy(total.accel_vec, update.accel_vec, sizeof(total.accel_vec));
+            total.report_ns = update.report_ns;
+        }
+        if (update.taps > 0) total.tap_ns = update.tap_ns;
+        total.reports += update.reports;
+        total.taps += update.taps;
+    }
+    return total;
+}
+
+static void test_coalescing(void) {
+    struct input_event events[] = {
+        ev(EV_ABS, ABS_X, 1, 1), ev(EV_ABS, ABS_Y, 2, 1), ev(EV_ABS, ABS_Z, 3, 1), ev(EV_SYN, SYN_REPORT, 0, 1),
+        ev(EV_ABS, ABS_X, 4, 2), ev(EV_ABS, ABS_Z, 6, 2), ev(EV_SYN, SYN_REPORT, 0, 2),
+        ev(EV_ABS, ABS_Y, 99, 3),  // Incomplete, for now
+    };
+    feed(events, sizeof(events) / sizeof(events[0]));
+    struct accel_update u = drain();
+    check(u.reports == 2, "reports miscounted");
+    check(u.accel_vec[0] == 4 && u.accel_vec[1] == 2 && u.accel_vec[2] == 6, "newest report not coalesced");
+    check(u.report_ns == 2000000000ULL, "report timestamp wrong");
+
+    // The rest of the report arrives in the next read
+    struct input_event rest[] = { ev(EV_SYN, SYN_REPORT, 0, 3) };
+    feed(rest, 1);
+    u = drain();
+    check(u.reports == 1 && u.accel_vec[1] == 99, "report split across reads lost");
+}
+
+static void test_split_event(void) {
+    struct input_event events[] = { ev(EV_ABS, ABS_Z, -7, 4), ev(EV_SYN, SYN_REPORT, 0, 4) };
+    const char *bytes = (const char *)events;
+    size_t half = sizeof(events[0]) / 2;
+    if (write(pipe_fds[1], bytes, half) < 0) perror("write");
+    struct accel_update u = drain();
+    check(u.reports == 0, "half an event produced a report");
+    if (write(pipe_fds[1], bytes + half, sizeof(events) - half) < 0) perror("write");
+    u = drain();
+    check(u.reports == 1 && u.accel_vec[2] == -7, "event split across reads lost");
+}
+
+static void test_taps(void) {
+    struct input_event events[] = {
+        ev(EV_KEY, BTN_TOUCH, 1, 5), ev(EV_SYN, SYN_REPORT, 0, 5),
+        ev(EV_KEY, BTN_TOUCH, 0, 5), ev(EV_SYN, SYN_REPORT, 0, 5),
+        ev(EV_KEY, BTN_TOUCH, 1, 6), ev(EV_SYN, SYN_REPORT, 0, 6),
+        ev(EV_KEY, BTN_TOUCH, 2, 6),  // Autorepeat isn't another tap
+    };
+    feed(events, sizeof(events) / sizeof(events[0]));
+    struct accel_update u = drain();
+    check(u.taps == 2, "taps miscounted");
+    check(u.tap_ns == 6000000000ULL, "tap timestamp wrong");
+    check(u.reports == 0, "taps counted as accelerometer reports");
+}
+
+static void test_dropped(void) {
+    struct input_event events[] = {
+        ev(EV_ABS, ABS_X, 100, 7), ev(EV_SYN, SYN_DROPPED, 0, 7),
+        ev(EV_ABS, ABS_Y, 200, 7), ev(EV_KEY, BTN_TOUCH, 0, 7), ev(EV_KEY, BTN_TOUCH, 1, 7),
+        ev(EV_SYN, SYN_REPORT, 0, 7),
+        ev(EV_ABS, ABS_X, 8, 8), ev(EV_SYN, SYN_REPORT, 0, 8),
+    };
+    feed(events, sizeof(events) / sizeof(events[0]));
+    struct accel_update u = drain();
+    // A pipe has no device state to resync from, so only the report after
+    // the dropped one counts
+    check(u.reports == 1 && u.report_ns == 8000000000ULL, "report after SYN_DROPPED not discarded");
+    check(u.accel_vec[0] == 8 && u.accel_vec[1] == 99, "dropped events leaked into a report");
+    check(u.taps == 0, "tap after SYN_DROPPED not discarded");
+}
+
+static void test_end(void) {
+    struct accel_update u;
+    check(accel_read(&in, &u) == 0, "empty pipe not reported as idle");
+    close(pipe_fds[1]);
+    check(accel_read(&in, &u) < 0, "closed pipe not reported as ended");
+}
+
+int main(void) {
+    if (pipe(pipe_fds) < 0) {
+        perror("Failed to create event pipe");
+        return 1;
+    }
+    fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+    in.fd = pipe_fds[0];
+    test_coalescing();
+    test_split_event();
+    test_taps();
+    test_dropped();
+    test_end();
+    close(pipe_fds[0]);
+    return check_summary();
+}
@@ -0,0 +1,153 @@
+/* Test for the ADC controller's processing chain.
+ * Checks each stage on its own (smoothing, deadband, slew-rate limit and gamma
+ * correction), and that only channels whose outputs change are reported.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "../adc_chain.h"
+
+#define CHECK_NAME "adc_chain"
+#include "check.h"
+
+#define NUM_CHANNELS 4
+
+static struct chain chain;
+
+// Feed the same reading to channel 0 of a one-channel chain
+static uint32_t step(uint32_t reading, uint32_t *changed) {
+    uint32_t duty_cycle;
+    *changed = chain_process(&chain, &reading, &duty_cycle);
+    return duty_cycle;
+}
+
+static void test_defaults(void) {
+    struct chain_config config;
+    chain_default_config(&config);
+    check(chain_init(&chain, NUM_CHANNELS, &config) == 0, "default settings rejected");
+    uint32_t readings[NUM_CHANNELS] = {0, 1, 0x800, 0x1000};
+    uint32_t duty_cycles[NUM_CHANNELS];
+    check(chain_process(&chain, readings, duty_cycles) == (1u << NUM_CHANNELS) - 1,
+          "first update doesn't report every channel");
+    bool same = true;
+    for (unsigned int i = 0; i < NUM_CHANNELS; i++) {
+        same &= duty_cycles[i] == readings[i];
+    }
+    check(same, "default settings don't pass readings through");
+    check(chain_process(&chain, readings, duty_cycles) == 0, "unchanged readings reported");
+    readings[2] = 0x801;
+    check(chain_process(&chain, readings, duty_cycles) == 1u << 2, "wrong channel reported");
+    readings[3] = 0xFFF;  // Twelve-bit ADC maximum; anything higher saturates
+    readings[1] = 0x2000;
+    check(chain_process(&chain, readings, duty_cycles) == ((1u << 1) | (1u << 3)), "wrong channels reported");
+    check(duty_cycles[1] == 0x1000, "over-range reading not saturated");
+}
+
+static void test_smoothing(void) {
+    struct chain_config config;
+    chain_default_config(&config);
+    config.alpha = CHAIN_ALPHA_ONE / 8;
+    chain_init(&chain, 1, &config);
+    uint32_t changed, out = step(0, &changed);
+    check(out == 0 && changed, "smoothing doesn't start at the first reading");
+    out = step(0x800, &changed);
+    check(out == 0x100, "smoothing step is wrong");
+    // Converges monotonically to the input
+    bool monotonic = true;
+    for (unsigned int i = 0; i < 200; i++) {
+        uint32_t next = step(0x800, &changed);
+        monotonic &= next >= out;
+        out = next;
+    }
+    check(monotonic, "smoothing overshoots");
+    check(out == 0x800, "smoothing doesn't converge");
+    step(0x800, &changed);
+    check(!changed, "converged output still reported as changed");
+
+    // Invalid weights are refused
+    config.alpha = 0;
+    check(chain_configure(&chain, 0, &config) < 0, "zero smoothing weight accepted");
+    config.alpha = CHAIN_ALPHA_ONE + 1;
+    check(chain_configure(&chain, 0, &config) < 0, "smoothing weight over one accepted");
+}
+
+static void test_deadband(void) {
+    struct chain_config config;
+    chain_default_config(&config);
+    config.deadband = 8;
+    chain_init(&chain, 1, &config);
+    uint32_t changed;
+    step(0x400, &changed);
+    // Jitter within the band is suppressed entirely
+    bool quiet = true;
+    for (int i = 0; i < 100; i++) {
+        uint32_t out = step(0x400 + (i % 17) - 8, &changed);
+        quiet &= out == 0x400 && !changed;
+    }
+    check(quiet, "jitter inside the deadband gets through");
+    check(step(0x409, &changed) == 0x409 && changed, "deadband doesn't release");
+    // The band follows the output, so coming back doesn't move it
+    check(step(0x401, &changed) == 0x409 && !changed, "deadband isn't hysteretic");
+    check(step(0x400, &changed) == 0x400 && changed, "deadband doesn't release downwards");
+}
+
+static void test_slew(void) {
+    struct chain_config config;
+    chain_default_config(&config);
+    config.slew = 0x100;
+    chain_init(&chain, 1, &config);
+    uint32_t changed, out = step(0, &changed);
+    unsigned int steps = 0;
+    bool limited = true;
+    while (out != 0x1000 && steps < 100) {
+        uint32_t next = step(0x1000, &changed);
+        limited &= next > out && next - out <= config.slew && changed;
+        out = next;
+        steps++;
+    }
+    check(limited, "slew rate exceeded on the way up");
+    check(steps == 0x1000 / 0x100, "slew-limited rise takes the wrong number of steps");
+    step(0x1000, &changed);
+    check(!changed, "settled output still reported as changed");
+    check(step(0x80, &changed) == 0xF00, "slew rate exceeded on the way down");
+}
+
+static void test_gamma(void) {
+    struct chain_config config;
+    chain_default_config(&config);
+    const double gammas[] = {0.45, 1.0, 2.2, 3.0};
+    for (unsigned int g = 0; g < sizeof(gammas) / sizeof(gammas[0]); g++) {
+        config.gamma = gammas[g];
+        chain_init(&chain, 1, &config);
+        const uint16_t *table = chain.channels[0].gamma_table;
+        check(table[0] == 0 && table[CHAIN_DUTY_ONE] == CHAIN_DUTY_ONE, "gamma table endpoints wrong");
+        bool monotonic = true, accurate = true;
+        for (unsigned int i = 1; i <= CHAIN_DUTY_ONE; i++) {
+            monotonic &= table[i] >= table[i - 1];
+            double exact = pow((double)i / CHAIN_DUTY_ONE, gammas[g]) * CHAIN_DUTY_ONE;
+            accurate &= fabs(table[i] - exact) <= 0.5;
+        }
+        check(monotonic, "gamma table isn't monotonic");
+        check(accurate, "gamma table is inaccurate");
+        uint32_t changed;
+        check(step(0x800, &changed) == table[0x800], "gamma table not applied");
+    }
+    config.gamma = 0;
+    check(chain_configure(&chain, 0, &config) < 0, "zero gamma accepted");
+    config.gamma = NAN;
+    check(chain_configure(&chain, 0, &config) < 0, "NaN gamma accepted");
+}
+
+int main(void) {
+    test_defaults();
+    test_smoothing();
+    test_deadband();
+    test_slew();
+    test_gamma();
+    return check_summary();
+}
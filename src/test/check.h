@@ -0,0 +1,34 @@
+/* Pass/fail bookkeeping shared by the unit tests.
+ * Define CHECK_NAME as the test's name before including this; failed checks
+ * and the final tally are reported under it.
+ * EELE 467
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifndef CHECK_NAME
+#error "Define CHECK_NAME before including check.h"
+#endif
+
+static unsigned long checks = 0, failures = 0;
+
+// Count a check, reporting what went wrong if it failed
+static void check(bool ok, const char *what) {
+    checks++;
+    if (!ok) {
+        fprintf(stderr, CHECK_NAME ": %s\n", what);
+        failures++;
+    }
+}
+
+// Print the tally; returns the test's exit status
+static int check_summary(void) {
+    printf(CHECK_NAME ": %lu checks, %lu failures\n", checks, failures);
+    return failures > 0;
+}
+
+#endif
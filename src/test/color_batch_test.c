@@ -0,0 +1,168 @@
+/* Test for the batch HSL/HSV conversion kernels.
+ * Checks that every SIMD kernel this CPU can run matches the scalar one bit
+ * for bit, including at every tail length, and that the scalar one stays
+ * within COLOR_BATCH_TOLERANCE of the floating-point hsl2rgb(). Also reports
+ * each kernel's speedup.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../control.h"
+#include "../color_batch.h"
+
+#define RANDOM_PIXELS 1000000
+#define MAX_TAIL 40
+#define GRID_STEP 256
+#define MAX_ERROR COLOR_BATCH_TOLERANCE
+
+static unsigned long checked = 0, failures = 0;
+static int worst = 0;
+
+
+// Reference HSV to RGB conversion, in the style of hsl2rgb()
+static void hsv2rgb(const float *hsv, float *rgb) {
+    float chroma = hsv[2] * hsv[1];
+    float h_prime = hsv[0] / (M_PI/3);
+    float other_comp = chroma * (1 - fabsf(fmodf(h_prime, 2) - 1));
+    static const unsigned int order[6][3] = {
+        {0, 1, 2}, {1, 0, 2}, {2, 0, 1}, {2, 1, 0}, {1, 2, 0}, {0, 2, 1},
+    };
+    float comps[3] = {chroma, other_comp, 0};
+    unsigned int sector = h_prime < 6 ? (unsigned int)h_prime : 5;
+    float m = hsv[2] - chroma;
+    for (unsigned int i = 0; i < 3; i++) {
+        rgb[i] = comps[order[sector][i]] + m;
+    }
+}
+
+// Compare one fixed-point pixel against the floating-point reference
+static void check_accuracy(const uint16_t *px, bool hsv) {
+    float in[3] = {
+        px[0] * (2 * M_PI / 65536), (float)px[1] / COLOR_BATCH_ONE, (float)px[2] / COLOR_BATCH_ONE
+    };
+    float rgb[3];
+    uint32_t expected[3];
+    uint16_t actual[3];
+    if (hsv) {
+        hsv2rgb(in, rgb);
+        hsv_to_rgb_batch_scalar(px, actual, 1);
+    } else {
+        hsl2rgb(in, rgb);
+        hsl_to_rgb_batch_scalar(px, actual, 1);
+    }
+    rgb_to_duty_cycles(rgb, expected);
+    checked++;
+    for (unsigned int i = 0; i < 3; i++) {
+        int error = abs((int)actual[i] - (int)expected[i]);
+        if (error > worst) worst = error;
+        if (error > MAX_ERROR && failures++ < 10) {
+            fprintf(stderr, "%s (%u, %u, %u) channel %u: got %u, expected %u\n", hsv ? "hsv" : "hsl",
+                    px[0], px[1], px[2], i, actual[i], expected[i]);
+        }
+    }
+}
+
+// Compare the SIMD and scalar kernels over the first n pixels
+static bool check_exact(const char *name, color_batch_fn simd, color_batch_fn scalar,
+                        const uint16_t *in, uint16_t *out_simd, uint16_t *out_scalar, size_t n) {
+    simd(in, out_simd, n);
+    scalar(in, out_scalar, n);
+    if (memcmp(out_simd, out_scalar, 3 * n * sizeof(uint16_t)) == 0) return true;
+    for (size_t i = 0; i < 3 * n; i++) {
+        if (out_simd[i] != out_scalar[i]) {
+            fprintf(stderr, "%s: pixel %zu of %zu channel %zu: got %u, expected %u\n",
+                    name, i / 3, n, i % 3, out_simd[i], out_scalar[i]);
+            break;
+        }
+    }
+    return false;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Time a kernel over a buffer of pixels, in ns per pixel
+static double time_kernel(color_batch_fn kernel, const uint16_t *in, uint16_t *out, size_t n) {
+    double start = now_sec();
+    kernel(in, out, n);
+    return (now_sec() - start) * 1e9 / n;
+}
+
+
+int main(void) {
+    static uint16_t pixels[3 * RANDOM_PIXELS], out_simd[3 * RANDOM_PIXELS], out_scalar[3 * RANDOM_PIXELS];
+    const struct color_batch_kernel *const *kernels;
+    size_t num_kernels = color_batch_kernels(&kernels);
+    bool exact = true;
+
+    // Random pixels, including saturation and lightness past 1.0
+    srand(467);
+    for (unsigned int i = 0; i < 3 * RANDOM_PIXELS; i++) {
+        pixels[i] = rand() & 0xFFFF;
+    }
+    // Every SIMD kernel (all but the scalar one, which is last): every tail
+    // length, at every alignment, then the whole buffer, then in place
+    for (size_t k = 0; k + 1 < num_kernels; k++) {
+        const struct color_batch_kernel *kernel = kernels[k];
+        bool same = true;
+        for (size_t offset = 0; offset < 8; offset++) {
+            for (size_t n = 0; n <= MAX_TAIL; n++) {
+                same &= check_exact(kernel->name, kernel->hsl, hsl_to_rgb_batch_scalar,
+                                    &pixels[3 * offset], out_simd, out_scalar, n);
+                same &= check_exact(kernel->name, kernel->hsv, hsv_to_rgb_batch_scalar,
+                                    &pixels[3 * offset], out_simd, out_scalar, n);
+            }
+        }
+        same &= check_exact(kernel->name, kernel->hsl, hsl_to_rgb_batch_scalar,
+                            pixels, out_simd, out_scalar, RANDOM_PIXELS);
+        same &= check_exact(kernel->name, kernel->hsv, hsv_to_rgb_batch_scalar,
+                            pixels, out_simd, out_scalar, RANDOM_PIXELS);
+        memcpy(out_simd, pixels, sizeof(pixels));
+        kernel->hsl(out_simd, out_simd, RANDOM_PIXELS);
+        hsl_to_rgb_batch_scalar(pixels, out_scalar, RANDOM_PIXELS);
+        if (memcmp(out_simd, out_scalar, sizeof(out_simd)) != 0) {
+            fprintf(stderr, "%s: in-place conversion differs\n", kernel->name);
+            same = false;
+        }
+        printf("color_batch: %s kernels %s the scalar ones\n", kernel->name, same ? "match" : "DIFFER from");
+        exact &= same;
+    }
+    if (num_kernels == 1) printf("color_batch: no SIMD kernels for this CPU\n");
+    printf("color_batch: batch functions use %s\n", color_batch_impl());
+
+    // Accuracy against floating point, over a grid of in-range inputs
+    for (unsigned int h = 0; h < 65536; h += GRID_STEP / 4) {
+        for (unsigned int s = 0; s <= COLOR_BATCH_ONE; s += GRID_STEP) {
+            for (unsigned int l = 0; l <= COLOR_BATCH_ONE; l += GRID_STEP) {
+                uint16_t px[3] = {h, s, l};
+                check_accuracy(px, false);
+                check_accuracy(px, true);
+            }
+        }
+    }
+    printf("color_batch: %lu pixels checked, worst error %d LSB, %lu over %d LSB\n",
+           checked, worst, failures, MAX_ERROR);
+
+    // Benchmark each kernel against the scalar one on the random pixels
+    double hsl_scalar_ns = time_kernel(hsl_to_rgb_batch_scalar, pixels, out_scalar, RANDOM_PIXELS);
+    double hsv_scalar_ns = time_kernel(hsv_to_rgb_batch_scalar, pixels, out_scalar, RANDOM_PIXELS);
+    printf("color_batch: scalar %.2f ns/pixel hsl, %.2f ns/pixel hsv\n", hsl_scalar_ns, hsv_scalar_ns);
+    for (size_t k = 0; k + 1 < num_kernels; k++) {
+        double hsl_ns = time_kernel(kernels[k]->hsl, pixels, out_simd, RANDOM_PIXELS);
+        double hsv_ns = time_kernel(kernels[k]->hsv, pixels, out_simd, RANDOM_PIXELS);
+        printf("color_batch: %s %.2f ns/pixel hsl (%.2fx), %.2f ns/pixel hsv (%.2fx)\n", kernels[k]->name,
+               hsl_ns, hsl_scalar_ns / hsl_ns, hsv_ns, hsv_scalar_ns / hsv_ns);
+    }
+
+    return !exact || failures > 0;
+}
@@ -0,0 +1,112 @@
+/* Accuracy test for the integer color pipeline.
+ * Compares accel_to_duty_cycles() against the floating-point reference path
+ * across the accelerometer's input range, and reports the speedup.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../control.h"
+#include "../color.h"
+
+#define NUM_CHANNELS 3
+#define GRID_LIMIT 512 // ADXL345 full-resolution counts at +/-2 g
+#define GRID_STEP 5
+#define RANDOM_SAMPLES 1000000
+#define RANDOM_LIMIT 4096 // +/-16 g
+#define MAX_ERROR 1
+
+
+// Reference: the original floating-point pipeline
+static void reference(const int *accel_vec, uint32_t *duty_cycles) {
+    float hsl[3], rgb[3];
+    accel_to_hsl(accel_vec, hsl);
+    hsl2rgb(hsl, rgb);
+    rgb_to_duty_cycles(rgb, duty_cycles);
+}
+
+static unsigned long checked = 0, failures = 0;
+static int worst = 0;
+
+static void check(int x, int y, int z) {
+    int accel_vec[3] = {x, y, z};
+    uint32_t expected[NUM_CHANNELS], actual[NUM_CHANNELS];
+    reference(accel_vec, expected);
+    accel_to_duty_cycles(accel_vec, actual);
+    checked++;
+    for (unsigned int i = 0; i < NUM_CHANNELS; i++) {
+        int error = abs((int)actual[i] - (int)expected[i]);
+        if (error > worst) worst = error;
+        if (error > MAX_ERROR && failures++ < 10) {
+            fprintf(stderr, "(%d, %d, %d) channel %u: got %u, expected %u\n",
+                    x, y, z, i, actual[i], expected[i]);
+        }
+    }
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Time a pipeline over a fixed set of inputs, in ns per call
+static double time_pipeline(void (*pipeline)(const int *, uint32_t *), const int (*inputs)[3], unsigned int n) {
+    volatile uint32_t sink = 0;
+    uint32_t duty_cycles[NUM_CHANNELS];
+    double start = now_sec();
+    for (unsigned int i = 0; i < n; i++) {
+        pipeline(inputs[i], duty_cycles);
+        sink += duty_cycles[0] + duty_cycles[1] + duty_cycles[2];
+    }
+    (void)sink;
+    return (now_sec() - start) * 1e9 / n;
+}
+
+
+int main(void) {
+    // Dense grid over the usual range
+    for (int x = -GRID_LIMIT; x <= GRID_LIMIT; x += GRID_STEP) {
+        for (int y = -GRID_LIMIT; y <= GRID_LIMIT; y += GRID_STEP) {
+            for (int z = -GRID_LIMIT; z <= GRID_LIMIT; z += GRID_STEP) {
+                check(x, y, z);
+            }
+        }
+    }
+    // Axes and other degenerate directions, including the zero vector
+    for (int v = -RANDOM_LIMIT; v <= RANDOM_LIMIT; v++) {
+        check(v, 0, 0);
+        check(0, v, 0);
+        check(0, 0, v);
+        check(v, v, v);
+        check(1, v, 0);
+        check(0, -1, v);
+    }
+    // Random samples over the full range
+    srand(467);
+    for (unsigned int i = 0; i < RANDOM_SAMPLES; i++) {
+        check(rand() % (2 * RANDOM_LIMIT + 1) - RANDOM_LIMIT,
+              rand() % (2 * RANDOM_LIMIT + 1) - RANDOM_LIMIT,
+              rand() % (2 * RANDOM_LIMIT + 1) - RANDOM_LIMIT);
+    }
+    printf("color: %lu inputs checked, worst error %d LSB, %lu over %d LSB\n",
+           checked, worst, failures, MAX_ERROR);
+
+    // Benchmark both pipelines on the same random inputs
+    static int inputs[RANDOM_SAMPLES][3];
+    for (unsigned int i = 0; i < RANDOM_SAMPLES; i++) {
+        for (unsigned int j = 0; j < 3; j++) {
+            inputs[i][j] = rand() % (2 * GRID_LIMIT + 1) - GRID_LIMIT;
+        }
+    }
+    double float_ns = time_pipeline(reference, inputs, RANDOM_SAMPLES);
+    double fixed_ns = time_pipeline(accel_to_duty_cycles, inputs, RANDOM_SAMPLES);
+    printf("color: float %.1f ns/frame, fixed %.1f ns/frame (%.2fx)\n",
+           float_ns, fixed_ns, float_ns / fixed_ns);
+
+    return failures > 0;
+}
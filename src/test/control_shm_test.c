@@ -0,0 +1,220 @@
+/* Test for accel_control's shared-memory control interface.
+ * Checks the command queue's ordering and limits, then has the telemetry
+ * seqlock's writer race a reader to catch torn snapshots, and several senders
+ * race to fill the queue. Also checks that a read-only mapping sees telemetry,
+ * that readers give up on a daemon that died mid-publish, but not on one that
+ * detached after creating the segment.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../control_shm.h"
+
+#define CHECK_NAME "control_shm"
+#include "check.h"
+
+#define STRESS_SNAPSHOTS 200000
+#define SENDERS 4
+#define COMMANDS_PER_SENDER 10000
+
+static char name[64];
+static struct control_shm *daemon_shm, *tool_shm;
+
+static void test_segment(void) {
+    check(control_shm_open(name, true) == NULL, "opened a segment that doesn't exist");
+    daemon_shm = control_shm_create(name);
+    check(daemon_shm != NULL, "segment creation failed");
+    tool_shm = control_shm_open(name, true);
+    check(tool_shm != NULL, "segment opening failed");
+    check(tool_shm->pid == (uint32_t)getpid(), "daemon's process ID not recorded");
+}
+
+static void test_readonly(void) {
+    struct control_shm *shm = control_shm_open(name, false);
+    check(shm != NULL, "read-only opening failed");
+    if (shm == NULL) return;
+    struct control_telemetry t = { .updates = 42 };
+    control_shm_publish(daemon_shm, &t);
+    t.updates = 0;
+    check(control_shm_read(shm, &t) == 0 && t.updates == 42, "read-only mapping missed telemetry");
+    control_shm_close(shm);
+    control_shm_publish(daemon_shm, &(struct control_telemetry){0});
+}
+
+static void test_dead_daemon(void) {
+    // Leave the telemetry mid-update under a process ID that's gone
+    pid_t child = fork();
+    if (child == 0) _exit(0);
+    if (child < 0 || waitpid(child, NULL, 0) != child) {
+        check(false, "failed to make a dead process ID");
+        return;
+    }
+    uint32_t seq = atomic_load(&daemon_shm->telemetry_seq);
+    atomic_store(&daemon_shm->telemetry_seq, seq + 1);
+    daemon_shm->pid = child;
+    struct control_telemetry t;
+    errno = 0;
+    check(control_shm_read(tool_shm, &t) < 0 && errno == ESRCH, "read waited on a dead daemon");
+    atomic_store(&daemon_shm->telemetry_seq, seq + 2);
+    daemon_shm->pid = getpid();
+}
+
+static void test_detached(void) {
+    // As accel_control -D does: create the segment, then detach, leaving the
+    // daemon in a grandchild once the launching process exits
+    char detached_name[80];
+    snprintf(detached_name, sizeof(detached_name), "%s.detached", name);
+    pid_t launcher = fork();
+    if (launcher == 0) {
+        struct control_shm *shm = control_shm_create(detached_name);
+        if (shm == NULL || daemon(1, 1) < 0) _exit(1);
+        // Go mid-publish before claiming the segment, and stay there long
+        // enough for a reader to check on us
+        uint32_t seq = atomic_load(&shm->telemetry_seq);
+        atomic_store(&shm->telemetry_seq, seq + 1);
+        control_shm_adopt(shm);
+        nanosleep(&(struct timespec){ .tv_nsec = 50000000 }, NULL);
+        shm->telemetry.updates = 42;
+        atomic_store(&shm->telemetry_seq, seq + 2);
+        _exit(0);
+    }
+    int status;
+    if (launcher < 0 || waitpid(launcher, &status, 0) != launcher || status != 0) {
+        check(false, "failed to start a detached daemon");
+        control_shm_unlink(detached_name);
+        return;
+    }
+    struct control_shm *shm = control_shm_open(detached_name, false);
+    check(shm != NULL, "detached daemon's segment missing");
+    if (shm != NULL) {
+        for (unsigned int ms = 0; shm->pid == (uint32_t)launcher && ms < 1000; ms++) {
+            nanosleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+        }
+        check(shm->pid != (uint32_t)launcher, "detached daemon's process ID not recorded");
+        struct control_telemetry t;
+        check(control_shm_read(shm, &t) == 0 && t.updates == 42, "read gave up on a detached daemon");
+        control_shm_close(shm);
+    }
+    control_shm_unlink(detached_name);
+}
+
+static void test_queue(void) {
+    struct control_command cmd = {0};
+    check(!control_shm_receive(daemon_shm, &cmd), "empty queue returned a command");
+
+    // Commands arrive in order, until the queue fills up
+    unsigned int sent = 0;
+    for (;;) {
+        cmd = (struct control_command){ .type = CONTROL_CMD_PERIOD, .args = { sent } };
+        if (control_shm_send(tool_shm, &cmd) < 0) break;
+        sent++;
+    }
+    check(errno == EAGAIN, "full queue didn't report EAGAIN");
+    check(sent == CONTROL_QUEUE_SLOTS, "queue holds the wrong number of commands");
+    bool ordered = true;
+    for (unsigned int i = 0; i < sent; i++) {
+        ordered &= control_shm_receive(daemon_shm, &cmd) && cmd.args[0] == i;
+    }
+    check(ordered, "commands out of order");
+    check(!control_shm_receive(daemon_shm, &cmd), "drained queue returned a command");
+
+    // Room again once drained, across the wrap
+    cmd.args[0] = 1234;
+    check(control_shm_send(tool_shm, &cmd) == 0, "drained queue still full");
+    check(control_shm_receive(daemon_shm, &cmd) && cmd.args[0] == 1234, "command lost after wrapping");
+}
+
+static void *publish(void *arg) {
+    (void)arg;
+    struct control_telemetry t = {0};
+    for (uint64_t n = 1; n <= STRESS_SNAPSHOTS; n++) {
+        // Every field follows n, so a torn snapshot shows up as a mismatch
+        t.updates = t.dropped = t.commands = t.timestamp_ns = n;
+        for (unsigned int i = 0; i < CONTROL_CHANNELS; i++) t.duty_cycles[i] = n;
+        control_shm_publish(daemon_shm, &t);
+    }
+    return NULL;
+}
+
+static void test_telemetry(void) {
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, publish, NULL) != 0) {
+        check(false, "failed to start telemetry writer");
+        return;
+    }
+    bool torn = false, backwards = false;
+    uint64_t last = 0;
+    while (last < STRESS_SNAPSHOTS) {
+        struct control_telemetry t;
+        if (control_shm_read(tool_shm, &t) < 0) {
+            torn = true;
+            break;
+        }
+        bool consistent = t.dropped == t.updates && t.commands == t.updates && t.timestamp_ns == t.updates;
+        for (unsigned int i = 0; i < CONTROL_CHANNELS; i++) consistent &= t.duty_cycles[i] == (uint32_t)t.updates;
+        torn |= !consistent;
+        backwards |= t.updates < last;
+        last = t.updates;
+    }
+    pthread_join(writer, NULL);
+    check(!torn, "torn telemetry snapshot read");
+    check(!backwards, "telemetry went backwards");
+}
+
+static void *send_many(void *arg) {
+    struct control_command cmd = { .type = CONTROL_CMD_PERIOD };
+    for (unsigned int i = 0; i < COMMANDS_PER_SENDER; i++) {
+        cmd.args[0] = (uintptr_t)arg * COMMANDS_PER_SENDER + i;
+        while (control_shm_send(tool_shm, &cmd) < 0) sched_yield();
+    }
+    return NULL;
+}
+
+static void test_senders(void) {
+    pthread_t senders[SENDERS];
+    for (uintptr_t s = 0; s < SENDERS; s++) pthread_create(&senders[s], NULL, send_many, (void *)s);
+    // Each sender's commands must arrive whole and in its own order
+    uint32_t next[SENDERS] = {0};
+    unsigned long received = 0;
+    bool ok = true;
+    while (received < SENDERS * COMMANDS_PER_SENDER) {
+        struct control_command cmd;
+        if (!control_shm_receive(daemon_shm, &cmd)) {
+            sched_yield();  // Let the senders run, even on one core
+            continue;
+        }
+        unsigned int s = cmd.args[0] / COMMANDS_PER_SENDER;
+        ok &= cmd.type == CONTROL_CMD_PERIOD && s < SENDERS && cmd.args[0] % COMMANDS_PER_SENDER == next[s];
+        if (s < SENDERS) next[s]++;
+        received++;
+    }
+    for (unsigned int s = 0; s < SENDERS; s++) pthread_join(senders[s], NULL);
+    check(ok, "commands from concurrent senders lost, duplicated or reordered");
+}
+
+int main(void) {
+    snprintf(name, sizeof(name), "/control_shm_test.%d", (int)getpid());
+    test_segment();
+    if (daemon_shm != NULL && tool_shm != NULL) {
+        test_queue();
+        test_readonly();
+        test_dead_daemon();
+        test_detached();
+        test_telemetry();
+        test_senders();
+        control_shm_close(tool_shm);
+        control_shm_close(daemon_shm);
+    }
+    control_shm_unlink(name);
+    return check_summary();
+}
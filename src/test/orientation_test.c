@@ -0,0 +1,272 @@
+/* Test for the orientation filter.
+ * Replays recorded evdev traces (evemu-record format) through the filter, on
+ * its own and attached to accel_input, checking that the fixed-point filter
+ * tracks a floating-point reference, that it smooths the noise out of the
+ * orientation without lagging far behind it, that taps barely move it, and
+ * that decimation hands on the right outputs.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../accel_input.h"
+#include "../orientation.h"
+
+#define CHECK_NAME "orientation"
+#include "check.h"
+
+#define DEFAULT_TRACE "test/traces/tumble.evemu"
+#define MAX_EVENTS 100000
+#define CHUNK_EVENTS 37      // Written to the pipe at a time, to vary batches
+#define TAP_SETTLE 10        // Samples after a tap excluded from tracking
+#define MAX_REF_ERROR 1      // Counts
+#define MIN_SMOOTHING 3.0    // Noise reduction factor
+#define MAX_LAG_DEG 12.0
+#define MAX_STEP_DEG 3.0
+#define DECIMATION 4
+
+// A trace, as events and the complete readings they add up to
+struct trace {
+    struct input_event *events;
+    size_t num_events;
+    int (*readings)[3];
+    bool *tapped;  // Whether each reading is within TAP_SETTLE of a tap
+    unsigned int num_readings;
+    unsigned int taps;
+};
+
+static int load_trace(const char *path, struct trace *trace) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    trace->events = calloc(MAX_EVENTS, sizeof(*trace->events));
+    trace->readings = calloc(MAX_EVENTS, sizeof(*trace->readings));
+    trace->tapped = calloc(MAX_EVENTS, sizeof(*trace->tapped));
+    trace->num_events = trace->num_readings = trace->taps = 0;
+    int vec[3] = {0};
+    bool moved = false;  // Reports with no axes in them are just taps
+    unsigned int since_tap = TAP_SETTLE;
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL && trace->num_events < MAX_EVENTS) {
+        unsigned long sec, usec;
+        unsigned int type, code;
+        int value;
+        if (sscanf(line, "E: %lu.%lu %x %x %d", &sec, &usec, &type, &code, &value) != 5) continue;
+        struct input_event *event = &trace->events[trace->num_events++];
+        event->input_event_sec = sec;
+        event->input_event_usec = usec;
+        event->type = type;
+        event->code = code;
+        event->value = value;
+        if (type == EV_ABS && code <= ABS_Z) {
+            vec[code] = value;
+            moved = true;
+        }
+        if (type == EV_KEY && value == 1) {
+            trace->taps++;
+            since_tap = 0;
+        }
+        if (type == EV_SYN && code == SYN_REPORT && moved) {
+            moved = false;
+            memcpy(trace->readings[trace->num_readings], vec, sizeof(vec));
+            trace->tapped[trace->num_readings++] = since_tap < TAP_SETTLE;
+            since_tap++;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static void free_trace(struct trace *trace) {
+    free(trace->events);
+    free(trace->readings);
+    free(trace->tapped);
+}
+
+// The same filter in floating point
+static void reference_filter(const struct orient_config *config, const int (*readings)[3], unsigned int n,
+                             double (*out)[3]) {
+    double g[3] = { readings[0][0], readings[0][1], readings[0][2] };
+    double one_g2 = (double)config->one_g * config->one_g;
+    double span = 2 * one_g2 * config->reject / ORIENT_GAIN_ONE;
+    for (unsigned int k = 0; k < n; k++) {
+        const int *a = readings[k];
+        if (k > 0) {
+            double weight = (double)config->gain / ORIENT_GAIN_ONE;
+            if (config->reject > 0) {
+                double off = fabs((double)a[0] * a[0] + (double)a[1] * a[1] + (double)a[2] * a[2] - one_g2);
+                weight *= off >= span ? 0 : 1 - off / span;
+            }
+            for (unsigned int i = 0; i < 3; i++) g[i] += (a[i] - g[i]) * weight;
+        }
+        memcpy(out[k], g, sizeof(g));
+    }
+}
+
+static double angle_deg(const int *a, const int *b) {
+    double dot = 0, na = 0, nb = 0;
+    for (unsigned int i = 0; i < 3; i++) {
+        dot += (double)a[i] * b[i];
+        na += (double)a[i] * a[i];
+        nb += (double)b[i] * b[i];
+    }
+    double c = dot / sqrt(na * nb);
+    return acos(c > 1 ? 1 : c < -1 ? -1 : c) * 180 / M_PI;
+}
+
+// Mean size of the second difference of the unit vectors, which noise
+// dominates and smooth motion barely registers in
+static double roughness(const int (*vecs)[3], unsigned int n) {
+    double sum = 0;
+    for (unsigned int k = 1; k + 1 < n; k++) {
+        double d2 = 0;
+        for (unsigned int i = 0; i < 3; i++) {
+            double u[3];
+            for (int j = -1; j <= 1; j++) {
+                const int *v = vecs[k + j];
+                u[j + 1] = v[i] / sqrt((double)v[0] * v[0] + (double)v[1] * v[1] + (double)v[2] * v[2]);
+            }
+            double d = u[0] - 2 * u[1] + u[2];
+            d2 += d * d;
+        }
+        sum += sqrt(d2);
+    }
+    return sum / (n - 2);
+}
+
+static void test_filter(const struct trace *trace) {
+    struct orient_config config;
+    orient_default_config(&config);
+    struct orient_filter filter;
+    check(orient_init(&filter, &config) == 0, "default settings rejected");
+    unsigned int n = trace->num_readings;
+    int (*out)[3] = calloc(n, sizeof(*out));
+    double (*ref)[3] = calloc(n, sizeof(*ref));
+    for (unsigned int k = 0; k < n; k++) orient_update(&filter, trace->readings[k], out[k]);
+    reference_filter(&config, (const int (*)[3])trace->readings, n, ref);
+
+    double worst = 0, lag = 0, step = 0, raw_step = 0;
+    for (unsigned int k = 0; k < n; k++) {
+        for (unsigned int i = 0; i < 3; i++) worst = fmax(worst, fabs(out[k][i] - ref[k][i]));
+        if (!trace->tapped[k]) lag = fmax(lag, angle_deg(out[k], trace->readings[k]));
+        if (k > 0) {
+            step = fmax(step, angle_deg(out[k], out[k - 1]));
+            raw_step = fmax(raw_step, angle_deg(trace->readings[k], trace->readings[k - 1]));
+        }
+    }
+    double smoothing = roughness((const int (*)[3])trace->readings, n) / roughness((const int (*)[3])out, n);
+    printf("orientation: %u readings; worst error %.2f counts, smoothing %.1fx, "
+           "lag at most %.1f deg, largest step %.1f deg (raw %.1f deg)\n",
+           n, worst, smoothing, lag, step, raw_step);
+    check(worst <= MAX_REF_ERROR, "fixed point strays from the floating-point reference");
+    check(smoothing >= MIN_SMOOTHING, "noise not smoothed out");
+    check(lag <= MAX_LAG_DEG, "filter lags too far behind the readings");
+    check(step <= MAX_STEP_DEG, "taps or noise jolted the filter");
+
+    // Without rejection, the taps come through
+    config.reject = 0;
+    orient_init(&filter, &config);
+    double unrejected = 0;
+    int last[3];
+    for (unsigned int k = 0; k < n; k++) {
+        orient_update(&filter, trace->readings[k], out[k]);
+        if (k > 0) unrejected = fmax(unrejected, angle_deg(out[k], last));
+        memcpy(last, out[k], sizeof(last));
+    }
+    if (trace->taps > 0) check(unrejected > step, "rejection made no difference to taps");
+    free(out);
+    free(ref);
+}
+
+static void test_replay(const struct trace *trace) {
+    struct orient_config config;
+    orient_default_config(&config);
+    config.decimation = DECIMATION;
+    struct orient_filter filter, direct;
+    orient_init(&filter, &config);
+    orient_init(&direct, &config);
+    int expected[3] = {0};
+    unsigned int expected_outputs = orient_process(&direct, (const int (*)[3])trace->readings,
+                                                   trace->num_readings, expected);
+
+    // Through accel_input, in uneven batches
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+        perror("Failed to create event pipe");
+        check(false, "replay not run");
+        return;
+    }
+    fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+    static struct accel_input in;
+    memset(&in, 0, sizeof(in));
+    in.fd = pipe_fds[0];
+    in.filter = &filter;
+    unsigned int outputs = 0, taps = 0;
+    int latest[3] = {0};
+    for (size_t sent = 0; sent < trace->num_events; sent += CHUNK_EVENTS) {
+        size_t count = trace->num_events - sent < CHUNK_EVENTS ? trace->num_events - sent : CHUNK_EVENTS;
+        if (write(pipe_fds[1], trace->events + sent, count * sizeof(struct input_event)) < 0) perror("write");
+        struct accel_update update;
+        while (accel_read(&in, &update) > 0) {
+            if (update.reports > 0) memcpy(latest, update.accel_vec, sizeof(latest));
+            outputs += update.reports;
+            taps += update.taps;
+        }
+    }
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    check(outputs == trace->num_readings / DECIMATION && outputs == expected_outputs, "decimated output count wrong");
+    check(memcmp(latest, expected, sizeof(latest)) == 0, "replay through accel_input doesn't match the filter");
+    check(taps == trace->taps, "taps lost in replay");
+}
+
+static void test_config(void) {
+    struct orient_config config;
+    struct orient_filter filter;
+    orient_default_config(&config);
+    config.gain = 0;
+    check(orient_init(&filter, &config) < 0, "zero gain accepted");
+    orient_default_config(&config);
+    config.decimation = 0;
+    check(orient_init(&filter, &config) < 0, "zero decimation accepted");
+
+    // Unity gain without rejection passes readings straight through
+    orient_default_config(&config);
+    config.gain = ORIENT_GAIN_ONE;
+    config.reject = 0;
+    orient_init(&filter, &config);
+    const int samples[3][3] = { {1, 2, 256}, {-300, 40, 7}, {5, -5, -250} };
+    bool same = true;
+    for (unsigned int k = 0; k < 3; k++) {
+        int out[3];
+        same &= orient_update(&filter, samples[k], out) && memcmp(out, samples[k], sizeof(out)) == 0;
+    }
+    check(same, "unity gain changed readings");
+}
+
+int main(int argc, char **argv) {
+    test_config();
+    // Replay every trace given, or the one that comes with the tests
+    const char *default_trace[] = { DEFAULT_TRACE };
+    const char **paths = argc > 1 ? (const char **)argv + 1 : default_trace;
+    int num_paths = argc > 1 ? argc - 1 : 1;
+    for (int i = 0; i < num_paths; i++) {
+        struct trace trace;
+        if (load_trace(paths[i], &trace) < 0 || trace.num_readings < 3) {
+            check(false, "trace unreadable");
+            continue;
+        }
+        test_filter(&trace);
+        test_replay(&trace);
+        free_trace(&trace);
+    }
+    return check_summary();
+}
@@ -0,0 +1,114 @@
+/* Test for the real-time support module.
+ * Checks the jitter histogram's bucketing, the deadline timer's schedule
+ * (against a fixed clock: its deadlines, and that it skips periods it overran),
+ * and that entering real-time mode without privileges degrades rather than
+ * fails.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+#include "../rt.h"
+
+#define CHECK_NAME "rt"
+#include "check.h"
+
+#define TIMER_HZ 1000
+#define TIMER_NS (1000000000L / TIMER_HZ)
+#define TIMER_PERIODS 20
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void test_histogram(void) {
+    struct rt_jitter j;
+    rt_jitter_init(&j);
+    rt_jitter_record(&j, 0);
+    rt_jitter_record(&j, 999);
+    rt_jitter_record(&j, 1000);
+    rt_jitter_record(&j, 1999);
+    rt_jitter_record(&j, 2000);
+    rt_jitter_record(&j, 3999);
+    rt_jitter_record(&j, 1000000000000ULL);
+    check(j.buckets[0] == 2, "sub-microsecond lateness misbucketed");
+    check(j.buckets[1] == 2, "1-2 us lateness misbucketed");
+    check(j.buckets[2] == 2, "2-4 us lateness misbucketed");
+    check(j.buckets[RT_JITTER_BUCKETS - 1] == 1, "huge lateness not clamped to the last bucket");
+    check(j.count == 7 && j.min_ns == 0 && j.max_ns == 1000000000000ULL, "summary statistics wrong");
+}
+
+static bool deadline_is(const struct rt_timer *timer, time_t sec, long nsec) {
+    return timer->next.tv_sec == sec && timer->next.tv_nsec == nsec;
+}
+
+static void test_schedule(void) {
+    struct rt_timer timer;
+    struct rt_jitter j;
+    rt_jitter_init(&j);
+    errno = 0;
+    check(rt_timer_start(&timer, 0) < 0 && errno == EINVAL, "zero rate accepted");
+    errno = 0;
+    check(rt_timer_start(&timer, 2000000000UL) < 0 && errno == EINVAL, "rate with a zero period accepted");
+
+    // Deadlines fall whole periods after the start, carrying into the seconds
+    struct timespec start = { .tv_sec = 100, .tv_nsec = 999500000 };
+    check(rt_timer_start_at(&timer, TIMER_HZ, &start) == 0, "timer start failed");
+    check(deadline_is(&timer, 101, 500000), "first deadline misplaced");
+
+    // Waking on time, or late but within the period, moves on one period
+    struct timespec now = timer.next;
+    rt_timer_advance(&timer, &now, &j);
+    check(deadline_is(&timer, 101, 500000 + TIMER_NS), "deadline after an on-time wakeup misplaced");
+    now.tv_nsec = 500000 + 2 * TIMER_NS - 1;
+    rt_timer_advance(&timer, &now, &j);
+    check(deadline_is(&timer, 101, 500000 + 2 * TIMER_NS), "deadline after a late wakeup misplaced");
+    check(j.count == 2 && j.min_ns == 0 && j.max_ns == TIMER_NS - 1 && j.overruns == 0,
+          "wakeup lateness recorded wrong");
+
+    // Waking five and a half periods late skips the five deadlines already
+    // missed, instead of bursting to catch up
+    now.tv_nsec = 500000 + 7 * TIMER_NS + TIMER_NS / 2;
+    rt_timer_advance(&timer, &now, &j);
+    check(deadline_is(&timer, 101, 500000 + 8 * TIMER_NS), "deadline after an overrun misplaced");
+    check(j.overruns == 5, "overrun periods not counted");
+    check(j.count == 3 && j.max_ns == 5 * TIMER_NS + TIMER_NS / 2, "overrun lateness recorded wrong");
+}
+
+static void test_timer(void) {
+    // The one check on the real clock: deadlines are absolute, so the run
+    // can't finish early, however the wakeups fall
+    struct rt_timer timer;
+    struct rt_jitter j;
+    rt_jitter_init(&j);
+    double start = now_sec();
+    rt_timer_start(&timer, TIMER_HZ);
+    for (unsigned int i = 0; i < TIMER_PERIODS; i++) rt_timer_wait(&timer, &j);
+    check(j.count == TIMER_PERIODS, "timer wakeups not all recorded");
+    check(now_sec() - start >= (TIMER_PERIODS - 0.01) / TIMER_HZ, "timer ran fast");
+}
+
+static void test_unprivileged(void) {
+    // Without CAP_SYS_NICE this just warns; either way we carry on
+    rt_lock_memory();
+    int failed = rt_enter(1, rt_default_cpu(), "rt_test");
+    check(failed >= 0 && failed <= 2, "rt_enter() reported nonsense");
+    struct rt_timer timer;
+    rt_timer_start(&timer, TIMER_HZ);
+    check(rt_timer_wait(&timer, NULL) == 0, "timer failed after entering real-time mode");
+}
+
+int main(void) {
+    test_histogram();
+    test_schedule();
+    test_timer();
+    test_unprivileged();
+    return check_summary();
+}
@@ -0,0 +1,117 @@
+/* Test for the latest-value-wins SPSC ring.
+ * Checks the single-threaded semantics (newest value only, skips counted),
+ * then has a producer thread race a consumer to catch torn or stale copies.
+ * EELE 467
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "../spsc.h"
+
+#define CHECK_NAME "spsc"
+#include "check.h"
+
+#define STRESS_VALUES 2000000
+#define VALUE_WORDS 6  // Wider than any single atomic store
+#define PRODUCER_DELAY 100
+
+// Every word holds the same sequence number, so a torn copy shows up as a mix
+struct value {
+    uint64_t words[VALUE_WORDS];
+};
+
+static void fill(struct value *v, uint64_t n) {
+    for (unsigned int i = 0; i < VALUE_WORDS; i++) v->words[i] = n;
+}
+
+static bool consistent(const struct value *v) {
+    for (unsigned int i = 1; i < VALUE_WORDS; i++) {
+        if (v->words[i] != v->words[0]) return false;
+    }
+    return true;
+}
+
+static void test_semantics(void) {
+    struct spsc_ring ring;
+    check(spsc_init(&ring, 3, sizeof(struct value)) < 0 && errno == EINVAL, "non-power-of-two size accepted");
+    check(spsc_init(&ring, 4, sizeof(struct value)) == 0, "ring allocation failed");
+
+    struct value v;
+    check(!spsc_take_latest(&ring, &v), "empty ring returned a value");
+    fill(&v, 1);
+    spsc_publish(&ring, &v);
+    fill(&v, 0);
+    check(spsc_take_latest(&ring, &v) && v.words[0] == 1, "single value not returned");
+    check(!spsc_take_latest(&ring, &v), "value returned twice");
+    check(ring.dropped == 0, "nothing should have been skipped");
+
+    // Several values, within and beyond the ring's size: only the newest counts
+    for (uint64_t n = 2; n <= 4; n++) {
+        fill(&v, n);
+        spsc_publish(&ring, &v);
+    }
+    check(spsc_take_latest(&ring, &v) && v.words[0] == 4, "newest value not returned");
+    check(ring.dropped == 2, "skipped values miscounted");
+    for (uint64_t n = 5; n <= 14; n++) {
+        fill(&v, n);
+        spsc_publish(&ring, &v);
+    }
+    check(spsc_take_latest(&ring, &v) && v.words[0] == 14, "newest value lost after wrapping");
+    check(ring.dropped == 11, "skipped values miscounted after wrapping");
+    check(!spsc_take_latest(&ring, &v), "value returned twice after wrapping");
+    spsc_free(&ring);
+}
+
+static struct spsc_ring stress_ring;
+
+static void *produce(void *arg) {
+    (void)arg;
+    struct value v;
+    for (uint64_t n = 1; n <= STRESS_VALUES; n++) {
+        fill(&v, n);
+        spsc_publish(&stress_ring, &v);
+        // Pace ourselves a little, so the consumer gets both clean copies and
+        // laps, rather than almost only laps
+        for (volatile unsigned int i = 0; i < PRODUCER_DELAY; i++);
+    }
+    return NULL;
+}
+
+static void test_stress(void) {
+    // A small ring gets lapped often, exercising the retry path
+    check(spsc_init(&stress_ring, 2, sizeof(struct value)) == 0, "ring allocation failed");
+    pthread_t producer;
+    if (pthread_create(&producer, NULL, produce, NULL) != 0) {
+        check(false, "failed to start producer");
+        return;
+    }
+    unsigned long taken = 0;
+    bool torn = false, backwards = false;
+    uint64_t last = 0;
+    struct value v;
+    while (last < STRESS_VALUES) {
+        if (!spsc_take_latest(&stress_ring, &v)) continue;
+        taken++;
+        torn |= !consistent(&v);
+        backwards |= v.words[0] <= last;
+        last = v.words[0];
+    }
+    pthread_join(producer, NULL);
+    check(!torn, "torn value returned");
+    check(!backwards, "stale value returned");
+    check(taken + stress_ring.dropped == STRESS_VALUES, "values taken and skipped don't add up");
+    printf("spsc: took %lu of %d values, skipping %llu\n",
+           taken, STRESS_VALUES, (unsigned long long)stress_ring.dropped);
+    spsc_free(&stress_ring);
+}
+
+int main(void) {
+    test_semantics();
+    test_stress();
+    return check_summary();
+}